@@ -25,10 +25,23 @@ public:
         /// An event without any drift hits.  Just pass it through.
         if (!drift) return true;
 
+        // The reconstruction already saved in the event when a file is
+        // reprocessed.  It's only used when captRecon.cluster3d.warmStart
+        // is true.
+        CP::THandle<CP::TAlgorithmResult> previous
+            = event.GetFit("TCaptainRecon");
+
         // Run the event reconstruction on the event.
         std::auto_ptr<CP::TAlgorithm> captRecon(new CP::TCaptainRecon());
         CP::THandle<CP::TAlgorithmResult> result;
-        if (pmt) result = captRecon->Process(*drift,*pmt);
+        if (previous && pmt) {
+            result = captRecon->Process(*drift,*pmt,*previous);
+        }
+        else if (previous) {
+            result = captRecon->Process(*drift,CP::TAlgorithmResult::Empty,
+                                        *previous);
+        }
+        else if (pmt) result = captRecon->Process(*drift,*pmt);
         else result = captRecon->Process(*drift);
         if (result) event.AddFit(result);
         else {
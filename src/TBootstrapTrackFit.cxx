@@ -1,4 +1,5 @@
 #include "TBootstrapTrackFit.hxx"
+#include "THitRegistry.hxx"
 
 #include <TReconNode.hxx>
 #include <TReconCluster.hxx>
@@ -22,7 +23,6 @@
 #include <TDecompChol.h>
 #include <TPrincipal.h>
 
-#include <map>
 #include <memory>
 
 /// A "local" name space for the Bootstrap Track Fitter (BTF).  This is the
@@ -841,24 +841,22 @@ CP::TBootstrapTrackFit::Apply(CP::THandle<CP::TReconTrack>& input) {
     }
 
     /// Estimate the number of degrees of freedom.
-    typedef std::map< CP::THandle<CP::THit>, double > ContribMap;
-    ContribMap contrib;
+    /// The oversampling is the number of times the wire hits are used by
+    /// the nodes divided by the number of different wire hits.
+    CP::THitRegistry contrib;
+    double oversample = 0.0;
     for (CP::TReconNodeContainer::iterator n = nodes.begin();
          n != nodes.end(); ++n) {
         CP::THandle<CP::TReconBase> object = (*n)->GetObject();
         for (CP::THitSelection::iterator h = object->GetHits()->begin();
              h != object->GetHits()->end(); ++h) {
             for (int c = 0; c < (*h)->GetConstituentCount(); ++c) {
-                contrib[(*h)->GetConstituent(c)] += 1.0;
+                contrib.Register((*h)->GetConstituent(c));
+                oversample += 1.0;
             }
         }
     }
-    double oversample = 0.0;
-    double sample = 0.0;
-    for (ContribMap::iterator c = contrib.begin(); c != contrib.end(); ++c) {
-        sample += 1.0;
-        oversample += c->second;
-    }
+    double sample = contrib.size();
     oversample /= sample;
     double trackDOF = std::max((3*nodes.size())/oversample - 6.0, 0.0);
     
@@ -1280,24 +1278,22 @@ CP::TForwardBootstrapTrackFit::Apply(CP::THandle<CP::TReconTrack>& input) {
     }
    
     /// Estimate the number of degrees of freedom.
-    typedef std::map< CP::THandle<CP::THit>, double > ContribMap;
-    ContribMap contrib;
+    /// The oversampling is the number of times the wire hits are used by
+    /// the nodes divided by the number of different wire hits.
+    CP::THitRegistry contrib;
+    double oversample = 0.0;
     for (CP::TReconNodeContainer::iterator n = nodes.begin();
          n != nodes.end(); ++n) {
         CP::THandle<CP::TReconBase> object = (*n)->GetObject();
         for (CP::THitSelection::iterator h = object->GetHits()->begin();
              h != object->GetHits()->end(); ++h) {
             for (int c = 0; c < (*h)->GetConstituentCount(); ++c) {
-                contrib[(*h)->GetConstituent(c)] += 1.0;
+                contrib.Register((*h)->GetConstituent(c));
+                oversample += 1.0;
             }
         }
     }
-    double oversample = 0.0;
-    double sample = 0.0;
-    for (ContribMap::iterator c = contrib.begin(); c != contrib.end(); ++c) {
-        sample += 1.0;
-        oversample += c->second;
-    }
+    double sample = contrib.size();
     oversample /= sample;
     double trackDOF = std::max((3*nodes.size())/oversample - 6.0, 0.0);
 
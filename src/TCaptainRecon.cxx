@@ -1,4 +1,5 @@
 #include "TCaptainRecon.hxx"
+#include "TIsolatedHitFilter.hxx"
 #include "TCluster3D.hxx"
 #include "TDensityCluster.hxx"
 #include "TClusterSlice.hxx"
@@ -16,6 +17,7 @@
 #include <TReconHit.hxx>
 #include <TReconCluster.hxx>
 #include <TCaptLog.hxx>
+#include <TRuntimeParameters.hxx>
 #include <CaptGeomId.hxx>
 #include <HEPUnits.hxx>
 
@@ -31,7 +33,7 @@ CP::TCaptainRecon::~TCaptainRecon() { }
 CP::THandle<CP::TAlgorithmResult>
 CP::TCaptainRecon::Process(const CP::TAlgorithmResult& driftInput,
                            const CP::TAlgorithmResult& pmtInput,
-                           const CP::TAlgorithmResult&) {
+                           const CP::TAlgorithmResult& previousInput) {
 
     CaptLog("TCaptainRecon Process " << GetEvent().GetContext());
     CP::THandle<CP::TAlgorithmResult> result(CP::TAlgorithm::CreateResult());
@@ -48,6 +50,14 @@ CP::TCaptainRecon::Process(const CP::TAlgorithmResult& driftInput,
 
     CP::THandle<CP::THitSelection> pmts = pmtInput.GetHits();
 
+    // The TCluster3D result from a previous reconstruction of this event.
+    // This is only used to start the charge sharing from the saved weights.
+    CP::THandle<CP::TAlgorithmResult> previous3D;
+    if (CP::TRuntimeParameters::Get().GetParameterI(
+            "captRecon.cluster3d.warmStart")) {
+        previous3D = previousInput.Get<CP::TAlgorithmResult>("TCluster3D");
+    }
+
     // The final objects from this will be copied into the final recon
     // container.  It might be NULL if there is a problem.
     CP::THandle<CP::TAlgorithmResult> currentResult;
@@ -61,9 +71,33 @@ CP::TCaptainRecon::Process(const CP::TAlgorithmResult& driftInput,
     // Apply the sub-algorithms in sequence.
     ///////////////////////////////////////////////////////////
     do {
+// Not usually applied since it changes which wire hits reach TCluster3D.
+//#define Apply_TIsolatedHitFilter
+#ifdef Apply_TIsolatedHitFilter
+        // Remove the isolated wire hits before looking for 3D hits.  If the
+        // filter fails, or removes every hit, then the unfiltered hits are
+        // used.
+        CP::THandle<CP::TAlgorithmResult> isolatedHitResult
+            = Run<CP::TIsolatedHitFilter>(*wires);
+        CP::THandle<CP::THitSelection> filteredWires;
+        if (isolatedHitResult) filteredWires = isolatedHitResult->GetHits();
+        if (filteredWires && !filteredWires->empty()) {
+            result->AddDatum(isolatedHitResult);
+            wires = filteredWires;
+        }
+        else {
+            CaptError("Isolated hit filter failed: Use unfiltered hits");
+        }
+#endif
+
         // Find the time zero and the 3D hits.
         CP::THandle<CP::TAlgorithmResult> cluster3DResult;
-        if (pmts) {
+        if (previous3D) {
+            CaptLog("Start the charge sharing from the previous result");
+            cluster3DResult = Run<CP::TCluster3D>(*wires,pmtInput,
+                                                  *previous3D);
+        }
+        else if (pmts) {
             cluster3DResult = Run<CP::TCluster3D>(*wires,*pmts);
         }
         else {
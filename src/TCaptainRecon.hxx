@@ -25,7 +25,11 @@ namespace CP {
 /// 
 /// The hit selection in the first input algorithm result is expected to be
 /// the wire hits.  The hit selection in the second input algorithm result is
-/// expected to be the PMT hits.
+/// expected to be the PMT hits.  The third input algorithm result is an
+/// optional previous TCaptainRecon result for the same event.  When
+/// captRecon.cluster3d.warmStart is true, the TCluster3D result saved in it
+/// is passed to TCluster3D so that the charge sharing starts from the saved
+/// weights (see captRecon.cluster3d.saveChargeWeights).
 class CP::TCaptainRecon: public CP::TAlgorithm {
 public:
     TCaptainRecon();
@@ -56,5 +60,15 @@ private:
         std::unique_ptr<T> ptr(new T);
         return ptr->Process(in1,in2);
     }
+
+    /// A template to simplify calling sub-algorithms.  This handles the
+    /// TAlgorithm memory management.
+    template<typename T>
+    CP::THandle<CP::TAlgorithmResult> Run(const CP::TAlgorithmResult& in1,
+                                          const CP::TAlgorithmResult& in2,
+                                          const CP::TAlgorithmResult& in3) {
+        std::unique_ptr<T> ptr(new T);
+        return ptr->Process(in1,in2,in3);
+    }
 };
 #endif
@@ -0,0 +1,103 @@
+#include "TChargeWeights.hxx"
+
+#include <HEPUnits.hxx>
+
+#include <cmath>
+
+CP::TChargeWeights::TChargeWeights()
+    : fSize(0), fPositionTolerance(0.5*unit::mm) {}
+
+CP::TChargeWeights::~TChargeWeights() {}
+
+void CP::TChargeWeights::Clear() {
+    fWeights.clear();
+    fSize = 0;
+}
+
+CP::TChargeWeights::Key
+CP::TChargeWeights::MakeKey(const CP::THit& hit) const {
+    Key key;
+    key.reserve(hit.GetConstituentCount());
+    for (int i = 0; i < hit.GetConstituentCount(); ++i) {
+        CP::THandle<CP::THit> constituent = hit.GetConstituent(i);
+        long time = std::floor(constituent->GetTime()/unit::ns + 0.5);
+        key.push_back(std::make_pair(constituent->GetGeomId().AsInt(),
+                                     time));
+    }
+    return key;
+}
+
+const CP::TChargeWeights::Entry*
+CP::TChargeWeights::FindEntry(const Entries& entries,
+                              const CP::THit& hit) const {
+    const Entry* best = NULL;
+    double bestDistance = fPositionTolerance;
+    for (Entries::const_iterator e = entries.begin();
+         e != entries.end(); ++e) {
+        double distance = (e->fPosition - hit.GetPosition()).Mag();
+        if (distance > bestDistance) continue;
+        best = &(*e);
+        bestDistance = distance;
+    }
+    return best;
+}
+
+void CP::TChargeWeights::Add(const CP::THit& hit,
+                             const std::vector<double>& weights) {
+    Entries& entries = fWeights[MakeKey(hit)];
+    Entry* entry = const_cast<Entry*>(FindEntry(entries, hit));
+    if (!entry) {
+        entries.push_back(Entry());
+        entry = &entries.back();
+        ++fSize;
+    }
+    entry->fPosition = hit.GetPosition();
+    entry->fWeights = weights;
+}
+
+bool CP::TChargeWeights::Add(const CP::THitSelection& hits,
+                             const std::vector<double>& weights) {
+    std::size_t count = 0;
+    for (CP::THitSelection::const_iterator h = hits.begin();
+         h != hits.end(); ++h) {
+        count += (*h)->GetConstituentCount();
+    }
+    if (count != weights.size()) return false;
+
+    std::vector<double> hitWeights;
+    std::vector<double>::const_iterator w = weights.begin();
+    for (CP::THitSelection::const_iterator h = hits.begin();
+         h != hits.end(); ++h) {
+        std::vector<double>::const_iterator end
+            = w + (*h)->GetConstituentCount();
+        hitWeights.assign(w, end);
+        Add(**h, hitWeights);
+        w = end;
+    }
+    return true;
+}
+
+bool CP::TChargeWeights::GetWeights(const CP::THit& hit,
+                                    std::vector<double>& weights) const {
+    std::map< Key, Entries >::const_iterator entries
+        = fWeights.find(MakeKey(hit));
+    if (entries == fWeights.end()) return false;
+    const Entry* entry = FindEntry(entries->second, hit);
+    if (!entry) return false;
+    weights = entry->fWeights;
+    return true;
+}
+
+void CP::TChargeWeights::Fill(const CP::THitSelection& hits,
+                              std::vector<double>& weights) const {
+    std::vector<double> hitWeights;
+    for (CP::THitSelection::const_iterator h = hits.begin();
+         h != hits.end(); ++h) {
+        int constituents = (*h)->GetConstituentCount();
+        if (!GetWeights(**h, hitWeights)
+            || (int) hitWeights.size() != constituents) {
+            hitWeights.assign(constituents, 1.0);
+        }
+        weights.insert(weights.end(), hitWeights.begin(), hitWeights.end());
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef TChargeWeights_hxx_seen
+#define TChargeWeights_hxx_seen
+
+#include <THit.hxx>
+#include <THitSelection.hxx>
+
+#include <TVector3.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace CP {
+    class TChargeWeights;
+};
+
+/// The link weights found when the charge of the wire hits is shared
+/// between 3D hits (see TDistributeCharge), kept so they can be used as the
+/// starting weights when an event is reconstructed again.  The weights of a
+/// 3D hit are kept in the order of its constituents, and the 3D hit is
+/// found using the geometry identifier and time (rounded to the nearest
+/// nanosecond) of each of its constituents.  The constituents will be
+/// different objects when the event is reprocessed, but the same wire hits
+/// have the same key, so the weights can be found after a calibration
+/// change.  Long wire hits are split into several 3D hits with the same
+/// constituents, so these are told apart by the position of the 3D hit,
+/// which must be inside the position tolerance.  TCluster3D saves the
+/// weights as a list of values for the constituents of each hit in the
+/// clustered hit selection (see Fill), and reads them back with Add.
+///
+/// \code
+/// CP::TChargeWeights previous;
+/// previous.Add(*clustered, chargeWeights->GetVector());
+/// std::vector<double> weights;
+/// if (previous.GetWeights(*hit, weights)) ...
+/// \endcode
+class CP::TChargeWeights {
+public:
+    TChargeWeights();
+    virtual ~TChargeWeights();
+
+    /// Remove all of the weights.
+    void Clear();
+
+    /// Save the weights for the constituents of a 3D hit.  The weights are
+    /// in the order of the constituents.  If the hit is already known, the
+    /// weights are replaced.
+    void Add(const CP::THit& hit, const std::vector<double>& weights);
+
+    /// Save the weights for a hit selection.  The weights are the values
+    /// for the constituents of each hit in the order of the selection (the
+    /// format filled by Fill).  This returns false, and doesn't add any
+    /// weights, if the number of weights doesn't match the number of
+    /// constituents.
+    bool Add(const CP::THitSelection& hits,
+             const std::vector<double>& weights);
+
+    /// Get the weights for the constituents of a 3D hit.  This returns false
+    /// if the hit isn't known.
+    bool GetWeights(const CP::THit& hit, std::vector<double>& weights) const;
+
+    /// Append the weights for the constituents of each hit in a selection to
+    /// a vector.  The weights for hits that aren't known are 1.0 (the
+    /// default starting weight).
+    void Fill(const CP::THitSelection& hits,
+              std::vector<double>& weights) const;
+
+    /// The number of 3D hits with weights.
+    std::size_t size() const {return fSize;}
+
+    /// True if there aren't any weights.
+    bool empty() const {return fSize < 1;}
+
+    /// Set the maximum distance between the positions of 3D hits with the
+    /// same constituents for them to be the same hit.
+    void SetPositionTolerance(double d) {fPositionTolerance = d;}
+
+    /// Get the position tolerance.
+    double GetPositionTolerance() const {return fPositionTolerance;}
+
+private:
+    /// The geometry identifier and time (in nanoseconds) of each constituent
+    /// of a 3D hit.
+    typedef std::vector< std::pair<int, long> > Key;
+
+    /// The weights for a 3D hit, and the position used to tell it apart
+    /// from other 3D hits with the same constituents.
+    struct Entry {
+        TVector3 fPosition;
+        std::vector<double> fWeights;
+    };
+    typedef std::vector<Entry> Entries;
+
+    /// Make the key for a 3D hit.
+    Key MakeKey(const CP::THit& hit) const;
+
+    /// Find the entry for a 3D hit in the entries with the same key.  This
+    /// returns NULL if there isn't an entry inside the position tolerance.
+    const Entry* FindEntry(const Entries& entries,
+                           const CP::THit& hit) const;
+
+    /// The weights for the 3D hits with each key.
+    std::map< Key, Entries > fWeights;
+
+    /// The number of 3D hits with weights.
+    std::size_t fSize;
+
+    /// The position tolerance.
+    double fPositionTolerance;
+};
+#endif
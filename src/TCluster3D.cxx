@@ -4,10 +4,14 @@
 #include "TShareCharge.hxx"
 #include "TDistributeCharge.hxx"
 #include "TRemoveOutliers.hxx"
+#include "TIntervalIndex.hxx"
+#include "TWireCrossings.hxx"
+#include "TGaussianTable.hxx"
 
 #include <THandle.hxx>
 #include <TReconHit.hxx>
 #include <TReconCluster.hxx>
+#include <TRealDatum.hxx>
 #include <TCaptLog.hxx>
 #include <CaptGeomId.hxx>
 #include <HEPUnits.hxx>
@@ -16,71 +20,214 @@
 
 #include <algorithm>
 #include <memory>
+#include <string>
 #include <cmath>
+#include <atomic>
+#include <thread>
+#include <functional>
 
 namespace {
-    struct hitTimeLowerBound {
-        bool operator () (const CP::THandle<CP::THit>& lhs,
-                          const double& rhs) {
-            return lhs->GetTime() < rhs;
-        }
-    };
-
-    struct hitTimeUpperBound {
-        bool operator () (const double& lhs,
-                          const CP::THandle<CP::THit>& rhs) {
-            return lhs < rhs->GetTime();
+    /// Order rows in the wire hit table by the hit time.  Hits with the same
+    /// time are ordered by the row so the order is reproducible.
+    struct compareHitTimes {
+        explicit compareHitTimes(const CP::TWireHitTable& table)
+            : fTable(table) {}
+        bool operator () (int lhs, int rhs) const {
+            if (fTable.GetTime(lhs) < fTable.GetTime(rhs)) return true;
+            if (fTable.GetTime(rhs) < fTable.GetTime(lhs)) return false;
+            return lhs < rhs;
         }
+        const CP::TWireHitTable& fTable;
     };
 
-    struct compareHitTimes {
-        bool operator () (const CP::THandle<CP::THit>& lhs,
-                          const CP::THandle<CP::THit>& rhs) {
-            return lhs->GetTime() < rhs->GetTime();
+    /// Order rows in the wire hit table by the start of the drift corrected
+    /// time range.
+    struct compareHitStarts {
+        explicit compareHitStarts(const CP::TWireHitTable& table)
+            : fTable(table) {}
+        bool operator () (int lhs, int rhs) const {
+            double l = fTable.GetDriftStart(lhs);
+            double r = fTable.GetDriftStart(rhs);
+            if (l < r) return true;
+            if (r < l) return false;
+            return lhs < rhs;
         }
+        const CP::TWireHitTable& fTable;
     };
 
-    double hitRMS(CP::THitSelection::iterator begin, 
-                  CP::THitSelection::iterator end) {
+    double hitRMS(const CP::TWireHitTable& table,
+                  const std::vector<int>& rows) {
         double mean = 0;
         double mean2 = 0;
         double w = 0.0;
-        while (begin != end) {
-            double v = (*begin)->GetCharge();
+        for (std::size_t i = 0; i<rows.size(); ++i) {
+            double v = table.GetCharge(rows[i]);
             mean += v;
             mean2 += v*v;
             w += 1.0;
-            ++begin;
         }
         mean /= w;
         mean2 /= w;
         return std::sqrt(mean2 - mean*mean);
     }
 
-    double hitMean(CP::THitSelection::iterator begin, 
-                   CP::THitSelection::iterator end) {
+    double hitMean(const CP::TWireHitTable& table,
+                   const std::vector<int>& rows) {
         double mean = 0;
         double w = 0.0;
-        while (begin != end) {
-            double v = (*begin)->GetCharge();
+        for (std::size_t i = 0; i<rows.size(); ++i) {
+            double v = table.GetCharge(rows[i]);
             mean += v;
             w += 1.0;
-            ++begin;
         }
         mean /= w;
         return mean;
     }
 
-    double hitTotal(CP::THitSelection::iterator begin, 
-                   CP::THitSelection::iterator end) {
+    double hitTotal(const CP::TWireHitTable& table,
+                    const std::vector<int>& rows) {
         double mean = 0;
-        while (begin != end) {
-            double v = (*begin)->GetCharge();
+        for (std::size_t i = 0; i<rows.size(); ++i) {
+            double v = table.GetCharge(rows[i]);
             mean += v;
-            ++begin;
         }
         return mean;
     }
+
+    /// The channel and time range of a wire hit used to check for
+    /// overlapping hits on the same channel.  These are sorted by channel,
+    /// and then by the start time.
+    struct channelInterval {
+        unsigned int fChannel;
+        double fStart;
+        double fStop;
+        int fHit;
+        bool operator < (const channelInterval& rhs) const {
+            if (fChannel < rhs.fChannel) return true;
+            if (rhs.fChannel < fChannel) return false;
+            if (fStart < rhs.fStart) return true;
+            if (rhs.fStart < fStart) return false;
+            return fHit < rhs.fHit;
+        }
+    };
+
+    /// The wire and time range of a wire hit used to build the 2D clusters
+    /// on a plane.  These are sorted by wire, and then by the start time.
+    /// The hit is the position in the plane.
+    struct wireInterval {
+        int fWire;
+        double fStart;
+        double fStop;
+        int fHit;
+        bool operator < (const wireInterval& rhs) const {
+            if (fWire < rhs.fWire) return true;
+            if (rhs.fWire < fWire) return false;
+            if (fStart < rhs.fStart) return true;
+            if (rhs.fStart < fStart) return false;
+            return fHit < rhs.fHit;
+        }
+    };
+
+    /// Find the root of an element in a disjoint set forest.  The path is
+    /// halved as it's followed.
+    int findRoot(std::vector<int>& parent, int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    /// Join the sets containing two elements of a disjoint set forest.  The
+    /// root is always the smallest element so the result is reproducible.
+    void joinSets(std::vector<int>& parent, int a, int b) {
+        a = findRoot(parent,a);
+        b = findRoot(parent,b);
+        if (a == b) return;
+        if (b < a) std::swap(a,b);
+        parent[b] = a;
+    }
+
+    /// Return true if two sorted vectors have a common element.
+    bool shareElement(const std::vector<int>& a, const std::vector<int>& b) {
+        std::vector<int>::const_iterator i = a.begin();
+        std::vector<int>::const_iterator j = b.begin();
+        while (i != a.end() && j != b.end()) {
+            if (*i < *j) ++i;
+            else if (*j < *i) ++j;
+            else return true;
+        }
+        return false;
+    }
+
+    /// Fill the drift corrected start and stop times for hits on a plane
+    /// (see TWireHitTable::GetDriftStart and GetDriftStop).
+    void fillIntervals(const CP::TWireHitTable& table,
+                       const std::vector<int>& rows,
+                       std::vector<double>& begin,
+                       std::vector<double>& end) {
+        begin.resize(rows.size());
+        end.resize(rows.size());
+        for (std::size_t i = 0; i<rows.size(); ++i) {
+            begin[i] = table.GetDriftStart(rows[i]);
+            end[i] = table.GetDriftStop(rows[i]);
+        }
+    }
+
+    /// Build an interval index for the time ranges of the hits on a plane.
+    /// The interval values are the index of the hit in the selection.
+    void buildIndex(const std::vector<double>& begin,
+                    const std::vector<double>& end,
+                    CP::TIntervalIndex& index) {
+        index.Clear();
+        for (std::size_t i = 0; i<begin.size(); ++i) {
+            index.Add(begin[i], end[i], i);
+        }
+        index.Build();
+    }
+};
+
+/// The workspace used to find 3D hits.  Each thread has its own worker, and
+/// when the worker is run as a thread, it takes ranges of X hits (chunks)
+/// from any of the interactions until all of the chunks are done.  The
+/// output for each chunk is separate so that the results can be combined in
+/// the same order as the serial calculation.
+struct CP::TCluster3D::Worker {
+    Worker() : fLog(true), fAlgorithm(NULL), fChunks(NULL), fOutputs(NULL),
+               fNext(NULL) {}
+
+    /// Run the worker as a thread.
+    void operator () () {
+        for (;;) {
+            std::size_t chunk = (*fNext)++;
+            if (chunk >= fChunks->size()) break;
+            const Chunk& c = (*fChunks)[chunk];
+            fAlgorithm->FindTriplets(*this,
+                                     fAlgorithm->fInteractions[c.fInteraction],
+                                     (*fOutputs)[chunk], c.fBegin, c.fEnd);
+        }
+    }
+
+    /// The workspace for the waveform overlap calculations.
+    CP::TWaveformOverlap fOverlap;
+
+    /// Scratch space for the triplet search.
+    std::vector<int> fVCandidates;
+    std::vector<int> fUCandidates;
+    std::vector<int> fXVIndex;
+    std::vector<int> fXVMatch;
+    std::vector<int> fXUMatch;
+
+    /// Write diagnostic messages.  The logging isn't thread safe, so this is
+    /// only true for the calling thread.
+    bool fLog;
+
+    /// The algorithm, chunks, output and work sharing used when running as
+    /// a thread.
+    const CP::TCluster3D* fAlgorithm;
+    const std::vector<Chunk>* fChunks;
+    std::vector<HitList>* fOutputs;
+    std::atomic<std::size_t>* fNext;
 };
 
 TVector3 CP::TCluster3D::PositionXY(const CP::THandle<CP::THit>& hit1,
@@ -108,23 +255,19 @@ TVector3 CP::TCluster3D::PositionXY(const CP::THandle<CP::THit>& hit1,
     return TVector3( (x1+s1*dx1), (y1+s1*dy1), 0.0);
 }
 
-double CP::TCluster3D::ChargeOverlap(const CP::THandle<CP::THit>& hit1,
-                                     const CP::THandle<CP::THit>& hit2) const {
+double CP::TCluster3D::ChargeOverlap(Worker& worker,
+                                     int hit1, int hit2) const {
+    const CP::TWireHitTable& table = fWireHits;
+    CP::TWaveformOverlap& overlap = worker.fOverlap;
+    const int hits[2] = {hit1, hit2};
     double startTime = 9E+30;
     double stopTime = -9E+30;
-    double expectedCharge = 9E+30;
     
     // Find the full range of time covered by this hit.
-    if (hit1) {
-        startTime = std::min(startTime, hit1->GetTimeStart());
-        stopTime = std::max(stopTime, hit1->GetTimeStop());
-        expectedCharge = std::min(expectedCharge, hit1->GetCharge());
-    }
-
-    if (hit2) {
-        startTime = std::min(startTime, hit2->GetTimeStart());
-        stopTime = std::max(stopTime, hit2->GetTimeStop());
-        expectedCharge = std::min(expectedCharge, hit2->GetCharge());
+    for (int h = 0; h<2; ++h) {
+        if (hits[h] < 0) continue;
+        startTime = std::min(startTime, table.GetTimeStart(hits[h]));
+        stopTime = std::max(stopTime, table.GetTimeStop(hits[h]));
     }
 
     // Extend the time range to cover for the drift between the wires.
@@ -133,45 +276,27 @@ double CP::TCluster3D::ChargeOverlap(const CP::THandle<CP::THit>& hit1,
 
     // Build an "overlap charge distribution"
     int bins = (stopTime-startTime)/fDigitStep + 1;
-    std::vector<double> overlap(bins);
-
-    CP::TDriftPosition drift;
-    if (hit1) {
-        double hitStart = drift.GetTime(*hit1);
-        hitStart += hit1->GetTimeStart()-hit1->GetTime();
-        if (hit1->GetTimeSamples() > 1) {
-            int ibin = (hitStart - startTime)/fDigitStep;
-            for (int i = 0; i<hit1->GetTimeSamples(); ++i) {
-                // The first hit must exist so just assign it.
-                overlap[i+ibin] = std::max(0.0,hit1->GetTimeSample(i));
-            }
-        }
-    }
-
-    if (hit2) {
-        double hitStart = drift.GetTime(*hit2);
-        hitStart += hit2->GetTimeStart()-hit2->GetTime();
-        if (hit2->GetTimeSamples() > 1) {
-            int ibin = (hitStart - startTime)/fDigitStep;
-            for (int i=0; i<ibin; ++i) overlap[i] = 0.0;
-            for (int i = 0; i<hit2->GetTimeSamples(); ++i) {
-                overlap[i+ibin] = std::max(0.0,
-                                           std::min(overlap[i+ibin],
-                                                    hit2->GetTimeSample(i)));
-            }
-            for (std::size_t i=ibin+hit2->GetTimeSamples();
-                 i<overlap.size(); ++i) {
-                overlap[i] = 0.0;
-            }
+    const float* samples[2];
+    int first[2];
+    int count[2];
+    int waveforms = 0;
+    for (int h = 0; h<2; ++h) {
+        if (hits[h] < 0) continue;
+        int n = table.GetSampleCount(hits[h]);
+        if (n < 2) {
+            if (h == 0) break;
+            continue;
         }
+        double hitStart = table.GetDriftTime(hits[h]);
+        hitStart += table.GetTimeStart(hits[h])-table.GetTime(hits[h]);
+        samples[waveforms] = table.GetFloatSamples(hits[h]);
+        first[waveforms] = (hitStart - startTime)/fDigitStep;
+        count[waveforms] = n;
+        ++waveforms;
     }
+    overlap.Fill(bins, waveforms, samples, first, count, 1.0);
 
-    double charge = 0.0;
-    for (std::size_t i = 0; i<overlap.size(); ++i) {
-        charge += overlap[i];
-    }
-
-    return charge;
+    return overlap.GetCharge();
 }
 
 bool CP::TCluster3D::OverlapXY(const CP::THandle<CP::THit>& hit1,
@@ -249,11 +374,67 @@ double CP::TCluster3D::TimeZero(const CP::THitSelection& pmts,
     return t0;
 }
 
+void CP::TCluster3D::TimeZeros(const CP::THitSelection& pmts,
+                               std::vector<double>& t0s) const {
+    t0s.clear();
+    if (pmts.empty()) return;
+
+    std::vector<double> times;
+    for (CP::THitSelection::const_iterator p = pmts.begin();
+         p != pmts.end(); ++p) {
+        times.push_back((*p)->GetTime());
+    }
+    std::sort(times.begin(),times.end());
+
+    // Count the PMT hits in the 2 microsecond window starting at each hit.
+    std::vector< std::pair<int,int> > windows;
+    for (std::size_t t = 0; t < times.size(); ++t) {
+        std::size_t h = t;
+        while (++h < times.size()) {
+            if (times[h] - times[t] > 2*unit::microsecond) break;
+        }
+        // Save minus the count so that the biggest flashes sort first, and
+        // flashes with the same count are in time order (like TimeZero).
+        windows.push_back(std::make_pair(- (int) (h-t), (int) t));
+    }
+    std::sort(windows.begin(), windows.end());
+
+    // Take the biggest flashes that don't overlap a flash that has already
+    // been found.
+    int maxHits = - windows.front().first;
+    std::vector<double> found;
+    for (std::size_t w = 0; w < windows.size(); ++w) {
+        if ((int) found.size() >= std::max(1,fMaxInteractions)) break;
+        int hits = - windows[w].first;
+        if (hits < fFlashFraction*maxHits) break;
+        double t0 = times[windows[w].second];
+        bool overlaps = false;
+        for (std::size_t f = 0; f < found.size(); ++f) {
+            if (std::abs(found[f] - t0) > 2*unit::microsecond) continue;
+            overlaps = true;
+            break;
+        }
+        if (overlaps) continue;
+        found.push_back(t0);
+    }
+
+    t0s = found;
+    std::sort(t0s.begin(), t0s.end());
+}
+
 CP::TCluster3D::TCluster3D()
-    : TAlgorithm("TCluster3D", "Cluster Wire Hits") {
+    : TAlgorithm("TCluster3D", "Cluster Wire Hits"), fChargeIterations(0) {
     fMaxDrift
         = CP::TRuntimeParameters::Get().GetParameterD(
             "captRecon.cluster3d.maxDrift");
+    fMaxInteractions = CP::TRuntimeParameters::Get().GetParameterI(
+            "captRecon.cluster3d.maxInteractions");
+    fFlashFraction = CP::TRuntimeParameters::Get().GetParameterD(
+            "captRecon.cluster3d.flashFraction");
+    fTimeSlices = CP::TRuntimeParameters::Get().GetParameterI(
+            "captRecon.cluster3d.timeSlices");
+    fPreCluster = CP::TRuntimeParameters::Get().GetParameterI(
+            "captRecon.cluster3d.preCluster");
 
     fXSeparation = CP::TRuntimeParameters::Get().GetParameterD(
             "captRecon.cluster3d.xSeparation");
@@ -275,184 +456,170 @@ CP::TCluster3D::TCluster3D()
     // This is the determined by the minimum tick of the digitizer.  
     fMinSeparation = fDigitStep;
 
-}
-
-CP::TCluster3D::~TCluster3D() { }
+    // The number of threads used to build 3D hits.  If this is zero, use
+    // the number of cores.
+    fThreads = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.cluster3d.threads");
+    if (fThreads < 1) fThreads = std::thread::hardware_concurrency();
+    if (fThreads < 1) fThreads = 1;
+
+    // The over-relaxation factor for the charge sharing.
+    fChargeRelaxation = CP::TRuntimeParameters::Get().GetParameterD(
+        "captRecon.cluster3d.chargeRelaxation");
+
+    // The method used for the charge sharing.  This can be "relaxation" or
+    // "leastSquares".
+    std::string chargeMethod = CP::TRuntimeParameters::Get().GetParameterS(
+        "captRecon.cluster3d.chargeMethod");
+    if (chargeMethod == "relaxation") {
+        fChargeMethod = CP::TDistributeCharge::kRelaxation;
+    }
+    else if (chargeMethod == "leastSquares") {
+        fChargeMethod = CP::TDistributeCharge::kLeastSquares;
+    }
+    else {
+        CaptError("Invalid value for captRecon.cluster3d.chargeMethod: "
+                  << chargeMethod);
+        fChargeMethod = CP::TDistributeCharge::kRelaxation;
+    }
 
-double CP::TCluster3D::OverlapTime(double r1, double r2, double step) const {
-#ifdef QUADRATURE_OVERLAP
-    return std::sqrt(r1*r1 + r2*r2 + step*step);
-#else
-    return std::max(r1,std::max(r2,step));
-#endif
-}
+    // Save the charge sharing weights with the 3D hits so they can be used
+    // to start the charge sharing when the event is reprocessed.
+    fSaveChargeWeights = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.cluster3d.saveChargeWeights");
+
+    // Check the input for overlapping hits on a channel.  The check can be
+    // "off", only count the overlaps ("count"), or log every overlapping
+    // pair ("log").
+    std::string overlapCheck = CP::TRuntimeParameters::Get().GetParameterS(
+        "captRecon.cluster3d.overlapCheck");
+    if (overlapCheck == "off") fOverlapCheck = kOverlapCheckOff;
+    else if (overlapCheck == "count") fOverlapCheck = kOverlapCheckCount;
+    else if (overlapCheck == "log") fOverlapCheck = kOverlapCheckLog;
+    else {
+        CaptError("Invalid value for captRecon.cluster3d.overlapCheck: "
+                  << overlapCheck);
+        fOverlapCheck = kOverlapCheckCount;
+    }
 
-bool CP::TCluster3D::OverlappingHits(CP::THandle<CP::THit> h1,
-                                     CP::THandle<CP::THit> h2) const {
-#define START_STOP_OVERLAP
-#ifdef START_STOP_OVERLAP
-    CP::TDriftPosition drift;
-    double b1 = drift.GetTime(*h1) + h1->GetTimeStart() - h1->GetTime();
-    double b2 = drift.GetTime(*h2) + h2->GetTimeStart() - h2->GetTime();
-    double e1 = drift.GetTime(*h1) + h1->GetTimeStop() - h1->GetTime();
-    double e2 = drift.GetTime(*h2) + h2->GetTimeStop() - h2->GetTime();
-    if (e1 < b2) return false;
-    if (e2 < b1) return false;
-    return true;
-#else
-    CP::TDriftPosition drift;
-    double t1 = drift.GetTime(*h1);
-    double t2 = drift.GetTime(*h2);
-    double r1 = fXSeparation*h1->GetTimeRMS();
-    double r2 = fUSeparation*h2->GetTimeRMS();
-    return (std::abs(t1-t2) < OverlapTime(r1,r2,fMinSeparation));
-#endif
 }
 
-bool CP::TCluster3D::MakeHit(CP::THitSelection& writableHits,
-                             const TVector3& hitPosition,
-                             double t0,
-                             const CP::THandle<CP::THit>& hit1,
-                             const CP::THandle<CP::THit>& hit2,
-                             const CP::THandle<CP::THit>& hit3) const {
+CP::TCluster3D::~TCluster3D() { }
 
-    double startTime = 9E+30;
-    double stopTime = -9E+30;
-    double expectedCharge = 9E+30;
-    
-    if (hit1 && hit2) {
-        if (CP::GeomId::Captain::GetWirePlane(hit1->GetGeomId())
-            == CP::GeomId::Captain::GetWirePlane(hit2->GetGeomId())) {
-            return false;
-        }
-        if (hit1->GetTimeStart() > hit2->GetTimeStop()) {
-            return false;
-        }
-        if (hit1->GetTimeStop() < hit2->GetTimeStart()) {
-            return false;
-        }
+int CP::TCluster3D::CheckOverlappingHits(
+    const CP::THitSelection& hits) const {
+    std::vector<channelInterval> intervals(hits.size());
+    for (std::size_t i = 0; i < hits.size(); ++i) {
+        intervals[i].fChannel = hits[i]->GetChannelId().AsUInt();
+        intervals[i].fStart = hits[i]->GetTimeStart();
+        intervals[i].fStop = hits[i]->GetTimeStop();
+        intervals[i].fHit = i;
     }
-
-    if (hit1 && hit3) {
-        if (CP::GeomId::Captain::GetWirePlane(hit1->GetGeomId())
-            == CP::GeomId::Captain::GetWirePlane(hit3->GetGeomId())) {
-            return false;
-        }
-        if (hit1->GetTimeStart() > hit3->GetTimeStop()) {
-            return false;
+    std::sort(intervals.begin(), intervals.end());
+
+    // Sweep through the hits on each channel keeping the hits that haven't
+    // ended yet.  Hits overlap if one starts before the other stops (hits
+    // that touch at the ends don't overlap).
+    int overlaps = 0;
+    std::vector<int> active;
+    for (std::size_t i = 0; i < intervals.size(); ++i) {
+        const channelInterval& current = intervals[i];
+        if (i == 0 || intervals[i-1].fChannel != current.fChannel) {
+            active.clear();
         }
-        if (hit1->GetTimeStop() < hit3->GetTimeStart()) {
-            return false;
+        std::size_t kept = 0;
+        for (std::size_t a = 0; a < active.size(); ++a) {
+            const channelInterval& previous = intervals[active[a]];
+            if (previous.fStop <= current.fStart) continue;
+            active[kept++] = active[a];
+            if (current.fStop <= previous.fStart) continue;
+            ++overlaps;
+            if (fOverlapCheck != kOverlapCheckLog) continue;
+            CaptError("Overlapping hit on "
+                      << hits[current.fHit]->GetChannelId());
+            CaptError("   hit " << previous.fStart << " " << previous.fStop);
+            CaptError("   hit " << current.fStart << " " << current.fStop);
         }
+        active.resize(kept);
+        active.push_back(i);
     }
 
-    if (hit2 && hit3) {
-        if (CP::GeomId::Captain::GetWirePlane(hit2->GetGeomId())
-            == CP::GeomId::Captain::GetWirePlane(hit3->GetGeomId())) {
-            return false;
-        }
-        if (hit2->GetTimeStart() > hit3->GetTimeStop()) {
-            return false;
-        }
-        if (hit2->GetTimeStop() < hit3->GetTimeStart()) {
-            return false;
+    return overlaps;
+}
+
+bool CP::TCluster3D::MakeHit(Worker& worker, HitList& output,
+                             const TVector3& hitPosition,
+                             int hit1, int hit2, int hit3) const {
+    const CP::TWireHitTable& table = fWireHits;
+    CP::TWaveformOverlap& overlap = worker.fOverlap;
+    const int hits[3] = {hit1, hit2, hit3};
+
+    // Check that the hits are on different planes and overlap in time.
+    for (int i = 0; i<3; ++i) {
+        if (hits[i] < 0) continue;
+        for (int j = i+1; j<3; ++j) {
+            if (hits[j] < 0) continue;
+            if (table.GetPlane(hits[i]) == table.GetPlane(hits[j])) {
+                return false;
+            }
+            if (table.GetTimeStart(hits[i]) > table.GetTimeStop(hits[j])) {
+                return false;
+            }
+            if (table.GetTimeStop(hits[i]) < table.GetTimeStart(hits[j])) {
+                return false;
+            }
         }
     }
 
     // Find the full range of time covered by this hit.
-    if (hit1) {
-        startTime = std::min(startTime, hit1->GetTimeStart());
-        stopTime = std::max(stopTime, hit1->GetTimeStop());
-        expectedCharge = std::min(expectedCharge, hit1->GetCharge());
-    }
-
-    if (hit2) {
-        startTime = std::min(startTime, hit2->GetTimeStart());
-        stopTime = std::max(stopTime, hit2->GetTimeStop());
-        expectedCharge = std::min(expectedCharge, hit2->GetCharge());
-    }
-
-    if (hit3) {
-        startTime = std::min(startTime, hit3->GetTimeStart());
-        stopTime = std::max(stopTime, hit3->GetTimeStop());
-        expectedCharge = std::min(expectedCharge, hit3->GetCharge());
+    double startTime = 9E+30;
+    double stopTime = -9E+30;
+    double expectedCharge = 9E+30;
+    for (int i = 0; i<3; ++i) {
+        if (hits[i] < 0) continue;
+        startTime = std::min(startTime, table.GetTimeStart(hits[i]));
+        stopTime = std::max(stopTime, table.GetTimeStop(hits[i]));
+        expectedCharge = std::min(expectedCharge, table.GetCharge(hits[i]));
     }
 
     // Extend the time range to cover for the drift between the wires.
     startTime -= 15*unit::microsecond;
     stopTime += 15*unit::microsecond;
     
-    CP::TDriftPosition drift;
-
-    // Build an "overlap charge distribution"
+    // Build an "overlap charge distribution".  This is the minimum of the
+    // waveforms in each time bin (and zero outside of the waveforms).  If
+    // the first hit doesn't have samples, then there isn't any overlap.
     int bins = (stopTime-startTime)/fDigitStep + 1;
-    std::vector<double> overlap(bins);
-
-    if (hit1) {
-        double hitStart = drift.GetTime(*hit1);
-        hitStart += hit1->GetTimeStart()-hit1->GetTime();
-        if (hit1->GetTimeSamples() > 1) {
-            int ibin = (hitStart - startTime)/fDigitStep;
-            for (int i = 0; i<hit1->GetTimeSamples(); ++i) {
-                // The first hit must exist so just assign it.
-                overlap[i+ibin] = std::max(0.0,hit1->GetTimeSample(i));
-            }
-        }
-    }
-
-    if (hit2) {
-        double hitStart = drift.GetTime(*hit2);
-        hitStart += hit2->GetTimeStart()-hit2->GetTime();
-        if (hit2->GetTimeSamples() > 1) {
-            int ibin = (hitStart - startTime)/fDigitStep;
-            for (int i=0; i<ibin; ++i) overlap[i] = 0.0;
-            for (int i = 0; i<hit2->GetTimeSamples(); ++i) {
-                overlap[i+ibin] = std::max(0.0,
-                                           std::min(overlap[i+ibin],
-                                                    hit2->GetTimeSample(i)));
-            }
-            for (std::size_t i=ibin+hit2->GetTimeSamples();
-                 i<overlap.size(); ++i) {
-                overlap[i] = 0.0;
-            }
+    const float* samples[3];
+    int first[3];
+    int count[3];
+    int waveforms = 0;
+    for (int h = 0; h<3; ++h) {
+        if (hits[h] < 0) continue;
+        int n = table.GetSampleCount(hits[h]);
+        if (n < 2) {
+            if (h == 0) break;
+            continue;
         }
+        double hitStart = table.GetDriftTime(hits[h]);
+        hitStart += table.GetTimeStart(hits[h])-table.GetTime(hits[h]);
+        samples[waveforms] = table.GetFloatSamples(hits[h]);
+        first[waveforms] = (hitStart - startTime)/fDigitStep;
+        count[waveforms] = n;
+        ++waveforms;
     }
+    overlap.Fill(bins, waveforms, samples, first, count, 1.0);
 
-    if (hit3) {
-        double hitStart = drift.GetTime(*hit3);
-        hitStart += hit3->GetTimeStart()-hit3->GetTime();
-        if (hit3->GetTimeSamples() > 1) {
-            int ibin = (hitStart - startTime)/fDigitStep;
-            for (int i=0; i<ibin; ++i) overlap[i] = 0.0;
-            for (int i = 0; i<hit3->GetTimeSamples(); ++i) {
-                overlap[i+ibin] = std::max(0.0,
-                                           std::min(overlap[i+ibin],
-                                                    hit3->GetTimeSample(i)));
-            }
-            for (std::size_t i=ibin+hit3->GetTimeSamples();
-                 i<overlap.size(); ++i) {
-                overlap[i] = 0.0;
-            }
-        }
-    }
-
-    // Find the time of the hit based on the overlaps between the wire hits.
-    double hitTime = 0.0;
-    double hitTimeRMS = 0.0;
-    double hitCharge = 0.0;
-    double hitStart = overlap.size();
-    double hitStop = 0;
-    for (std::size_t i = 0; i<overlap.size(); ++i) {
-        double t = startTime + fDigitStep*i;
-        hitTime += t*overlap[i];
-        hitTimeRMS += t*t*overlap[i];
-        hitCharge += overlap[i];
-        if (i < hitStart && overlap[i] > 1) hitStart = i;
-        if (i > hitStop && overlap[i] > 1) hitStop = i;
-    }
+    // Find the charge and extent of the overlap between the wire hits.
+    double hitCharge = overlap.GetCharge();
+    double hitStart = overlap.GetFirst();
+    double hitStop = overlap.GetLast();
     
     // Make sure the hits overlapped by a reasonable amount.
     if (hitCharge < fMinimumOverlap*expectedCharge) {
+        // The logging isn't thread safe, so only the calling thread writes
+        // diagnostics.
+        if (!worker.fLog) return false;
         CaptNamedInfo("Cluster","Insufficient overlap: "
                      << hitCharge << "/" << expectedCharge
                      << " from "
@@ -460,44 +627,19 @@ bool CP::TCluster3D::MakeHit(CP::THitSelection& writableHits,
                      << " to " 
                      << unit::AsString(startTime+hitStop*fDigitStep, "time"));
         CP::TCaptLog::IncreaseIndentation();
-        if (hit1) {
+        for (int h = 0; h<3; ++h) {
+            if (hits[h] < 0) continue;
             CaptNamedVerbose(
                 "Cluster",
-                "Hit1: ("
-                << CP::GeomId::Captain::GetWirePlane(hit1->GetGeomId())
-                << "-" << CP::GeomId::Captain::GetWireNumber(hit1->GetGeomId())
+                "Hit" << h+1 << ": ("
+                << table.GetPlane(hits[h])
+                << "-" << table.GetWire(hits[h])
                 << ")"
-                << " " << unit::AsString(hit1->GetCharge(), "pe")
+                << " " << unit::AsString(table.GetCharge(hits[h]), "pe")
                 << " from " 
-                << unit::AsString(hit1->GetTimeStart(), "time")
+                << unit::AsString(table.GetTimeStart(hits[h]), "time")
                 << " to " 
-                << unit::AsString(hit1->GetTimeStop(), "time"));
-        }
-        if (hit2) {
-            CaptNamedVerbose(
-                "Cluster",
-                "Hit2: ("
-                << CP::GeomId::Captain::GetWirePlane(hit2->GetGeomId())
-                << "-" << CP::GeomId::Captain::GetWireNumber(hit2->GetGeomId())
-                << ")"
-                << " " << unit::AsString(hit2->GetCharge(), "pe")
-                << " from " 
-                << unit::AsString(hit2->GetTimeStart(), "time")
-                << " to " 
-                << unit::AsString(hit2->GetTimeStop(), "time"));
-        }
-        if (hit3) {
-            CaptNamedVerbose(
-                "Cluster",
-                "Hit3: ("
-                << CP::GeomId::Captain::GetWirePlane(hit3->GetGeomId())
-                << "-" << CP::GeomId::Captain::GetWireNumber(hit3->GetGeomId())
-                << ")"
-                << " " << unit::AsString(hit3->GetCharge(), "pe")
-                << " from " 
-                << unit::AsString(hit3->GetTimeStart(), "time")
-                << " to " 
-                << unit::AsString(hit3->GetTimeStop(), "time"));
+                << unit::AsString(table.GetTimeStop(hits[h]), "time"));
         }
         CP::TCaptLog::DecreaseIndentation();
         return false;
@@ -530,53 +672,70 @@ bool CP::TCluster3D::MakeHit(CP::THitSelection& writableHits,
     std::vector<int>::iterator end = begin+1;
     while (end != splits.end()) {
         // Find the time of the hit based on the overlaps between the wire
-        // hits.
-        double splitTime = 0.0;
-        double splitTimeRMS = 0.0;
+        // hits.  The moments are in units of the bin number.
         double splitCharge = 0.0;
-        for (int i = *begin; i< *end; ++i) {
-            double t = startTime + fDigitStep*i;
-            splitTime += t*overlap[i];
-            splitTimeRMS += t*t*overlap[i];
-            splitCharge += overlap[i];
-        }
-        splitTime /= splitCharge;
-        splitTimeRMS /= splitCharge;
-        splitTimeRMS = splitTimeRMS - splitTime*splitTime;
+        double splitBin = 0.0;
+        double splitBinRMS = 0.0;
+        overlap.Moments(*begin, *end, splitCharge, splitBin, splitBinRMS);
+        splitBin /= splitCharge;
+        splitBinRMS /= splitCharge;
+        double splitTime = startTime + fDigitStep*splitBin;
+        double splitTimeRMS
+            = fDigitStep*fDigitStep*(splitBinRMS - splitBin*splitBin);
         if (splitTimeRMS > 0) splitTimeRMS = std::sqrt(splitTimeRMS);
-        
+
+        HitCandidate candidate;
+        for (int h = 0; h<3; ++h) candidate.fHits[h] = hits[h];
+        candidate.fX = hitPosition.X();
+        candidate.fY = hitPosition.Y();
+        candidate.fTime = splitTime;
+        candidate.fTimeRMS = splitTimeRMS;
+        candidate.fCharge = splitCharge;
+        output.fCandidates.push_back(candidate);
+        begin = end; ++end;
+    }
+
+    return true;
+}
+
+void CP::TCluster3D::EmitHits(const HitList& input, double t0,
+                              CP::THitSelection& writableHits,
+                              CP::TDenseHitSet& used) const {
+    const CP::TWireHitTable& table = fWireHits;
+    const CP::TDriftPosition& drift = table.GetDrift();
+
+    for (std::vector<HitCandidate>::const_iterator c
+             = input.fCandidates.begin();
+         c != input.fCandidates.end(); ++c) {
+        const int* hits = c->fHits;
+        CP::THandle<CP::THit> handles[3];
+        for (int h = 0; h<3; ++h) {
+            if (hits[h] < 0) continue;
+            handles[h] = table.GetHit(hits[h]);
+        }
+
         CP::THandle<CP::TWritableReconHit> hit(
-            new CP::TWritableReconHit(hit1,hit2,hit3));
-        hit->SetPosition(hitPosition);
-        hit->SetTime(splitTime);
+            new CP::TWritableReconHit(handles[0],handles[1],handles[2]));
+        hit->SetPosition(TVector3(c->fX, c->fY, 0.0));
+        hit->SetTime(c->fTime);
         // Correct for the time zero.
         hit->SetPosition(drift.GetPosition(*hit,t0).Vect());
         hit->SetTime(t0);
-        hit->SetTimeUncertainty(splitTimeRMS/sqrt(3.0));
-        hit->SetTimeRMS(splitTimeRMS);
-        hit->SetCharge(splitCharge);
-        
+        hit->SetTimeUncertainty(c->fTimeRMS/sqrt(3.0));
+        hit->SetTimeRMS(c->fTimeRMS);
+        hit->SetCharge(c->fCharge);
+
         // Estimate the charge uncertainty.
         double splitChargeUnc = 0.0;
-        if (hit1) {
-            double w = hit1->GetChargeUncertainty();
+        for (int h = 0; h<3; ++h) {
+            if (hits[h] < 0) continue;
+            double w = table.GetChargeUncertainty(hits[h]);
             splitChargeUnc += 1.0/(w*w);
         }
-        
-        if (hit2) {
-            double w = hit2->GetChargeUncertainty();
-            splitChargeUnc += 1.0/(w*w);
-        }
-        
-        if (hit3) {
-            double w = hit3->GetChargeUncertainty();
-            splitChargeUnc += 1.0/(w*w);
-        }
-        
         if (splitChargeUnc > 0.0) {
             hit->SetChargeUncertainty(std::sqrt(1.0/splitChargeUnc));
         }
-        
+
         // Find the xyRMS and xyUncertainty.  This is not being done
         // correctly, but this should be an acceptable approximation.  The
         // approximation is that the X rms of the three 2D hits is
@@ -585,9 +744,10 @@ bool CP::TCluster3D::MakeHit(CP::THitSelection& writableHits,
         // rms then has the overlap spacing added in to account for lack of
         // perfect overlaps (this is the constant 2mm squared).
         double xyRMS = 0.0;
-        if (hit1) xyRMS += hit1->GetRMS().X()*hit1->GetRMS().X();
-        if (hit2) xyRMS += hit2->GetRMS().X()*hit2->GetRMS().X();
-        if (hit3) xyRMS += hit3->GetRMS().X()*hit3->GetRMS().X();
+        for (int h = 0; h<3; ++h) {
+            if (hits[h] < 0) continue;
+            xyRMS += table.GetRMSX(hits[h])*table.GetRMSX(hits[h]);
+        }
         xyRMS /= 3.0;
         xyRMS += xyRMS + 4*unit::mm*unit::mm;
         xyRMS = std::sqrt(xyRMS);
@@ -601,93 +761,106 @@ bool CP::TCluster3D::MakeHit(CP::THitSelection& writableHits,
                      drift.GetAverageVelocity()*hit->GetTimeUncertainty()));
         
         writableHits.push_back(hit);
-        begin = end; ++end;
     }
 
-    return true;
+    for (std::vector<int>::const_iterator h = input.fUsed.begin();
+         h != input.fUsed.end(); ++h) {
+        used.Insert(*h);
+    }
 }
 
 double
 CP::TCluster3D::FindOverlap(const CP::THandle<CP::THit>& hit,
-                            const CP::THandle<CP::THit>& constituent) const {
-    double total = 0.0;
+                            int constituent) const {
+    const CP::TWireHitTable& table = fWireHits;
+    double hitTime = table.GetDrift().GetTime(*hit);
+    double hitRMS = hit->GetTimeRMS();
+    double startTime = table.GetDriftTime(constituent);
+    startTime += table.GetTimeStart(constituent) - table.GetTime(constituent);
+
+    // The total is cached in the table since the same wire hit is a
+    // constituent of several 3D hits.  The samples more than 2 sigma after
+    // the hit time are not included in the overlap.
+    double total = table.GetSampleTotal(constituent);
     double frac = 0.0;
-    CP::TDriftPosition drift;
-    double hitTime = drift.GetTime(*hit);
-    double startTime = drift.GetTime(*constituent);
-    startTime += constituent->GetTimeStart() - constituent->GetTime();
-    for (int i = 0; i<constituent->GetTimeSamples(); ++i) {
-        total += constituent->GetTimeSample(i);
-        double t = startTime + fDigitStep*i - hitTime;
-        t /= hit->GetTimeRMS();
-        if (t > 2.0) continue;
-        frac += std::exp(-0.5*t*t)*constituent->GetTimeSample(i);
+    if (hitRMS > 0.0) {
+        frac = CP::TGaussianTable::Get().WeightedSum(
+            table.GetSamples(constituent),
+            table.GetSampleCount(constituent),
+            (startTime - hitTime)/hitRMS, fDigitStep/hitRMS, 2.0);
     }
 
     if (total>0.0) return frac/total;
     return 1E-5;
 }
                             
-CP::THandle<CP::TAlgorithmResult>
-CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
-                        const CP::TAlgorithmResult& pmts,
-                        const CP::TAlgorithmResult&) {
-    CaptLog("TCluster3D Process " << GetEvent().GetContext());
-    CP::THandle<CP::THitSelection> wireHits = wires.GetHits();
-    if (!wireHits) {
-        CaptError("No input hits");
-        return CP::THandle<CP::TAlgorithmResult>();
+void CP::TCluster3D::FillPlane(Plane& plane,
+                               const std::vector<int>& rows) const {
+    plane.fHits = rows;
+    fillIntervals(fWireHits, plane.fHits, plane.fBegin, plane.fEnd);
+    buildIndex(plane.fBegin, plane.fEnd, plane.fIndex);
+}
+
+void CP::TCluster3D::FillInteractions(const std::vector<double>& t0s,
+                                      double primaryT0) {
+    std::vector<double> times(t0s);
+    if (times.empty()) times.push_back(primaryT0);
+
+    // The interaction with the biggest flash gets the hits that aren't in
+    // the drift window of any interaction.
+    std::size_t primary = std::find(times.begin(), times.end(), primaryT0)
+        - times.begin();
+    if (primary >= times.size()) primary = 0;
+
+    fInteractions.clear();
+    fInteractions.resize(times.size());
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        fInteractions[i].fT0 = times[i];
     }
 
-#define CHECK_FOR_OVERLAPPED_HITS
-#ifdef  CHECK_FOR_OVERLAPPED_HITS
-    for (CP::THitSelection::iterator h = wireHits->begin();
-         h != wireHits->end(); ++h) {
-        for (CP::THitSelection::iterator i = h+1; i != wireHits->end(); ++i) {
-            // The hits aren't the same channel, so they can't overlap.
-            if ((*i)->GetChannelId() != (*h)->GetChannelId()) continue;
-            // "i" starts after "h" ends, so they can't overlap.
-            if ((*i)->GetTimeStart() >= (*h)->GetTimeStop()) continue;
-            // "i" ends before "h" begins, so they can't overlap.
-            if ((*i)->GetTimeStop() <= (*h)->GetTimeStart()) continue;
-            CaptError("Overlapping hit on " << (*h)->GetChannelId());
-            CaptError("   hit " << (*h)->GetTimeStart()
-                      << " " << (*h)->GetTimeStop());
-            CaptError("   hit " << (*i)->GetTimeStart()
-                      << " " << (*i)->GetTimeStop());
+    double maxDriftTime = fMaxDrift/fWireHits.GetDrift().GetAverageVelocity();
+    for (std::size_t h = 0; h < fWireHits.size(); ++h) {
+        double hitTime = fWireHits.GetDriftTime(h);
+        std::size_t which = primary;
+        for (std::size_t i = times.size(); i > 0; --i) {
+            if (hitTime < times[i-1]) continue;
+            if (times[i-1] + maxDriftTime < hitTime) continue;
+            which = i-1;
+            break;
         }
+        fInteractions[which].fRows.push_back(h);
     }
-#endif
 
-    double t0 = 0.0;
-    CP::THandle<CP::THitSelection>  pmtHits = pmts.GetHits();
-    if (pmtHits) t0 = TimeZero(*pmtHits,*wireHits);
-        
-    CP::THandle<CP::TAlgorithmResult> result = CreateResult();
+    if (fInteractions.size() > 1) {
+        CP::TCaptLog::IncreaseIndentation();
+        for (std::size_t i = 0; i < fInteractions.size(); ++i) {
+            CaptLog("Interaction " << i
+                    << " T0: " << unit::AsString(fInteractions[i].fT0,"time")
+                    << " Wire hits: " << fInteractions[i].fRows.size());
+        }
+        CP::TCaptLog::DecreaseIndentation();
+    }
 
-    typedef std::set< CP::THandle<CP::THit> >  HitSet;
-    HitSet usedSet;
-    
+    for (std::size_t i = 0; i < fInteractions.size(); ++i) {
+        fInteractions[i].fMaxDeltaT = MaxDeltaT(fInteractions[i].fRows);
+    }
+
+    if (!fTimeSlices) return;
+
+    // Split each interaction into time slices.
+    std::vector<Interaction> interactions;
+    interactions.swap(fInteractions);
+    for (std::size_t i = 0; i < interactions.size(); ++i) {
+        SliceInteraction(interactions[i]);
+    }
+    CaptNamedLog("Cluster","Time slices: " << fInteractions.size());
+}
+
+double CP::TCluster3D::MaxDeltaT(const std::vector<int>& rows) const {
     std::vector<float> allRMS;
-    CP::THitSelection xHits;
-    CP::THitSelection vHits;
-    CP::THitSelection uHits;
-    for (CP::THitSelection::iterator h = wireHits->begin(); 
-         h != wireHits->end(); ++h) {
-        int plane = CP::GeomId::Captain::GetWirePlane((*h)->GetGeomId());
-        allRMS.push_back((*h)->GetTimeRMS());
-        if (plane == CP::GeomId::Captain::kXPlane) {
-            xHits.push_back(*h);
-        }
-        else if (plane == CP::GeomId::Captain::kVPlane) {
-            vHits.push_back(*h);
-        }
-        else if (plane == CP::GeomId::Captain::kUPlane) {
-            uHits.push_back(*h);
-        }
-        else {
-            CaptError("Invalid wire plane");
-        }
+    for (std::vector<int>::const_iterator h = rows.begin();
+         h != rows.end(); ++h) {
+        allRMS.push_back(fWireHits.GetTimeRMS(*h));
     }
 
     // Set the maximum time difference between 2D clusters that might become a
@@ -702,97 +875,454 @@ CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
     // problem is that the full, unoptimized, calculation is approximately
     // O(nHits^3), so for large events this is a very slow.
     double deltaRMS = 3.0;
-    std::sort(allRMS.begin(), allRMS.end());
-    maxDeltaT = std::min(maxDeltaT, deltaRMS*allRMS[0.90*allRMS.size()]);
+    if (!allRMS.empty()) {
+        std::sort(allRMS.begin(), allRMS.end());
+        maxDeltaT = std::min(maxDeltaT,
+                             deltaRMS*allRMS[0.90*allRMS.size()]);
+    }
     maxDeltaT = std::max(maxDeltaT,2*unit::microsecond);
+
+    return maxDeltaT;
+}
+
+void CP::TCluster3D::SliceInteraction(const Interaction& interaction) {
+    // Sort the hits by the start of the drift corrected time range.
+    std::vector<int> rows(interaction.fRows);
+    std::sort(rows.begin(), rows.end(), compareHitStarts(fWireHits));
+
+    // Start a new slice when there is a gap bigger than the maximum time
+    // difference between matched hits.  Hits in different slices can't
+    // overlap, so they are never combined into the same 3D hit, and the 3D
+    // hits in different slices never share a wire hit.
+    double gap = std::max(interaction.fMaxDeltaT, 0.0);
+    double sliceEnd = 0.0;
+    std::size_t first = fInteractions.size();
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        double start = fWireHits.GetDriftStart(rows[i]);
+        if (i == 0 || sliceEnd + gap < start) {
+            fInteractions.push_back(Interaction());
+            fInteractions.back().fT0 = interaction.fT0;
+            fInteractions.back().fMaxDeltaT = interaction.fMaxDeltaT;
+            sliceEnd = fWireHits.GetDriftStop(rows[i]);
+        }
+        sliceEnd = std::max(sliceEnd, fWireHits.GetDriftStop(rows[i]));
+        fInteractions.back().fRows.push_back(rows[i]);
+    }
+
+    // Keep the hits in each slice in the input order.
+    for (std::size_t i = first; i < fInteractions.size(); ++i) {
+        std::sort(fInteractions[i].fRows.begin(),
+                  fInteractions[i].fRows.end());
+    }
+}
+
+void CP::TCluster3D::FillInteraction(Interaction& interaction) const {
+    std::vector<int> xHits;
+    std::vector<int> vHits;
+    std::vector<int> uHits;
+    for (std::vector<int>::const_iterator h = interaction.fRows.begin();
+         h != interaction.fRows.end(); ++h) {
+        int plane = fWireHits.GetPlane(*h);
+        if (plane == CP::GeomId::Captain::kXPlane) {
+            xHits.push_back(*h);
+        }
+        else if (plane == CP::GeomId::Captain::kVPlane) {
+            vHits.push_back(*h);
+        }
+        else if (plane == CP::GeomId::Captain::kUPlane) {
+            uHits.push_back(*h);
+        }
+        else {
+            CaptError("Invalid wire plane");
+        }
+    }
     
-    std::sort(xHits.begin(), xHits.end(), compareHitTimes());
-    std::sort(vHits.begin(), vHits.end(), compareHitTimes());
-    std::sort(uHits.begin(), uHits.end(), compareHitTimes());
+    std::sort(xHits.begin(), xHits.end(), compareHitTimes(fWireHits));
+    std::sort(vHits.begin(), vHits.end(), compareHitTimes(fWireHits));
+    std::sort(uHits.begin(), uHits.end(), compareHitTimes(fWireHits));
 
     CP::TCaptLog::IncreaseIndentation();
     CaptLog("X Hits: " << xHits.size()
             << " V Hits: " << vHits.size()
             << " U Hits: " << uHits.size()
-            << "  max(RMS): " << unit::AsString(maxDeltaT,"time"));
+            << "  max(RMS): "
+            << unit::AsString(interaction.fMaxDeltaT,"time"));
     CP::TCaptLog::DecreaseIndentation();
 
-    CP::TDriftPosition drift;
-    CP::THitSelection xvMatch;
-    CP::THitSelection xuMatch;
+    // Build the interval indices of the drift corrected time ranges on each
+    // plane.  The hits in each plane are sorted by time, so the indices
+    // returned by the interval search are in time order.
+    FillPlane(interaction.fXPlane, xHits);
+    FillPlane(interaction.fVPlane, vHits);
+    FillPlane(interaction.fUPlane, uHits);
+
+    if (!fPreCluster) return;
+    ClusterPlane(interaction.fXPlane);
+    ClusterPlane(interaction.fVPlane);
+    ClusterPlane(interaction.fUPlane);
+    MatchClusters(interaction);
+}
+
+void CP::TCluster3D::ClusterPlane(Plane& plane) const {
+    std::size_t n = plane.fHits.size();
+    std::vector<wireInterval> intervals(n);
+    std::vector<int> parent(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        intervals[i].fWire = fWireHits.GetWire(plane.fHits[i]);
+        intervals[i].fStart = plane.fBegin[i];
+        intervals[i].fStop = plane.fEnd[i];
+        intervals[i].fHit = i;
+        parent[i] = i;
+    }
+    std::sort(intervals.begin(), intervals.end());
+
+    // Join the hits that overlap in time on the same wire, and on the next
+    // wire.  The hits on each wire are sorted by the start time, so the
+    // search for overlapping hits stops at the first hit that starts after
+    // the current hit ends.
+    std::size_t first = 0;
+    while (first < n) {
+        int wire = intervals[first].fWire;
+        std::size_t last = first;
+        while (last < n && intervals[last].fWire == wire) ++last;
+        std::size_t nextEnd = last;
+        while (nextEnd < n && intervals[nextEnd].fWire == wire+1) ++nextEnd;
+        for (std::size_t i = first; i < last; ++i) {
+            const wireInterval& hit = intervals[i];
+            for (std::size_t j = i+1; j < last; ++j) {
+                if (hit.fStop < intervals[j].fStart) break;
+                joinSets(parent, hit.fHit, intervals[j].fHit);
+            }
+            for (std::size_t j = last; j < nextEnd; ++j) {
+                if (hit.fStop < intervals[j].fStart) break;
+                if (intervals[j].fStop < hit.fStart) continue;
+                joinSets(parent, hit.fHit, intervals[j].fHit);
+            }
+        }
+        first = last;
+    }
+
+    // Number the clusters in the order of the first hit and find the range
+    // of times and the wires covered by each cluster.
+    std::vector<int> cluster(n, -1);
+    plane.fCluster.assign(n, -1);
+    plane.fClusters.clear();
+    for (std::size_t i = 0; i < n; ++i) {
+        int root = findRoot(parent, i);
+        if (cluster[root] < 0) {
+            cluster[root] = plane.fClusters.size();
+            plane.fClusters.push_back(WireCluster());
+            plane.fClusters.back().fBegin = plane.fBegin[i];
+            plane.fClusters.back().fEnd = plane.fEnd[i];
+        }
+        WireCluster& c = plane.fClusters[cluster[root]];
+        c.fBegin = std::min(c.fBegin, plane.fBegin[i]);
+        c.fEnd = std::max(c.fEnd, plane.fEnd[i]);
+        c.fWires.push_back(fWireHits.GetWire(plane.fHits[i]));
+        plane.fCluster[i] = cluster[root];
+    }
+    for (std::vector<WireCluster>::iterator c = plane.fClusters.begin();
+         c != plane.fClusters.end(); ++c) {
+        std::sort(c->fWires.begin(), c->fWires.end());
+        c->fWires.erase(std::unique(c->fWires.begin(), c->fWires.end()),
+                        c->fWires.end());
+    }
+}
+
+void CP::TCluster3D::MatchClusters(Interaction& interaction) const {
+    const CP::TWireCrossings& crossings = CP::TWireCrossings::Get();
+    const std::vector<WireCluster>& xClusters
+        = interaction.fXPlane.fClusters;
+    const std::vector<WireCluster>& vClusters
+        = interaction.fVPlane.fClusters;
+    const std::vector<WireCluster>& uClusters
+        = interaction.fUPlane.fClusters;
+
+    // Index the V and U clusters by the time range.
+    CP::TIntervalIndex vIndex;
+    for (std::size_t i = 0; i < vClusters.size(); ++i) {
+        vIndex.Add(vClusters[i].fBegin, vClusters[i].fEnd, i);
+    }
+    vIndex.Build();
+    CP::TIntervalIndex uIndex;
+    for (std::size_t i = 0; i < uClusters.size(); ++i) {
+        uIndex.Add(uClusters[i].fBegin, uClusters[i].fEnd, i);
+    }
+    uIndex.Build();
+
+    interaction.fXVClusters.assign(xClusters.size(), std::vector<int>());
+    interaction.fXUClusters.assign(xClusters.size(), std::vector<int>());
+    interaction.fVUClusters.assign(xClusters.size(),
+                                   std::vector< std::pair<int,int> >());
+
+    // For each X and V cluster that overlap in time, find the U wires that
+    // cross the X and V wires at a single point, and then look for a U
+    // cluster that overlaps both clusters in time and has a hit on one of
+    // the wires.  The index returns the clusters in increasing order, so
+    // the (V, U) pairs are found in sorted order.
+    std::size_t matched = 0;
+    std::vector<int> vCandidates;
+    std::vector<int> uCandidates;
+    std::vector<int> uWires;
+    for (std::size_t x = 0; x < xClusters.size(); ++x) {
+        const WireCluster& xc = xClusters[x];
+        vCandidates.clear();
+        vIndex.Find(xc.fBegin, xc.fEnd, vCandidates);
+        if (vCandidates.empty()) continue;
+        uCandidates.clear();
+        uIndex.Find(xc.fBegin, xc.fEnd, uCandidates);
+        if (uCandidates.empty()) continue;
+        std::vector<int>& xvClusters = interaction.fXVClusters[x];
+        std::vector<int>& xuClusters = interaction.fXUClusters[x];
+        std::vector< std::pair<int,int> >& vuClusters
+            = interaction.fVUClusters[x];
+        for (std::vector<int>::iterator v = vCandidates.begin();
+             v != vCandidates.end(); ++v) {
+            const WireCluster& vc = vClusters[*v];
+            uWires.clear();
+            for (std::vector<int>::const_iterator xw = xc.fWires.begin();
+                 xw != xc.fWires.end(); ++xw) {
+                for (std::vector<int>::const_iterator vw = vc.fWires.begin();
+                     vw != vc.fWires.end(); ++vw) {
+                    crossings.CompatibleU(*xw, *vw, uWires);
+                }
+            }
+            if (uWires.empty()) continue;
+            std::sort(uWires.begin(), uWires.end());
+            uWires.erase(std::unique(uWires.begin(), uWires.end()),
+                         uWires.end());
+            for (std::vector<int>::iterator u = uCandidates.begin();
+                 u != uCandidates.end(); ++u) {
+                const WireCluster& uc = uClusters[*u];
+                if (uc.fEnd < vc.fBegin) continue;
+                if (vc.fEnd < uc.fBegin) continue;
+                if (!shareElement(uWires, uc.fWires)) continue;
+                vuClusters.push_back(std::make_pair(*v, *u));
+                xuClusters.push_back(*u);
+                if (xvClusters.empty() || xvClusters.back() != *v) {
+                    xvClusters.push_back(*v);
+                }
+            }
+        }
+        std::sort(xuClusters.begin(), xuClusters.end());
+        xuClusters.erase(std::unique(xuClusters.begin(), xuClusters.end()),
+                         xuClusters.end());
+        matched += vuClusters.size();
+    }
+
+    CP::TCaptLog::IncreaseIndentation();
+    CaptLog("X Clusters: " << xClusters.size()
+            << " V Clusters: " << vClusters.size()
+            << " U Clusters: " << uClusters.size()
+            << " Matched: " << matched);
+    CP::TCaptLog::DecreaseIndentation();
+}
+
+void CP::TCluster3D::FindTwoWireHits(Worker& worker,
+                                     const Interaction& interaction,
+                                     const CP::TDenseHitSet& used,
+                                     HitList& output) const {
+    std::vector<int> xHits2;
+    std::vector<int> vHits2;
+    std::vector<int> uHits2;
+    for (std::vector<int>::const_iterator h = interaction.fRows.begin();
+         h != interaction.fRows.end(); ++h) {
+        if (used.Contains(*h)) continue;
+        int plane = fWireHits.GetPlane(*h);
+        if (plane == CP::GeomId::Captain::kXPlane) {
+            xHits2.push_back(*h);
+        }
+        else if (plane == CP::GeomId::Captain::kVPlane) {
+            vHits2.push_back(*h);
+        }
+        else if (plane == CP::GeomId::Captain::kUPlane) {
+            uHits2.push_back(*h);
+        }
+        else {
+            CaptError("Invalid wire plane");
+        }
+    }
+    CaptLog("X Hits2: " << xHits2.size()
+            << " V Hits2: " << vHits2.size()
+            << " U Hits2: " << uHits2.size());
     
-    CP::THitSelection writableHits;
-    for (CP::THitSelection::iterator xh=xHits.begin();
-         xh!=xHits.end(); ++xh) {
+    // Index the unused V and U hits by the drift corrected time range so
+    // that each X hit is only compared to the hits that overlap it in time.
+    // The index returns positions in the hit vectors in increasing order, so
+    // the hits are considered in the same order as a full loop.  The wire
+    // pairs are then checked against the crossing table so that hits are
+    // only combined when the wires cross inside the length of both wires.
+    Plane xPlane2;
+    Plane vPlane2;
+    Plane uPlane2;
+    FillPlane(xPlane2, xHits2);
+    FillPlane(vPlane2, vHits2);
+    FillPlane(uPlane2, uHits2);
+    const CP::TWireCrossings& crossings = CP::TWireCrossings::Get();
+    std::vector<int> candidates;
+    for (std::size_t xi = 0; xi < xHits2.size(); ++xi) {
+        int xh = xHits2[xi];
+        int xWire = fWireHits.GetWire(xh);
+
+        candidates.clear();
+        vPlane2.fIndex.Find(xPlane2.fBegin[xi], xPlane2.fEnd[xi], candidates);
+        for (std::vector<int>::iterator v = candidates.begin();
+             v != candidates.end(); ++v) {
+            int vh = vHits2[*v];
+            int vWire = fWireHits.GetWire(vh);
+            if (!crossings.CrossesXV(xWire,vWire)) continue;
+            if (!MakeHit(worker,output,
+                         crossings.CrossingXV(xWire,vWire),
+                         xh,vh,-1)) continue;
+            output.fUsed.push_back(xh);
+            output.fUsed.push_back(vh);
+        }
+
+        candidates.clear();
+        uPlane2.fIndex.Find(xPlane2.fBegin[xi], xPlane2.fEnd[xi], candidates);
+        for (std::vector<int>::iterator u = candidates.begin();
+             u != candidates.end(); ++u) {
+            int uh = uHits2[*u];
+            int uWire = fWireHits.GetWire(uh);
+            if (!crossings.CrossesXU(xWire,uWire)) continue;
+            if (!MakeHit(worker,output,
+                         crossings.CrossingXU(xWire,uWire),
+                         xh,uh,-1)) continue;
+            output.fUsed.push_back(xh);
+            output.fUsed.push_back(uh);
+        }
+    }
+}
+
+void CP::TCluster3D::FindTriplets(Worker& worker,
+                                  const Interaction& interaction,
+                                  HitList& output,
+                                  std::size_t begin, std::size_t end) const {
+    const CP::TWireHitTable& table = fWireHits;
+    const CP::TWireCrossings& crossings = CP::TWireCrossings::Get();
+    const Plane& xPlane = interaction.fXPlane;
+    const Plane& vPlane = interaction.fVPlane;
+    const Plane& uPlane = interaction.fUPlane;
+    const std::vector<int>& xHits = xPlane.fHits;
+    const std::vector<int>& vHits = vPlane.fHits;
+    const std::vector<int>& uHits = uPlane.fHits;
+    const std::vector<double>& vBegin = vPlane.fBegin;
+    const std::vector<double>& vEnd = vPlane.fEnd;
+    const std::vector<double>& uBegin = uPlane.fBegin;
+    const std::vector<double>& uEnd = uPlane.fEnd;
+    const double maxDeltaT = interaction.fMaxDeltaT;
+
+    std::vector<int>& vCandidates = worker.fVCandidates;
+    std::vector<int>& uCandidates = worker.fUCandidates;
+    std::vector<int>& xvIndex = worker.fXVIndex;
+    std::vector<int>& xvMatch = worker.fXVMatch;
+    std::vector<int>& xuMatch = worker.fXUMatch;
+
+    for (std::size_t xi = begin; xi < end; ++xi) {
+        int xh = xHits[xi];
         int hitsForThisXHit = 0;
+        double xTime = table.GetTime(xh);
+
+        // When the hits are pre-clustered, only the V and U hits in the
+        // clusters matched to the cluster of the X hit are combined with
+        // it.
+        const std::vector<int>* xvClusters = NULL;
+        const std::vector<int>* xuClusters = NULL;
+        const std::vector< std::pair<int,int> >* vuClusters = NULL;
+        if (fPreCluster) {
+            int xCluster = xPlane.fCluster[xi];
+            xvClusters = &interaction.fXVClusters[xCluster];
+            xuClusters = &interaction.fXUClusters[xCluster];
+            vuClusters = &interaction.fVUClusters[xCluster];
+        }
 
+        // Find the V hits that overlap the X hit in time.  The time window
+        // around the X hit is still applied so that long hits don't get
+        // matched to hits that are far away.
         xvMatch.clear();
-#ifdef LOOK_AT_ALL_HITS
-        CP::THitSelection::iterator xvBegin = vHits.begin();
-        CP::THitSelection::iterator xvEnd = vHits.end();
-#else
-        CP::THitSelection::iterator xvBegin
-            = std::lower_bound(vHits.begin(), vHits.end(),
-                               (*xh)->GetTime()-maxDeltaT,
-                               hitTimeLowerBound());
-        CP::THitSelection::iterator xvEnd
-            = std::upper_bound(xvBegin, vHits.end(),
-                               (*xh)->GetTime()+maxDeltaT,
-                               hitTimeUpperBound());
+        xvIndex.clear();
+        vCandidates.clear();
+        vPlane.fIndex.Find(xPlane.fBegin[xi], xPlane.fEnd[xi], vCandidates);
+        for (std::vector<int>::iterator v = vCandidates.begin();
+             v != vCandidates.end(); ++v) {
+#ifndef LOOK_AT_ALL_HITS
+            double vTime = table.GetTime(vHits[*v]);
+            if (vTime < xTime-maxDeltaT || xTime+maxDeltaT < vTime) continue;
 #endif
-        for (CP::THitSelection::iterator vh=xvBegin;
-             vh!=xvEnd; ++vh) {
-            // Check that the X and V wires overlap in time.
-            if (!OverlappingHits(*xh, *vh)) continue;
-            xvMatch.push_back(*vh);
+            xvMatch.push_back(vHits[*v]);
+            if (xvClusters
+                && !std::binary_search(xvClusters->begin(),
+                                       xvClusters->end(),
+                                       vPlane.fCluster[*v])) continue;
+            xvIndex.push_back(*v);
         }
         
+        // Find the U hits that overlap the X hit in time.  Define
+        // LOOK_AT_ALL_HITS to check if any X and U hit (and X and V) hits
+        // overlap.  If this isn't set, then only U (V) hits within a time
+        // window of the X hit are checked for matchs.
         xuMatch.clear();
-#ifdef LOOK_AT_ALL_HITS
-        // Define LOOK_AT_ALL_HITS to check if any X and U hit (and later X
-        // and V) hits overlap.  If this isn't set, then only U (V) hits
-        // within a time window of the X hit are checked for matchs.
-        CP::THitSelection::iterator xuBegin = uHits.begin();
-        CP::THitSelection::iterator xuEnd = uHits.end();
-#else
-        CP::THitSelection::iterator xuBegin
-            = std::lower_bound(uHits.begin(), uHits.end(),
-                               (*xh)->GetTime()-maxDeltaT,
-                               hitTimeLowerBound());
-        CP::THitSelection::iterator xuEnd
-            = std::upper_bound(xuBegin, uHits.end(),
-                               (*xh)->GetTime()+maxDeltaT,
-                               hitTimeUpperBound());
+        uCandidates.clear();
+        uPlane.fIndex.Find(xPlane.fBegin[xi], xPlane.fEnd[xi], uCandidates);
+        for (std::vector<int>::iterator u = uCandidates.begin();
+             u != uCandidates.end(); ++u) {
+#ifndef LOOK_AT_ALL_HITS
+            double uTime = table.GetTime(uHits[*u]);
+            if (uTime < xTime-maxDeltaT || xTime+maxDeltaT < uTime) continue;
 #endif
-        for (CP::THitSelection::iterator uh=xuBegin;
-             uh!=xuEnd; ++uh) {
-            // Check that the X and U wires overlap in time.
-            if (!OverlappingHits(*xh, *uh)) continue;
-            xuMatch.push_back(*uh);
+            int uh = uHits[*u];
+            xuMatch.push_back(uh);
+            if (xuClusters
+                && !std::binary_search(xuClusters->begin(),
+                                       xuClusters->end(),
+                                       uPlane.fCluster[*u])) continue;
             
-            for (CP::THitSelection::iterator vh=xvMatch.begin();
-                 vh != xvMatch.end(); ++vh) {
-                // Check that the U and V wires overlap in time.
-                if (!OverlappingHits(*uh, *vh)) continue;
+            for (std::size_t m = 0; m < xvIndex.size(); ++m) {
+                int v = xvIndex[m];
+
+                // Only combine hits from a matched cluster triplet.
+                if (vuClusters
+                    && !std::binary_search(
+                        vuClusters->begin(), vuClusters->end(),
+                        std::make_pair(vPlane.fCluster[v],
+                                       uPlane.fCluster[*u]))) continue;
+
+                // Check that the wires all cross at one "point" using the
+                // precalculated crossing table.  This is done before looking
+                // at the hit times since it's a cheap table lookup.  Two
+                // millimeters is a "magic number chosen based on the
+                // geometry for a 3mm separation between the wires.  It needs
+                // to change if the wire spacing changes.
+                int vh = vHits[v];
+                if (!crossings.Compatible(table.GetWire(xh),
+                                          table.GetWire(vh),
+                                          table.GetWire(uh))) {
+                    continue;
+                }
+
+                // Check that the U and V wires overlap in time.  Since the X
+                // hit overlaps both, all three time ranges share a common
+                // interval.
+                if (uEnd[*u] < vBegin[v]) continue;
+                if (vEnd[v] < uBegin[*u]) continue;
             
-                // Find the points at which the wires cross and check that the
-                // wires all cross and one "point".  Two millimeters is a
-                // "magic number chosen based on the geometry for a 3mm
-                // separation between the wires.  It needs to change if the
-                // wire spacing changes.
+                // Find the position of the crossing point.  This is the same
+                // as OverlapXY.
                 TVector3 hitPosition;
-                if (!OverlapXY(*xh,*vh,*uh,hitPosition)) continue;
+                if (!crossings.Overlap(table.GetWire(xh),
+                                       table.GetWire(vh),
+                                       table.GetWire(uh),
+                                       hitPosition)) continue;
             
                 // Create new writables hits from the overlapping hits.  If
                 // the 2D wire hits overlap for a long time (several
                 // microseconds), this create several new 3D hits.
-                if (!MakeHit(writableHits,hitPosition,t0,*xh,*vh,*uh)) continue;
+                if (!MakeHit(worker,output,hitPosition,xh,vh,uh)) continue;
                 ++hitsForThisXHit;
 
-                usedSet.insert(*xh);
-                usedSet.insert(*vh);
-                usedSet.insert(*uh);
-                
+                output.fUsed.push_back(xh);
+                output.fUsed.push_back(vh);
+                output.fUsed.push_back(uh);
             }
         }
         
@@ -805,137 +1335,214 @@ CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
         /// an oblique angle.
         if (hitsForThisXHit>0) continue;
         
-        CP::THandle<CP::THit> bestPartner;
+        int bestPartner = -1;
         double partnerCharge = 0.0;
-        for (CP::THitSelection::iterator ph = xuMatch.begin();
+        for (std::vector<int>::iterator ph = xuMatch.begin();
              ph != xuMatch.end(); ++ph) {
-            if (!bestPartner) {
+            if (bestPartner < 0) {
                 bestPartner = *ph;
-                partnerCharge = ChargeOverlap(*xh,*ph);
+                partnerCharge = ChargeOverlap(worker,xh,*ph);
                 continue;
             }
-            double charge = ChargeOverlap(*xh,*ph);
+            double charge = ChargeOverlap(worker,xh,*ph);
             if (partnerCharge > charge) continue;
             partnerCharge = charge;
             bestPartner = *ph;
         }
         
-        for (CP::THitSelection::iterator ph = xvMatch.begin();
+        for (std::vector<int>::iterator ph = xvMatch.begin();
              ph != xvMatch.end(); ++ph) {
-            if (!bestPartner) {
+            if (bestPartner < 0) {
                 bestPartner = *ph;
-                partnerCharge = ChargeOverlap(*xh,*ph);
+                partnerCharge = ChargeOverlap(worker,xh,*ph);
                 continue;
             }
-            double charge = ChargeOverlap(*xh,*ph);
+            double charge = ChargeOverlap(worker,xh,*ph);
             if (partnerCharge > charge) continue;
             partnerCharge = charge;
             bestPartner = *ph;
         }
         
         // No partner was found.
-        if (!bestPartner) continue;
+        if (bestPartner < 0) continue;
         
         // See if it's a reasonable hit.
-        if (!MakeHit(writableHits,PositionXY(*xh,bestPartner),
-                     t0,*xh,bestPartner,CP::THandle<CP::THit>())) continue;
+        if (!MakeHit(worker,output,
+                     PositionXY(table.GetHit(xh),table.GetHit(bestPartner)),
+                     xh,bestPartner,-1)) continue;
 
         // Now check if it can be added to the bookkeeping objects.
-        usedSet.insert(*xh);
-        usedSet.insert(bestPartner);
+        output.fUsed.push_back(xh);
+        output.fUsed.push_back(bestPartner);
 #endif
     }
+}
 
-    // All of the 3 wire 3D hits have been found, now check any unassociated
-    // hits to see if there are any 2 wire 3D hits that should be formed.
-    CP::THitSelection xHits2;
-    CP::THitSelection vHits2;
-    CP::THitSelection uHits2;
-    for (CP::THitSelection::iterator h = wireHits->begin(); 
-         h != wireHits->end(); ++h) {
-        if (usedSet.find(*h) != usedSet.end()) continue;
-        int plane = CP::GeomId::Captain::GetWirePlane((*h)->GetGeomId());
-        if (plane == CP::GeomId::Captain::kXPlane) {
-            xHits2.push_back(*h);
-        }
-        else if (plane == CP::GeomId::Captain::kVPlane) {
-            vHits2.push_back(*h);
-        }
-        else if (plane == CP::GeomId::Captain::kUPlane) {
-            uHits2.push_back(*h);
-        }
-        else {
-            CaptError("Invalid wire plane");
+void CP::TCluster3D::FindTripletsParallel(
+    const std::vector<Chunk>& chunks,
+    std::vector<HitList>& outputs) const {
+    outputs.clear();
+    outputs.resize(chunks.size());
+    std::size_t threads = std::min((std::size_t) fThreads, chunks.size());
+    if (threads < 1) return;
+
+    std::atomic<std::size_t> next(0);
+    std::vector<Worker> workers(threads);
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers[i].fLog = false;
+        workers[i].fAlgorithm = this;
+        workers[i].fChunks = &chunks;
+        workers[i].fOutputs = &outputs;
+        workers[i].fNext = &next;
+        pool.push_back(std::thread(std::ref(workers[i])));
+    }
+    for (std::size_t i = 0; i < pool.size(); ++i) pool[i].join();
+}
+
+void CP::TCluster3D::BuildHits(Worker& worker,
+                               std::size_t first, std::size_t last,
+                               CP::TDenseHitSet& used,
+                               CP::THitSelection& writableHits) {
+    for (std::size_t i = first; i < last; ++i) {
+        FillInteraction(fInteractions[i]);
+    }
+
+    // Find the three wire hits.  Each X hit is independent, so the X hits
+    // for all of the interactions are split into chunks that can be done in
+    // parallel.  There are several chunks per thread so the work is
+    // balanced when the hit density isn't uniform.  When running in a single
+    // thread, each interaction is a single chunk.
+    std::size_t xHitCount = 0;
+    for (std::size_t i = first; i < last; ++i) {
+        xHitCount += fInteractions[i].fXPlane.fHits.size();
+    }
+    std::size_t chunkSize = std::max((std::size_t) 1, xHitCount);
+    if (fThreads > 1) {
+        std::size_t chunkCount
+            = std::min(xHitCount, (std::size_t) 8*fThreads);
+        if (chunkCount > 0) {
+            chunkSize = (xHitCount + chunkCount - 1)/chunkCount;
         }
     }
-    CaptLog("X Hits2: " << xHits2.size()
-            << " V Hits2: " << vHits2.size()
-            << " U Hits2: " << uHits2.size());
-    
-    for (CP::THitSelection::iterator h1=xHits2.begin();
-         h1!=xHits2.end(); ++h1) {
-        for (CP::THitSelection::iterator h2=vHits2.begin();
-             h2!=vHits2.end(); ++h2) {
-            if (!OverlappingHits(*h1,*h2)) continue;
-            if (!MakeHit(writableHits,PositionXY(*h1,*h2),
-                         t0,*h1,*h2,CP::THandle<CP::THit>())) continue;
-            usedSet.insert(*h1);
-            usedSet.insert(*h2);
+    std::vector<Chunk> chunks;
+    for (std::size_t i = first; i < last; ++i) {
+        std::size_t hits = fInteractions[i].fXPlane.fHits.size();
+        for (std::size_t begin = 0; begin < hits; begin += chunkSize) {
+            Chunk chunk;
+            chunk.fInteraction = i;
+            chunk.fBegin = begin;
+            chunk.fEnd = std::min(hits, begin + chunkSize);
+            chunks.push_back(chunk);
         }
+    }
 
-        for (CP::THitSelection::iterator h2=uHits2.begin();
-             h2!=uHits2.end(); ++h2) {
-            if (!OverlappingHits(*h1,*h2)) continue;
-            if (!MakeHit(writableHits,PositionXY(*h1,*h2),
-                         t0,*h1,*h2,CP::THandle<CP::THit>())) continue;
-            usedSet.insert(*h1);
-            usedSet.insert(*h2);
+    std::vector<HitList> tripletHits;
+    if (fThreads > 1) {
+        FindTripletsParallel(chunks, tripletHits);
+    }
+    else {
+        tripletHits.resize(chunks.size());
+        for (std::size_t c = 0; c < chunks.size(); ++c) {
+            FindTriplets(worker, fInteractions[chunks[c].fInteraction],
+                         tripletHits[c], chunks[c].fBegin, chunks[c].fEnd);
         }
     }
 
+    for (std::size_t c = 0; c < chunks.size(); ++c) {
+        EmitHits(tripletHits[c], fInteractions[chunks[c].fInteraction].fT0,
+                 writableHits, used);
+    }
+    tripletHits.clear();
+
+    // All of the 3 wire 3D hits have been found, now check any unassociated
+    // hits to see if there are any 2 wire 3D hits that should be formed.
+    for (std::size_t i = first; i < last; ++i) {
+        HitList twoWireHits;
+        FindTwoWireHits(worker, fInteractions[i], used, twoWireHits);
+        EmitHits(twoWireHits, fInteractions[i].fT0, writableHits, used);
+    }
+
     CaptNamedLog("Cluster","Number of 3D Hits: " << writableHits.size());
+}
 
+int CP::TCluster3D::ShareCharge(CP::THitSelection& writableHits,
+                                 const CP::TChargeWeights& previous,
+                                 CP::TChargeWeights& solved) const {
 #ifdef REMOVE_OUTLIERS
     CP::TRemoveOutliers outliers;
     outliers.Apply(writableHits);
 #endif
 
+    int chargeIterations = 0;
 #define SHARE_CLUSTERED_CHARGE
 #ifdef SHARE_CLUSTERED_CHARGE
     // Share the charge among the 3D hits so that the total charge in the
-    // event is not overcounted.
-    CP::TDistributeCharge share;
-
-    // Fill the charge sharing object.
+    // event is not overcounted.  The charge sharing can be done in single
+    // precision by defining SINGLE_PRECISION_CHARGE.  The charges agree with
+    // the double precision result to well within the tolerance.
+#ifdef SINGLE_PRECISION_CHARGE
+    typedef CP::TFloatDistributeCharge Share;
+#else
+    typedef CP::TDistributeCharge Share;
+#endif
+    Share share;
+    share.SetThreads(fThreads);
+    share.SetRelaxation(fChargeRelaxation);
+    share.SetMethod(fChargeMethod);
+
+    // Fill the charge sharing object.  The links start with the previous
+    // weights when they are known.  If there are previous weights, a 3D hit
+    // that isn't found was almost always removed because the charge sharing
+    // took away all of its charge, so it starts with a small weight.
+    std::vector<double> weights;
+    double missingWeight = previous.empty() ? 1.0 : 0.0;
+    int seeded = 0;
     for (CP::THitSelection::iterator h = writableHits.begin();
          h != writableHits.end(); ++h) {
-        CP::DistributeCharge::TMeasurementGroup& group = share.AddGroup(*h);
+        Share::TMeasurementGroup& group = share.AddGroup(*h);
         CP::THandle<CP::TWritableReconHit> groupHit = *h;
-        for (int i=0; i<groupHit->GetConstituentCount(); ++i) {
+        int constituents = groupHit->GetConstituentCount();
+        if (!previous.empty() && previous.GetWeights(*groupHit, weights)
+            && (int) weights.size() == constituents) ++seeded;
+        else weights.assign(constituents, missingWeight);
+        for (int i=0; i<constituents; ++i) {
             CP::THandle<CP::THit> hit = groupHit->GetConstituent(i); 
-            double physicsWeight = FindOverlap(groupHit,hit);
-            group.AddMeasurement(hit, hit->GetCharge(), physicsWeight);
+            int row = fWireHits.Find(hit);
+            double physicsWeight = FindOverlap(groupHit,row);
+            group.AddMeasurement(hit, fWireHits.GetCharge(row),
+                                 physicsWeight, weights[i]);
         }
     }
+    if (!previous.empty()) {
+        CaptNamedLog("Cluster","Start charge sharing with previous weights"
+                     << " for " << seeded << " of " << writableHits.size()
+                     << " hits");
+    }
 
     int iterations = 15 + 100000/(writableHits.size()+1);
     iterations = std::min(iterations,5000);
     CaptNamedLog("Cluster","Distribute charge with " <<
                  iterations <<" iterations");
     share.Solve(0.01,iterations);
+    chargeIterations = share.GetTotalIterations();
+    CaptNamedLog("Cluster","Charge shared in " << share.GetComponents()
+                 << " components with " << share.GetIterations()
+                 << " iterations (" << share.GetTotalIterations()
+                 << " total, " << share.GetUnconverged() << " unconverged)"
+                 << "  change: " << share.GetChange()
+                 << "  time: " << share.GetSolveTime() << " s");
 
     // Loops over the measurement groups, and update the charges of the 3D
     // hits.  Since the 3D hit handles reference the hits in the writableHits
     // THitSelection, this also updates the hits that will be copied into the
     // output.
-    for (CP::TDistributeCharge::Groups::const_iterator g
-             = share.GetGroups().begin();
+    for (Share::Groups::const_iterator g = share.GetGroups().begin();
          g != share.GetGroups().end(); ++g) {
         CP::THandle<CP::TWritableReconHit> groupHit = g->GetObject();
         double totalCharge = g->GetGroupCharge();
         double totalSigma = 0.0;
-        for(CP::DistributeCharge::TLinks::const_iterator c
-                = g->GetLinks().begin();
+        for(Share::TLinks::const_iterator c = g->GetLinks().begin();
             c != g->GetLinks().end(); ++c) {
             CP::THandle<CP::THit> hit = (*c)->GetMeasurement()->GetObject();
             // Notice that the sigma is not reduced by the weight.  This is an
@@ -947,9 +1554,84 @@ CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
         totalSigma = std::sqrt(1.0/totalSigma);
         groupHit->SetCharge(totalCharge);
         groupHit->SetChargeUncertainty(totalSigma);
+        if (!fSaveChargeWeights) continue;
+        weights.clear();
+        for(Share::TLinks::const_iterator c = g->GetLinks().begin();
+            c != g->GetLinks().end(); ++c) {
+            weights.push_back((*c)->GetWeight());
+        }
+        solved.Add(*groupHit, weights);
     }
 #endif
 
+    return chargeIterations;
+}
+
+CP::THandle<CP::TAlgorithmResult>
+CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
+                        const CP::TAlgorithmResult& pmts,
+                        const CP::TAlgorithmResult& previousResult) {
+    CaptLog("TCluster3D Process " << GetEvent().GetContext());
+    CP::THandle<CP::THitSelection> wireHits = wires.GetHits();
+    if (!wireHits) {
+        CaptError("No input hits");
+        return CP::THandle<CP::TAlgorithmResult>();
+    }
+
+    // Check that there aren't any hits on the same channel that overlap in
+    // time.  These shouldn't be produced by the hit finding.
+    if (fOverlapCheck != kOverlapCheckOff) {
+        int overlaps = CheckOverlappingHits(*wireHits);
+        if (overlaps > 0) {
+            CaptError("Overlapping wire hits: " << overlaps << " pairs in "
+                      << wireHits->size() << " hits");
+        }
+    }
+
+    CP::THandle<CP::TAlgorithmResult> result = CreateResult();
+
+    // Copy the hit properties into a table so that the hot loops don't need
+    // to go through the hit handles.  The rest of the algorithm refers to
+    // the hits by their row in the table.
+    fWireHits.Fill(*wireHits);
+
+    // Find the time zero for each interaction (PMT flash) in the event, and
+    // split the wire hits between the interactions.  Each interaction is
+    // clustered separately.
+    double t0 = 0.0;
+    std::vector<double> t0s;
+    CP::THandle<CP::THitSelection>  pmtHits = pmts.GetHits();
+    if (pmtHits) {
+        t0 = TimeZero(*pmtHits,*wireHits);
+        TimeZeros(*pmtHits,t0s);
+    }
+    FillInteractions(t0s, t0);
+
+    // The wire hits that have been used in a 3D hit (as rows in fWireHits).
+    CP::TDenseHitSet usedSet(fWireHits.size());
+
+    // Build the wire crossing table from the geometry before any threads
+    // are started.  The table is read only, and is only built for the first
+    // event.
+    CP::TWireCrossings::Get();
+
+    // The workspace for the calculations done in this thread.
+    Worker worker;
+
+    // Get the charge sharing weights from a previous result for this event.
+    // The solved weights are saved if they will be added to the output.
+    CP::TChargeWeights previous;
+    CP::TChargeWeights solved;
+    fChargeIterations = 0;
+    CP::THandle<CP::THitSelection> previousHits
+        = previousResult.GetHits("clustered");
+    CP::THandle<CP::TRealDatum> previousWeights
+        = previousResult.Get<CP::TRealDatum>("chargeWeights");
+    if (previousHits && previousWeights
+        && !previous.Add(*previousHits, previousWeights->GetVector())) {
+        CaptError("Previous charge weights don't match the clustered hits");
+    }
+
     std::unique_ptr<CP::THitSelection> clustered(new CP::THitSelection(
                                                      "clustered"));
     std::unique_ptr<CP::THitSelection> twoWire(new CP::THitSelection(
@@ -957,40 +1639,71 @@ CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
     std::unique_ptr<CP::THitSelection> threeWire(new CP::THitSelection(
                                                      "threeWire"));
     
-    // Copy the selection of writable hits into a selection of recon hits.
-    for (CP::THitSelection::iterator h = writableHits.begin();
-         h != writableHits.end(); ++h) {
-        CP::THandle<CP::TWritableReconHit> hit = *h;
-        // Don't include hits that have had all their charge taken away by the
-        // charge sharing.  The  10 electron cut corresponds to a hit energy of
-        // about 340 eV.
-        if (hit->GetCharge() < 10.0) continue;
-        CP::THandle<CP::TReconHit> newHit(new CP::TReconHit(*hit));
-        clustered->push_back(newHit);
-        if (hit->GetConstituentCount() < 3) twoWire->push_back(newHit);
-        else threeWire->push_back(newHit);
+    // Build the 3D hits, share the charge between them and copy them to the
+    // output.  Normally all of the interactions are done together, but when
+    // the event is split into time slices each slice is done separately and
+    // the memory used by the slice is released as soon as it's finished.
+    // The wire hit table, the used hit set and the output selections are
+    // for the whole event, so they aren't released.
+    std::size_t step = fInteractions.size();
+    if (fTimeSlices) step = 1;
+    for (std::size_t first = 0; first < fInteractions.size(); first += step) {
+        std::size_t last = std::min(fInteractions.size(), first + step);
+        CP::THitSelection writableHits;
+        BuildHits(worker, first, last, usedSet, writableHits);
+        fChargeIterations += ShareCharge(writableHits, previous, solved);
+
+        // Copy the writable hits into a selection of recon hits.
+        for (CP::THitSelection::iterator h = writableHits.begin();
+             h != writableHits.end(); ++h) {
+            CP::THandle<CP::TWritableReconHit> hit = *h;
+            // Don't include hits that have had all their charge taken away
+            // by the charge sharing.  The 10 electron cut corresponds to a
+            // hit energy of about 340 eV.
+            if (hit->GetCharge() < 10.0) continue;
+            CP::THandle<CP::TReconHit> newHit(new CP::TReconHit(*hit));
+            clustered->push_back(newHit);
+            if (hit->GetConstituentCount() < 3) twoWire->push_back(newHit);
+            else threeWire->push_back(newHit);
+        }
+
+        if (!fTimeSlices) continue;
+        for (std::size_t i = first; i < last; ++i) {
+            Interaction empty;
+            std::swap(fInteractions[i], empty);
+        }
+    }
+
+    std::vector<int> xHits;
+    std::vector<int> vHits;
+    std::vector<int> uHits;
+    for (std::size_t h = 0; h < fWireHits.size(); ++h) {
+        int plane = fWireHits.GetPlane(h);
+        if (plane == CP::GeomId::Captain::kXPlane) xHits.push_back(h);
+        else if (plane == CP::GeomId::Captain::kVPlane) vHits.push_back(h);
+        else if (plane == CP::GeomId::Captain::kUPlane) uHits.push_back(h);
     }
 
     CaptNamedInfo("Cluster","Mean X Hit Charge " 
-            << unit::AsString(hitMean(xHits.begin(), xHits.end()),
-                              hitRMS(xHits.begin(), xHits.end()),
+            << unit::AsString(hitMean(fWireHits, xHits),
+                              hitRMS(fWireHits, xHits),
                               "pe"));
     CaptNamedInfo("Cluster","Total X Hit Charge " 
-            << unit::AsString(hitTotal(xHits.begin(), xHits.end()),
+            << unit::AsString(hitTotal(fWireHits, xHits),
                               "pe"));
     CaptNamedInfo("Cluster","Mean V Hit Charge " 
-            << unit::AsString(hitMean(vHits.begin(), vHits.end()),
-                              hitRMS(vHits.begin(), vHits.end()),
+            << unit::AsString(hitMean(fWireHits, vHits),
+                              hitRMS(fWireHits, vHits),
                               "pe"));
     CaptNamedInfo("Cluster","Total V Hit Charge " 
-            << unit::AsString(hitTotal(vHits.begin(), vHits.end()),
+            << unit::AsString(hitTotal(fWireHits, vHits),
                               "pe"));
     CaptNamedInfo("Cluster","Mean U Hit Charge "
-            << unit::AsString(hitMean(uHits.begin(), uHits.end()),
-                              hitRMS(uHits.begin(), uHits.end()),
+            << unit::AsString(hitMean(fWireHits, uHits),
+                              hitRMS(fWireHits, uHits),
                               "pe"));
     CaptNamedInfo("Cluster","Total U Hit Charge " 
-            << unit::AsString(hitTotal(uHits.begin(), uHits.end()),
+            << unit::AsString(hitTotal(fWireHits, uHits),
                               "pe"));
 
     std::unique_ptr<CP::TReconObjectContainer> final(
@@ -1010,18 +1723,13 @@ CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
         = CreateCluster("threeWire", threeWire->begin(), threeWire->end());
     clusters->push_back(threeWireCluster);
         
-    /// Save the used 2D wire hits for output.
+    /// Save the used and unused 2D wire hits for output.  The rows in
+    /// fWireHits are in the same order as the input hits.
     std::unique_ptr<CP::THitSelection> used(new CP::THitSelection("used"));
-    for (HitSet::iterator h = usedSet.begin(); h != usedSet.end(); ++h) {
-        used->push_back(*h);
-    }
-
-    /// Save the unused 2D wire hits for output.
     std::unique_ptr<CP::THitSelection> unused(new CP::THitSelection("unused"));
-    for (CP::THitSelection::iterator h = wireHits->begin(); 
-         h != wireHits->end(); ++h) {
-        if (usedSet.find(*h) != usedSet.end()) continue;
-        unused->push_back(*h);
+    for (std::size_t h = 0; h < fWireHits.size(); ++h) {
+        if (usedSet.Contains(h)) used->push_back(fWireHits.GetHit(h));
+        else unused->push_back(fWireHits.GetHit(h));
     }
 
     CaptLog("Total hit charge: " 
@@ -1035,6 +1743,14 @@ CP::TCluster3D::Process(const CP::TAlgorithmResult& wires,
     CaptLog("  Used hits: " << used->size()
             << "  Unused hits: " << unused->size());
     
+    // Save the charge sharing weights for the clustered hits.
+    if (fSaveChargeWeights) {
+        std::unique_ptr<CP::TRealDatum> chargeWeights(
+            new CP::TRealDatum("chargeWeights"));
+        solved.Fill(*clustered, chargeWeights->GetVector());
+        result->AddDatum(chargeWeights.release());
+    }
+
     if (unused->size() > 0) result->AddHits(unused.release());
     if (used->size() > 0) result->AddHits(used.release());
     result->AddHits(clustered.release());
@@ -1,8 +1,19 @@
 #ifndef TCluster3D_hxx_seen
 #define TCluster3D_hxx_seen
+#include "TWireHitTable.hxx"
+#include "TWaveformOverlap.hxx"
+#include "TIntervalIndex.hxx"
+#include "TDenseHitSet.hxx"
+#include "TDistributeCharge.hxx"
+#include "TChargeWeights.hxx"
+
 #include <TAlgorithm.hxx>
 #include <TAlgorithmResult.hxx>
 
+#include <vector>
+#include <utility>
+#include <algorithm>
+
 namespace CP {
     class TCluster3D;
 };
@@ -35,12 +46,42 @@ public:
     ///                  this algorithm.  This is the last THitSelection
     ///                  added.
     ///
-    /// The second and third parameters are ignored by this algorithm.
+    ///   * chargeWeights -- A TRealDatum with the charge sharing weights for
+    ///                  the constituents of each clustered hit (see
+    ///                  TChargeWeights).  This is only saved when
+    ///                  captRecon.cluster3d.saveChargeWeights is true
+    ///                  (see SetSaveChargeWeights).
+    ///
+    /// The second parameter is the PMT hits used to find the time zero.  The
+    /// third parameter is an optional previous result of this algorithm
+    /// for the same event.  If it has the chargeWeights datum, the saved
+    /// weights are used to start the charge sharing, so reprocessing after
+    /// a calibration change converges in a few iterations.
     CP::THandle<CP::TAlgorithmResult> 
     Process(const CP::TAlgorithmResult& input,
             const CP::TAlgorithmResult& input1 = CP::TAlgorithmResult::Empty,
             const CP::TAlgorithmResult& input2 = CP::TAlgorithmResult::Empty);
 
+    /// Set the number of threads used to find the three wire 3D hits and
+    /// to share the charge.  This overrides captRecon.cluster3d.threads.
+    /// The result is the same for any number of threads.
+    void SetThreads(int threads) {fThreads = std::max(threads,1);}
+
+    /// Get the number of threads used to find the 3D hits.
+    int GetThreads() const {return fThreads;}
+
+    /// Set if the charge sharing weights are saved in the output.  This
+    /// overrides captRecon.cluster3d.saveChargeWeights.
+    void SetSaveChargeWeights(bool save) {fSaveChargeWeights = save;}
+
+    /// Get if the charge sharing weights are saved in the output.
+    bool GetSaveChargeWeights() const {return fSaveChargeWeights;}
+
+    /// The total number of charge sharing iterations for all of the
+    /// connected components in the last call to Process.  This is much
+    /// smaller when the charge sharing starts from previous weights.
+    int GetChargeIterations() const {return fChargeIterations;}
+
     /// Determine the XY crossing point for two wires.  This will throw and
     /// exception if the wires are parallel (e.g. two X wires).  The
     /// z-position of the position is always set to zero.
@@ -61,12 +102,135 @@ public:
     double TimeZero(const CP::THitSelection& pmts,
                     const CP::THitSelection& wires);
 
+    /// Find the time zero for each of the significant PMT flashes in the
+    /// event and return them in time order.  The flashes are found in the
+    /// same way as TimeZero() (the time of the densest 2 microsecond window
+    /// of PMT hits), and the first flash found is the TimeZero() result.
+    /// Additional flashes are kept if they don't overlap a flash already
+    /// found, and have at least captRecon.cluster3d.flashFraction of the
+    /// hits in the biggest flash.  At most
+    /// captRecon.cluster3d.maxInteractions flashes are returned.
+    void TimeZeros(const CP::THitSelection& pmts,
+                   std::vector<double>& times) const;
+
 private:
 
+    /// A 2D (wire-time) cluster of the wire hits on one plane.  The hits in
+    /// a cluster are connected by hits on the same or adjacent wires that
+    /// overlap in drift corrected time.  The cluster keeps the time range
+    /// covered by the hits, and the (sorted) wires with hits.
+    struct WireCluster {
+        double fBegin;
+        double fEnd;
+        std::vector<int> fWires;
+    };
+
+    /// The wire hits on one plane sorted by time.  The hits are rows in
+    /// fWireHits, and the drift corrected time range of each hit is saved
+    /// along with an index to find the hits overlapping a time range.  The
+    /// index returns positions in fHits.  When pre-clustering is used, the
+    /// 2D clusters for the plane are saved along with the cluster of each
+    /// hit (indexed by the position in fHits).
+    struct Plane {
+        std::vector<int> fHits;
+        std::vector<double> fBegin;
+        std::vector<double> fEnd;
+        CP::TIntervalIndex fIndex;
+        std::vector<int> fCluster;
+        std::vector<WireCluster> fClusters;
+    };
+
+    /// A 3D hit found by MakeHit.  The candidates are turned into
+    /// TWritableReconHit objects by EmitHits.  This is separate from
+    /// constructing the TWritableReconHit so that the candidates can be found
+    /// in worker threads without touching the THit handles.
+    struct HitCandidate {
+        /// The constituent wire hits as rows in fWireHits (negative if there
+        /// isn't a hit).
+        int fHits[3];
+        /// The XY position of the hit (at Z equal zero).
+        double fX;
+        double fY;
+        /// The time, time RMS and charge of the overlapping charge.
+        double fTime;
+        double fTimeRMS;
+        double fCharge;
+    };
+
+    /// The 3D hit candidates found for a range of X hits, and the wire hits
+    /// (rows in fWireHits) that were used to make them.
+    struct HitList {
+        std::vector<HitCandidate> fCandidates;
+        std::vector<int> fUsed;
+    };
+
+    /// The wire hits associated with a single interaction (i.e. a PMT
+    /// flash).  Each interaction is clustered separately using its own time
+    /// zero.
+    struct Interaction {
+        /// The time zero of the interaction.
+        double fT0;
+
+        /// The wire hits as rows in fWireHits (in input order).
+        std::vector<int> fRows;
+
+        /// The maximum time difference between the central times of a X hit
+        /// and the V and U hits that it can be matched with.
+        double fMaxDeltaT;
+
+        /// The X, V and U hits for the interaction.
+        Plane fXPlane;
+        Plane fVPlane;
+        Plane fUPlane;
+
+        /// The V clusters, the U clusters, and the (V, U) cluster pairs
+        /// that are matched with each X cluster.  These are sorted so they
+        /// can be searched, and are only filled when pre-clustering is
+        /// used.
+        std::vector< std::vector<int> > fXVClusters;
+        std::vector< std::vector<int> > fXUClusters;
+        std::vector< std::vector< std::pair<int,int> > > fVUClusters;
+    };
+
+    /// A contiguous range of X hits (positions in fXPlane.fHits) in an
+    /// interaction.  This is the unit of work for the triplet search.
+    struct Chunk {
+        std::size_t fInteraction;
+        std::size_t fBegin;
+        std::size_t fEnd;
+    };
+
+    /// The workspace used while finding 3D hits.  There is one per thread.
+    struct Worker;
+
     /// The maximum drift distance in the TPC.  This is set using the
     /// captRecon.Cluster3D.maxDrift
     double fMaxDrift;
 
+    /// The maximum number of interactions (PMT flashes) in an event.  This
+    /// is set using captRecon.cluster3d.maxInteractions.
+    int fMaxInteractions;
+
+    /// The minimum size of a PMT flash relative to the biggest flash for it
+    /// to be a separate interaction.  This is set using
+    /// captRecon.cluster3d.flashFraction.
+    double fFlashFraction;
+
+    /// If true, split each interaction into time slices at gaps in the wire
+    /// hits, and cluster each slice separately.  This is set using
+    /// captRecon.cluster3d.timeSlices.  Only the per-slice work (the plane
+    /// indices, the 3D hit candidates and the charge sharing) is bounded by
+    /// the slice.  The wire hit table (fWireHits) and the set of used wire
+    /// hits still cover the whole event, and the output selections hold all
+    /// of the 3D hits since they are returned in a single result.
+    bool fTimeSlices;
+
+    /// If true, group the hits on each plane into 2D wire-time clusters and
+    /// match the clusters between the planes before looking for 3D hits.
+    /// Only hits in matched cluster triplets are combined.  This is set
+    /// using captRecon.cluster3d.preCluster.
+    bool fPreCluster;
+
     /// The time around the central time of the X hit where a V or U hit is
     /// considered to overlap.  This is in units of the time RMS.
     double fXSeparation;
@@ -108,34 +272,145 @@ private:
     /// The amount of time per digitizer sample.  This is the same for all
     /// hits (and is nominally 500*ns).
     double fDigitStep;
-    
-    /// Take the "size" of each hit, and the minimum separation (basically the
-    /// time bin size), and return an overlap time.  If hits are within the
-    /// overlap time of each other, then they are considered to overlap.
-    double OverlapTime(double rms1, double rms2, double step) const;
-
-    /// Return true if two hits overlap.
-    bool OverlappingHits(CP::THandle<CP::THit> h1,
-                         CP::THandle<CP::THit> h2) const;
+
+    /// The properties of the wire hits being clustered.  This is filled at
+    /// the start of Process() and the hits are referred to by their row in
+    /// the table.
+    CP::TWireHitTable fWireHits;
+
+    /// The interactions in the current event.
+    std::vector<Interaction> fInteractions;
+
+    /// The number of threads used to find the three wire 3D hits.  This is
+    /// set using captRecon.cluster3d.threads.  If this is one, then
+    /// everything is done in the calling thread.
+    int fThreads;
+
+    /// The over-relaxation factor used when the charge is shared between
+    /// the 3D hits (see TDistributeCharge::SetRelaxation).  This is set
+    /// using captRecon.cluster3d.chargeRelaxation.
+    double fChargeRelaxation;
+
+    /// The method used to share the charge between the 3D hits.  This is
+    /// set using captRecon.cluster3d.chargeMethod.
+    CP::TDistributeCharge::Method fChargeMethod;
+
+    /// If true, save the charge sharing weights in the output.  This is set
+    /// using captRecon.cluster3d.saveChargeWeights.
+    bool fSaveChargeWeights;
+
+    /// The total number of charge sharing iterations in the last call to
+    /// Process.
+    int fChargeIterations;
+
+    /// How the input wire hits are checked for overlapping hits on the same
+    /// channel.  This is set using captRecon.cluster3d.overlapCheck.
+    enum {kOverlapCheckOff, kOverlapCheckCount, kOverlapCheckLog};
+    int fOverlapCheck;
+
+    /// Check the wire hits for hits on the same channel that overlap in
+    /// time and return the number of overlapping pairs.  The hits are
+    /// grouped by channel and sorted by start time, so this is O(n log(n))
+    /// instead of comparing every pair of hits.  Each pair is only logged
+    /// when fOverlapCheck is kOverlapCheckLog.
+    int CheckOverlappingHits(const CP::THitSelection& hits) const;
+
+    /// Fill the hits for a plane.  The rows must already be sorted by time.
+    void FillPlane(Plane& plane, const std::vector<int>& rows) const;
+
+    /// Split the wire hits between the interactions.  A wire hit is assigned
+    /// to the latest interaction where the hit time is inside the maximum
+    /// drift time after the time zero.  Hits that are not inside the drift
+    /// window of any interaction are assigned to the interaction with the
+    /// biggest flash.
+    void FillInteractions(const std::vector<double>& t0s,
+                          double primaryT0);
+
+    /// Find the maximum time difference between the central times of
+    /// matched wire hits.  This depends on the distribution of the time RMS
+    /// for the hits.
+    double MaxDeltaT(const std::vector<int>& rows) const;
+
+    /// Split the hits in an interaction into time slices and add the slices
+    /// to fInteractions.  A new slice is started when there is a gap between
+    /// the drift corrected time ranges of the hits that is longer than the
+    /// maximum time difference for matched hits, so the slices can be
+    /// clustered independently.
+    void SliceInteraction(const Interaction& interaction);
+
+    /// Fill the planes of an interaction from the wire hit rows.
+    void FillInteraction(Interaction& interaction) const;
+
+    /// Group the hits on a plane into 2D wire-time clusters.
+    void ClusterPlane(Plane& plane) const;
+
+    /// Match the 2D clusters between the planes of an interaction.  A X, V
+    /// and U cluster triplet is matched if the time ranges of the clusters
+    /// overlap, and there are wires in each cluster that cross at a single
+    /// point.  Every triplet of wire hits that can make a 3D hit is in a
+    /// matched cluster triplet.
+    void MatchClusters(Interaction& interaction) const;
+
+    /// Find the 3D hits for the interactions in [first, last) and add them
+    /// to writableHits.  The used wire hits are added to the used set.
+    void BuildHits(Worker& worker, std::size_t first, std::size_t last,
+                   CP::TDenseHitSet& used, CP::THitSelection& writableHits);
+
+    /// Share the charge of the wire hits among the 3D hits.  The charge
+    /// sharing is started from the previous weights for the 3D hits that
+    /// are found there.  If fSaveChargeWeights is true, the weights are
+    /// added to the solved weights.  This returns the total number of
+    /// charge sharing iterations.
+    int ShareCharge(CP::THitSelection& writableHits,
+                     const CP::TChargeWeights& previous,
+                     CP::TChargeWeights& solved) const;
+
+    /// Find the three wire 3D hits for the X hits in [begin, end) (positions
+    /// in fXPlane.fHits) of an interaction.  This only reads the event data,
+    /// so it can be run in parallel for different X hit ranges and
+    /// interactions.
+    void FindTriplets(Worker& worker, const Interaction& interaction,
+                      HitList& output,
+                      std::size_t begin, std::size_t end) const;
+
+    /// Find the three wire 3D hits for several chunks using several
+    /// threads.  The output for each chunk is returned separately so the
+    /// result is the same as the serial calculation.
+    void FindTripletsParallel(const std::vector<Chunk>& chunks,
+                              std::vector<HitList>& outputs) const;
+
+    /// Find the two wire 3D hits using the wire hits in an interaction that
+    /// are not in the used set.
+    void FindTwoWireHits(Worker& worker, const Interaction& interaction,
+                         const CP::TDenseHitSet& used,
+                         HitList& output) const;
+
+    /// Turn the 3D hit candidates into TWritableReconHit objects corrected
+    /// for the time zero and add them to writableHits.  The used wire hits
+    /// are added to the used set as rows in fWireHits.
+    void EmitHits(const HitList& input, double t0,
+                  CP::THitSelection& writableHits,
+                  CP::TDenseHitSet& used) const;
         
-    /// The (up to) three wire hits and make a 3D TWritableReconHit handle.
-    /// The hits need to be from different plans (i.e. the wires cannot be
-    /// parallel).  This will return an empty handle if there is a problem
-    /// constructing the hit.
-    bool MakeHit(CP::THitSelection& writableHits,
+    /// The (up to) three wire hits and make 3D hit candidates (see
+    /// EmitHits).  The hits are rows in fWireHits, and a missing hit is
+    /// indicated by a negative row.  The hits need to be from different
+    /// plans (i.e. the wires cannot be parallel).  This will return false if
+    /// there is a problem constructing the hit.  The worker provides the
+    /// workspace for the calculation.
+    bool MakeHit(Worker& worker, HitList& output,
                  const TVector3& hitPosition,
-                 double t0,
-                 const CP::THandle<CP::THit>& hit1,
-                 const CP::THandle<CP::THit>& hit2,
-                 const CP::THandle<CP::THit>& hit3) const;
+                 int hit1, int hit2, int hit3) const;
 
-    /// Find the fractional overlap of the hit with the constituent.
+    /// Find the fractional overlap of the hit with the constituent.  The
+    /// constituent is a row in fWireHits.
     double FindOverlap(const CP::THandle<CP::THit>& hit,
-                       const CP::THandle<CP::THit>& constituent) const;
+                       int constituent) const;
 
-    /// Find the overlapping charge between two wire hits.
-    double ChargeOverlap(const CP::THandle<CP::THit>& hit1,
-                         const CP::THandle<CP::THit>& hit2) const;
+    /// Find the overlapping charge between two wire hits.  The hits are rows
+    /// in fWireHits, and a missing hit is indicated by a negative row.  The
+    /// worker provides the workspace for the calculation.
+    double ChargeOverlap(Worker& worker, int hit1, int hit2) const;
 
 };
 #endif
@@ -16,6 +16,42 @@
 #include <memory>
 #include <cmath>
 
+namespace {
+    typedef CP::TPositionDensityCluster< CP::THandle<CP::THit> >
+        IterativeCluster;
+    typedef CP::TPositionDensityCluster< CP::THandle<CP::THit>,
+                                         CP::TGridNeighbors >
+        GridCluster;
+
+    // Resplit a cluster using the cluster extent in the XY plane and the
+    // time metric along the Z axis.  The new clusters are added to final,
+    // or the original object is added if it isn't split.
+    template <class ClusterAlgorithm>
+    void ResplitCluster(const CP::THandle<CP::TReconBase>& object,
+                        double clusterExtent, double timeMetric,
+                        CP::TReconObjectContainer& final) {
+        std::unique_ptr<ClusterAlgorithm> 
+            clusterAlgorithm(new ClusterAlgorithm(1,clusterExtent));
+        clusterAlgorithm->SetBasis(TVector3(1,0,0),
+                                   TVector3(0,1,0),
+                                   TVector3(0,0,timeMetric));
+        clusterAlgorithm->Cluster(object->GetHits()->begin(),
+                                  object->GetHits()->end());
+        int nClusters = clusterAlgorithm->GetClusterCount();
+        if (nClusters<2) {
+            final.push_back(object);
+            return;
+        }
+        for (int i=0; i<nClusters; ++i) {
+            const typename ClusterAlgorithm::Points& points 
+                = clusterAlgorithm->GetCluster(i);
+            CP::THandle<CP::TReconCluster> cluster
+                = CreateCluster("mergedCluster",points.begin(),points.end());
+            final.push_back(cluster);
+        }
+    }
+}
+
 CP::TClusterMerge::TClusterMerge()
     : TAlgorithm("TClusterMerge", 
                  "Merge clusters that are incorrectly split") {
@@ -26,6 +62,8 @@ CP::TClusterMerge::TClusterMerge()
     fMinimumLength = 25*unit::mm;
     fClusterExtent = 15*unit::mm;
     fTimeMetric = 0.3;
+    fGridNeighbors = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.gridNeighbors");
 }
 
 CP::TClusterMerge::~TClusterMerge() { }
@@ -135,28 +173,13 @@ CP::TClusterMerge::Process(const CP::TAlgorithmResult& input,
                     // they should be resplit.  This handles V topologies
                     // where two branches are be merged, but are clearly split
                     // away from the "V".
-                    typedef CP::TPositionDensityCluster<CP::THandle<CP::THit> > 
-                        ClusterAlgorithm;
-                    std::unique_ptr<ClusterAlgorithm> 
-                        clusterAlgorithm(
-                            new ClusterAlgorithm(1,fClusterExtent));
-                    clusterAlgorithm->SetBasis(TVector3(1,0,0),
-                                               TVector3(0,1,0),
-                                               TVector3(0,0,fTimeMetric));
-                    clusterAlgorithm->Cluster((*o)->GetHits()->begin(),
-                                              (*o)->GetHits()->end());
-                    int nClusters = clusterAlgorithm->GetClusterCount();
-                    if (nClusters<2) {
-                        final->push_back(*o);
-                        continue;
+                    if (fGridNeighbors) {
+                        ResplitCluster<GridCluster>(*o, fClusterExtent,
+                                                    fTimeMetric, *final);
                     }
-                    for (int i=0; i<nClusters; ++i) {
-                        const ClusterAlgorithm::Points& points 
-                            = clusterAlgorithm->GetCluster(i);
-                        CP::THandle<CP::TReconCluster> cluster
-                            = CreateCluster("mergedCluster",
-                                            points.begin(),points.end());
-                        final->push_back(cluster);
+                    else {
+                        ResplitCluster<IterativeCluster>(*o, fClusterExtent,
+                                                         fTimeMetric, *final);
                     }
                 }
             }
@@ -87,6 +87,11 @@ private:
     /// The distance metric to be used along the Z direction (i.e. the time
     /// axis).  The metric along the X and Y axis will be 1.0.
     double fTimeMetric;
+
+    /// If true, the merged clusters are resplit using TGridNeighbors to find
+    /// the neighboring hits instead of TIterativeNeighbors.  This is set
+    /// using captRecon.gridNeighbors.
+    bool fGridNeighbors;
     
 };
 #endif
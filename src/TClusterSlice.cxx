@@ -24,6 +24,40 @@ namespace {
             return (lhs->GetPosition().Z() < rhs->GetPosition().Z());
         }
     };
+
+    typedef CP::TPositionDensityCluster<CP::THandle<CP::THit> >
+        IterativeCluster;
+    typedef CP::TPositionDensityCluster<CP::THandle<CP::THit>,
+                                        CP::TGridNeighbors>
+        GridCluster;
+
+    // Find the clusters in a range of hits and add a zCluster to the result
+    // for each one with at least the minimum charge.  This returns the
+    // number of clusters found.
+    template <class ClusterAlgorithm>
+    int SliceClusters(CP::THitSelection::iterator begin,
+                      CP::THitSelection::iterator end,
+                      int minSize, double clusterExtent, double minCharge,
+                      CP::TReconObjectContainer& result) {
+        std::unique_ptr<ClusterAlgorithm> 
+            clusterAlgorithm(new ClusterAlgorithm(minSize,clusterExtent));
+        clusterAlgorithm->Cluster(begin,end);
+        int nClusters = clusterAlgorithm->GetClusterCount();
+        for (int i=0; i<nClusters; ++i) {
+            const typename ClusterAlgorithm::Points& points 
+                = clusterAlgorithm->GetCluster(i);
+            CaptNamedVerbose("TClusterSlice","       Cluster " << i
+                         << " with " << points.size() << " hits");
+            CP::THandle<CP::TReconCluster> cluster
+                = CreateCluster("zCluster",points.begin(),points.end());
+            if (!cluster) continue;
+            if (cluster->GetEDeposit() < minCharge) {
+                continue;
+            }
+            result.push_back(cluster);
+        }
+        return nClusters;
+    }
 };
 
 
@@ -43,10 +77,26 @@ CP::TClusterSlice::TClusterSlice()
     fClusterGrowth = CP::TRuntimeParameters::Get().GetParameterD(
         "captRecon.clusterSlice.clusterGrowth");
     fClusterCharge = 0.5*unit::mm*approxArgon::dEdX*approxArgon::Electrons;
+    fGridNeighbors = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.gridNeighbors");
 }
 
 CP::TClusterSlice::~TClusterSlice() { }
 
+int CP::TClusterSlice::ClusterHits(CP::THitSelection::iterator begin,
+                                   CP::THitSelection::iterator end,
+                                   int minSize,
+                                   CP::TReconObjectContainer& result) {
+    if (fGridNeighbors) {
+        return SliceClusters<GridCluster>(begin, end, minSize,
+                                          fClusterExtent, fClusterCharge,
+                                          result);
+    }
+    return SliceClusters<IterativeCluster>(begin, end, minSize,
+                                           fClusterExtent, fClusterCharge,
+                                           result);
+}
+
 CP::THandle<CP::TReconObjectContainer> 
 CP::TClusterSlice::MakeSlices(CP::THandle<CP::THitSelection> inputHits) {
     CP::THandle<CP::TReconObjectContainer> result(
@@ -74,10 +124,6 @@ CP::TClusterSlice::MakeSlices(CP::THandle<CP::THitSelection> inputHits) {
                  << unit::AsString(deltaZ,"length") 
                  << " (" << unit::AsString(zStep,"length") << " each)");
 
-    // This is the (dramatically) faster clustering algorithm for hits.
-    typedef CP::TPositionDensityCluster<CP::THandle<CP::THit> > 
-        ClusterAlgorithm;
-
 // #define USE_SLICE_MINSIZE
 #ifdef USE_SLICE_MINSIZE
     double eventScale = std::log(1.0*hits->size()+1.0)/std::log(fClusterGrowth);
@@ -138,54 +184,20 @@ CP::TClusterSlice::MakeSlices(CP::THandle<CP::THitSelection> inputHits) {
         // The hits between first and curr should be run through the density
         // cluster again since it's very likely that the hits are disjoint in
         // the Z slice.
-        std::unique_ptr<ClusterAlgorithm> 
-            clusterAlgorithm(new ClusterAlgorithm(minSize,
-                                                  fClusterExtent));
-        clusterAlgorithm->Cluster(first,curr);
-        int nClusters = clusterAlgorithm->GetClusterCount();
+        int nClusters = ClusterHits(first, curr, minSize, *result);
         CaptNamedInfo("TClusterSlice",
                      trials
                      << " -- Slice with " << nClusters
                      << " clusters from " << curr-first << " hits in slice"
                      << "   dZ: " << deltaZ);
-        for (int i=0; i<nClusters; ++i) {
-            const ClusterAlgorithm::Points& points 
-                = clusterAlgorithm->GetCluster(i);
-            CaptNamedVerbose("TClusterSlice","       Cluster " << i
-                         << " with " << points.size() << " hits");
-            CP::THandle<CP::TReconCluster> cluster
-                = CreateCluster("zCluster",points.begin(),points.end());
-            if (!cluster) continue;
-            if (cluster->GetEDeposit() < fClusterCharge) {
-                continue;
-            }
-            result->push_back(cluster);
-        }
         // Reset first to start looking for a new set of hits.
         first = curr;
     }
     if (first != end) {
         // Build the final clusters.
-        std::unique_ptr<ClusterAlgorithm> 
-            clusterAlgorithm(new ClusterAlgorithm((int) minSize,
-                                                  fClusterExtent));
-        clusterAlgorithm->Cluster(first,end);
-        int nClusters = clusterAlgorithm->GetClusterCount();
+        int nClusters = ClusterHits(first, end, minSize, *result);
         CaptNamedVerbose("TClusterSlice","    Final slice with " << nClusters
                      << " clusters from " << end-first << " hits");
-        for (int i=0; i<nClusters; ++i) {
-            const ClusterAlgorithm::Points& points 
-                = clusterAlgorithm->GetCluster(i);
-            CaptNamedVerbose("TClusterSlice","       Cluster " << i
-                         << " with " << points.size() << " hits");
-            CP::THandle<CP::TReconCluster> cluster
-                = CreateCluster("zCluster",points.begin(),points.end());
-            if (!cluster) continue;
-            if (cluster->GetEDeposit() < fClusterCharge) {
-                continue;
-            }
-            result->push_back(cluster);
-        }
     }
 
     return result;
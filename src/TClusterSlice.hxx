@@ -32,6 +32,14 @@ private:
     CP::THandle<CP::TReconObjectContainer> 
     MakeSlices(CP::THandle<CP::THitSelection> input);
 
+    /// Find the clusters in a range of hits (a slice) and add the clusters
+    /// with at least fClusterCharge to the result.  This returns the number
+    /// of clusters found.
+    int ClusterHits(CP::THitSelection::iterator begin,
+                    CP::THitSelection::iterator end,
+                    int minSize,
+                    CP::TReconObjectContainer& result);
+
     /// The minimum number of hits in the input in the input object for the
     /// hits to be sliced into clusters.  This keeps "micro" events from
     /// being split up since they will be best handled using the cluster
@@ -65,5 +73,10 @@ private:
     /// really small clusters from being formed.  This is not parameterized,
     /// since it sets a very low floor on the cluster size.
     double fClusterCharge;
+
+    /// If true, the slices are clustered using TGridNeighbors to find the
+    /// neighboring hits instead of TIterativeNeighbors.  This is set using
+    /// captRecon.gridNeighbors.
+    bool fGridNeighbors;
 };
 #endif
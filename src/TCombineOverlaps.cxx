@@ -37,19 +37,43 @@ double CP::TCombineOverlaps::CountSetOverlaps(
     if (set2Size<1) return 0.0;
     double overlap = 0;
     if (set1Size < set2Size) {
-        for (HitSet::const_iterator h = set1.begin(); h!=set1.end(); ++h) {
-            if (set2.find(*h) != set2.end()) overlap += 1.0;
+        const std::vector<int>& members = set1.GetMembers();
+        for (std::vector<int>::const_iterator h = members.begin();
+             h!=members.end(); ++h) {
+            if (set2.Contains(*h)) overlap += 1.0;
         }
         return overlap/set1Size;
     }
     else {
-        for (HitSet::const_iterator h = set2.begin(); h!=set2.end(); ++h) {
-            if (set1.find(*h) != set1.end()) overlap += 1.0;
+        const std::vector<int>& members = set2.GetMembers();
+        for (std::vector<int>::const_iterator h = members.begin();
+             h!=members.end(); ++h) {
+            if (set1.Contains(*h)) overlap += 1.0;
         }
         return overlap/set2Size;
     }
     return 0;
 }
+
+void CP::TCombineOverlaps::FillHitSets(CP::THandle<CP::TReconBase> object,
+                                       CP::TCombineOverlaps::HitSet& setU,
+                                       CP::TCombineOverlaps::HitSet& setV,
+                                       CP::TCombineOverlaps::HitSet& setX) {
+    setU.Clear();
+    setV.Clear();
+    setX.Clear();
+    for (CP::THitSelection::iterator h = object->GetHits()->begin();
+         h != object->GetHits()->end(); ++h) {
+        for (int i = 0; i < (*h)->GetConstituentCount(); ++i) {
+            CP::THandle<CP::THit> w = (*h)->GetConstituent(i);
+            CP::TGeometryId id = w->GetGeomId();
+            int hitId = fRegistry.Register(w);
+            if (CP::GeomId::Captain::IsUWire(id)) setU.Insert(hitId);
+            if (CP::GeomId::Captain::IsVWire(id)) setV.Insert(hitId);
+            if (CP::GeomId::Captain::IsXWire(id)) setX.Insert(hitId);
+        }
+    }
+}
                                           
 CP::THandle<CP::TReconBase> 
 CP::TCombineOverlaps::MergeObjects(CP::THandle<CP::TReconBase> object1,
@@ -112,6 +136,17 @@ CP::TCombineOverlaps::Process(const CP::TAlgorithmResult& input,
     std::copy(inputObjects->begin(), inputObjects->end(),
               std::back_inserter(objectList));
 
+    // The 2D hits are given identifiers as they are seen so that the hit sets
+    // can be compared using flat arrays.  The sets are reused for each
+    // object.
+    fRegistry.Clear();
+    CP::TCombineOverlaps::HitSet set1u;
+    CP::TCombineOverlaps::HitSet set1v;
+    CP::TCombineOverlaps::HitSet set1x;
+    CP::TCombineOverlaps::HitSet set2u;
+    CP::TCombineOverlaps::HitSet set2v;
+    CP::TCombineOverlaps::HitSet set2x;
+
     // Pop an object off the stack and see if it should be merged.  If the track
     // is merged, the result is pushed back on the stack.  If it doesn't get
     // merge, the track get's pushed into the final object container.
@@ -124,37 +159,13 @@ CP::TCombineOverlaps::Process(const CP::TAlgorithmResult& input,
                       << "    UID: " << object1->GetUniqueID());
 
         // Divide objects into 2D hits.
-        CP::TCombineOverlaps::HitSet set1u;
-        CP::TCombineOverlaps::HitSet set1v;
-        CP::TCombineOverlaps::HitSet set1x;
-        for (CP::THitSelection::iterator h = object1->GetHits()->begin();
-             h != object1->GetHits()->end(); ++h) {
-            for (int i = 0; i < (*h)->GetConstituentCount(); ++i) {
-                CP::THandle<CP::THit> w = (*h)->GetConstituent(i);
-                CP::TGeometryId id = w->GetGeomId();
-                if (CP::GeomId::Captain::IsUWire(id)) set1u.insert(w);
-                if (CP::GeomId::Captain::IsVWire(id)) set1v.insert(w);
-                if (CP::GeomId::Captain::IsXWire(id)) set1x.insert(w);
-            }
-        }
+        FillHitSets(object1, set1u, set1v, set1x);
 
         for (ObjectList::iterator t = objectList.begin();
              t!=objectList.end(); ++t) {
             CP::THandle<CP::TReconBase> object2 = *t;
 
-            CP::TCombineOverlaps::HitSet set2u;
-            CP::TCombineOverlaps::HitSet set2v;
-            CP::TCombineOverlaps::HitSet set2x;
-            for (CP::THitSelection::iterator h = object2->GetHits()->begin();
-                 h != object2->GetHits()->end(); ++h) {
-                for (int i = 0; i < (*h)->GetConstituentCount(); ++i) {
-                    CP::THandle<CP::THit> w = (*h)->GetConstituent(i);
-                    CP::TGeometryId id = w->GetGeomId();
-                    if (CP::GeomId::Captain::IsUWire(id)) set2u.insert(w);
-                    if (CP::GeomId::Captain::IsVWire(id)) set2v.insert(w);
-                    if (CP::GeomId::Captain::IsXWire(id)) set2x.insert(w);
-                }
-            }
+            FillHitSets(object2, set2u, set2v, set2x);
 
             int overlappingDimensions = 0;
             double overlap = 1.0;
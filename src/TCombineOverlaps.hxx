@@ -1,11 +1,12 @@
 #ifndef TCombineOverlaps_hxx_seen
 #define TCombineOverlaps_hxx_seen
 
+#include "TDenseHitSet.hxx"
+#include "THitRegistry.hxx"
+
 #include <TAlgorithm.hxx>
 #include <TAlgorithmResult.hxx>
 
-#include <set>
-
 namespace CP {
     class TCombineOverlaps;
 };
@@ -19,7 +20,8 @@ namespace CP {
 class CP::TCombineOverlaps
     : public CP::TAlgorithm {
 public:
-    typedef std::set< CP::THandle<CP::THit> > HitSet;
+    /// A set of 2D hits saved as identifiers from the hit registry.
+    typedef CP::TDenseHitSet HitSet;
 
     TCombineOverlaps();
     virtual ~TCombineOverlaps();
@@ -42,6 +44,12 @@ private:
     double CheckOverlap(CP::THandle<CP::TReconBase> object1,
                         CP::THandle<CP::TReconBase> object2) const;
 
+    /// Fill the sets of U, V and X wire hits used by an object.
+    void FillHitSets(CP::THandle<CP::TReconBase> object,
+                     CP::TCombineOverlaps::HitSet& setU,
+                     CP::TCombineOverlaps::HitSet& setV,
+                     CP::TCombineOverlaps::HitSet& setX);
+
     /// Count the number of overlaps in a set.
     double CountSetOverlaps(const CP::TCombineOverlaps::HitSet& set1,
                             const CP::TCombineOverlaps::HitSet& set2) const;
@@ -55,5 +63,8 @@ private:
     /// combined.
     double fOverlapCut;
 
+    /// The identifiers for the 2D hits in the current event.
+    CP::THitRegistry fRegistry;
+
 };
 #endif
@@ -0,0 +1,25 @@
+#include "TDenseHitSet.hxx"
+
+CP::TDenseHitSet::TDenseHitSet(std::size_t capacity)
+    : fFlags(capacity, 0) {}
+
+CP::TDenseHitSet::~TDenseHitSet() {}
+
+void CP::TDenseHitSet::Clear() {
+    for (std::vector<int>::iterator m = fMembers.begin();
+         m != fMembers.end(); ++m) {
+        fFlags[*m] = 0;
+    }
+    fMembers.clear();
+}
+
+void CP::TDenseHitSet::Reserve(std::size_t capacity) {
+    if (fFlags.size() < capacity) fFlags.resize(capacity, 0);
+    fMembers.reserve(capacity);
+}
+
+void CP::TDenseHitSet::Grow(int id) {
+    std::size_t capacity = 2*fFlags.size();
+    if (capacity < (std::size_t) id + 1) capacity = id + 1;
+    Reserve(capacity);
+}
@@ -0,0 +1,73 @@
+#ifndef TDenseHitSet_hxx_seen
+#define TDenseHitSet_hxx_seen
+
+#include <vector>
+
+namespace CP {
+    class TDenseHitSet;
+};
+
+/// A set of dense hit identifiers (for instance, rows in a TWireHitTable, or
+/// the identifiers from a THitRegistry).  Membership is kept as a flag per
+/// identifier so that Insert() and Contains() are array accesses, and the
+/// members are also kept in the order they were inserted so that the set can
+/// be iterated and cleared in a time proportional to the number of members.
+/// This replaces std::set< CP::THandle<CP::THit> > for bookkeeping inside a
+/// single event.
+///
+/// \code
+/// CP::TDenseHitSet used(table.size());
+/// used.Insert(row);
+/// if (used.Contains(row)) continue;
+/// \endcode
+class CP::TDenseHitSet {
+public:
+    /// Make a set that can hold identifiers in [0, capacity) without
+    /// growing.
+    explicit TDenseHitSet(std::size_t capacity = 0);
+    virtual ~TDenseHitSet();
+
+    /// Remove all of the members.  The memory is kept so the set can be
+    /// reused.
+    void Clear();
+
+    /// Make sure that identifiers in [0, capacity) can be added without
+    /// growing the set.
+    void Reserve(std::size_t capacity);
+
+    /// Add an identifier to the set.  This returns true if the identifier
+    /// wasn't already in the set.
+    bool Insert(int id) {
+        if ((int) fFlags.size() <= id) Grow(id);
+        if (fFlags[id]) return false;
+        fFlags[id] = 1;
+        fMembers.push_back(id);
+        return true;
+    }
+
+    /// Check if an identifier is in the set.
+    bool Contains(int id) const {
+        if (id < 0 || (int) fFlags.size() <= id) return false;
+        return fFlags[id];
+    }
+
+    /// The members of the set in the order they were inserted.
+    const std::vector<int>& GetMembers() const {return fMembers;}
+
+    /// The number of members in the set.
+    std::size_t size() const {return fMembers.size();}
+
+    /// True if there are no members in the set.
+    bool empty() const {return fMembers.empty();}
+
+private:
+    /// Grow the set so that it can hold an identifier.
+    void Grow(int id);
+
+    /// A flag for each possible identifier that is set for the members.
+    std::vector<char> fFlags;
+
+    /// The members in the order they were inserted.
+    std::vector<int> fMembers;
+};
+#endif
@@ -1,6 +1,7 @@
 #include "TDensityCluster.hxx"
 #include "HitUtilities.hxx"
 #include "TPositionDensityCluster.hxx"
+#include "TParallelDensityCluster.hxx"
 #include "CreateCluster.hxx"
 
 #include <THandle.hxx>
@@ -11,6 +12,26 @@
 
 #include <memory>
 #include <cmath>
+#include <thread>
+
+namespace {
+    // Make a TReconCluster for each cluster found by the clustering
+    // algorithm, and add it to the container.
+    template <class ClusterAlgorithm>
+    void AddClusters(ClusterAlgorithm& clusterAlgorithm,
+                     CP::TReconObjectContainer& final) {
+        int nClusters = clusterAlgorithm.GetClusterCount();
+        for (int i=0; i<nClusters; ++i) {
+            const typename ClusterAlgorithm::Points& points
+                = clusterAlgorithm.GetCluster(i);
+            CP::THandle<CP::TReconCluster> cluster
+                = CreateCluster("TDensityCluster",points.begin(),points.end());
+            CaptLog("   Cluster with " << cluster->GetHits()->size()
+                    << " hits");
+            final.push_back(cluster);
+        }
+    }
+}
 
 CP::TDensityCluster::TDensityCluster()
     : TAlgorithm("TDensityCluster", "Find Simply Connected Hits") {
@@ -21,7 +42,18 @@ CP::TDensityCluster::TDensityCluster()
     fMaxDist = CP::TRuntimeParameters::Get().GetParameterD(
         "captRecon.densityCluster.maxDistance");
 
+    fParallel = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.densityCluster.parallel");
 
+    fGridNeighbors = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.gridNeighbors");
+
+    // The number of threads for the parallel clustering.  If this is zero,
+    // use the number of cores.
+    fThreads = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.densityCluster.threads");
+    if (fThreads < 1) fThreads = std::thread::hardware_concurrency();
+    if (fThreads < 1) fThreads = 1;
 }
 
 CP::TDensityCluster::~TDensityCluster() { }
@@ -47,23 +79,26 @@ CP::TDensityCluster::Process(const CP::TAlgorithmResult& input,
         final(new CP::TReconObjectContainer("final"));
     std::unique_ptr<CP::THitSelection> used(new CP::THitSelection("used"));
 
-    // This is the (dramatically) faster clustering algorithm for hits.
-    typedef CP::TPositionDensityCluster< CP::THandle<CP::THit> > 
-        ClusterAlgorithm;
-
-    std::unique_ptr<ClusterAlgorithm> 
-        clusterAlgorithm(new ClusterAlgorithm(fMinPoints,fMaxDist));
-
-    clusterAlgorithm->Cluster(inputHits->begin(), inputHits->end());
-
-    int nClusters = clusterAlgorithm->GetClusterCount();
-    for (int i=0; i<nClusters; ++i) {
-        const ClusterAlgorithm::Points& points 
-            = clusterAlgorithm->GetCluster(i);
-        CP::THandle<CP::TReconCluster> cluster
-            = CreateCluster("TDensityCluster",points.begin(),points.end());
-        CaptLog("   Cluster with " << cluster->GetHits()->size() << " hits");
-        final->push_back(cluster);
+    if (fParallel) {
+        CP::TParallelDensityCluster< CP::THandle<CP::THit> >
+            clusterAlgorithm(fMinPoints,fMaxDist);
+        clusterAlgorithm.SetThreads(fThreads);
+        clusterAlgorithm.Cluster(inputHits->begin(), inputHits->end());
+        AddClusters(clusterAlgorithm, *final);
+    }
+    else if (fGridNeighbors) {
+        CP::TPositionDensityCluster< CP::THandle<CP::THit>,
+                                     CP::TGridNeighbors >
+            clusterAlgorithm(fMinPoints,fMaxDist);
+        clusterAlgorithm.Cluster(inputHits->begin(), inputHits->end());
+        AddClusters(clusterAlgorithm, *final);
+    }
+    else {
+        // This is the (dramatically) faster clustering algorithm for hits.
+        CP::TPositionDensityCluster< CP::THandle<CP::THit> >
+            clusterAlgorithm(fMinPoints,fMaxDist);
+        clusterAlgorithm.Cluster(inputHits->begin(), inputHits->end());
+        AddClusters(clusterAlgorithm, *final);
     }
 
     // Copy all of the hits that got added to a reconstruction object into the
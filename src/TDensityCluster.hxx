@@ -33,5 +33,17 @@ private:
     /// The radius over which points are counted to determine if a point is in
     /// a high density region.
     int fMaxDist;
+
+    /// If true, use the standard DBSCAN definition of the clusters with the
+    /// points split between several threads (see TParallelDensityCluster).
+    bool fParallel;
+
+    /// If true, the (serial) clustering uses TGridNeighbors to find the
+    /// neighboring hits instead of TIterativeNeighbors.  This is set using
+    /// captRecon.gridNeighbors.
+    bool fGridNeighbors;
+
+    /// The number of threads used for the parallel clustering.
+    int fThreads;
 };
 #endif
@@ -15,11 +15,84 @@
  
 #include <memory>
 #include <set>
+#include <iterator>
 #include <cmath>
 
+namespace {
+    typedef CP::TPositionDensityCluster< CP::THandle<CP::THit> >
+        IterativeCluster;
+    typedef CP::TPositionDensityCluster< CP::THandle<CP::THit>,
+                                         CP::TGridNeighbors >
+        GridCluster;
+
+    // Split the hits into big, medium and small clusters.  The big clusters
+    // are added to big, and the medium and small clusters are added to
+    // small.
+    template <class ClusterAlgorithm, class Iterator>
+    void SplitClusters(Iterator begin, Iterator end,
+                       CP::TReconObjectContainer& big,
+                       CP::TReconObjectContainer& small) {
+        // Find the big clusters.
+        ClusterAlgorithm bigClusters(12,8*unit::mm);
+        bigClusters.Cluster(begin, end);
+
+        int nClusters = bigClusters.GetClusterCount();
+        CaptNamedLog("TDisassociateHits",
+                     "With " << nClusters << " big clusters"
+                     << " from " << std::distance(begin,end) << " hits");
+        for (int i=0; i<nClusters; ++i) {
+            const typename ClusterAlgorithm::Points& points 
+                = bigClusters.GetCluster(i);
+            CP::THandle<CP::TReconCluster> cluster
+                = CreateCluster("cluster",points.begin(),points.end());
+            big.push_back(cluster);
+        }
+
+        // Find the medium clusters.
+        ClusterAlgorithm mediumClusters(6,8*unit::mm);
+        mediumClusters.Cluster(bigClusters.GetCluster(nClusters).begin(), 
+                               bigClusters.GetCluster(nClusters).end());
+
+        nClusters = mediumClusters.GetClusterCount();
+        CaptNamedLog("TDisassociateHits",
+                     "With " << nClusters << " medium clusters"
+                     << " from " << bigClusters.GetCluster(nClusters).size() 
+                     << " hits");
+
+        for (int i=0; i<nClusters; ++i) {
+            const typename ClusterAlgorithm::Points& points 
+                = mediumClusters.GetCluster(i);
+            CP::THandle<CP::TReconCluster> cluster
+                = CreateCluster("cluster",points.begin(),points.end());
+            small.push_back(cluster);
+        }
+
+        // Find the small clusters.
+        ClusterAlgorithm smallClusters(1,8*unit::mm);
+        smallClusters.Cluster(mediumClusters.GetCluster(nClusters).begin(), 
+                                mediumClusters.GetCluster(nClusters).end());
+
+        nClusters = smallClusters.GetClusterCount();
+        CaptNamedLog("TDisassociateHits",
+                     "With " << nClusters << " small clusters"
+                     << " from "
+                     << mediumClusters.GetCluster(nClusters).size() 
+                     << " hits");
+        for (int i=0; i<nClusters; ++i) {
+            const typename ClusterAlgorithm::Points& points 
+                = smallClusters.GetCluster(i);
+            CP::THandle<CP::TReconCluster> cluster
+                = CreateCluster("cluster",points.begin(),points.end());
+            small.push_back(cluster);
+        }
+    }
+}
+
 CP::TDisassociateHits::TDisassociateHits()
     : TAlgorithm("TDisassociateHits", 
                  "Break up objects into separate hits") {
+    fGridNeighbors = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.gridNeighbors");
 }
 
 CP::TDisassociateHits::~TDisassociateHits() { }
@@ -110,61 +183,14 @@ CP::TDisassociateHits::Process(const CP::TAlgorithmResult& input,
     std::set< CP::THandle<CP::THit> > hits;
     CP::hits::ReconHits(disassociate->begin(), disassociate->end(), hits);
 
-    typedef CP::TPositionDensityCluster< CP::THandle<THit> > ClusterAlgorithm;
-
-    // Find the big clusters.
-    ClusterAlgorithm bigClusters(12,8*unit::mm);
-    bigClusters.Cluster(hits.begin(), hits.end());
-    
-    int nClusters = bigClusters.GetClusterCount();
-    CaptNamedLog("TDisassociateHits",
-                 "With " << nClusters << " big clusters"
-                 << " from " << hits.size() << " hits");
-    for (int i=0; i<nClusters; ++i) {
-        const ClusterAlgorithm::Points& points 
-            = bigClusters.GetCluster(i);
-        CP::THandle<CP::TReconCluster> cluster
-            = CreateCluster("cluster",points.begin(),points.end());
-        big->push_back(cluster);
+    if (fGridNeighbors) {
+        SplitClusters<GridCluster>(hits.begin(), hits.end(), *big, *small);
     }
-    
-    // Find the medium clusters.
-    ClusterAlgorithm mediumClusters(6,8*unit::mm);
-    mediumClusters.Cluster(bigClusters.GetCluster(nClusters).begin(), 
-                           bigClusters.GetCluster(nClusters).end());
-    
-    nClusters = mediumClusters.GetClusterCount();
-    CaptNamedLog("TDisassociateHits",
-                 "With " << nClusters << " medium clusters"
-                 << " from " << bigClusters.GetCluster(nClusters).size() 
-                 << " hits");
-    
-    for (int i=0; i<nClusters; ++i) {
-        const ClusterAlgorithm::Points& points 
-            = mediumClusters.GetCluster(i);
-        CP::THandle<CP::TReconCluster> cluster
-            = CreateCluster("cluster",points.begin(),points.end());
-        small->push_back(cluster);
-    }
-    
-    // Find the small clusters.
-    ClusterAlgorithm smallClusters(1,8*unit::mm);
-    smallClusters.Cluster(mediumClusters.GetCluster(nClusters).begin(), 
-                            mediumClusters.GetCluster(nClusters).end());
-    
-    nClusters = smallClusters.GetClusterCount();
-    CaptNamedLog("TDisassociateHits",
-                 "With " << nClusters << " small clusters"
-                 << " from " << mediumClusters.GetCluster(nClusters).size() 
-                 << " hits");
-    for (int i=0; i<nClusters; ++i) {
-        const ClusterAlgorithm::Points& points 
-            = smallClusters.GetCluster(i);
-        CP::THandle<CP::TReconCluster> cluster
-            = CreateCluster("cluster",points.begin(),points.end());
-        small->push_back(cluster);
+    else {
+        SplitClusters<IterativeCluster>(hits.begin(), hits.end(),
+                                        *big, *small);
     }
-    
+
     std::sort(final->begin(), final->end(), CompareReconObjects());
     std::sort(tracks->begin(), tracks->end(), CompareReconObjects());
     std::sort(big->begin(), big->end(), CompareReconObjects());
@@ -32,5 +32,9 @@ public:
             const CP::TAlgorithmResult& input2 = CP::TAlgorithmResult::Empty);
 
 private:
+    /// If true, the hits are clustered using TGridNeighbors to find the
+    /// neighboring hits instead of TIterativeNeighbors.  This is set using
+    /// captRecon.gridNeighbors.
+    bool fGridNeighbors;
 };
 #endif
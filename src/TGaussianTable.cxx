@@ -0,0 +1,30 @@
+#include "TGaussianTable.hxx"
+
+const CP::TGaussianTable& CP::TGaussianTable::Get() {
+    static CP::TGaussianTable table;
+    return table;
+}
+
+CP::TGaussianTable::TGaussianTable() : fScale(512.0), fEntries(8*512) {
+    // The weight at the edge of the table (8 sigma) is about 1E-14, so
+    // treating it as zero outside the table doesn't matter.
+    fTable.resize(fEntries+1);
+    for (std::size_t i = 0; i < fTable.size(); ++i) {
+        double t = i/fScale;
+        fTable[i] = std::exp(-0.5*t*t);
+    }
+}
+
+CP::TGaussianTable::~TGaussianTable() {}
+
+double CP::TGaussianTable::WeightedSum(const double* samples, int count,
+                                       double t0, double dt,
+                                       double tMax) const {
+    double sum = 0.0;
+    for (int i = 0; i < count; ++i) {
+        double t = t0 + dt*i;
+        if (t > tMax) break;
+        sum += Value(t)*samples[i];
+    }
+    return sum;
+}
@@ -0,0 +1,61 @@
+#ifndef TGaussianTable_hxx_seen
+#define TGaussianTable_hxx_seen
+
+#include <vector>
+#include <cmath>
+
+namespace CP {
+    class TGaussianTable;
+};
+
+/// A table of the (unnormalized) Gaussian weight exp(-0.5*t*t) where t is
+/// measured in units of the sigma.  The weight is linearly interpolated
+/// between table entries, which is accurate to better than 1E-6, and is zero
+/// outside of the table range (|t| >= GetRange()).  This is used to weight
+/// the time samples of a wire hit by the time distribution of a 3D hit (see
+/// TCluster3D::FindOverlap) without calling std::exp for every sample.  The
+/// table is shared by all users and is accessed with
+///
+/// \code
+/// const CP::TGaussianTable& gaussian = CP::TGaussianTable::Get();
+/// double w = gaussian.Value(t);
+/// \endcode
+class CP::TGaussianTable {
+public:
+    /// Get the table shared by all of the users.
+    static const TGaussianTable& Get();
+
+    virtual ~TGaussianTable();
+
+    /// Return exp(-0.5*t*t) interpolated from the table.
+    double Value(double t) const {
+        double x = std::abs(t)*fScale;
+        if (!(x < fEntries)) return 0.0;
+        int i = x;
+        double f = x - i;
+        return fTable[i] + f*(fTable[i+1] - fTable[i]);
+    }
+
+    /// Return the sum of samples[i]*Value(t0 + i*dt) for the samples where
+    /// t0 + i*dt is not more than tMax.  The step, dt, must be positive, and
+    /// the loop stops at the first sample after tMax.
+    double WeightedSum(const double* samples, int count,
+                       double t0, double dt, double tMax) const;
+
+    /// The range of the table in units of sigma.
+    double GetRange() const {return fEntries/fScale;}
+
+private:
+    TGaussianTable();
+
+    /// The number of table entries per sigma.
+    double fScale;
+
+    /// The number of intervals in the table.
+    int fEntries;
+
+    /// The values of exp(-0.5*t*t) at t = i/fScale.  There is an extra entry
+    /// so the interpolation never reads past the end.
+    std::vector<double> fTable;
+};
+#endif
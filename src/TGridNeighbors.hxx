@@ -0,0 +1,282 @@
+#ifndef TGridNeighbors_hxx_seen
+#define TGridNeighbors_hxx_seen
+
+#include <TMatrixD.h>
+#include <TVector3.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace CP {
+    template<typename ValueType> class TGridNeighbors;
+}
+
+/// A template to quickly find all of the points that are within a fixed
+/// radius of a position.  This has the same interface for adding points
+/// (and the same anisotropic basis) as TIterativeNeighbors, but only
+/// provides the ForEachWithin() radius search.  The points are not returned
+/// in order of increasing distance, so there isn't a priority queue to
+/// maintain, and a search costs O(local density).  This is used like this:
+///
+/// \code
+/// typedef CP::TGridNeighbors< CP::THandle<CP::THit> > Neighbors;
+/// Neighbors neighbors(10*unit::mm);
+///
+/// for (CP::THitSelection::iterator h = hits.begin(); h!= hits.end(); ++h) {
+///    neighbors.AddPoint((*h),
+///                       (*h)->GetPosition().X(),
+///                       (*h)->GetPosition().Y(),
+///                       (*h)->GetPosition().Z());
+/// }
+///
+/// struct Print {
+///     bool operator()(const CP::THandle<CP::THit>& hit, float dist2) {
+///         std::cout << "The neighbor " << hit
+///                   << " is " << std::sqrt(dist2) << " away" << std::endl;
+///         return true;
+///     }
+/// } print;
+/// neighbors.ForEachWithin(0.0, 0.0, 0.0, 10*unit::mm, print);
+/// \endcode
+///
+/// The points are kept in a uniform grid of cubic cells (in the transformed
+/// coordinates) sorted by cell, and a search only looks at the cells that
+/// overlap the search sphere.  The search is fastest when the cell size is
+/// close to the search radius.  The template argument is the type of a value
+/// to be attached to each point.  Typically, this is a hit or a cluster.
+template<typename ValueType>
+class CP::TGridNeighbors {
+public:
+    /// Create an empty set of points that will be filled using the AddPoint()
+    /// method.  The cell size is the length of the side of a grid cell.  If
+    /// it is zero, the cell size is set to the radius of the first search.
+    explicit TGridNeighbors(double cellSize = 0.0)
+        : fCellSize(cellSize), fBuilt(false) {
+        for (int i=0; i<3; ++i) {
+            for (int j=0; j<3; ++j) {
+                fMetric[i][j] = (i==j) ? 1.0: 0.0;
+            }
+        }
+    }
+
+    /// Create an empty set of points that will be filled using the AddPoint()
+    /// method.  The distance between points is euclidean in the basis
+    /// defined by e1, e2 and e3 (see TIterativeNeighbors), and the cell size
+    /// is in the same basis.
+    TGridNeighbors(const TVector3& e1,
+                   const TVector3& e2,
+                   const TVector3& e3,
+                   double cellSize = 0.0)
+        : fCellSize(cellSize), fBuilt(false) {
+        TMatrixD metric(3,3);
+        for (int i=0; i<3; ++i) {
+            metric(0,i) = e1(i);
+            metric(1,i) = e2(i);
+            metric(2,i) = e3(i);
+        }
+        metric.Invert();
+        for (int i=0; i<3; ++i) {
+            for (int j=0; j<3; ++j) {
+                fMetric[i][j] = metric(i,j);
+            }
+        }
+    }
+
+    virtual ~TGridNeighbors() {}
+
+    /// Add a new point to the neighbor search.  The first argument is the
+    /// value associated with the point, and the remaining three are the
+    /// cartesian coordinates of the point.  The grid is rebuilt by the next
+    /// search.
+    virtual void AddPoint(const ValueType& v,
+                          double x, double y, double z) {
+        Point point;
+        point.fValue = v;
+        Transform(x,y,z,point.fVec);
+        fPoints.push_back(point);
+        fBuilt = false;
+    }
+
+    /// Call the visitor for every point within radius of the position.  The
+    /// visitor is called as "bool visitor(const ValueType& value, float
+    /// dist2)" where dist2 is the squared distance to the point (calculated
+    /// the same way as TIterativeNeighbors).  The search stops if the
+    /// visitor returns false.  The points are visited in an arbitrary order.
+    template <class Visitor>
+    void ForEachWithin(double x, double y, double z, double radius,
+                       Visitor& visitor) {
+        if (fPoints.empty()) return;
+        if (!fBuilt) Build(radius);
+        float vec[3];
+        Transform(x,y,z,vec);
+        double dist2 = radius*radius;
+        int low[3];
+        int high[3];
+        for (int i=0; i<3; ++i) {
+            low[i] = CellIndex(vec[i]-radius, i);
+            high[i] = CellIndex(vec[i]+radius, i);
+            if (high[i] < 0 || low[i] >= fCells[i]) return;
+            low[i] = std::max(low[i],0);
+            high[i] = std::min(high[i],fCells[i]-1);
+        }
+        // The cells with the same first two indices are contiguous, so each
+        // row of cells is a single range of the sorted keys.
+        for (int ix = low[0]; ix <= high[0]; ++ix) {
+            for (int iy = low[1]; iy <= high[1]; ++iy) {
+                long long first = Key(ix,iy,low[2]);
+                long long last = Key(ix,iy,high[2]);
+                std::size_t p = std::lower_bound(fKeys.begin(), fKeys.end(),
+                                                 first) - fKeys.begin();
+                for (; p < fKeys.size() && fKeys[p] <= last; ++p) {
+                    const Point& point = fPoints[p];
+                    float d2 = 0.0;
+                    for (int i=0; i<3; ++i) {
+                        float d = vec[i] - point.fVec[i];
+                        d2 += d*d;
+                    }
+                    if (d2 > dist2) continue;
+                    if (!visitor(point.fValue, d2)) return;
+                }
+            }
+        }
+    }
+
+    /// The number of points in the neighbor search.
+    std::size_t size() const {return fPoints.size();}
+
+    /// True if there are no points in the neighbor search.
+    bool empty() const {return fPoints.empty();}
+
+    /// The length of the side of a grid cell.  This is zero until the first
+    /// search if it wasn't set in the constructor.
+    double GetCellSize() const {return fCellSize;}
+
+private:
+    /// An internal representation of a point.  The position is in the
+    /// transformed coordinates and, like TIterativeNeighbors, doesn't need
+    /// much precision.
+    struct Point {
+        float fVec[3];
+        ValueType fValue;
+    };
+
+    /// Order the points by the key of the cell that contains them.
+    struct KeyOrdering {
+        explicit KeyOrdering(const std::vector<long long>& keys)
+            : fKeys(keys) {}
+        bool operator() (std::size_t lhs, std::size_t rhs) const {
+            return fKeys[lhs] < fKeys[rhs];
+        }
+        const std::vector<long long>& fKeys;
+    };
+
+    /// Transform from the external coordinate system to the internal one.
+    /// This is the same transformation as TIterativeNeighbors.
+    void Transform(double x, double y, double z, float* vec) const {
+        float xf = x;
+        float yf = y;
+        float zf = z;
+        for (int i=0; i<3; ++i) {
+            vec[i] = fMetric[i][0]*xf + fMetric[i][1]*yf + fMetric[i][2]*zf;
+        }
+    }
+
+    /// The unclamped cell index of a transformed coordinate along an axis.
+    int CellIndex(double coord, int axis) const {
+        double index = std::floor((coord - fLow[axis])/fCellSize);
+        if (index < -1.0) return -1;
+        if (index > fCells[axis]) return fCells[axis];
+        return (int) index;
+    }
+
+    /// The sort key for a cell.
+    long long Key(int ix, int iy, int iz) const {
+        return (1LL*ix*fCells[1] + iy)*fCells[2] + iz;
+    }
+
+    /// Sort the points by cell.  The radius is used to set the cell size if
+    /// it wasn't set in the constructor.
+    void Build(double radius) {
+        if (fCellSize <= 0.0) fCellSize = radius;
+        if (fCellSize <= 0.0) fCellSize = 1.0;
+        double high[3];
+        for (int i=0; i<3; ++i) {
+            fLow[i] = fPoints.front().fVec[i];
+            high[i] = fPoints.front().fVec[i];
+        }
+        for (typename std::vector<Point>::iterator p = fPoints.begin();
+             p != fPoints.end(); ++p) {
+            for (int i=0; i<3; ++i) {
+                fLow[i] = std::min(fLow[i], (double) p->fVec[i]);
+                high[i] = std::max(high[i], (double) p->fVec[i]);
+            }
+        }
+        // Make sure the number of cells along each axis fits into an int, and
+        // the cell keys fit into a long long.  The number of cells is found
+        // as a double so it can't overflow.  This only changes the cell size
+        // for very sparse points.
+        const double maxCells = 1<<20;
+        while (true) {
+            double cells[3];
+            double total = 1.0;
+            for (int i=0; i<3; ++i) {
+                cells[i] = std::floor((high[i]-fLow[i])/fCellSize) + 1;
+                total *= cells[i];
+            }
+            if (cells[0] <= maxCells && cells[1] <= maxCells
+                && cells[2] <= maxCells && total < 1E18) {
+                for (int i=0; i<3; ++i) fCells[i] = (int) cells[i];
+                break;
+            }
+            fCellSize *= 2.0;
+        }
+        std::vector<long long> keys(fPoints.size());
+        std::vector<std::size_t> order(fPoints.size());
+        for (std::size_t p = 0; p < fPoints.size(); ++p) {
+            int index[3];
+            for (int i=0; i<3; ++i) {
+                index[i] = CellIndex(fPoints[p].fVec[i], i);
+                index[i] = std::max(0,std::min(index[i],fCells[i]-1));
+            }
+            keys[p] = Key(index[0],index[1],index[2]);
+            order[p] = p;
+        }
+        std::stable_sort(order.begin(), order.end(), KeyOrdering(keys));
+        std::vector<Point> points;
+        points.reserve(fPoints.size());
+        fKeys.resize(fPoints.size());
+        for (std::size_t p = 0; p < order.size(); ++p) {
+            points.push_back(fPoints[order[p]]);
+            fKeys[p] = keys[order[p]];
+        }
+        fPoints.swap(points);
+        fBuilt = true;
+    }
+
+    /// The points sorted by the key of the cell that contains them (once the
+    /// grid is built).
+    std::vector<Point> fPoints;
+
+    /// The cell key for each point in fPoints.
+    std::vector<long long> fKeys;
+
+    /// The length of the side of a cell in the transformed coordinates.
+    double fCellSize;
+
+    /// The transformed coordinate of the lower corner of the grid.
+    double fLow[3];
+
+    /// The number of cells along each axis.
+    int fCells[3];
+
+    /// True if the points are sorted into the grid.
+    bool fBuilt;
+
+    /// A matrix to transform from the external coordinate system to an
+    /// internal coordinate system that is used to calculate the distance
+    /// between points.  The distance is euclidean in the transformed
+    /// coordinate system.
+    float fMetric[3][3];
+};
+#endif
@@ -0,0 +1,65 @@
+#include "THitRegistry.hxx"
+
+#include <algorithm>
+
+CP::THitRegistry::THitRegistry() {}
+
+CP::THitRegistry::~THitRegistry() {}
+
+void CP::THitRegistry::Clear() {
+    fHits.clear();
+    std::fill(fKeys.begin(), fKeys.end(), (const CP::THit*) NULL);
+}
+
+void CP::THitRegistry::Reserve(std::size_t hits) {
+    fHits.reserve(hits);
+    std::size_t slots = 16;
+    while (slots < 2*hits) slots *= 2;
+    if (fKeys.size() < slots) Rehash(slots);
+}
+
+std::size_t CP::THitRegistry::Slot(const CP::THit* hit) const {
+    // Mix the pointer bits (the low bits are always zero because of the
+    // alignment) and then search linearly for the hit or an empty slot.
+    std::size_t mask = fKeys.size() - 1;
+    std::size_t key = reinterpret_cast<std::size_t>(hit);
+    key ^= key >> 17;
+    key *= 0x9E3779B1U;
+    key ^= key >> 15;
+    std::size_t slot = key & mask;
+    while (fKeys[slot] && fKeys[slot] != hit) slot = (slot + 1) & mask;
+    return slot;
+}
+
+void CP::THitRegistry::Rehash(std::size_t slots) {
+    fKeys.assign(slots, (const CP::THit*) NULL);
+    fIds.assign(slots, -1);
+    for (std::size_t i = 0; i < fHits.size(); ++i) {
+        const CP::THit* hit = CP::GetPointer(fHits[i]);
+        std::size_t slot = Slot(hit);
+        fKeys[slot] = hit;
+        fIds[slot] = i;
+    }
+}
+
+int CP::THitRegistry::Register(const CP::THandle<CP::THit>& hit) {
+    // Keep the table at most half full.
+    if (fKeys.size() < 2*(fHits.size()+1)) {
+        Rehash(std::max((std::size_t) 16, 2*fKeys.size()));
+    }
+    const CP::THit* pointer = CP::GetPointer(hit);
+    std::size_t slot = Slot(pointer);
+    if (fKeys[slot]) return fIds[slot];
+    int id = fHits.size();
+    fHits.push_back(hit);
+    fKeys[slot] = pointer;
+    fIds[slot] = id;
+    return id;
+}
+
+int CP::THitRegistry::Find(const CP::THandle<CP::THit>& hit) const {
+    if (fKeys.empty()) return -1;
+    std::size_t slot = Slot(CP::GetPointer(hit));
+    if (!fKeys[slot]) return -1;
+    return fIds[slot];
+}
@@ -0,0 +1,81 @@
+#ifndef THitRegistry_hxx_seen
+#define THitRegistry_hxx_seen
+
+#include <THit.hxx>
+#include <THandle.hxx>
+
+#include <vector>
+
+namespace CP {
+    class THitRegistry;
+};
+
+/// Give each hit seen during an event a dense integer identifier.  The
+/// identifiers are assigned in the order that the hits are registered
+/// (starting at zero), so they can be used as indices into flat vectors, or
+/// into a TDenseHitSet, instead of keeping std::map or std::set containers
+/// keyed by the hit handle.  Both wire hits and 3D hits can be registered.
+/// The registry is used like this:
+///
+/// \code
+/// CP::THitRegistry registry;
+/// std::vector<double> charge;
+/// for (CP::THitSelection::iterator h = hits.begin(); h != hits.end(); ++h) {
+///     int id = registry.Register(*h);
+///     if ((int) charge.size() <= id) charge.resize(id+1);
+///     charge[id] += (*h)->GetCharge();
+/// }
+/// \endcode
+///
+/// The hits are found using an open addressing hash table on the hit
+/// pointer, so registering and finding a hit doesn't allocate memory (except
+/// when the table grows).
+class CP::THitRegistry {
+public:
+    THitRegistry();
+    virtual ~THitRegistry();
+
+    /// Remove all of the hits from the registry.  The memory is kept so the
+    /// registry can be reused for the next event.
+    void Clear();
+
+    /// Reserve space for a number of hits.
+    void Reserve(std::size_t hits);
+
+    /// Get the identifier for a hit, and add the hit to the registry if it
+    /// hasn't been seen before.
+    int Register(const CP::THandle<CP::THit>& hit);
+
+    /// Get the identifier for a hit.  This returns -1 if the hit hasn't been
+    /// registered.
+    int Find(const CP::THandle<CP::THit>& hit) const;
+
+    /// Get the hit for an identifier.
+    const CP::THandle<CP::THit>& GetHit(int id) const {return fHits[id];}
+
+    /// The number of hits in the registry.  The identifiers run from zero to
+    /// size()-1.
+    std::size_t size() const {return fHits.size();}
+
+    /// True if there are no hits in the registry.
+    bool empty() const {return fHits.empty();}
+
+private:
+    /// Find the slot in the hash table for a hit pointer.  The slot either
+    /// holds the pointer, or is empty.
+    std::size_t Slot(const CP::THit* hit) const;
+
+    /// Resize the hash table and reinsert all of the hits.
+    void Rehash(std::size_t slots);
+
+    /// The registered hits indexed by the identifier.
+    std::vector< CP::THandle<CP::THit> > fHits;
+
+    /// The hash table of hit pointers.  Empty slots are NULL.  The size is
+    /// always a power of two.
+    std::vector<const CP::THit*> fKeys;
+
+    /// The identifier for the hit in the same slot of fKeys.
+    std::vector<int> fIds;
+};
+#endif
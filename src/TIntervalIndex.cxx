@@ -0,0 +1,114 @@
+#include "TIntervalIndex.hxx"
+
+#include <TCaptLog.hxx>
+
+#include <algorithm>
+
+namespace {
+    /// Order the intervals by the start time, and then by the value so the
+    /// order doesn't depend on the order of insertion.
+    struct IntervalOrder {
+        IntervalOrder(const std::vector<double>& begin,
+                      const std::vector<int>& value)
+            : fBegin(begin), fValue(value) {}
+        bool operator () (int lhs, int rhs) const {
+            if (fBegin[lhs] < fBegin[rhs]) return true;
+            if (fBegin[rhs] < fBegin[lhs]) return false;
+            return fValue[lhs] < fValue[rhs];
+        }
+        const std::vector<double>& fBegin;
+        const std::vector<int>& fValue;
+    };
+
+    /// Fill the maximum end of each node in the implicit tree.
+    double FillMaxEnd(std::vector<double>& maxEnd,
+                      const std::vector<double>& end,
+                      int node, int lo, int hi) {
+        if (hi - lo == 1) {
+            maxEnd[node] = end[lo];
+            return maxEnd[node];
+        }
+        int mid = (lo + hi)/2;
+        double left = FillMaxEnd(maxEnd, end, 2*node+1, lo, mid);
+        double right = FillMaxEnd(maxEnd, end, 2*node+2, mid, hi);
+        maxEnd[node] = std::max(left,right);
+        return maxEnd[node];
+    }
+};
+
+CP::TIntervalIndex::TIntervalIndex() : fBuilt(true) {}
+
+CP::TIntervalIndex::~TIntervalIndex() {}
+
+void CP::TIntervalIndex::Clear() {
+    fBegin.clear();
+    fEnd.clear();
+    fValue.clear();
+    fMaxEnd.clear();
+    fBuilt = true;
+}
+
+void CP::TIntervalIndex::Add(double begin, double end, int value) {
+    fBegin.push_back(begin);
+    fEnd.push_back(end);
+    fValue.push_back(value);
+    fBuilt = false;
+}
+
+void CP::TIntervalIndex::Build() {
+    std::vector<int> order(fBegin.size());
+    for (std::size_t i = 0; i<order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), IntervalOrder(fBegin,fValue));
+
+    std::vector<double> begin(order.size());
+    std::vector<double> end(order.size());
+    std::vector<int> value(order.size());
+    for (std::size_t i = 0; i<order.size(); ++i) {
+        begin[i] = fBegin[order[i]];
+        end[i] = fEnd[order[i]];
+        value[i] = fValue[order[i]];
+    }
+    fBegin.swap(begin);
+    fEnd.swap(end);
+    fValue.swap(value);
+
+    fMaxEnd.clear();
+    if (!fBegin.empty()) {
+        fMaxEnd.resize(4*fBegin.size());
+        FillMaxEnd(fMaxEnd, fEnd, 0, 0, fBegin.size());
+    }
+    fBuilt = true;
+}
+
+int CP::TIntervalIndex::CountBefore(double time) const {
+    return std::upper_bound(fBegin.begin(), fBegin.end(), time)
+        - fBegin.begin();
+}
+
+void CP::TIntervalIndex::Collect(int node, int lo, int hi, int limit,
+                                 double begin,
+                                 std::vector<int>& output) const {
+    if (limit <= lo) return;
+    if (fMaxEnd[node] < begin) return;
+    if (hi - lo == 1) {
+        output.push_back(fValue[lo]);
+        return;
+    }
+    int mid = (lo + hi)/2;
+    Collect(2*node+1, lo, mid, limit, begin, output);
+    Collect(2*node+2, mid, hi, limit, begin, output);
+}
+
+void CP::TIntervalIndex::Find(double begin, double end,
+                              std::vector<int>& output) const {
+    if (!fBuilt) {
+        CaptError("Interval index searched before being built");
+        return;
+    }
+    if (fBegin.empty()) return;
+    int limit = CountBefore(end);
+    if (limit < 1) return;
+    std::size_t first = output.size();
+    Collect(0, 0, fBegin.size(), limit, begin, output);
+    std::sort(output.begin()+first, output.end());
+}
@@ -0,0 +1,88 @@
+#ifndef TIntervalIndex_hxx_seen
+#define TIntervalIndex_hxx_seen
+
+#include <vector>
+
+namespace CP {
+    class TIntervalIndex;
+};
+
+/// A static index of closed intervals ([begin, end]) that can be quickly
+/// searched for all of the intervals overlapping a query range.  Each
+/// interval carries an integer value which is usually an index into a vector
+/// (or THitSelection) owned by the caller.  This is used by TCluster3D to
+/// find the wire hits on one plane that overlap in (drift corrected) time
+/// with a wire hit on another plane.  The index is used like this:
+///
+/// \code
+/// CP::TIntervalIndex index;
+/// for (std::size_t i = 0; i < hits.size(); ++i) {
+///     index.Add(hits[i]->GetTimeStart(), hits[i]->GetTimeStop(), i);
+/// }
+/// index.Build();
+///
+/// std::vector<int> overlaps;
+/// index.Find(begin, end, overlaps);
+/// \endcode
+///
+/// The intervals are kept sorted by the start of the interval with a
+/// implicit binary tree holding the maximum end time of each sub-range, so a
+/// search costs O(log(n) + k) where k is the number of overlapping
+/// intervals.  Intervals that touch at an end point are considered to
+/// overlap (the same definition TCluster3D uses for the drift corrected
+/// wire hit times).
+class CP::TIntervalIndex {
+public:
+    TIntervalIndex();
+    virtual ~TIntervalIndex();
+
+    /// Remove all of the intervals from the index.
+    void Clear();
+
+    /// Add a new interval to the index.  The index must be rebuilt (using
+    /// Build()) before it can be searched.
+    void Add(double begin, double end, int value);
+
+    /// Build the search tree.  This must be called after all of the
+    /// intervals have been added, and before Find() is used.
+    void Build();
+
+    /// Find the values for all intervals that overlap the range [begin,end].
+    /// The values are appended to the output vector in increasing order so
+    /// that if the values are indices into a sorted vector, the original
+    /// ordering is preserved.
+    void Find(double begin, double end, std::vector<int>& output) const;
+
+    /// The number of intervals in the index.
+    std::size_t size() const {return fBegin.size();}
+
+    /// True if there are no intervals in the index.
+    bool empty() const {return fBegin.empty();}
+
+private:
+    /// Recursively collect the overlapping intervals below a node.  The node
+    /// covers the intervals in [lo,hi), and only the first "limit" intervals
+    /// can overlap since the rest start after the end of the query.
+    void Collect(int node, int lo, int hi, int limit, double begin,
+                 std::vector<int>& output) const;
+
+    /// The number of intervals that begin at or before time.
+    int CountBefore(double time) const;
+
+    /// The start of each interval, sorted in increasing order.
+    std::vector<double> fBegin;
+
+    /// The end of each interval in the same order as fBegin.
+    std::vector<double> fEnd;
+
+    /// The value attached to each interval in the same order as fBegin.
+    std::vector<int> fValue;
+
+    /// An implicit binary tree (node i has children 2i+1 and 2i+2) holding
+    /// the maximum end of all intervals covered by the node.
+    std::vector<double> fMaxEnd;
+
+    /// True if the search tree matches the intervals.
+    bool fBuilt;
+};
+#endif
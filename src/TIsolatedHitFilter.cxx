@@ -0,0 +1,225 @@
+#include "TIsolatedHitFilter.hxx"
+#include "TDriftPosition.hxx"
+#include "TWireCrossings.hxx"
+
+#include <THandle.hxx>
+#include <THit.hxx>
+#include <TCaptLog.hxx>
+#include <CaptGeomId.hxx>
+#include <HEPUnits.hxx>
+#include <TRuntimeParameters.hxx>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <cmath>
+
+namespace {
+    /// A wire hit with the drift corrected time range.  The hit is the
+    /// index in the input selection.
+    struct gridHit {
+        int fHit;
+        int fWire;
+        double fStart;
+        double fStop;
+    };
+
+    /// Order the hits in a time bin by the wire number.
+    struct compareGridWires {
+        bool operator () (const gridHit& lhs, const gridHit& rhs) const {
+            if (lhs.fWire < rhs.fWire) return true;
+            if (rhs.fWire < lhs.fWire) return false;
+            return lhs.fHit < rhs.fHit;
+        }
+    };
+
+    /// The occupancy of one wire plane.  The hits are binned by the start
+    /// of the drift corrected time range and the hits in each bin are
+    /// sorted by wire.  The hits in bin b are [fOffset[b], fOffset[b+1]) in
+    /// fHits.
+    struct occupancyGrid {
+        double fOrigin;
+        double fBinWidth;
+        double fMaxLength;
+        std::vector<int> fOffset;
+        std::vector<gridHit> fHits;
+
+        int Bins() const {return fOffset.size() - 1;}
+
+        /// The bin containing a time, clamped to the grid.
+        int Bin(double t) const {
+            double b = std::floor((t - fOrigin)/fBinWidth);
+            if (b < 0) return 0;
+            if (b > Bins()-1) return Bins()-1;
+            return b;
+        }
+
+        void Fill(const std::vector<gridHit>& hits, double width) {
+            fBinWidth = width;
+            fOrigin = 0.0;
+            fMaxLength = 0.0;
+            fOffset.assign(1, 0);
+            fHits.clear();
+            if (hits.empty()) return;
+            double last = hits.front().fStart;
+            fOrigin = last;
+            for (std::vector<gridHit>::const_iterator h = hits.begin();
+                 h != hits.end(); ++h) {
+                fOrigin = std::min(fOrigin, h->fStart);
+                last = std::max(last, h->fStart);
+                fMaxLength = std::max(fMaxLength, h->fStop - h->fStart);
+            }
+            int bins = std::floor((last - fOrigin)/fBinWidth) + 1;
+            fOffset.assign(bins+1, 0);
+            for (std::vector<gridHit>::const_iterator h = hits.begin();
+                 h != hits.end(); ++h) {
+                ++fOffset[Bin(h->fStart)+1];
+            }
+            for (int b = 0; b < bins; ++b) fOffset[b+1] += fOffset[b];
+            std::vector<int> next(fOffset.begin(), fOffset.end()-1);
+            fHits.resize(hits.size());
+            for (std::vector<gridHit>::const_iterator h = hits.begin();
+                 h != hits.end(); ++h) {
+                fHits[next[Bin(h->fStart)]++] = *h;
+            }
+            for (int b = 0; b < bins; ++b) {
+                std::sort(fHits.begin() + fOffset[b],
+                          fHits.begin() + fOffset[b+1],
+                          compareGridWires());
+            }
+        }
+    };
+
+    /// Check if wires on two different planes cross inside the length of
+    /// both wires.  The crossing table only has the X-V and X-U crossings,
+    /// so V and U wires are assumed to cross.
+    bool wiresCross(int plane1, int wire1, int plane2, int wire2) {
+        if (plane2 == CP::GeomId::Captain::kXPlane) {
+            std::swap(plane1, plane2);
+            std::swap(wire1, wire2);
+        }
+        if (plane1 != CP::GeomId::Captain::kXPlane) return true;
+        const CP::TWireCrossings& crossings = CP::TWireCrossings::Get();
+        if (plane2 == CP::GeomId::Captain::kVPlane) {
+            return crossings.CrossesXV(wire1, wire2);
+        }
+        return crossings.CrossesXU(wire1, wire2);
+    }
+
+    /// Check if a hit on one plane has a neighbor in the grid for a plane
+    /// (which may be the same plane).  The grid is binned by the hit start
+    /// time, so the bins are searched from the earliest start time of a hit
+    /// that can be in the time window.
+    bool hasNeighbor(const gridHit& hit, int plane,
+                     const occupancyGrid& grid, int gridPlane,
+                     double window, int wireWindow) {
+        if (grid.Bins() < 1) return false;
+        bool samePlane = (plane == gridPlane);
+        int first = grid.Bin(hit.fStart - window - grid.fMaxLength);
+        int last = grid.Bin(hit.fStop + window);
+        for (int b = first; b <= last; ++b) {
+            for (int i = grid.fOffset[b]; i < grid.fOffset[b+1]; ++i) {
+                const gridHit& other = grid.fHits[i];
+                if (samePlane) {
+                    if (other.fWire < hit.fWire - wireWindow) continue;
+                    if (hit.fWire + wireWindow < other.fWire) break;
+                    if (other.fHit == hit.fHit) continue;
+                }
+                if (hit.fStop + window < other.fStart) continue;
+                if (other.fStop + window < hit.fStart) continue;
+                if (!samePlane
+                    && !wiresCross(plane, hit.fWire,
+                                   gridPlane, other.fWire)) continue;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+CP::TIsolatedHitFilter::TIsolatedHitFilter()
+    : TAlgorithm("TIsolatedHitFilter", "Remove Isolated Wire Hits") {
+
+    fTimeWindow = CP::TRuntimeParameters::Get().GetParameterD(
+        "captRecon.isolatedHitFilter.timeWindow");
+    fTimeWindow = std::max(fTimeWindow, 1*unit::ns);
+
+    fWireWindow = CP::TRuntimeParameters::Get().GetParameterI(
+        "captRecon.isolatedHitFilter.wireWindow");
+}
+
+CP::TIsolatedHitFilter::~TIsolatedHitFilter() { }
+
+CP::THandle<CP::TAlgorithmResult>
+CP::TIsolatedHitFilter::Process(const CP::TAlgorithmResult& input,
+                                const CP::TAlgorithmResult&,
+                                const CP::TAlgorithmResult&) {
+
+    CP::THandle<CP::THitSelection> inputHits = input.GetHits();
+    if (!inputHits) {
+        CaptError("No input hits");
+        return CP::THandle<CP::TAlgorithmResult>();
+    }
+
+    CaptLog("TIsolatedHitFilter Process "
+            << GetEvent().GetContext()
+            << " w/ " <<  inputHits->size() << " hits");
+
+    CP::THandle<CP::TAlgorithmResult> result = CreateResult();
+
+    // Sort the wire hits by plane.
+    CP::TDriftPosition drift;
+    std::vector<gridHit> planeHits[3];
+    for (std::size_t i = 0; i < inputHits->size(); ++i) {
+        const CP::THit& hit = *(*inputHits)[i];
+        int plane = CP::GeomId::Captain::GetWirePlane(hit.GetGeomId());
+        if (plane < 0 || 2 < plane) continue;
+        int wire = CP::GeomId::Captain::GetWireNumber(hit.GetGeomId());
+        if (wire < 0) continue;
+        double driftTime = drift.GetTime(hit);
+        gridHit g;
+        g.fHit = i;
+        g.fWire = wire;
+        g.fStart = driftTime + hit.GetTimeStart() - hit.GetTime();
+        g.fStop = driftTime + hit.GetTimeStop() - hit.GetTime();
+        planeHits[plane].push_back(g);
+    }
+
+    occupancyGrid grids[3];
+    for (int p = 0; p < 3; ++p) grids[p].Fill(planeHits[p], fTimeWindow);
+
+    // Look for a neighbor for each hit, starting with the same plane.
+    std::vector<char> isolated(inputHits->size(), 0);
+    for (int p = 0; p < 3; ++p) {
+        for (std::vector<gridHit>::iterator h = planeHits[p].begin();
+             h != planeHits[p].end(); ++h) {
+            if (hasNeighbor(*h, p, grids[p], p,
+                            fTimeWindow, fWireWindow)) continue;
+            bool found = false;
+            for (int q = 0; q < 3 && !found; ++q) {
+                if (q == p) continue;
+                found = hasNeighbor(*h, p, grids[q], q,
+                                    fTimeWindow, fWireWindow);
+            }
+            if (!found) isolated[h->fHit] = 1;
+        }
+    }
+
+    // Save the hits in the input order.
+    std::unique_ptr<CP::THitSelection>
+        filtered(new CP::THitSelection("filtered"));
+    std::unique_ptr<CP::THitSelection>
+        rejected(new CP::THitSelection("rejected"));
+    for (std::size_t i = 0; i < inputHits->size(); ++i) {
+        if (isolated[i]) rejected->push_back((*inputHits)[i]);
+        else filtered->push_back((*inputHits)[i]);
+    }
+
+    CaptLog("  Kept hits: " << filtered->size()
+            << "  Isolated hits: " << rejected->size());
+
+    result->AddHits(rejected.release());
+    result->AddHits(filtered.release());
+
+    return result;
+}
@@ -0,0 +1,47 @@
+#ifndef TIsolatedHitFilter_hxx_seen
+#define TIsolatedHitFilter_hxx_seen
+#include <TAlgorithm.hxx>
+#include <TAlgorithmResult.hxx>
+
+namespace CP {
+    class TIsolatedHitFilter;
+};
+
+/// Take a hit selection of 2D wire hits and remove the isolated hits that
+/// can't be part of a 3D hit.  This is run before TCluster3D so that noise
+/// hits don't need to be considered in the (expensive) search for 3D hits.
+/// A wire hit is kept if there is another hit on the same plane within
+/// captRecon.isolatedHitFilter.wireWindow wires, or a hit on another plane
+/// with a wire that crosses it.  In both cases, the drift corrected time
+/// ranges of the hits must be within captRecon.isolatedHitFilter.timeWindow.
+/// The hits on each plane are binned in time (and sorted by wire in each
+/// bin), so only nearby hits are checked.  Hits that are not on a wire plane
+/// are always kept.  The output TAlgorithmResult will contain:
+///
+///   * rejected -- A hit selection of the isolated hits.
+///
+///   * filtered -- A hit selection of the hits that were kept.  This is the
+///                 default hit selection.
+class CP::TIsolatedHitFilter
+    : public CP::TAlgorithm {
+public:
+    TIsolatedHitFilter();
+    virtual ~TIsolatedHitFilter();
+
+    /// Apply the algorithm.
+    CP::THandle<CP::TAlgorithmResult>
+    Process(const CP::TAlgorithmResult& input,
+            const CP::TAlgorithmResult& input1 = CP::TAlgorithmResult::Empty,
+            const CP::TAlgorithmResult& input2 = CP::TAlgorithmResult::Empty);
+
+private:
+    /// The maximum time between the drift corrected time ranges of
+    /// neighboring hits.  This is also the width of the time bins.  This is
+    /// set using captRecon.isolatedHitFilter.timeWindow.
+    double fTimeWindow;
+
+    /// The maximum difference in wire number for neighboring hits on the
+    /// same plane.  This is set using captRecon.isolatedHitFilter.wireWindow.
+    int fWireWindow;
+};
+#endif
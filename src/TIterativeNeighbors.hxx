@@ -1,12 +1,15 @@
 #ifndef TIterativeNeighbors_hxx_seen
 #define TIterativeNeighbors_hxx_seen
 
-#include <CGAL/Search_traits.h>
-#include <CGAL/Orthogonal_incremental_neighbor_search.h>
-
 #include <TMatrixD.h>
 #include <TVector3.h>
 
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <cmath>
+
 namespace CP {
     template<typename ValueType> class TIterativeNeighbors;
 }
@@ -26,16 +29,24 @@ namespace CP {
 ///                       (*h)->GetPosition().Y(),
 ///                       (*h)->GetPosition().Z());
 /// }
-/// 
-/// for (Neighbors::iterator h 
+///
+/// for (Neighbors::iterator h
 ///          = neighbors.begin(0.0, 0.0, 0.0);
-///      h != neighbors.end(); ++h) { 
+///      h != neighbors.end(); ++h) {
 ///     std::cout << "The neighbor " << h->first
 ///               << " is " << std::sqrt(h->second) << " away"
 ///               << " std::endl;
 /// }
 /// \endcode
 ///
+/// The points are kept in a k-d tree that is stored in a flat vector (each
+/// node is the median point of a range of the vector), and the neighbors are
+/// found with a best-first search.  The search state is held by a TCursor
+/// which keeps its storage between searches, so once the cursor has grown to
+/// the size needed, a search doesn't allocate any memory.  The begin() method
+/// uses a cursor owned by the TIterativeNeighbors object, and more than one
+/// search can be active at the same time by using separate TCursor objects.
+///
 /// The template argument is the type of a value to be attached to each point.
 /// Typically, this is a hit or a cluster.
 template<typename ValueType>
@@ -55,30 +66,8 @@ public:
         Point() {fVec[0]=fVec[1]=fVec[2]=0.0;}
 
         /// A constructor for a point
-        Point(const value_t& v, double x, double y, double z) : fValue(v)
-            {fVec[0]=x; fVec[1]=y; fVec[2]=z;}
-        
-        /// A constructor from a position.
-        Point(double x, double y, double z) 
+        Point(const value_t& v, coord_t x, coord_t y, coord_t z) : fValue(v)
             {fVec[0]=x; fVec[1]=y; fVec[2]=z;}
-        
-        /// Used by CGAL to check for exact equality for numeric calculations. 
-        bool operator ==(const Point& rhs) {
-            for (int i=0; i<3; ++i) if (fVec[i] != rhs.fVec[i]) return false;
-            return true;
-        }
-        bool operator !=(const Point& rhs) {return !(*this == rhs);}
-
-        /// A constructor for iterator used by CGAL to access
-        /// the coordinates of this point.
-        struct coord_iterator {
-            /// The type returned by the coordinate iterator.
-            typedef const typename Point::coord_t* result_type;
-            result_type operator() (const Point& p) const 
-                {return static_cast<result_type>(p.fVec);}
-            result_type operator() (const Point& p, int) const 
-                {return static_cast<result_type>(p.fVec+3);}
-        };
 
         /// The position information for this point.
         coord_t fVec[3];
@@ -87,14 +76,139 @@ public:
         value_t fValue;
     };
 
-    /// A typedef required by CGAL.
-    typedef CGAL::Search_traits<
-        typename Point::coord_t, 
-        Point,
-        typename Point::coord_iterator::result_type,
-        typename Point::coord_iterator > TreeTraits;
-    /// A typedef required by CGAL.
-    typedef CGAL::Orthogonal_incremental_neighbor_search<TreeTraits> Neighbors;
+    /// A reusable search for the neighbors of a position.  The neighbors are
+    /// returned in order of closest to furthest.  The cursor keeps its
+    /// storage between searches.  This is used like this:
+    ///
+    /// \code
+    /// Neighbors::TCursor cursor(neighbors);
+    /// for (...) {
+    ///     cursor.Start(x,y,z);
+    ///     while (cursor.Next()) {
+    ///         if (cursor.GetNeighbor().second > threshold) break;
+    ///         std::cout << "Value: " << cursor.GetNeighbor().first;
+    ///     }
+    /// }
+    /// \endcode
+    ///
+    /// Points must not be added to the TIterativeNeighbors object while a
+    /// search is active.
+    class TCursor {
+    public:
+        /// The neighbor found by the search.  The first element is the value
+        /// at the point and the second element is the squared distance to
+        /// the search position.
+        typedef std::pair<ValueType, typename Point::coord_t> value_type;
+
+        explicit TCursor(TIterativeNeighbors& neighbors)
+            : fNeighbors(&neighbors) {}
+
+        /// Start a new search for the neighbors of a position.  This
+        /// abandons any previous search.
+        void Start(double x, double y, double z) {
+            fHeap.clear();
+            fNeighbors->Build();
+            fNeighbors->Transform(x,y,z,fQuery);
+            if (fNeighbors->fPoints.empty()) return;
+            Entry root;
+            root.fDist2 = 0.0;
+            root.fBegin = 0;
+            root.fEnd = fNeighbors->fPoints.size();
+            root.fOffset[0] = root.fOffset[1] = root.fOffset[2] = 0.0;
+            Push(root);
+        }
+
+        /// Move to the next closest neighbor.  This returns false when all
+        /// of the points have been returned.
+        bool Next() {
+            const std::vector<Point>& points = fNeighbors->fPoints;
+            while (!fHeap.empty()) {
+                std::pop_heap(fHeap.begin(), fHeap.end(), EntryOrdering());
+                Entry entry = fHeap.back();
+                fHeap.pop_back();
+                if (entry.fEnd < 0) {
+                    fNeighbor.first = points[entry.fBegin].fValue;
+                    fNeighbor.second = entry.fDist2;
+                    return true;
+                }
+                // Open a node.  The median point is queued with its distance,
+                // and the two sub-ranges are queued with the lower bound on
+                // the distance to any point they contain.
+                int middle = (entry.fBegin + entry.fEnd)/2;
+                const Point& point = points[middle];
+                Entry median;
+                median.fDist2 = Distance2(point);
+                median.fBegin = middle;
+                median.fEnd = -1;
+                Push(median);
+                int axis = fNeighbors->fAxis[middle];
+                float diff = fQuery[axis] - point.fVec[axis];
+                Entry low = entry;
+                low.fEnd = middle;
+                Entry high = entry;
+                high.fBegin = middle + 1;
+                Entry& far = (diff < 0.0) ? high : low;
+                far.fDist2 += diff*diff
+                    - entry.fOffset[axis]*entry.fOffset[axis];
+                far.fOffset[axis] = std::abs(diff);
+                if (low.fBegin < low.fEnd) Push(low);
+                if (high.fBegin < high.fEnd) Push(high);
+            }
+            return false;
+        }
+
+        /// The current neighbor.  This is only valid after Next() has
+        /// returned true.
+        const value_type& GetNeighbor() const {return fNeighbor;}
+
+    private:
+        /// An entry in the search queue.  This is either a point (fEnd is
+        /// negative and fBegin is the index of the point), or a range of
+        /// points [fBegin,fEnd).  The distance is the squared distance to
+        /// the point, or a lower bound on the squared distance to any point
+        /// in the range.  The offset is the component of the lower bound
+        /// along each axis.
+        struct Entry {
+            float fDist2;
+            int fBegin;
+            int fEnd;
+            float fOffset[3];
+        };
+
+        /// Order the search queue so the closest entry is first.
+        struct EntryOrdering {
+            bool operator() (const Entry& lhs, const Entry& rhs) const {
+                return lhs.fDist2 > rhs.fDist2;
+            }
+        };
+
+        void Push(const Entry& entry) {
+            fHeap.push_back(entry);
+            std::push_heap(fHeap.begin(), fHeap.end(), EntryOrdering());
+        }
+
+        /// The squared distance from the search position to a point.
+        float Distance2(const Point& point) const {
+            float dist2 = 0.0;
+            for (int i=0; i<3; ++i) {
+                float d = fQuery[i] - point.fVec[i];
+                dist2 += d*d;
+            }
+            return dist2;
+        }
+
+        /// The points being searched.
+        TIterativeNeighbors* fNeighbors;
+
+        /// The search position in the internal coordinates.
+        float fQuery[3];
+
+        /// The search queue.  This keeps its capacity between searches.
+        std::vector<Entry> fHeap;
+
+        /// The current neighbor.
+        value_type fNeighbor;
+    };
 
     /// An input iterator that returns the values in order of closest to
     /// furthest.  The iterator points to a std::pair<ValueType,float> where
@@ -104,42 +218,38 @@ public:
     /// be modified (even if you use const_cast.
     class iterator {
     public:
-        typedef typename Neighbors::iterator base_iterator;
-        typedef std::pair<ValueType, 
-                          typename base_iterator::value_type::second_type> 
-            value_type;
+        typedef typename TCursor::value_type value_type;
         typedef std::input_iterator_tag iterator_category;
-        iterator() {}
-        iterator(const base_iterator& i) : fBase(i) {}
-        iterator& operator ++() {++fBase; return *this;} 
-        const value_type& operator *() {
-            fValue.first = fBase->first.fValue;
-            fValue.second = fBase->second;
-            return fValue;
+        iterator() : fCursor(NULL) {}
+        explicit iterator(TCursor* cursor) : fCursor(cursor) {
+            if (fCursor && !fCursor->Next()) fCursor = NULL;
         }
-        const value_type* operator ->() {
-            fValue.first = fBase->first.fValue;
-            fValue.second = fBase->second;
-            return &fValue;
+        iterator& operator ++() {
+            if (!fCursor->Next()) fCursor = NULL;
+            return *this;
+        }
+        const value_type& operator *() const {return fCursor->GetNeighbor();}
+        const value_type* operator ->() const {
+            return &fCursor->GetNeighbor();
         }
-        bool operator == (const iterator& rhs) const {return fBase==rhs.fBase;}
+        bool operator == (const iterator& rhs) const {
+            return fCursor==rhs.fCursor;}
         bool operator !=(const iterator& rhs) const {return !((*this)==rhs);}
     private:
-        base_iterator fBase;
-        value_type fValue;
+        TCursor* fCursor;
     };
-        
+
     /// An input iterator over all of the values in the neighbor tree.  This
     /// does not interfere with the neighbor iterator.  The pointed to value
     /// is a constant.
     class value_iterator {
     public:
-        typedef typename Neighbors::Tree::iterator base_iterator;
+        typedef typename std::vector<Point>::const_iterator base_iterator;
         typedef ValueType value_type;
         typedef std::input_iterator_tag iterator_category;
         value_iterator() {}
         value_iterator(const base_iterator& i) : fBase(i) {}
-        value_iterator& operator ++() {++fBase; return *this;} 
+        value_iterator& operator ++() {++fBase; return *this;}
         const value_type& operator *() {
             return fBase->fValue;
         }
@@ -153,15 +263,15 @@ public:
     private:
         base_iterator fBase;
     };
-        
-    virtual ~TIterativeNeighbors() {if (fNeighbors) delete fNeighbors;}
+
+    virtual ~TIterativeNeighbors() {}
 
     /// Create an empty set of points that will be filled using the AddPoint()
     /// method.
-    TIterativeNeighbors() : fNeighbors(NULL), fMetric(3,3) {
+    TIterativeNeighbors() : fBuilt(false), fCursor(*this) {
         for (int i=0; i<3; ++i) {
             for (int j=0; j<3; ++j) {
-                fMetric(i,j) = (i==j) ? 1.0: 0.0;
+                fMetric[i][j] = (i==j) ? 1.0: 0.0;
             }
         }
     }
@@ -169,27 +279,64 @@ public:
     /// Create an empty set of points that will be filled using the AddPoint()
     /// method.
     TIterativeNeighbors(const TVector3& e1,
-                        const TVector3& e2,                        
+                        const TVector3& e2,
                         const TVector3& e3)
-        : fNeighbors(NULL), fMetric(3,3) {
+        : fBuilt(false), fCursor(*this) {
+        TMatrixD metric(3,3);
+        for (int i=0; i<3; ++i) {
+            metric(0,i) = e1(i);
+            metric(1,i) = e2(i);
+            metric(2,i) = e3(i);
+        }
+        metric.Invert();
+        for (int i=0; i<3; ++i) {
+            for (int j=0; j<3; ++j) {
+                fMetric[i][j] = metric(i,j);
+            }
+        }
+    }
+
+    /// Copy the points and the metric.  The copy gets its own cursor (the
+    /// cursor refers back to the object that owns it), so a search in
+    /// progress isn't copied.
+    TIterativeNeighbors(const TIterativeNeighbors& rhs)
+        : fPoints(rhs.fPoints), fAxis(rhs.fAxis), fBuilt(rhs.fBuilt),
+          fCursor(*this) {
+        for (int i=0; i<3; ++i) {
+            for (int j=0; j<3; ++j) {
+                fMetric[i][j] = rhs.fMetric[i][j];
+            }
+        }
+    }
+
+    /// Copy the points and the metric.  This abandons any search in
+    /// progress, and the cursor still refers to this object.
+    TIterativeNeighbors& operator = (const TIterativeNeighbors& rhs) {
+        if (this == &rhs) return *this;
+        fPoints = rhs.fPoints;
+        fAxis = rhs.fAxis;
+        fBuilt = rhs.fBuilt;
+        fCursor = TCursor(*this);
         for (int i=0; i<3; ++i) {
-            fMetric(0,i) = e1(i);
-            fMetric(1,i) = e2(i);
-            fMetric(2,i) = e3(i);
+            for (int j=0; j<3; ++j) {
+                fMetric[i][j] = rhs.fMetric[i][j];
+            }
         }
-        fMetric.Invert();
+        return *this;
     }
-    
+
     /// Add a new point to the neighbor search.  The first argument is the
     /// value associated with the point, and the remaining three are the
     /// cartesian coordinates of the point.  The cartesian coordinates are
-    /// used to define the neighbors of this point.
-    virtual void AddPoint(const ValueType& v, 
+    /// used to define the neighbors of this point.  The tree is rebuilt by
+    /// the next search.
+    virtual void AddPoint(const ValueType& v,
                           double x, double y, double z) {
-        double xp = fMetric(0,0)*x + fMetric(0,1)*y + fMetric(0,2)*z;
-        double yp = fMetric(1,0)*x + fMetric(1,1)*y + fMetric(1,2)*z;
-        double zp = fMetric(2,0)*x + fMetric(2,1)*y + fMetric(2,2)*z;
-        fNeighborTree.insert(Point(v,xp,yp,zp));
+        Point point;
+        point.fValue = v;
+        Transform(x,y,z,point.fVec);
+        fPoints.push_back(point);
+        fBuilt = false;
     }
 
     /// Get the neighbors.  This returns the neighbors in order of closest to
@@ -203,7 +350,7 @@ public:
     /// CP::TIterativeNeighbors<int>::iterator begin = neighbors.begin(0,0,0);
     /// CP::TIterativeNeighbors<int>::iterator end = neighbors.end();
     /// while (begin != end) {
-    ///    std::cout << "Value: " << begin->first 
+    ///    std::cout << "Value: " << begin->first
     ///              << " is " << std::sqrt(begin->second) << " away"
     ///              << std::endl;
     ///    if (begin->second > threshold) break;
@@ -211,48 +358,128 @@ public:
     /// }
     /// \endcode
     virtual iterator begin(double x, double y, double z) {
-        if (fNeighbors) delete fNeighbors;
-        double xp = fMetric(0,0)*x + fMetric(0,1)*y + fMetric(0,2)*z;
-        double yp = fMetric(1,0)*x + fMetric(1,1)*y + fMetric(1,2)*z;
-        double zp = fMetric(2,0)*x + fMetric(2,1)*y + fMetric(2,2)*z;
-        fNeighbors = new Neighbors(fNeighborTree, Point(xp,yp,zp));
-        iterator it(fNeighbors->begin());
-        fCurrentEnd = iterator(fNeighbors->end());
-        return it;
+        fCursor.Start(x,y,z);
+        return iterator(&fCursor);
     }
 
-    /// One past the last neighbor of the point.  This is invalidated by the
-    /// next call to begin.
+    /// One past the last neighbor of the point.
     virtual const iterator& end() const {return fCurrentEnd;}
 
+    /// Call the visitor for every point within radius of the position in
+    /// order of increasing distance.  The visitor is called as "bool
+    /// visitor(const ValueType& value, float dist2)" where dist2 is the
+    /// squared distance to the point, and the search stops if the visitor
+    /// returns false.  This has the same interface as
+    /// TGridNeighbors::ForEachWithin() and, since it uses the same cursor as
+    /// begin(), it invalidates any current neighbor iterators.
+    template <class Visitor>
+    void ForEachWithin(double x, double y, double z, double radius,
+                       Visitor& visitor) {
+        double dist2 = radius*radius;
+        fCursor.Start(x,y,z);
+        while (fCursor.Next()) {
+            const typename TCursor::value_type& neighbor
+                = fCursor.GetNeighbor();
+            if (neighbor.second > dist2) break;
+            if (!visitor(neighbor.first, neighbor.second)) break;
+        }
+    }
+
     /// Return an interator to all of the points in the neighbors search.
-    /// This does not invalidate the neighbors iterator (returned by begin()).
+    /// This does not invalidate the neighbors iterator (returned by begin()),
+    /// but is invalidated by adding a point.
     virtual value_iterator begin_values() {
-        return fNeighborTree.begin();
+        Build();
+        return value_iterator(fPoints.begin());
     }
 
     /// Return an interator to all of the points in the neighbors search.
-    /// This does not invalidate the neighbors iterator (returned by begin()).
+    /// This does not invalidate the neighbors iterator (returned by begin()),
+    /// but is invalidated by adding a point.
     virtual value_iterator end_values() {
-        return fNeighborTree.end();
+        Build();
+        return value_iterator(fPoints.end());
     }
 
 private:
-    /// A tree allocated to hold the mosts recent nearest neighbors.
-    Neighbors* fNeighbors;
+    /// Order points along one axis.
+    struct AxisOrdering {
+        explicit AxisOrdering(int axis) : fAxis(axis) {}
+        bool operator() (const Point& lhs, const Point& rhs) const {
+            return lhs.fVec[fAxis] < rhs.fVec[fAxis];
+        }
+        int fAxis;
+    };
+
+    /// Transform from the external coordinate system to the internal one.
+    void Transform(double x, double y, double z, float* vec) const {
+        float xf = x;
+        float yf = y;
+        float zf = z;
+        for (int i=0; i<3; ++i) {
+            vec[i] = fMetric[i][0]*xf + fMetric[i][1]*yf + fMetric[i][2]*zf;
+        }
+    }
+
+    /// Arrange the points into the tree if points have been added since the
+    /// last time it was built.
+    void Build() {
+        if (fBuilt) return;
+        fAxis.resize(fPoints.size());
+        BuildNode(0, fPoints.size());
+        fBuilt = true;
+    }
+
+    /// Arrange the points in [begin,end) so that the median point along the
+    /// widest axis is in the middle of the range, and then arrange each half.
+    void BuildNode(int begin, int end) {
+        if (end - begin < 2) return;
+        float low[3];
+        float high[3];
+        for (int i=0; i<3; ++i) {
+            low[i] = high[i] = fPoints[begin].fVec[i];
+        }
+        for (int p = begin+1; p < end; ++p) {
+            for (int i=0; i<3; ++i) {
+                low[i] = std::min(low[i], fPoints[p].fVec[i]);
+                high[i] = std::max(high[i], fPoints[p].fVec[i]);
+            }
+        }
+        int axis = 0;
+        for (int i=1; i<3; ++i) {
+            if (high[i]-low[i] > high[axis]-low[axis]) axis = i;
+        }
+        int middle = (begin + end)/2;
+        std::nth_element(fPoints.begin()+begin,
+                         fPoints.begin()+middle,
+                         fPoints.begin()+end,
+                         AxisOrdering(axis));
+        fAxis[middle] = axis;
+        BuildNode(begin, middle);
+        BuildNode(middle+1, end);
+    }
+
+    /// The points arranged as a k-d tree (once it has been built).  The
+    /// median of the range [begin,end) is the point at (begin+end)/2 and
+    /// the points before it are below it along fAxis[(begin+end)/2].
+    std::vector<Point> fPoints;
+
+    /// The axis that each range is split along indexed by the median point.
+    std::vector<unsigned char> fAxis;
+
+    /// True if the points are arranged as a tree.
+    bool fBuilt;
 
-    /// A k-d tree representation of the point positions.  This allows very
-    /// quick lookup of neighbors.
-    typename Neighbors::Tree fNeighborTree;
+    /// The cursor used by begin() and ForEachWithin().
+    TCursor fCursor;
 
-    /// The current end of the neighbor points.  This is actually one past the
-    /// furthest point.  This is set by the Neighbors method.
+    /// The end of the neighbor points.
     iterator fCurrentEnd;
 
     /// A matrix to transform from the external coordinate system to an
     /// internal coordinate system that is used to calculate the distance
     /// between points.  The distance is euclidean in the transformed
     /// coordinate system.
-    TMatrixD fMetric;
+    float fMetric[3][3];
 };
 #endif
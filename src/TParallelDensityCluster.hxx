@@ -0,0 +1,511 @@
+#ifndef TParallelDensityCluster_hxx_seen
+#define TParallelDensityCluster_hxx_seen
+
+#include "TCaptLog.hxx"
+
+#include <TMatrixD.h>
+#include <TVector3.h>
+
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <cmath>
+
+namespace CP {
+    template <class PositionHandle> class TParallelDensityCluster;
+}
+
+/// A class that performs density-based clustering (DBSCAN) using a cartesian
+/// metric and several threads.  It has the same interface as
+/// TPositionDensityCluster, and works on any class that implements the
+/// PositionHandle concept (see TPositionDensityCluster).  Here is a code
+/// snippet using this template:
+///
+/// \code
+///    const double maxDist = 20*unit::mm;
+///    const unsigned int minPoints = 4;
+///
+///    CP::TParallelDensityCluster<CP::THandle<CP::THit> >
+///        clusterAlgorithm(minPoints, maxDist);
+///    clusterAlgorithm.SetThreads(8);
+///    clusterAlgorithm.Cluster(hits.begin(), hits.end());
+/// \endcode
+///
+/// This uses the standard definition of DBSCAN, which is not quite the same
+/// as TPositionDensityCluster (which grows one cluster at a time from the
+/// densest remaining seed).  A point is a core point if there are at least
+/// minPts other points within maxDist.  Core points that are within maxDist
+/// of each other are in the same cluster, and a point that isn't a core
+/// point is added to the cluster of the closest core point within maxDist.
+/// The remaining points are not in a cluster.
+///
+/// The points are sorted into a grid of cells with sides of maxDist, so the
+/// neighbors of a point are in the 27 surrounding cells.  The threads take
+/// cells from a shared counter to find the core points, then to join the
+/// clusters (using a lock-free union-find where a cluster is always joined to
+/// the cluster with the lowest point index), and then to assign the other
+/// points.  Each cluster is labeled by the index of its first point, so the
+/// result is the same for any number of threads.  The clusters are ordered
+/// by decreasing size (clusters of the same size are in the order of their
+/// first point), and the points in a cluster are in the input order.
+template <class PositionHandle>
+class CP::TParallelDensityCluster {
+public:
+    /// A collection of points for use in clustering.  A Points collection is
+    /// returned by GetCluster().
+    typedef std::list<PositionHandle> Points;
+
+    /// Create a density clustering class that requires at least minPts within
+    /// a distance of maxDist.  The distance is the cartesian distance between
+    /// the points.
+    TParallelDensityCluster(std::size_t minPts, double maxDist);
+    virtual ~TParallelDensityCluster() {}
+
+    /// Cluster a group of objects between the begin and end iterator.  The
+    /// results are accessed using GetCluster().  The iterators must implement
+    /// the concept of an iterator to objects of type PositionHandle.
+    template <class InputIterator>
+    void Cluster(InputIterator begin, InputIterator end);
+
+    /// Return the number of clusters found by the density clustering.  This
+    /// is only valid after the Cluster() method has been used.
+    std::size_t GetClusterCount() { return fClusters.size(); }
+
+    /// Get the i-th cluster.  This is only valid after the cluster method has
+    /// been used.  If the index is equal to the number of found clusters,
+    /// then the return value will be the list of unclustered points.
+    const Points& GetCluster(std::size_t i) const {
+        if (fClusters.size() <= i) return fRemaining;
+        return fClusters.at(i);
+    }
+
+    /// Set the basis for this clustering.
+    void SetBasis(const TVector3& e1, const TVector3& e2, const TVector3& e3) {
+        fE1 = e1;
+        fE2 = e2;
+        fE3 = e3;
+    }
+
+    /// Set the number of threads used to cluster the points.  The result is
+    /// the same for any number of threads.
+    void SetThreads(int threads) {fThreads = std::max(threads,1);}
+
+    /// Get the number of threads used to cluster the points.
+    int GetThreads() const {return fThreads;}
+
+private:
+    /// The passes over the cells that are done in parallel.
+    enum Pass {kFindCore, kJoinCore, kAssignBorder};
+
+    /// The workspace for a thread.  The worker takes cells from the shared
+    /// counter until all of them are done.
+    struct Worker {
+        void operator () () {
+            for (;;) {
+                std::size_t next = (*fNext)++;
+                if (next >= fCluster->fCellKey.size()) break;
+                fCluster->ProcessCell(fPass, next);
+            }
+        }
+        TParallelDensityCluster* fCluster;
+        Pass fPass;
+        std::atomic<std::size_t>* fNext;
+    };
+
+    /// Run a pass over all of the cells.
+    void RunPass(Pass pass);
+
+    /// Do a pass for the points in one cell.
+    void ProcessCell(Pass pass, std::size_t cell);
+
+    /// Find the ranges of the sorted points that are in the cells around a
+    /// cell.  There are at most nine ranges (one for each row of three
+    /// cells), and this returns the number of ranges found.
+    int NeighborRanges(std::size_t cell, int begin[9], int end[9]) const;
+
+    /// The squared distance between two points (in the sorted order).
+    float Distance2(int a, int b) const {
+        float dist2 = 0.0;
+        for (int i=0; i<3; ++i) {
+            float d = fPosition[3*a+i] - fPosition[3*b+i];
+            dist2 += d*d;
+        }
+        return dist2;
+    }
+
+    /// Find the cluster label of a point.  This can be used while other
+    /// threads are joining clusters.
+    int Find(int point);
+
+    /// Join the clusters of two core points.  The cluster with the larger
+    /// label is joined to the cluster with the smaller label.
+    void Join(int a, int b);
+
+    /// Order the point indices by cell, and then by index.
+    struct CellOrdering {
+        explicit CellOrdering(const std::vector<long long>& keys)
+            : fKeys(keys) {}
+        bool operator() (int lhs, int rhs) const {
+            if (fKeys[lhs] != fKeys[rhs]) return fKeys[lhs] < fKeys[rhs];
+            return lhs < rhs;
+        }
+        const std::vector<long long>& fKeys;
+    };
+
+    /// The sorting comparison to order the clusters at the end of the
+    /// search.  Each cluster is a vector of point indices in increasing
+    /// order.
+    struct ClusterOrdering {
+        bool operator() (const std::vector<int>* lhs,
+                         const std::vector<int>* rhs) const {
+            if (lhs->size() != rhs->size()) return lhs->size() > rhs->size();
+            return lhs->front() < rhs->front();
+        }
+    };
+
+    /// The minimum number of other points that must be within fMaxDist for
+    /// a point to be a core point.
+    unsigned int fMinPoints;
+
+    /// The maximum distance between points for which points are defined as
+    /// being neighbors.
+    double fMaxDist;
+
+    /// The number of threads used for the clustering.
+    int fThreads;
+
+    /// The clusters that have been found.
+    std::vector<Points> fClusters;
+
+    /// The objects that didn't make it into a cluster.
+    Points fRemaining;
+
+    /// The input index of each point in the sorted order.  The points are
+    /// sorted by cell so the points in a cell are contiguous.
+    std::vector<int> fIndex;
+
+    /// The position of each point in the sorted order in the internal
+    /// coordinates (three values per point).
+    std::vector<float> fPosition;
+
+    /// The key of the cell that contains each point in the sorted order.
+    std::vector<long long> fPointKey;
+
+    /// The key of each cell that contains a point.
+    std::vector<long long> fCellKey;
+
+    /// The first point in each cell (in the sorted order) with an extra
+    /// entry for the end of the last cell.
+    std::vector<int> fCellBegin;
+
+    /// The number of cells along each axis.
+    long long fCells[3];
+
+    /// True if a point is a core point (in the sorted order).
+    std::vector<char> fCore;
+
+    /// The cluster label for each point in the sorted order.  The label is
+    /// the sorted index of a core point in the same cluster, or -1 if the
+    /// point isn't in a cluster.  During kJoinCore this is the union-find
+    /// tree of the core points.
+    std::vector< std::atomic<int> > fLabel;
+
+    // The basis vectors for the clustering.
+    TVector3 fE1;
+    TVector3 fE2;
+    TVector3 fE3;
+};
+
+////////////////////////////////////////////////////////////////
+// Define the TParallelDensityCluster class methods.
+////////////////////////////////////////////////////////////////
+
+template <class PositionHandle>
+CP::TParallelDensityCluster<PositionHandle>::TParallelDensityCluster(
+    std::size_t minPts, double maxDist)
+    : fMinPoints(minPts), fMaxDist(maxDist), fThreads(1),
+      fE1(1,0,0), fE2(0,1,0), fE3(0,0,1) { }
+
+template <class PositionHandle>
+template <class InputIterator>
+void CP::TParallelDensityCluster<PositionHandle>::Cluster(
+    InputIterator begin, InputIterator end) {
+
+    // Clear out the internal data structures.
+    fClusters.clear();
+    fRemaining.clear();
+
+    std::vector<PositionHandle> handles;
+    for (InputIterator handle = begin; handle != end; ++handle) {
+        handles.push_back(*handle);
+    }
+    int points = handles.size();
+    if (points < 1) return;
+
+    // Find the positions in the internal coordinate system where the
+    // distance is euclidean.  This is the same transformation as
+    // TIterativeNeighbors.
+    TMatrixD basis(3,3);
+    for (int i=0; i<3; ++i) {
+        basis(0,i) = fE1(i);
+        basis(1,i) = fE2(i);
+        basis(2,i) = fE3(i);
+    }
+    basis.Invert();
+    float metric[3][3];
+    for (int i=0; i<3; ++i) {
+        for (int j=0; j<3; ++j) metric[i][j] = basis(i,j);
+    }
+    std::vector<float> position(3*points);
+    for (int p = 0; p < points; ++p) {
+        float x = handles[p]->GetPosition().X();
+        float y = handles[p]->GetPosition().Y();
+        float z = handles[p]->GetPosition().Z();
+        for (int i=0; i<3; ++i) {
+            position[3*p+i] = metric[i][0]*x + metric[i][1]*y + metric[i][2]*z;
+        }
+    }
+
+    // Sort the points into cells.  The cells need to be at least as big as
+    // the maximum distance, and are made bigger if the keys won't fit into a
+    // long long.
+    double low[3];
+    double high[3];
+    for (int i=0; i<3; ++i) low[i] = high[i] = position[i];
+    for (int p = 0; p < points; ++p) {
+        for (int i=0; i<3; ++i) {
+            low[i] = std::min(low[i], (double) position[3*p+i]);
+            high[i] = std::max(high[i], (double) position[3*p+i]);
+        }
+    }
+    double cellSize = (fMaxDist > 0.0) ? fMaxDist : 1.0;
+    while (true) {
+        double total = 1.0;
+        for (int i=0; i<3; ++i) {
+            fCells[i] = std::floor((high[i]-low[i])/cellSize) + 1;
+            total *= fCells[i];
+        }
+        if (total < 1E18) break;
+        cellSize *= 2.0;
+    }
+    std::vector<long long> keys(points);
+    for (int p = 0; p < points; ++p) {
+        long long index[3];
+        for (int i=0; i<3; ++i) {
+            index[i] = std::floor((position[3*p+i]-low[i])/cellSize);
+            index[i] = std::max(0LL, std::min(index[i], fCells[i]-1));
+        }
+        keys[p] = (index[0]*fCells[1] + index[1])*fCells[2] + index[2];
+    }
+    fIndex.resize(points);
+    for (int p = 0; p < points; ++p) fIndex[p] = p;
+    std::sort(fIndex.begin(), fIndex.end(), CellOrdering(keys));
+    fPosition.resize(3*points);
+    fPointKey.resize(points);
+    fCellKey.clear();
+    fCellBegin.clear();
+    for (int p = 0; p < points; ++p) {
+        for (int i=0; i<3; ++i) fPosition[3*p+i] = position[3*fIndex[p]+i];
+        fPointKey[p] = keys[fIndex[p]];
+        if (fCellKey.empty() || fCellKey.back() != fPointKey[p]) {
+            fCellKey.push_back(fPointKey[p]);
+            fCellBegin.push_back(p);
+        }
+    }
+    fCellBegin.push_back(points);
+
+    CaptNamedDebug("cluster", "Input points: " << points
+                   << " in " << fCellKey.size() << " cells");
+
+    // Find the core points, join them into clusters, and then add the other
+    // points.  Each pass has to finish before the next one starts.
+    fCore.assign(points, 0);
+    std::vector< std::atomic<int> > label(points);
+    fLabel.swap(label);
+    for (int p = 0; p < points; ++p) fLabel[p] = -1;
+    RunPass(kFindCore);
+    for (int p = 0; p < points; ++p) if (fCore[p]) fLabel[p] = p;
+    RunPass(kJoinCore);
+    RunPass(kAssignBorder);
+
+    // Collect the points in each cluster in the input order.  The cluster
+    // for each label is found in the input order, so the clusters are built
+    // in the order of their first point.
+    std::vector<int> clusterIndex(points, -1);
+    std::vector< std::vector<int> > clusters;
+    std::vector<int> sorted(points);
+    for (int p = 0; p < points; ++p) sorted[fIndex[p]] = p;
+    for (int i = 0; i < points; ++i) {
+        int p = sorted[i];
+        int l = fLabel[p];
+        if (l < 0) {
+            fRemaining.push_back(handles[i]);
+            continue;
+        }
+        int root = Find(l);
+        if (clusterIndex[root] < 0) {
+            clusterIndex[root] = clusters.size();
+            clusters.push_back(std::vector<int>());
+        }
+        clusters[clusterIndex[root]].push_back(i);
+    }
+
+    std::vector<const std::vector<int>*> order;
+    for (std::size_t c = 0; c < clusters.size(); ++c) {
+        order.push_back(&clusters[c]);
+    }
+    std::sort(order.begin(), order.end(), ClusterOrdering());
+    fClusters.resize(order.size());
+    for (std::size_t c = 0; c < order.size(); ++c) {
+        for (std::vector<int>::const_iterator i = order[c]->begin();
+             i != order[c]->end(); ++i) {
+            fClusters[c].push_back(handles[*i]);
+        }
+    }
+
+    CaptNamedDebug("cluster", "Clusters: " << fClusters.size()
+                   << " Remaining: " << fRemaining.size());
+}
+
+template <class PositionHandle>
+void CP::TParallelDensityCluster<PositionHandle>::RunPass(Pass pass) {
+    std::size_t threads = std::min((std::size_t) fThreads, fCellKey.size());
+    if (threads > 1) {
+        std::atomic<std::size_t> next(0);
+        std::vector<Worker> workers(threads);
+        std::vector<std::thread> pool;
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers[i].fCluster = this;
+            workers[i].fPass = pass;
+            workers[i].fNext = &next;
+            pool.push_back(std::thread(std::ref(workers[i])));
+        }
+        for (std::size_t i = 0; i < pool.size(); ++i) pool[i].join();
+    }
+    else {
+        for (std::size_t c = 0; c < fCellKey.size(); ++c) {
+            ProcessCell(pass, c);
+        }
+    }
+}
+
+template <class PositionHandle>
+int CP::TParallelDensityCluster<PositionHandle>::NeighborRanges(
+    std::size_t cell, int begin[9], int end[9]) const {
+    long long key = fCellKey[cell];
+    long long index[3];
+    index[2] = key % fCells[2];
+    index[1] = (key / fCells[2]) % fCells[1];
+    index[0] = key / (fCells[2] * fCells[1]);
+    long long zLow = std::max(index[2]-1, 0LL);
+    long long zHigh = std::min(index[2]+1, fCells[2]-1);
+    int ranges = 0;
+    for (long long ix = index[0]-1; ix <= index[0]+1; ++ix) {
+        if (ix < 0 || ix >= fCells[0]) continue;
+        for (long long iy = index[1]-1; iy <= index[1]+1; ++iy) {
+            if (iy < 0 || iy >= fCells[1]) continue;
+            // The cells in a row along the third axis are contiguous.
+            long long row = (ix*fCells[1] + iy)*fCells[2];
+            int b = std::lower_bound(fPointKey.begin(), fPointKey.end(),
+                                     row + zLow) - fPointKey.begin();
+            int e = std::upper_bound(fPointKey.begin()+b, fPointKey.end(),
+                                     row + zHigh) - fPointKey.begin();
+            if (b >= e) continue;
+            begin[ranges] = b;
+            end[ranges] = e;
+            ++ranges;
+        }
+    }
+    return ranges;
+}
+
+template <class PositionHandle>
+void CP::TParallelDensityCluster<PositionHandle>::ProcessCell(
+    Pass pass, std::size_t cell) {
+    int begin[9];
+    int end[9];
+    int ranges = NeighborRanges(cell, begin, end);
+    double dist2 = fMaxDist*fMaxDist;
+    for (int p = fCellBegin[cell]; p < fCellBegin[cell+1]; ++p) {
+        if (pass == kFindCore) {
+            // Count the other points within the maximum distance.
+            std::size_t count = 0;
+            for (int r = 0; r < ranges && count < fMinPoints; ++r) {
+                for (int q = begin[r]; q < end[r]; ++q) {
+                    if (q == p) continue;
+                    if (Distance2(p,q) > dist2) continue;
+                    if (++count >= fMinPoints) break;
+                }
+            }
+            fCore[p] = (count >= fMinPoints);
+        }
+        else if (pass == kJoinCore) {
+            // Join with the core points within the maximum distance.  Each
+            // pair is only checked from the lower index.
+            if (!fCore[p]) continue;
+            for (int r = 0; r < ranges; ++r) {
+                for (int q = begin[r]; q < end[r]; ++q) {
+                    if (q <= p || !fCore[q]) continue;
+                    if (Distance2(p,q) > dist2) continue;
+                    Join(p,q);
+                }
+            }
+        }
+        else if (pass == kAssignBorder) {
+            // Find the closest core point within the maximum distance.
+            // Equally close points are decided by the input order.
+            if (fCore[p]) continue;
+            int closest = -1;
+            float closestDist2 = 0.0;
+            for (int r = 0; r < ranges; ++r) {
+                for (int q = begin[r]; q < end[r]; ++q) {
+                    if (!fCore[q]) continue;
+                    float d2 = Distance2(p,q);
+                    if (d2 > dist2) continue;
+                    if (closest >= 0) {
+                        if (d2 > closestDist2) continue;
+                        if (d2 == closestDist2
+                            && fIndex[q] > fIndex[closest]) continue;
+                    }
+                    closest = q;
+                    closestDist2 = d2;
+                }
+            }
+            fLabel[p] = closest;
+        }
+    }
+}
+
+template <class PositionHandle>
+int CP::TParallelDensityCluster<PositionHandle>::Find(int point) {
+    for (;;) {
+        int parent = fLabel[point];
+        if (parent == point) return point;
+        int grandParent = fLabel[parent];
+        // Shorten the path.  This only moves a point closer to the root, so
+        // it's safe if another thread changed the parent first.
+        if (parent != grandParent) {
+            fLabel[point].compare_exchange_weak(parent, grandParent);
+        }
+        point = grandParent;
+    }
+}
+
+template <class PositionHandle>
+void CP::TParallelDensityCluster<PositionHandle>::Join(int a, int b) {
+    for (;;) {
+        a = Find(a);
+        b = Find(b);
+        if (a == b) return;
+        if (a < b) std::swap(a,b);
+        // Join the root with the larger label to the root with the smaller
+        // label.  This fails if another thread changed the root first, and
+        // then the roots are found again.
+        int expected = a;
+        if (fLabel[a].compare_exchange_strong(expected, b)) return;
+    }
+}
+#endif
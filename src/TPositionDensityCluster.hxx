@@ -2,6 +2,7 @@
 #define TPositionDensityCluster_seen
 
 #include "TIterativeNeighbors.hxx"
+#include "TGridNeighbors.hxx"
 
 #include "TCaptLog.hxx"
 
@@ -13,7 +14,9 @@
 #include <algorithm>
 
 namespace CP {
-    template <class PositionHandle> class TPositionDensityCluster;
+    template <class PositionHandle,
+              template <typename> class NeighborSearch = TIterativeNeighbors>
+    class TPositionDensityCluster;
 }
 
 /// A class that performs density-based clustering using the DBSCAN algorithm
@@ -42,7 +45,22 @@ namespace CP {
 /// requirement is that the objectd returned by the GetPosition() method must
 /// be returned by reference, and must implement the X(), Y() and Z() methods
 /// returning a float or double value.
-template <class PositionHandle>
+///
+/// The second template argument selects the neighbor search.  The default is
+/// TIterativeNeighbors (a k-d tree with an incremental search), and
+/// TGridNeighbors (a uniform grid with cells the size of maxDist) can be
+/// used instead.  The grid is much faster since the clustering only ever
+/// needs the points within maxDist.  Both searches find the same clusters,
+/// and the points in each cluster are in the same order (except for points
+/// at exactly the same distance from a cluster point).
+///
+/// \code
+///    typedef CP::TPositionDensityCluster<CP::THandle<CP::THit>,
+///                                        CP::TGridNeighbors>
+///        ClusterAlgorithm;
+/// \endcode
+template <class PositionHandle,
+          template <typename> class NeighborSearch>
 class CP::TPositionDensityCluster {
 public:
     /// A collection of points for use in clustering.  A Points collection is
@@ -96,36 +114,92 @@ protected:
         PositionHandle fHandle;
     };
 
-    /// The k-d tree neighbors.
-    typedef typename CP::TIterativeNeighbors<NeighborEntry> Neighbors;
+    /// The neighbor search.
+    typedef NeighborSearch<NeighborEntry> Neighbors;
 
-    /// Find the set of points with highest density in input.  If the density
-    /// is greater that fMinPoints, then return the set of points in output.
-    /// Points that are in the seed are added to the output using GetNeighbors
-    /// and have their color changed from black to white.  This returns true
-    /// if a new cluster seed was found.
-    bool FindSeeds(Neighbors& input, Points& output);
+    /// A neighbor search visitor to count the neighbors that are not already
+    /// in a cluster (including the point itself).
+    struct CountFree {
+        CountFree(const std::vector<int>& colors)
+            : fColors(colors), fCount(0) {}
+        bool operator()(const NeighborEntry& entry, float) {
+            // Don't count a handle that's already in a cluster.
+            if (fColors[entry.fColorIndex] == kBlack) return true;
+            ++fCount;
+            return true;
+        }
+        const std::vector<int>& fColors;
+        std::size_t fCount;
+    };
 
-    /// Find the neighbors for a reference hit in the input points and place
-    /// them into the output.  Neighbors are defined as all points for which
-    /// the distance to the reference is less than fMaxDist (a point is a
-    /// neighbor to itself).  Any neighbors that are not currently in a
-    /// cluster will be returned in the output variable.  Any point added to
-    /// the output has it's color changed from black to white.
-    void GetNeighbors(PositionHandle reference, 
-                      Neighbors& input, Points& output);
+    /// A neighbor search visitor to count all of the neighbors (except the
+    /// point itself).  This is used for points that are in a cluster, so
+    /// the saved count of free neighbors for each neighbor is out of date.
+    struct CountAll {
+        CountAll(std::vector<int>& freeCounts)
+            : fFreeCounts(freeCounts), fCount(0) {}
+        bool operator()(const NeighborEntry& entry, float dist2) {
+            fFreeCounts[entry.fColorIndex] = -1;
+            // Don't count the current handle.
+            if (dist2 < 1E-6) return true;
+            ++fCount;
+            return true;
+        }
+        std::vector<int>& fFreeCounts;
+        std::size_t fCount;
+    };
 
-    /// Count the neighbors for a reference in the input points, but do not
-    /// return a copy of the neighbors.  The point is not counted as a
-    /// neighbor.  This counts points even if they have already been added to
-    /// a cluster.
-    std::size_t CountNeighbors(PositionHandle reference, Neighbors& input);
+    /// A neighbor search visitor to collect the neighbors that are not
+    /// already in a cluster and mark them as in a cluster.  The neighbors
+    /// are saved as the distance and the index in fEntries.
+    struct CollectFree {
+        CollectFree(std::vector<int>& colors,
+                    std::vector< std::pair<float,int> >& found)
+            : fColors(colors), fFound(found) {}
+        bool operator()(const NeighborEntry& entry, float dist2) {
+            // Don't add handle that's already in a cluster.
+            if (fColors[entry.fColorIndex] == kBlack) return true;
+            // Mark the handle as in a cluster.
+            fColors[entry.fColorIndex] = kBlack;
+            fFound.push_back(std::make_pair(dist2,entry.fColorIndex));
+            return true;
+        }
+        std::vector<int>& fColors;
+        std::vector< std::pair<float,int> >& fFound;
+    };
 
-    /// Color all of the grey handles in the map to black.
-    void MakeGreyBlack();
+    /// Order found neighbors by distance.
+    struct DistanceOrdering {
+        bool operator()(const std::pair<float,int>& lhs,
+                        const std::pair<float,int>& rhs) const {
+            return lhs.first < rhs.first;
+        }
+    };
 
-    /// Color all of the grey handles in the map to white.
-    void MakeGreyWhite();
+    /// Find the point with the highest density that is not in a cluster.
+    /// If the density is greater than fMinPoints, then the point and its
+    /// neighbors that are not in a cluster are returned in output (as
+    /// indices into fEntries) and colored black.  This returns true if a new
+    /// cluster seed was found.
+    bool FindSeeds(Neighbors& input, std::vector<int>& output);
+
+    /// Find the neighbors for a reference point (an index into fEntries) in
+    /// the input points and append them to the output in order of
+    /// increasing distance.  Neighbors are defined as all points for which
+    /// the distance to the reference is less than fMaxDist (a point is a
+    /// neighbor to itself).  Only neighbors that are not currently in a
+    /// cluster (i.e. white) are added to the output, and they have their
+    /// color changed to black.
+    void GetNeighbors(int reference, Neighbors& input,
+                      std::vector<int>& output);
+
+    /// Count the neighbors for a reference point (an index into fEntries)
+    /// in the input points, but do not return a copy of the neighbors.  The
+    /// point is not counted as a neighbor.  This counts points even if they
+    /// have already been added to a cluster.  The reference must be in a
+    /// cluster, and the saved free neighbor counts of its neighbors are
+    /// marked as out of date.
+    std::size_t CountNeighbors(int reference, Neighbors& input);
 
 private:
     /// The minimum number of points that must be within the fMaxDist
@@ -153,12 +227,31 @@ private:
 
     /// The mapping of color to each point in the neighborTree.  This is
     /// indexed by the fColorIndex field of the NeighborEntry.  The color map
-    /// has three shades: 0) white -- this is when the point is free.  1) grey
-    /// -- this is when a point is currently being checked.  2) black -- this
-    /// is when a point has been included in a cluster.
-    enum {kWhite=0, kGrey, kBlack};
+    /// has two shades: 0) white -- this is when the point is free.  1) black
+    /// -- this is when a point has been included in a cluster.
+    enum {kWhite=0, kBlack};
     std::vector<int> fColorMap;
 
+    /// A flag for each point that has too few neighbors outside of a
+    /// cluster to be a seed.  Points are only added to clusters, so the
+    /// number of neighbors outside of a cluster never increases, and
+    /// FindSeeds doesn't need to count the neighbors of these points again.
+    std::vector<bool> fSparse;
+
+    /// The number of neighbors outside of a cluster (including the point
+    /// itself) for each point, or -1 if it needs to be counted.  The count is
+    /// marked as out of date when a neighbor is added to a cluster (by
+    /// CountNeighbors), so FindSeeds only counts the neighbors of points near
+    /// the last cluster.
+    std::vector<int> fFreeCounts;
+
+    /// The first entry that might be a seed.  All of the earlier entries are
+    /// either in a cluster or sparse.
+    std::size_t fFirstCandidate;
+
+    /// Work space for GetNeighbors to sort the neighbors by distance.
+    std::vector< std::pair<float,int> > fFound;
+
     /// The sorting comparison to order the clusters at the end of the search.
     template <class T>
     struct ClusterOrdering :
@@ -178,37 +271,24 @@ private:
 // Define the TPositionDensityCluster class methods.
 ////////////////////////////////////////////////////////////////
 
-template <class PositionHandle>
-CP::TPositionDensityCluster<PositionHandle>::TPositionDensityCluster(
-    std::size_t MinPts, double maxDist)  
+template <class PositionHandle,
+          template <typename> class NeighborSearch>
+CP::TPositionDensityCluster<PositionHandle,NeighborSearch>
+::TPositionDensityCluster(std::size_t MinPts, double maxDist)  
     : fMinPoints(MinPts), fMaxDist(maxDist),
       fE1(1,0,0), fE2(0,1,0), fE3(0,0,1) { }
 
-template <class PositionHandle>
-void CP::TPositionDensityCluster<PositionHandle>::MakeGreyBlack() {
-    for (std::vector<int>::iterator c = fColorMap.begin();
-         c != fColorMap.end(); ++c) {
-        if (*c == kGrey) *c = kBlack;
-    }
-}
-
-template <class PositionHandle>
-void CP::TPositionDensityCluster<PositionHandle>::MakeGreyWhite() {
-    for (std::vector<int>::iterator c = fColorMap.begin();
-         c != fColorMap.end(); ++c) {
-        if (*c == kGrey) *c = kWhite;
-    }
-}
-
-template <class PositionHandle>
+template <class PositionHandle,
+          template <typename> class NeighborSearch>
 template <class InputIterator>
-void CP::TPositionDensityCluster<PositionHandle>::Cluster(
+void CP::TPositionDensityCluster<PositionHandle,NeighborSearch>::Cluster(
     InputIterator begin, InputIterator end) {
 
     // Clear out the  internal data structures.
     fClusters.clear();
+    fEntries.clear();
 
-    // Insert the input into the tree.
+    // Insert the input into the neighbor search.
     Neighbors neighborTree(fE1,fE2,fE3);
     
     int index = 0;
@@ -219,52 +299,47 @@ void CP::TPositionDensityCluster<PositionHandle>::Cluster(
                               fEntries.back().fHandle->GetPosition().Y(),
                               fEntries.back().fHandle->GetPosition().Z());
     }
-    fColorMap.resize(index);
-    for (std::vector<int>::iterator c = fColorMap.begin();
-         c != fColorMap.end(); ++c) {
-        *c = kWhite;
-    }
+    fColorMap.assign(index, kWhite);
+    fSparse.assign(index, false);
+    fFreeCounts.assign(index, -1);
+    fFirstCandidate = 0;
 
     CaptNamedDebug("cluster", "Input points: " << index
                    << " fColorMap " << fColorMap.size());
 
     // Now continue removing points until there aren't any more points, or a
     // seed isn't found.
+    std::vector<int> cluster;
     while (true) {
-        Points seeds; 
-
         // Find the next set of seeds to start a cluster.  The seeds are
-        // enough to form a cluster, and are marked in FindSeeds (by way of
-        // GetNeighbors) as being in a cluster.
-        seeds.clear();
-        if (!FindSeeds(neighborTree,seeds)) {
+        // enough to form a cluster, and are marked in FindSeeds as being in
+        // a cluster.
+        cluster.clear();
+        if (!FindSeeds(neighborTree,cluster)) {
             CaptNamedDebug("cluster", "No seed found");
             break;
         }
 
         CaptNamedDebug("cluster", "Start seed with " 
-                       << seeds.size() << " points");
-
-        // Start a new cluster and add the current seeds to it.
-        Points cluster;
-        std::copy(seeds.begin(), seeds.end(), std::back_inserter(cluster));
+                       << cluster.size() << " points");
 
-        Points tmp;
-        while (!seeds.empty()) {
-            PositionHandle handle = seeds.front();
-            seeds.erase(seeds.begin());
-            std::size_t count = CountNeighbors(handle, neighborTree);
+        // Grow the cluster.  The cluster is also the frontier of points that
+        // still need to be expanded.  Each point is expanded once in the
+        // order it was added, and any of its neighbors that are not already
+        // in a cluster are appended to the end.
+        for (std::size_t next = 0; next < cluster.size(); ++next) {
+            std::size_t count = CountNeighbors(cluster[next], neighborTree);
             if (count < fMinPoints) continue;
-            tmp.clear();
-            GetNeighbors(handle,neighborTree,tmp);
-            MakeGreyBlack();
-            std::copy(tmp.begin(),tmp.end(),std::back_inserter(seeds));
-            std::copy(tmp.begin(),tmp.end(),std::back_inserter(cluster));
+            GetNeighbors(cluster[next],neighborTree,cluster);
         }
 
         CaptNamedDebug("cluster", "Cluster with "
                        << cluster.size() << " points");
-        fClusters.push_back(cluster);
+        fClusters.push_back(Points());
+        for (std::vector<int>::iterator c = cluster.begin();
+             c != cluster.end(); ++c) {
+            fClusters.back().push_back(fEntries[*c].fHandle);
+        }
     }
 
     std::sort(fClusters.begin(), fClusters.end(),
@@ -279,110 +354,92 @@ void CP::TPositionDensityCluster<PositionHandle>::Cluster(
     
 }
     
-template <class PositionHandle>
-bool CP::TPositionDensityCluster<PositionHandle>::FindSeeds(
-    Neighbors& in, Points& out) {
+template <class PositionHandle,
+          template <typename> class NeighborSearch>
+bool CP::TPositionDensityCluster<PositionHandle,NeighborSearch>::FindSeeds(
+    Neighbors& in, std::vector<int>& out) {
     out.clear();
-    double dist2 = fMaxDist*fMaxDist;
     int seedCount = 0;
+    int best = -1;
+    std::size_t bestSize = 0;
     CaptNamedDebug("cluster", "start " << seedCount);
-    for (typename std::vector<NeighborEntry>::iterator p = fEntries.begin(); 
-         p != fEntries.end(); ++p) {
-        CaptNamedDebug("cluster", "point: " << seedCount
-                       << " " << p->fColorIndex
-                       << " " << p->fHandle);
-        if (fColorMap[p->fColorIndex] == kBlack) {
-            continue;
-        }
-        CaptNamedDebug("cluster", "   not black: " << seedCount);
-        std::size_t count = 0;
-        PositionHandle h = p->fHandle;
-        CaptNamedDebug("cluster", "    Start neighbors ");
-        typename Neighbors::iterator neighbor = in.begin(h->GetPosition().X(),
-                                                h->GetPosition().Y(),
-                                                h->GetPosition().Z());
-        typename Neighbors::iterator neighbor_end = in.end();
-        for (;neighbor != neighbor_end; ++neighbor) {
-            CaptNamedDebug("cluster", "      check: "
-                           << " " << neighbor->second
-                           << " " << neighbor->first.fColorIndex
-                           << " " << neighbor->first.fHandle);
-            // Stop looking at distant handles.
-            if (neighbor->second > dist2) {
-                break;
-            }
-            // Don't count a handle that's already in a cluster.
-            if (fColorMap[neighbor->first.fColorIndex] == kBlack) {
-                continue;
-            }
-            ++count;
-            // Short-circuit the search.
-            if (count>2*fMinPoints) break;
+    // Skip the entries at the start that can't be a seed.
+    while (fFirstCandidate < fEntries.size()
+           && (fColorMap[fFirstCandidate] == kBlack
+               || fSparse[fFirstCandidate])) {
+        ++fFirstCandidate;
+    }
+    for (std::size_t p = fFirstCandidate; p < fEntries.size(); ++p) {
+        if (fColorMap[p] == kBlack) continue;
+        if (fSparse[p]) continue;
+        if (fFreeCounts[p] < 0) {
+            PositionHandle h = fEntries[p].fHandle;
+            CountFree counter(fColorMap);
+            in.ForEachWithin(h->GetPosition().X(),
+                             h->GetPosition().Y(),
+                             h->GetPosition().Z(),
+                             fMaxDist, counter);
+            fFreeCounts[p] = counter.fCount;
         }
+        CaptNamedDebug("cluster", "point: " << seedCount
+                       << " " << p << " " << fFreeCounts[p]);
+        // The density is the number of free neighbors (up to a limit).
         // Increment count since the current point is also part of the seed.
-        ++count;
-        // Not enough points, so look at the next value.
+        std::size_t count = std::min<std::size_t>(fFreeCounts[p],
+                                                  2*fMinPoints+1) + 1;
+        // Not enough points, so look at the next value.  This point won't
+        // have enough points for any later seed either.
         if (count<fMinPoints) {
+            fSparse[p] = true;
             continue;
         }
         // We already have a bigger seed.
-        if (count<out.size()) {
+        if (count<bestSize) {
             continue;
         }
-        // We found that "h" is a better seed, so copy it into out. This
-        // adds the test hit as well as it's neighbors to the seeds.
-        out.clear();
-        MakeGreyWhite();
-        GetNeighbors(h, in, out);
+        // We found that "p" is a better seed.  The seed will be the point
+        // and all of the free neighbors.
+        best = p;
+        bestSize = fFreeCounts[p];
         // Sort-circuit the search if we've found a good enough seed.
         if (seedCount > 5 && count > 3*fMinPoints) break;
         ++seedCount;
     }
-    if (out.size() < fMinPoints) {
-        MakeGreyWhite();
-        return false;
-    }
-    MakeGreyBlack();
+    if (best < 0 || bestSize < fMinPoints) return false;
+    GetNeighbors(best, in, out);
     return true;
 }
 
-template <class PositionHandle>
-void CP::TPositionDensityCluster<PositionHandle>::GetNeighbors(
-    PositionHandle pnt, Neighbors& in, Points& out) {
-    double dist2 = fMaxDist*fMaxDist;
-    typename Neighbors::iterator neighbor = in.begin(pnt->GetPosition().X(),
-                                                     pnt->GetPosition().Y(),
-                                                     pnt->GetPosition().Z());
-    typename Neighbors::iterator neighbor_end = in.end();
-    for (;neighbor != neighbor_end; ++neighbor) {
-        // Stop looking at distant handles.
-        if (neighbor->second > dist2) break;
-        // Don't add handle that's already in a cluster.
-        if (fColorMap[neighbor->first.fColorIndex]) continue;
-        // Mark the handle as in a cluster.
-        fColorMap[neighbor->first.fColorIndex] = kGrey;
-        // Add the value to the output
-        out.push_back(neighbor->first.fHandle);
+template <class PositionHandle,
+          template <typename> class NeighborSearch>
+void CP::TPositionDensityCluster<PositionHandle,NeighborSearch>::GetNeighbors(
+    int pnt, Neighbors& in, std::vector<int>& out) {
+    PositionHandle h = fEntries[pnt].fHandle;
+    fFound.clear();
+    CollectFree collector(fColorMap, fFound);
+    in.ForEachWithin(h->GetPosition().X(),
+                     h->GetPosition().Y(),
+                     h->GetPosition().Z(),
+                     fMaxDist, collector);
+    // Add the values to the output in order of increasing distance so the
+    // result doesn't depend on the neighbor search.
+    std::stable_sort(fFound.begin(), fFound.end(), DistanceOrdering());
+    for (std::vector< std::pair<float,int> >::iterator f = fFound.begin();
+         f != fFound.end(); ++f) {
+        out.push_back(f->second);
     }
 }
     
-template <class PositionHandle>
-std::size_t CP::TPositionDensityCluster<PositionHandle>::CountNeighbors(
-    PositionHandle pnt, Neighbors& in) {
-    double dist2 = fMaxDist*fMaxDist;
-    std::size_t count = 0;
-    typename Neighbors::iterator neighbor = in.begin(pnt->GetPosition().X(),
-                                                     pnt->GetPosition().Y(),
-                                                     pnt->GetPosition().Z());
-    typename Neighbors::iterator neighbor_end = in.end();
-    for (;neighbor != neighbor_end; ++neighbor) {
-        // Stop looking at distant handles.
-        if (neighbor->second > dist2) break;
-        // Don't count the current handle.
-        if (neighbor->second < 1E-6) continue;
-        ++count;
-    }
-    return count;
+template <class PositionHandle,
+          template <typename> class NeighborSearch>
+std::size_t CP::TPositionDensityCluster<PositionHandle,NeighborSearch>
+::CountNeighbors(int pnt, Neighbors& in) {
+    PositionHandle h = fEntries[pnt].fHandle;
+    CountAll counter(fFreeCounts);
+    in.ForEachWithin(h->GetPosition().X(),
+                     h->GetPosition().Y(),
+                     h->GetPosition().Z(),
+                     fMaxDist, counter);
+    return counter.fCount;
 }
 #endif
-
@@ -14,7 +14,7 @@ CP::TRemoveOutliers::TRemoveOutliers(int maxSize, double small, double big)
 
 bool CP::TRemoveOutliers::IsOutlier(CP::THandle<CP::THit> hit, int index) {
     CP::THandle<CP::TReconHit> reconHit = hit;
-    HitInfo& info = fHitMap[reconHit->GetConstituent(index)];
+    HitInfo& info = fHitMap[fRegistry.Find(reconHit->GetConstituent(index))];
 
     int plane = CP::GeomId::Captain::GetWirePlane(
         reconHit->GetConstituent(index)->GetGeomId());
@@ -88,6 +88,7 @@ int CP::TRemoveOutliers::LocalGroup(int wire, std::set<int>& input) {
 }
 
 void CP::TRemoveOutliers::Apply(CP::THitSelection& hits) {
+    fRegistry.Clear();
     fHitMap.clear();
 
     for (CP::THitSelection::iterator h = hits.begin();
@@ -100,7 +101,9 @@ void CP::TRemoveOutliers::Apply(CP::THitSelection& hits) {
         // Fill the one to many map of 2D Hits to 3D hits. 
         for (int i=0; i<reconHit->GetConstituentCount(); ++i) {
             CP::THandle<CP::THit> hit = reconHit->GetConstituent(i);
-            fHitMap[hit].fContainedBy.push_back(reconHit);
+            int id = fRegistry.Register(hit);
+            if ((int) fHitMap.size() <= id) fHitMap.resize(id+1);
+            fHitMap[id].fContainedBy.push_back(reconHit);
         }
     }
  
@@ -1,10 +1,12 @@
 #ifndef TRemoveOutliers_hxx_seen
 #define TRemoveOutliers_hxx_seen
 
+#include "THitRegistry.hxx"
+
 #include <THitSelection.hxx>
 #include <TReconHit.hxx>
 
-#include <map>
+#include <vector>
 #include <set>
 
 namespace CP {
@@ -29,7 +31,9 @@ public:
         CP::THitSelection fContainedBy;
     };
 
-    typedef std::map< CP::THandle<CP::THit>, HitInfo> HitMap;
+    /// The information for each 2D hit indexed by the hit identifier in
+    /// fRegistry.
+    typedef std::vector<HitInfo> HitMap;
 
     /// Start outlier removal using an input hit selection that contains
     /// TReconHit objects.  This hits in the hit selection will be modified.
@@ -50,6 +54,9 @@ private:
     /// Find the wires that are in the same group as the wire.
     int LocalGroup(int wire, std::set<int>& input);
 
+    /// The identifiers for the 2D hits.
+    CP::THitRegistry fRegistry;
+
     /// A map from the 2D hits back to the 3D hits.
     HitMap fHitMap;
 
@@ -0,0 +1,1532 @@
+#ifndef TTmplShareCharge_hxx_seen
+#define TTmplShareCharge_hxx_seen
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <list>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <TCaptLog.hxx>
+#include <THandle.hxx>
+
+namespace CP {
+    template <class Object, class Weighting, class Real = double>
+    class TTmplShareCharge;
+
+    namespace TmplShareCharge {
+        struct TPhysicsWeights;
+        struct TUnitWeights;
+
+        /// The methods used to find the link weights (see
+        /// TTmplShareCharge::SetMethod).
+        enum Method {kRelaxation, kLeastSquares};
+
+        /// Find the root of an element in a disjoint set forest.  The path
+        /// is halved as it's followed.
+        inline int FindRoot(std::vector<int>& parent, int i) {
+            while (parent[i] != i) {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+            }
+            return i;
+        }
+
+        /// Join the sets containing two elements of a disjoint set forest.
+        inline void JoinSets(std::vector<int>& parent, int a, int b) {
+            a = FindRoot(parent,a);
+            b = FindRoot(parent,b);
+            if (a == b) return;
+            if (b < a) std::swap(a,b);
+            parent[b] = a;
+        }
+
+        /// Order the components so the biggest are solved first.
+        struct CompareComponentSize {
+            explicit CompareComponentSize(const std::vector<int>& begin)
+                : fBegin(begin) {}
+            bool operator () (int lhs, int rhs) const {
+                int l = fBegin[lhs+1] - fBegin[lhs];
+                int r = fBegin[rhs+1] - fBegin[rhs];
+                if (l != r) return r < l;
+                return lhs < rhs;
+            }
+            const std::vector<int>& fBegin;
+        };
+    };
+};
+
+/// The weighting policy for TTmplShareCharge when the links have physics
+/// weights (this is used by TDistributeCharge).  The physics weight sets the
+/// maximum contribution of a measurement to a measurement group, and the
+/// physics weights of the links to a measurement are normalized so the
+/// largest is one.  The charge of a group is the average of the charge in
+/// its links since each link is a separate measurement of the same charge.
+struct CP::TmplShareCharge::TPhysicsWeights {
+    /// The physics weights are used.
+    static const bool kPhysicsWeights = true;
+
+    /// Links with a small weight are not eliminated.
+    static const bool kEliminateLinks = false;
+
+    /// The physics weight used for a link.
+    static double PhysicsWeight(double w) {return w;}
+
+    /// The charge of a group given the charge summed over its links.
+    static double GroupCharge(double charge, int links) {
+        return charge/links;
+    }
+};
+
+/// The weighting policy for TTmplShareCharge without physics weights (this
+/// is used by TShareCharge).  Every link has a physics weight of one, so the
+/// multiplications by the physics weight drop out of the inner loops.  The
+/// charge of a group is the sum of the charge in its links.  Links with a
+/// weight below the weight cut are eliminated during the iteration.
+struct CP::TmplShareCharge::TUnitWeights {
+    /// The physics weights are ignored.
+    static const bool kPhysicsWeights = false;
+
+    /// Links with a small weight are eliminated.
+    static const bool kEliminateLinks = true;
+
+    /// The physics weight used for a link.
+    static double PhysicsWeight(double) {return 1.0;}
+
+    /// The charge of a group given the charge summed over its links.
+    static double GroupCharge(double charge, int) {return charge;}
+};
+
+/// Share charge among groups (ie TMeasurementGroup objects) of measurement
+/// objects (ie TMeasurement objects) that might overlap.  This is the solver
+/// used by TShareCharge and TDistributeCharge.  The first template argument
+/// is the type of the objects for the measurements and the groups (a
+/// CP::THandle), the second is the weighting policy
+/// (TmplShareCharge::TPhysicsWeights or TmplShareCharge::TUnitWeights), and
+/// the third is the floating point type used for the flat tables (see
+/// below).
+///
+/// The charge is shared among the groups by observing that if \f$n\f$
+/// groups contribute \f$Q_1\f$, ... \f$Q_n\f$ to the total charge in the
+/// event, then the total charge in a group \f$i\f$ can be expressed as
+///
+/// \f[ Q_i = w_i q_s + Q'_i \f]
+///
+/// where \f$q_s\f$ is an element of charge shared between multiple groups,
+/// \f$w_i\f$ is the fraction of the shared charge contributing to group
+/// \f$i\f$, and \f$Q'_i\f$ is the charge that is not shared with other
+/// groups.  For groups, the measurement element is taken to be a single hit
+/// and it will typically be shared between one (i.e. not shared), two or
+/// three groups.  For clarity, the following assumes the hit is shared
+/// between three groups, but the derived result is general.
+///
+/// When three groups overlap and share a measurement \f$q_s\f$, the
+/// ratio of the weights are related.
+///
+/// \f[\frac{w_1}{w_2} = \frac{Q'_1}{Q'_2},\ \frac{w_1}{w_3} = \frac{Q'_1}{Q'_3},\ \frac{w_2}{w_3} = \frac{Q'_2}{Q'_3}\f]
+///
+/// or equivalently
+///
+/// \f[\frac{w_1}{Q'_1} = \frac{w_2}{Q'_2},\ \frac{w_1}{Q'_1} = \frac{w_3}{Q'_3},\ \frac{w_2}{Q'_2} = \frac{w_3}{Q'_3}\f]
+///
+/// subject to the constraint that \f$w_1 + w_2 + w_3 = 1\f$.
+///
+/// The optimal choice of weights can then be found by minimizing
+///
+/// \f[S = \left(\frac{w_1}{Q'_1}-\frac{w_2}{Q'_2}\right)^2 + \left(\frac{w_1}{Q'_1} - \frac{w_3}{Q'_3}\right)^2 + \left(\frac{w_2}{Q'_2} - \frac{w_3}{Q'_3}\right)^2 + \left(w_1 + w_2 + w_3 - 1 \right)^2\f]
+///
+/// with respect to \f$w_1\f$, \f$w_2\f$, and \f$w_3\f$.  This has the simple
+/// solution that
+///
+/// \f[w_1 = \frac{Q'_1}{Q'_1 + Q'_2 + Q'_3}\f]
+///
+/// with similar solutions for all weights.
+///
+/// Finally, since the \f$Q'_i\f$ entering into the solution for \f$w_i\f$ may
+/// share measurements with other clusters, the solution for all of the
+/// weights contributing to an event must be solved iteratively.
+///
+/// The groups, measurements and links are built using AddGroup and
+/// TMeasurementGroup::AddMeasurement.  When Solve() is called, the links
+/// are copied into flat tables (contiguous arrays of the link weights with
+/// index ranges for the links of each measurement and each group) so that
+/// the relaxation iterations don't need to follow pointers through the
+/// lists.  The final weights are copied back into the TLink objects.  The
+/// link weights, physics weights, charges and group totals in the tables
+/// have the Real type.  The wire charges are only known to a few parts in a
+/// thousand, so float is precise enough for the usual tolerance of 0.01.
+/// It halves the memory used by the tables, and the loops over the links
+/// are written without branches so the compiler can vectorize them with
+/// twice as many values in each vector register.  The TLink objects always
+/// keep the weights as double.
+///
+/// The groups that share measurements form connected components (for 3D
+/// hits, these are usually the separate track regions) and the charge in
+/// one component doesn't affect the other components.  Each component is
+/// solved separately with its own convergence test, so small components stop
+/// as soon as they have converged.  The components can be solved in
+/// parallel using SetThreads().
+///
+/// There are two methods to find the weights (see SetMethod).  The default
+/// (kRelaxation) is the multiplicative relaxation described above.  The
+/// kLeastSquares method treats the charge sharing as a linear inverse
+/// problem.  The charge of each measurement is the sum of the charges of
+/// the groups linked to it, multiplied by the physics weight of each link,
+/// and the group charges are found with a non-negative least squares fit
+/// (coordinate descent with a small ridge term so that groups that can't be
+/// separated share the charge evenly).  The measurement charge is then
+/// split between the links in proportion to the fitted contribution of
+/// each group.  Both methods conserve the total charge of each measurement.
+/// When the measurements determine the group charges, the methods agree.
+/// When they don't (e.g. every 3D hit that can be made from two wires on
+/// each plane), they choose different solutions: the fit puts no charge on
+/// groups that it doesn't need, while the relaxation leaves some charge on
+/// every group.
+///
+/// This code is derived from the IMB3 event reconstruction.
+///
+/// \code
+/// /* #Id: share_flux.c,v 1.1 1994/02/28 19:33:15 clark Exp mcgrew # */
+/// /* Find the fraction of the total Cherenkov energy that is in each track. */
+/// /* This is called by a routine that finds the flux as a function of */
+/// /* direction.  The main entry point is (share_flux).   */
+/// \endcode
+template <class Object, class Weighting, class Real>
+class CP::TTmplShareCharge {
+public:
+    class TMeasurement;
+    class TLink;
+    class TMeasurementGroup;
+
+    typedef std::list<TLink*> TLinks;
+
+    typedef std::list<TLink> Links;
+    typedef std::set<TMeasurement> Measurements;
+    typedef std::list<TMeasurementGroup> Groups;
+
+    /// The methods used to find the link weights.  These are shared by all
+    /// of the instantiations so a method can be chosen before the precision.
+    typedef TmplShareCharge::Method Method;
+    static const Method kRelaxation = TmplShareCharge::kRelaxation;
+    static const Method kLeastSquares = TmplShareCharge::kLeastSquares;
+
+    TTmplShareCharge();
+    virtual ~TTmplShareCharge() {}
+
+    /// Add a new measurement group.  This allocates the new group empty and
+    /// then returns a reference.  The group will then need to have the
+    /// measurements that make up the group added to it.
+    TMeasurementGroup& AddGroup(Object& object);
+
+    void DumpGroups(bool dumpLinks = true) const;
+    void DumpMeasurements(bool dumpLinks = true) const;
+    void Dump(bool dumpLinks = true) const {DumpGroups(dumpLinks);}
+
+    /// Solve the coupled equations to find the optimal set of weight to share
+    /// the charge measurements among the measurement groups.  After this has
+    /// been called, the charge in the measurement groups have been updated.
+    /// The couple equations are solved using interative relaxation.  Each
+    /// connected component is iterated until the change is less than the
+    /// tolerance, or the maximum number of iterations is reached.  The
+    /// return value is the largest change in the last iteration of any
+    /// component.  The number of iterations and the time used are saved
+    /// (see GetIterations() and GetSolveTime()).
+    double Solve(double tolerance = 1E-3, int iterations = 2500);
+
+    /// Set the number of threads used to solve the connected components.
+    /// The result is the same for any number of threads.
+    void SetThreads(int threads) {fThreads = std::max(threads,1);}
+
+    /// Get the number of threads used to solve the connected components.
+    int GetThreads() const {return fThreads;}
+
+    /// Set the relaxation factor.  Each iteration moves the weights by this
+    /// factor times the change found by the fixed-point update, so 1.0 is
+    /// the plain fixed-point iteration.  Values less than one damp the
+    /// update, and values greater than one over-relax it.  A damping factor
+    /// of about 0.7 reaches the tolerance in the fewest iterations, but
+    /// doesn't give a result that is closer to the converged solution.  The
+    /// weights are kept positive and normalized.  If an iteration doesn't
+    /// reduce the change by at least 10%, the factor is halved (but not
+    /// below 0.05), and after an iteration that does, it's increased by
+    /// half (but not above the requested factor).  The convergence test uses
+    /// the undamped fixed-point change, so it doesn't depend on the factor.
+    void SetRelaxation(double r) {
+        fRelaxation = std::min(std::max(r,0.05),1.95);
+    }
+
+    /// Get the relaxation factor.
+    double GetRelaxation() const {return fRelaxation;}
+
+    /// Set the method used to find the link weights.  The relaxation factor
+    /// is only used by kRelaxation.
+    void SetMethod(Method method) {fMethod = method;}
+
+    /// Get the method used to find the link weights.
+    Method GetMethod() const {return fMethod;}
+
+    /// The largest number of iterations used for any connected component in
+    /// the last call to Solve.
+    int GetIterations() const {return fIterations;}
+
+    /// The total number of iterations for all of the connected components in
+    /// the last call to Solve.  This is a measure of the total work.
+    int GetTotalIterations() const {return fTotalIterations;}
+
+    /// The number of times a link was visited by the inner loops of the
+    /// solver in the last call to Solve.  This is a deterministic measure of
+    /// the work that doesn't depend on the machine.
+    long GetLinkVisits() const {return fLinkVisits;}
+
+    /// The number of connected components in the last call to Solve.
+    int GetComponents() const {return fComponentBegin.size() - 1;}
+
+    /// The number of components that didn't converge in the last call to
+    /// Solve.
+    int GetUnconverged() const {return fUnconverged;}
+
+    /// The value returned by the last call to Solve.
+    double GetChange() const {return fChange;}
+
+    /// The wall clock time spent in the last call to Solve (in seconds).
+    double GetSolveTime() const {return fSolveTime;}
+
+    /// Return the measurement groups.  This is how the result of the charge
+    /// sharing is accessed.
+    const Groups& GetGroups() const {return fGroups;}
+
+    /// Set the weight cut used to remove links where the weight is
+    /// effectively zero.  This is only used when the weighting policy
+    /// eliminates links.
+    void SetWeightCut(double w) {fWeightCut = w;}
+
+    /// Get the weight cut.
+    double GetWeightCut() const {return fWeightCut;}
+
+private:
+    /// The workspace for a thread solving the components.
+    struct Worker;
+
+    /// The result of solving one connected component.
+    struct Status {
+        Status() : fChange(0.0), fIterations(0), fWarnings(0),
+                   fLinkVisits(0) {}
+
+        /// The change in the last iteration.
+        double fChange;
+
+        /// The number of iterations used.
+        int fIterations;
+
+        /// The number of links found with a zero weight.
+        int fWarnings;
+
+        /// The number of link visits (see GetLinkVisits).
+        long fLinkVisits;
+    };
+
+    /// Solve a connected component and fill the status.  This only touches
+    /// the tables for the component, so different components can be solved
+    /// in parallel.
+    void SolveComponent(int c, double tolerance, int iterations,
+                        Status& status);
+
+    /// Find the weights for a component with the non-negative least squares
+    /// fit.  The weights must be normalized before it's called.  The change
+    /// is the fractional change of the group charges in the last iteration.
+    void FitComponent(int c, double tolerance, int iterations,
+                      Status& status);
+
+    /// This returns how much the fixed-point update changes the weights of a
+    /// component.  The weights are then moved by the relaxation factor times
+    /// that change, but the returned change isn't damped.  It should be
+    /// called until the change is small.  The weights must be normalized
+    /// before it's called (they are normalized again before it returns), and
+    /// the change is measured between the normalized weights.  The group
+    /// charges are cached for the iteration, so the cost is proportional to
+    /// the number of links.  The zero weight warnings and the link visits
+    /// are added to the status.
+    double RelaxWeights(int c, double relaxation, Status& status);
+
+    /// Get an measurement from the collection of measurements.  If the
+    /// measurement does not exist, then it will be added to the collection.
+    /// This returns a reference to the measurement.  This is used by the
+    /// TMeasurementGroup class.  The TMeasurementGroup object will need to
+    /// add the appropriate links between itself and the TMeasurement object.
+    TMeasurement* FindMeasurement(Object& object, double charge);
+
+    /// Create a new link between a measurement and a measurement group.  THis
+    /// is used by the TMeasurementGroup object.
+    TLink* CreateLink(TMeasurementGroup* group, TMeasurement* measurement,
+                      double physicsWeight);
+
+    /// Copy the measurements, groups and links into the flat tables used
+    /// by the relaxation.  The measurements are sorted by connected
+    /// component (and are in the order of fMeasurements inside a
+    /// component), so the measurements for component c are
+    /// [fComponentBegin[c], fComponentBegin[c+1]).  The links are stored in
+    /// measurement order so the links for measurement m are
+    /// [fMeasurementBegin[m], fMeasurementBegin[m+1]).  The links for group
+    /// g are fGroupLinks[fGroupBegin[g]] to fGroupLinks[fGroupBegin[g+1]-1]
+    /// in the order they were added to the group.  The groups in component
+    /// c are fComponentGroups[fComponentGroupBegin[c]] to
+    /// fComponentGroups[fComponentGroupBegin[c+1]-1].
+    void BuildTables();
+
+    /// Copy the weights from the flat tables back into the TLink objects.
+    void SaveWeights();
+
+    /// Normalize the physics weights of a measurement so the maximum physics
+    /// weight is 1.0.  This is only done when the weighting policy uses
+    /// physics weights.
+    void NormalizePhysicsWeights(int m);
+
+    /// Normalize the weights of a measurement.  With physics weights, the
+    /// weights are normalized so that the sum of the weights times the
+    /// physics weights is one, and none of the weights are greater than 1.0.
+    void NormalizeWeights(int m);
+
+    /// Find the new link weights for a measurement.  This returns the
+    /// number of links with a zero weight in groups with charge (which
+    /// shouldn't happen).  The number of link visits is added to visits.
+    int FindLinkWeights(int m, long& visits);
+
+    /// Update the weights of a measurement with the new weights.
+    void UpdateWeights(int m);
+
+    /// Eliminate excess links.  This checks for any links of a measurement
+    /// that have almost zero weight and eliminates them.  When a link is
+    /// eliminated, the new weights for all of the links to the group are
+    /// set to zero.
+    void EliminateLinks(int m);
+
+    /// Fill the total charge in each group of a component using the current
+    /// weights.  This is done once per iteration since the weights don't
+    /// change until UpdateWeights is called.  This returns the number of
+    /// link visits.
+    long SumGroupCharges(int c);
+
+    /// Fill fUniqueCharge for the links of a measurement.  This is the
+    /// charge in the linked group that isn't contributed by the
+    /// measurement, and is the same as TMeasurementGroup::GetUniqueCharge.
+    /// It's found by subtracting the measurement's links from the cached
+    /// group charge, so it doesn't loop over the links in the group.  This
+    /// returns the number of link visits.
+    long FindUniqueCharges(int m);
+
+    /// All of the measurements associated with this object.
+    Measurements fMeasurements;
+
+    /// All of the measurement groups associated with this object.
+    Groups fGroups;
+
+    /// All of the links between measurements and groups associated with this
+    /// object.
+    Links fLinks;
+
+    /// The charge fraction below which links are eliminated.  This is used to
+    /// remove links where the weight has effectively gone to zero.
+    double fWeightCut;
+
+    /// The TLink objects in the order of the flat tables.
+    std::vector<TLink*> fLinkObjects;
+
+    /// The link properties in the flat tables.  The physics charge is the
+    /// physics weight times the measurement charge.
+    std::vector<Real> fWeight;
+    std::vector<Real> fNewWeight;
+    std::vector<Real> fPhysicsWeight;
+    std::vector<Real> fPhysicsCharge;
+    std::vector<int> fLinkGroup;
+    std::vector<int> fLinkMeasurement;
+
+    /// The measurement charges and the range of links for each measurement.
+    std::vector<Real> fMeasurementCharge;
+    std::vector<int> fMeasurementBegin;
+
+    /// The range in fGroupLinks for each group, and the links in each group.
+    std::vector<int> fGroupBegin;
+    std::vector<int> fGroupLinks;
+
+    /// The charge in each group for the current iteration.  The number of
+    /// links in a group is fGroupBegin[g+1]-fGroupBegin[g].  This is the
+    /// fitted charge when the least squares method is used.
+    std::vector<Real> fGroupCharge;
+
+    /// The measurement charge not explained by the fitted group charges
+    /// (only used by the least squares method).
+    std::vector<Real> fResidual;
+
+    /// The unique charge of the group for each link (see FindUniqueCharges).
+    std::vector<Real> fUniqueCharge;
+
+    /// The link weights at the start of the current iteration.
+    std::vector<Real> fLastWeight;
+
+    /// The range of measurements for each connected component.
+    std::vector<int> fComponentBegin;
+
+    /// The groups in each connected component.
+    std::vector<int> fComponentGroupBegin;
+    std::vector<int> fComponentGroups;
+
+    /// The number of threads used to solve the components.
+    int fThreads;
+
+    /// The relaxation factor.
+    double fRelaxation;
+
+    /// The method used to find the link weights.
+    Method fMethod;
+
+    /// The statistics for the last call to Solve.
+    int fIterations;
+    int fTotalIterations;
+    long fLinkVisits;
+    int fUnconverged;
+    double fChange;
+    double fSolveTime;
+};
+
+/// An object describing a single measurement of the charge.  This measurement
+/// may be shared by more than one TMeasurementGroup, and it's contribution is
+/// going to be split over the TMeasurementGroups that contain it.  The
+/// TMeasurement objects are "singles" in the since that the charge (or
+/// energy) represented by a TMeasurement object is contained in exactly one
+/// TMeasurement object (i.e. charge is not shared between TMeasurement
+/// objects).  The TMeasurement object is connected to a single THit.
+template <class Object, class Weighting, class Real>
+class CP::TTmplShareCharge<Object,Weighting,Real>::TMeasurement {
+public:
+    explicit TMeasurement(const Object& hit, double charge)
+        : fObject(hit), fCharge(charge) {}
+
+    /// Get the raw measurement object used to construct the TMeasurement.
+    Object GetObject() const {return fObject;}
+
+    /// Get the amount of charge for this measurement.
+    double GetCharge() const {return fCharge;}
+
+    /// @{ Get the list of Link objects that contain this
+    /// TMeasurement object.
+    TLinks& GetLinks() {return fLinks;}
+    const TLinks& GetLinks() const {return fLinks;}
+    /// @}
+
+    /// Dump the measurement
+    void Dump(bool dumpLinks = true) const;
+
+    bool operator == (const TMeasurement& rhs) const {
+        return (CP::GetPointer(GetObject()) == CP::GetPointer(rhs.GetObject()));
+    }
+
+    bool operator < (const TMeasurement& rhs) const {
+        return (CP::GetPointer(GetObject()) < CP::GetPointer(rhs.GetObject()));
+    }
+
+private:
+    /// The object associated with this measurement.  This is a single
+    /// hit.
+    Object fObject;
+
+    /// The charge (i.e. the deposited energy) associated with this
+    /// measurement.
+    double fCharge;
+
+    /// A list of links to the clusters bins which contain this measurement
+    TLinks fLinks;
+};
+
+////////////////////////////////////////////////////////////////
+/// An object describing a group of measurements that are combined into a
+/// single cluster (or other "physics" related object).  This might represent
+/// a track that could share measurements (i.e. hits) with another track, or
+/// it could be a simple cluster.
+///
+/// In the context of CAPTAIN, this represents a 3D hit that is constructed
+/// from 2D hits.  A single 2D hit (i.e. the measurement in the context of
+/// CAPTAIN) might contribute to multiple 3D hits.
+template <class Object, class Weighting, class Real>
+class CP::TTmplShareCharge<Object,Weighting,Real>::TMeasurementGroup {
+public:
+    /// Create a new measurement group and assign the owner.
+    explicit TMeasurementGroup(TTmplShareCharge* owner, Object& object)
+        : fOwner(owner), fObject(object) {}
+
+    /// Add a new measurement to this group.  This takes an object that will
+    /// be linked to a TMeaasurement object (ie a THit), and the charge
+    /// associated with that object.  If the input object is already
+    /// associated with a TMeasurement, then a new link is added between that
+    /// measurement and the current TMeasurementGroup.  If the input object is
+    /// not associated with a TMeasurement, a new TMeasurement object is
+    /// created and the link to this TMeasurementGroup is established.  The
+    /// physics weight is ignored if the weighting policy doesn't use
+    /// physics weights.  The weight is the starting weight for the link.
+    /// The default starts the relaxation from scratch, but the weight from
+    /// a previous solution (see TChargeWeights) can be used so the solution
+    /// converges in a few iterations.  The starting weight is not allowed
+    /// to be less than 0.01 so that a link that was eliminated by the
+    /// previous solution can come back.
+    TMeasurement* AddMeasurement(Object& object,
+                                 double charge,
+                                 double physicsWeight = 1.0,
+                                 double weight = 1.0) {
+        // Find the existing measurement, or create a new one.
+        TMeasurement* measurement = fOwner->FindMeasurement(object,charge);
+        TLink* link = fOwner->CreateLink(this,measurement,physicsWeight);
+        link->SetWeight(std::max(weight, 0.01));
+        return measurement;
+    }
+
+    /// @{ Get the list of measurements that are part of this cluster bin.
+    const TLinks& GetLinks() const {return fLinks;}
+    TLinks& GetLinks() {return fLinks;}
+    // @}
+
+    /// Get the node that is associated with this cluster bin.
+    Object GetObject() const {return fObject;}
+
+    /// Get the total charge in the group.  This returns the charge for the
+    /// group adjusted by the current link weights (both physical and the
+    /// weights being fitted by TTmplShareCharge).
+    double GetGroupCharge() const {return GetUniqueCharge(NULL);}
+
+    /// Get the charge in the group not contributed by a particular
+    /// measurement.
+    double GetUniqueCharge(const TMeasurement* cb) const;
+
+    void Dump(bool dumpLinks = true) const;
+
+private:
+    // This should never be used!
+    TMeasurementGroup() :fOwner(NULL) {}
+
+    /// The owner of this object;
+    TTmplShareCharge* fOwner;
+
+    /// The track or shower node associated with the TMeasurementGroup.
+    Object fObject;
+
+    /// The measurements that are part of this cluster bin.
+    TLinks fLinks;
+};
+
+////////////////////////////////////////////////////////////////
+/// A link between a TMeasurement object and one of the TMeasurementGroup
+/// objects which contain it.  In addition to recording the connection between
+/// a TMeasurement object and a TMeasurementGroup object, the link records the
+/// fraction of the charge in the measurement that is associated with the
+/// TMeasurementGroup.
+template <class Object, class Weighting, class Real>
+class CP::TTmplShareCharge<Object,Weighting,Real>::TLink {
+public:
+    friend class TTmplShareCharge;
+
+    TLink() : fWeight(1.0), fNewWeight(1.0), fPhysicsWeight(1.0),
+              fMeasurement(NULL), fMeasurementGroup(NULL), fIndex(-1) {}
+
+    TLink(TMeasurementGroup* group, TMeasurement* charge)
+        : fWeight(1.0), fNewWeight(1.0), fPhysicsWeight(1.0),
+          fMeasurement(charge), fMeasurementGroup(group), fIndex(-1) { }
+
+    /// Get the weight of the measurement in the linked measurement group.
+    /// This is set as the result of the TTmplShareCharge algoritm.
+    double GetWeight() const {return fWeight;}
+
+    /// Set the weight of the measurement in the linked measurement group.
+    void SetWeight(double w) {fWeight = w;}
+
+    /// Get the new weight for the link.  This is used for internal
+    /// bookkeeping during the calculation of the link weight by the
+    /// TTmplShareCharge algorithm.
+    double GetNewWeight() const {return fNewWeight;}
+
+    /// Set the new weight for the link.  This is used for internal
+    /// bookkeeping during the calculation of the link weight by the
+    /// TTmplShareCharge algorithm.
+    void SetNewWeight(double w) {fNewWeight = w;}
+
+    /// Set the physics weight for this link.  This sents the maximum
+    /// contribution of a measurement to a measurement group.  It's ignored
+    /// if the weighting policy doesn't use physics weights.
+    void SetPhysicsWeight(double w) {fPhysicsWeight = w;}
+
+    /// Get the physics weight for this link.
+    double GetPhysicsWeight() const {
+        return Weighting::PhysicsWeight(fPhysicsWeight);
+    }
+
+    /// Get the raw charge for the link.  This is the raw charge for the
+    /// measurement without any weighting.
+    double GetRawCharge() const {return GetMeasurement()->GetCharge();}
+
+    /// Get the charge for the link.  This is the charge for the measurement
+    /// corrected for any physics effects such as attenuation.
+    double GetPhysicsCharge() const {return GetPhysicsWeight()*GetRawCharge();}
+
+    /// Get the weighted charge that the measurement associated with this link
+    /// adds to the measurement group associated with this link.
+    double GetCharge() const {return GetWeight()*GetPhysicsCharge();}
+
+    /// Get the measurement associated with the link.
+    const TMeasurement* GetMeasurement() const {return fMeasurement;}
+
+    /// Get the measurement group associated with this link.
+    const TMeasurementGroup* GetGroup() const {return fMeasurementGroup;}
+
+    /// Dump the values in the link.
+    void Dump() const;
+
+private:
+    /// The weight of the link (between 0 and 1).  This gives the amount of
+    /// charge in the measurement that should be added to the measurement group.
+    double fWeight;
+
+    /// The new weight of the link after relaxation.
+    double fNewWeight;
+
+    /// The physics based weighting between the measurement and the cluster
+    /// bin.  The weight applied to the measurement should be actually
+    /// fWeight*fPhysicsWeight.  The maximum value for the physics weight is
+    /// 1.0, and default value for the physics weight is 1.0.  Note that the
+    /// physics weight can not be greater than one.  All of the physics
+    /// weights for a measurement (i.e. the physics weights in the links
+    /// connected to a measurement) will be normalized so that the maximum
+    /// value is 1.0 (i.e. physicsWeight/maxhysicsWeight).  That is done in
+    /// NormalizePhysicsWeight.
+    double fPhysicsWeight;
+
+    /// The TMeasurement end of the link.
+    TMeasurement* fMeasurement;
+
+    /// The cluster end of the link;
+    TMeasurementGroup* fMeasurementGroup;
+
+    /// The order that the link was created by TTmplShareCharge.  This is
+    /// used to find the link in the flat tables used by Solve().
+    int fIndex;
+};
+
+/// The workspace for a thread solving components.  The worker takes
+/// components from the list until all of them are done.  The result for each
+/// component is saved separately so the result doesn't depend on the order
+/// that the components are solved.
+template <class Object, class Weighting, class Real>
+struct CP::TTmplShareCharge<Object,Weighting,Real>::Worker {
+    void operator () () {
+        for (;;) {
+            std::size_t next = (*fNext)++;
+            if (next >= fOrder->size()) break;
+            int c = (*fOrder)[next];
+            fSolver->SolveComponent(c, fTolerance, fIterations,
+                                    (*fStatus)[c]);
+        }
+    }
+
+    TTmplShareCharge* fSolver;
+    double fTolerance;
+    int fIterations;
+    const std::vector<int>* fOrder;
+    std::vector<Status>* fStatus;
+    std::atomic<std::size_t>* fNext;
+};
+
+//////////////////////////////////////////////////////////////////////
+// TMeasurement, TMeasurementGroup and TLink
+//////////////////////////////////////////////////////////////////////
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::TMeasurement::Dump(
+    bool dumpLinks) const {
+    CaptLog("TMeasurement(" << std::hex << this << ")"
+             << std::dec << " w/ " << fLinks.size() << " links"
+            << "  charge: " << GetCharge());
+    if (dumpLinks) {
+        CP::TCaptLog::IncreaseIndentation();
+        for (typename TLinks::const_iterator link = fLinks.begin();
+             link != fLinks.end(); ++link) {
+            (*link)->Dump();
+        }
+        CP::TCaptLog::DecreaseIndentation();
+    }
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::TMeasurementGroup::Dump(
+    bool dumpLinks) const {
+    CaptLog("TMeasurementGroup(" << std::hex << this << ")"
+             << std::dec << " w/ " << fLinks.size() << " links"
+            << "  charge: " << GetGroupCharge());
+    if (dumpLinks) {
+        CP::TCaptLog::IncreaseIndentation();
+        for (typename TLinks::const_iterator link = fLinks.begin();
+             link != fLinks.end(); ++link) {
+            (*link)->Dump();
+        }
+        CP::TCaptLog::DecreaseIndentation();
+    }
+}
+
+template <class Object, class Weighting, class Real>
+double CP::TTmplShareCharge<Object,Weighting,Real>::TMeasurementGroup::
+GetUniqueCharge(const TMeasurement* cb) const {
+    double charge = 0.0;
+    int count = 0;
+    for (typename TLinks::const_iterator link = GetLinks().begin();
+         link != GetLinks().end(); ++link) {
+        if ((*link)->GetMeasurement() == cb) continue;
+        charge += (*link)->GetCharge();
+        ++count;
+    }
+    if (count < 1) return 0.0;
+    return Weighting::GroupCharge(charge,count);
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::TLink::Dump() const {
+    CaptLog("TLink(" << std::hex << this << ")"
+            << std::dec <<std::setprecision(3) << " Q " << GetRawCharge()
+            << std::dec <<std::setprecision(3) << " G "
+            << GetGroup()->GetGroupCharge()
+            << std::dec <<std::setprecision(3) << " U "
+            << GetGroup()->GetUniqueCharge(GetMeasurement())
+            << std::dec <<std::setprecision(3) << " q " << GetCharge()
+            << std::dec <<std::setprecision(3) << " w " << fWeight
+            << std::dec <<std::setprecision(3) << " p " << fPhysicsWeight
+            << std::hex << " g " << fMeasurementGroup
+            << std::hex << " M " << fMeasurement
+            << std::dec);
+}
+
+/////////////////////////////////////////////////////////////////////
+// TTmplShareCharge
+/////////////////////////////////////////////////////////////////////
+
+template <class Object, class Weighting, class Real>
+const typename CP::TTmplShareCharge<Object,Weighting,Real>::Method
+CP::TTmplShareCharge<Object,Weighting,Real>::kRelaxation;
+
+template <class Object, class Weighting, class Real>
+const typename CP::TTmplShareCharge<Object,Weighting,Real>::Method
+CP::TTmplShareCharge<Object,Weighting,Real>::kLeastSquares;
+
+template <class Object, class Weighting, class Real>
+CP::TTmplShareCharge<Object,Weighting,Real>::TTmplShareCharge()
+    : fWeightCut(0.1), fThreads(1), fRelaxation(1.0), fMethod(kRelaxation),
+      fIterations(0), fTotalIterations(0), fLinkVisits(0), fUnconverged(0),
+      fChange(0.0), fSolveTime(0.0) {}
+
+template <class Object, class Weighting, class Real>
+typename CP::TTmplShareCharge<Object,Weighting,Real>::TMeasurementGroup&
+CP::TTmplShareCharge<Object,Weighting,Real>::AddGroup(Object& object) {
+    fGroups.push_back(TMeasurementGroup(this,object));
+    return fGroups.back();
+}
+
+template <class Object, class Weighting, class Real>
+typename CP::TTmplShareCharge<Object,Weighting,Real>::TMeasurement*
+CP::TTmplShareCharge<Object,Weighting,Real>::FindMeasurement(Object& object,
+                                                        double charge) {
+    typename Measurements::iterator m
+        = fMeasurements.insert(TMeasurement(object,charge)).first;
+    return const_cast<TMeasurement*>(&(*m));
+}
+
+template <class Object, class Weighting, class Real>
+typename CP::TTmplShareCharge<Object,Weighting,Real>::TLink*
+CP::TTmplShareCharge<Object,Weighting,Real>::CreateLink(
+    TMeasurementGroup* group, TMeasurement* measurement,
+    double physicsWeight) {
+    fLinks.push_back(TLink(group,measurement));
+    TLink* link = &fLinks.back();
+    link->fIndex = fLinks.size() - 1;
+    link->SetPhysicsWeight(physicsWeight);
+    measurement->GetLinks().push_back(link);
+    group->GetLinks().push_back(link);
+    return link;
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::DumpGroups(
+    bool dumpLinks) const {
+    CaptLog("TTmplShareCharge(" << std::hex << this << ")  Groups:");
+    CP::TCaptLog::IncreaseIndentation();
+    for (typename Groups::const_iterator g = fGroups.begin();
+         g != fGroups.end(); ++g) {
+        g->Dump(dumpLinks);
+    }
+    CP::TCaptLog::DecreaseIndentation();
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::DumpMeasurements(
+    bool dumpLinks) const {
+    CaptLog("TTmplShareCharge(" << std::hex << this << ")  Measurements:");
+    CP::TCaptLog::IncreaseIndentation();
+    for (typename Measurements::const_iterator m = fMeasurements.begin();
+         m != fMeasurements.end(); ++m) {
+        m->Dump(dumpLinks);
+    }
+    CP::TCaptLog::DecreaseIndentation();
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::BuildTables() {
+    std::size_t nLinks = fLinks.size();
+    std::size_t nMeasurements = fMeasurements.size();
+
+    // Find the group for each link (indexed by the order the links were
+    // created).
+    std::vector<int> creationGroup(nLinks, -1);
+    int nGroups = 0;
+    for (typename Groups::const_iterator g = fGroups.begin();
+         g != fGroups.end(); ++g, ++nGroups) {
+        for (typename TLinks::const_iterator link = g->GetLinks().begin();
+             link != g->GetLinks().end(); ++link) {
+            creationGroup[(*link)->fIndex] = nGroups;
+        }
+    }
+
+    // Find the connected components.  The groups linked to the same
+    // measurement are in the same component.
+    std::vector<int> parent(nGroups);
+    for (int g = 0; g < nGroups; ++g) parent[g] = g;
+    std::vector<typename Measurements::const_iterator> measurements;
+    measurements.reserve(nMeasurements);
+    for (typename Measurements::const_iterator m = fMeasurements.begin();
+         m != fMeasurements.end(); ++m) {
+        measurements.push_back(m);
+        const TLinks& links = m->GetLinks();
+        if (links.empty()) continue;
+        int first = creationGroup[links.front()->fIndex];
+        for (typename TLinks::const_iterator link = links.begin();
+             link != links.end(); ++link) {
+            TmplShareCharge::JoinSets(parent, first,
+                                      creationGroup[(*link)->fIndex]);
+        }
+    }
+
+    // Number the components in the order of the first measurement, and
+    // sort the measurements by component.
+    std::vector<int> groupComponent(nGroups, -1);
+    std::vector<int> measurementComponent(nMeasurements, -1);
+    fComponentBegin.assign(1, 0);
+    for (std::size_t m = 0; m < nMeasurements; ++m) {
+        const TLinks& links = measurements[m]->GetLinks();
+        int* component = &measurementComponent[m];
+        if (!links.empty()) {
+            int root = TmplShareCharge::FindRoot(
+                parent, creationGroup[links.front()->fIndex]);
+            component = &groupComponent[root];
+        }
+        if (*component < 0) {
+            *component = fComponentBegin.size() - 1;
+            fComponentBegin.push_back(0);
+        }
+        measurementComponent[m] = *component;
+        ++fComponentBegin[*component+1];
+    }
+    for (std::size_t c = 1; c < fComponentBegin.size(); ++c) {
+        fComponentBegin[c] += fComponentBegin[c-1];
+    }
+    std::vector<int> next(fComponentBegin.begin(), fComponentBegin.end()-1);
+    std::vector<int> order(nMeasurements);
+    for (std::size_t m = 0; m < nMeasurements; ++m) {
+        order[next[measurementComponent[m]]++] = m;
+    }
+
+    // Sort the groups by component.  A group without any links isn't in a
+    // component.
+    int components = fComponentBegin.size() - 1;
+    std::vector<int> groupComponents(nGroups, -1);
+    fComponentGroupBegin.assign(components+1, 0);
+    for (int g = 0; g < nGroups; ++g) {
+        int c = groupComponent[TmplShareCharge::FindRoot(parent, g)];
+        if (c < 0) continue;
+        groupComponents[g] = c;
+        ++fComponentGroupBegin[c+1];
+    }
+    for (int c = 0; c < components; ++c) {
+        fComponentGroupBegin[c+1] += fComponentGroupBegin[c];
+    }
+    fComponentGroups.resize(fComponentGroupBegin.back());
+    next.assign(fComponentGroupBegin.begin(), fComponentGroupBegin.end()-1);
+    for (int g = 0; g < nGroups; ++g) {
+        if (groupComponents[g] < 0) continue;
+        fComponentGroups[next[groupComponents[g]]++] = g;
+    }
+
+    // Find the position of each link in the tables.  The links are stored
+    // in the order of the measurements.
+    std::vector<int> position(nLinks, -1);
+    fLinkObjects.clear();
+    fLinkObjects.reserve(nLinks);
+    fLinkMeasurement.clear();
+    fLinkMeasurement.reserve(nLinks);
+    fMeasurementCharge.clear();
+    fMeasurementCharge.reserve(nMeasurements);
+    fMeasurementBegin.clear();
+    fMeasurementBegin.reserve(nMeasurements+1);
+    for (std::size_t i = 0; i < nMeasurements; ++i) {
+        typename Measurements::const_iterator m = measurements[order[i]];
+        fMeasurementBegin.push_back(fLinkObjects.size());
+        for (typename TLinks::const_iterator link = m->GetLinks().begin();
+             link != m->GetLinks().end(); ++link) {
+            position[(*link)->fIndex] = fLinkObjects.size();
+            fLinkObjects.push_back(*link);
+            fLinkMeasurement.push_back(fMeasurementCharge.size());
+        }
+        fMeasurementCharge.push_back(m->GetCharge());
+    }
+    fMeasurementBegin.push_back(fLinkObjects.size());
+
+    // Copy the link weights.
+    fWeight.resize(nLinks);
+    fNewWeight.resize(nLinks);
+    fPhysicsWeight.resize(nLinks);
+    fPhysicsCharge.resize(nLinks);
+    for (std::size_t l = 0; l < nLinks; ++l) {
+        fWeight[l] = fLinkObjects[l]->GetWeight();
+        fNewWeight[l] = fLinkObjects[l]->GetNewWeight();
+        fPhysicsWeight[l] = fLinkObjects[l]->GetPhysicsWeight();
+    }
+
+    // Fill the links for each group.
+    fLinkGroup.assign(nLinks, -1);
+    fGroupLinks.clear();
+    fGroupLinks.reserve(nLinks);
+    fGroupBegin.clear();
+    fGroupBegin.reserve(fGroups.size()+1);
+    for (typename Groups::const_iterator g = fGroups.begin();
+         g != fGroups.end(); ++g) {
+        int group = fGroupBegin.size();
+        fGroupBegin.push_back(fGroupLinks.size());
+        for (typename TLinks::const_iterator link = g->GetLinks().begin();
+             link != g->GetLinks().end(); ++link) {
+            int l = position[(*link)->fIndex];
+            fGroupLinks.push_back(l);
+            fLinkGroup[l] = group;
+        }
+    }
+    fGroupBegin.push_back(fGroupLinks.size());
+
+    fGroupCharge.assign(fGroups.size(), 0.0);
+    fResidual.assign(nMeasurements, 0.0);
+    fUniqueCharge.assign(nLinks, 0.0);
+    fLastWeight.assign(nLinks, 0.0);
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::SaveWeights() {
+    for (std::size_t l = 0; l < fLinkObjects.size(); ++l) {
+        fLinkObjects[l]->SetWeight(fWeight[l]);
+        fLinkObjects[l]->SetNewWeight(fNewWeight[l]);
+        if (!Weighting::kPhysicsWeights) continue;
+        fLinkObjects[l]->SetPhysicsWeight(fPhysicsWeight[l]);
+    }
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::NormalizePhysicsWeights(
+    int m) {
+    int begin = fMeasurementBegin[m];
+    int end = fMeasurementBegin[m+1];
+    double maxWeight = 0.0;
+    for (int l = begin; l < end; ++l) {
+        double w = fPhysicsWeight[l];
+        if (w<0) w = 0.0;
+        maxWeight = std::max(maxWeight,w);
+    }
+
+    if (maxWeight < 1E-6) {
+        for (int l = begin; l < end; ++l) fPhysicsWeight[l] = 1.0;
+        return;
+    }
+
+    for (int l = begin; l < end; ++l) {
+        double w = fPhysicsWeight[l];
+        if (w<0) w = maxWeight;
+        fPhysicsWeight[l] = w/maxWeight;
+    }
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::NormalizeWeights(int m) {
+    int begin = fMeasurementBegin[m];
+    int end = fMeasurementBegin[m+1];
+
+    // Without physics weights, the weights just add up to one.
+    if (!Weighting::kPhysicsWeights) {
+        Real totalWeight = 0.0;
+        for (int l = begin; l < end; ++l) {
+            Real w = fWeight[l];
+            if (w<0) w = 0;
+            totalWeight += w;
+        }
+        if (totalWeight < 1E-6) {
+            for (int l = begin; l < end; ++l) fWeight[l] = 1.0/(end-begin);
+            return;
+        }
+        for (int l = begin; l < end; ++l) {
+            Real w = fWeight[l];
+            if (w<0) w = 0;
+            fWeight[l] = w/totalWeight;
+        }
+        return;
+    }
+
+    Real totalWeight = 0;
+    Real weightOffset = 0.0;
+    int throttle = 5;
+    do {
+        totalWeight = 0;
+        for (int l = begin; l < end; ++l) {
+            Real w = fWeight[l]*fPhysicsWeight[l];
+            if (w<0) w = 0;
+            totalWeight += w;
+        }
+
+        // Make sure that at least some of the weights are positive.  If not,
+        // then set some default values.
+        if (totalWeight < 1E-6) {
+            totalWeight = 0.0;
+            for (int l = begin; l < end; ++l) {
+                fWeight[l] = 1.0/(end-begin);
+                Real w = fWeight[l]*fPhysicsWeight[l];
+                if (w<0) w = 0;
+                totalWeight += w;
+            }
+        }
+
+        Real scaleFactor = (totalWeight-weightOffset)/(1.0-weightOffset);
+
+        weightOffset = 0.0;
+        totalWeight = 0.0;
+        for (int l = begin; l < end; ++l) {
+            Real w = fWeight[l]/scaleFactor;
+            if (w<0) w = 0;
+            if (w>0.9999) {
+                w = 1.0;
+                weightOffset += w*fPhysicsWeight[l];
+            }
+            totalWeight += w*fPhysicsWeight[l];
+            fWeight[l] = w;
+        }
+    } while (std::abs(totalWeight-1.0) > 0.001 && 0 <= --throttle);
+}
+
+template <class Object, class Weighting, class Real>
+long CP::TTmplShareCharge<Object,Weighting,Real>::SumGroupCharges(int c) {
+    int begin = fMeasurementBegin[fComponentBegin[c]];
+    int end = fMeasurementBegin[fComponentBegin[c+1]];
+    for (int l = begin; l < end; ++l) fGroupCharge[fLinkGroup[l]] = 0.0;
+    for (int l = begin; l < end; ++l) {
+        fGroupCharge[fLinkGroup[l]] += fWeight[l]*fPhysicsCharge[l];
+    }
+    return 2L*(end - begin);
+}
+
+template <class Object, class Weighting, class Real>
+long CP::TTmplShareCharge<Object,Weighting,Real>::FindUniqueCharges(int m) {
+    int begin = fMeasurementBegin[m];
+    int end = fMeasurementBegin[m+1];
+    long visits = 0;
+    for (int l = begin; l < end; ++l) {
+        int g = fLinkGroup[l];
+        // Remove the charge from all of the links between the group and this
+        // measurement.  There is almost always only one.
+        Real charge = fGroupCharge[g];
+        int count = fGroupBegin[g+1] - fGroupBegin[g];
+        for (int k = begin; k < end; ++k) {
+            if (fLinkGroup[k] != g) continue;
+            charge -= fWeight[k]*fPhysicsCharge[k];
+            --count;
+        }
+        visits += end - begin;
+        if (count < 1) {
+            fUniqueCharge[l] = 0.0;
+            continue;
+        }
+        // Don't let rounding leave a negative charge.
+        fUniqueCharge[l] = Weighting::GroupCharge(std::max(charge, Real(0)),
+                                                  count);
+    }
+    return visits;
+}
+
+template <class Object, class Weighting, class Real>
+int CP::TTmplShareCharge<Object,Weighting,Real>::FindLinkWeights(
+    int m, long& visits) {
+    int begin = fMeasurementBegin[m];
+    int end = fMeasurementBegin[m+1];
+
+    // There isn't an overlap.
+    if (end - begin == 1) {
+        fNewWeight[begin] = 1.0;
+        return 0;
+    }
+
+    // Find the total charge in all the measurement groups, not including the
+    // charge in this measurement.
+    visits += FindUniqueCharges(m);
+    int warnings = 0;
+    Real totalCharge = 0.0;
+    for (int l = begin; l < end; ++l) {
+        Real q = fUniqueCharge[l];
+        if (q > 0 && fWeight[l] <= 0) ++warnings;
+        totalCharge += q;
+    }
+
+    // Find the new weights for each link in this measurement.  The new weight
+    // is the ratio of the unique charge in the measurement group that is
+    // linked to to the total charge.
+    if (!(totalCharge>1E-9)) {
+        for (int l = begin; l < end; ++l) fNewWeight[l] = 1.0/(end-begin);
+        return warnings;
+    }
+    Real scale = fMeasurementCharge[m]/totalCharge;
+    for (int l = begin; l < end; ++l) {
+        Real w = fWeight[l];
+        Real q = w*fPhysicsCharge[l];
+        w = (q > Real(1E-6)) ? w*(fUniqueCharge[l]/q) : Real(0);
+        fNewWeight[l] = std::min(w*scale, Real(1));
+    }
+
+    return warnings;
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::UpdateWeights(int m) {
+    int begin = fMeasurementBegin[m];
+    int end = fMeasurementBegin[m+1];
+    Real totalWeight = 0;
+    for (int l = begin; l < end; ++l) {
+        Real w = fNewWeight[l];
+        if (w<0) w = 0;
+        totalWeight += w;
+    }
+
+    if (totalWeight < 1E-6) return;
+
+    for (int l = begin; l < end; ++l) {
+        Real w = fNewWeight[l];
+        if (w<0) w = 0;
+        w = w/totalWeight;
+        fNewWeight[l] = w;
+        fWeight[l] = w;
+    }
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::EliminateLinks(int m) {
+    int begin = fMeasurementBegin[m];
+    int end = fMeasurementBegin[m+1];
+
+    // There isn't an overlap.
+    if (end - begin < 2) return;
+
+    // Get the total weight and the minimum weight.
+    Real totalWeight = 0;
+    Real minWeight = 1000.0;
+    int minLink = begin;
+    for (int l = begin; l < end; ++l) {
+        Real w = fWeight[l];
+        if (w<0) w = 0;
+        if (w>0 && w < minWeight) {
+            minLink = l;
+            minWeight = w;
+        }
+        totalWeight += w;
+    }
+
+    Real averageWeight = totalWeight/(end-begin);
+
+    if (minWeight > fWeightCut*averageWeight) return;
+
+    // The minimum link needs to be eliminated.  When it's eliminated, the
+    // other links to the TMeasurementGroup have their weights set to zero.
+    int g = fLinkGroup[minLink];
+    for (int i = fGroupBegin[g]; i < fGroupBegin[g+1]; ++i) {
+        fNewWeight[fGroupLinks[i]] = 0.0;
+    }
+}
+
+template <class Object, class Weighting, class Real>
+double CP::TTmplShareCharge<Object,Weighting,Real>::Solve(double tolerance,
+                                                     int iterations) {
+    CaptInfo("Share charge with tolerance: " << tolerance);
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+
+    // Copy the links into flat tables so the relaxation iterations are
+    // passes over contiguous arrays.
+    BuildTables();
+    int components = fComponentBegin.size() - 1;
+
+    // Solve the components.  The biggest components are started first so
+    // the threads finish at about the same time.
+    std::vector<Status> status(components);
+    std::size_t threads = std::min(fThreads, components);
+    if (threads > 1) {
+        std::vector<int> order(components);
+        for (int c = 0; c < components; ++c) order[c] = c;
+        std::sort(order.begin(), order.end(),
+                  TmplShareCharge::CompareComponentSize(fComponentBegin));
+        std::atomic<std::size_t> next(0);
+        std::vector<Worker> workers(threads);
+        std::vector<std::thread> pool;
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers[i].fSolver = this;
+            workers[i].fTolerance = tolerance;
+            workers[i].fIterations = iterations;
+            workers[i].fOrder = &order;
+            workers[i].fStatus = &status;
+            workers[i].fNext = &next;
+            pool.push_back(std::thread(std::ref(workers[i])));
+        }
+        for (std::size_t i = 0; i < pool.size(); ++i) pool[i].join();
+    }
+    else {
+        for (int c = 0; c < components; ++c) {
+            SolveComponent(c, tolerance, iterations, status[c]);
+        }
+    }
+
+    SaveWeights();
+
+    fChange = 0.0;
+    fIterations = 0;
+    fTotalIterations = 0;
+    fLinkVisits = 0;
+    fUnconverged = 0;
+    int zeroWeights = 0;
+    for (int c = 0; c < components; ++c) {
+        fChange = std::max(fChange, status[c].fChange);
+        fIterations = std::max(fIterations, status[c].fIterations);
+        fTotalIterations += status[c].fIterations;
+        fLinkVisits += status[c].fLinkVisits;
+        if (!(status[c].fChange < tolerance)) ++fUnconverged;
+        zeroWeights += status[c].fWarnings;
+    }
+    if (zeroWeights > 0) {
+        CaptSevere("Zero weight link in group with charge ("
+                   << zeroWeights << " times)");
+    }
+
+    fSolveTime = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    CaptInfo("Shared charge in " << components << " components"
+             << "  iterations: " << fIterations
+             << " (total " << fTotalIterations << ")"
+             << "  unconverged: " << fUnconverged
+             << "  change: " << fChange
+             << "  time: " << fSolveTime << " s");
+
+    return fChange;
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::SolveComponent(
+    int c, double tolerance, int iterations, Status& status) {
+    int begin = fComponentBegin[c];
+    int end = fComponentBegin[c+1];
+
+    // Make sure the input weights are normalized.
+    if (Weighting::kPhysicsWeights) {
+        for (int m = begin; m < end; ++m) NormalizePhysicsWeights(m);
+    }
+    for (int l = fMeasurementBegin[begin]; l < fMeasurementBegin[end]; ++l) {
+        fPhysicsCharge[l] = Weighting::PhysicsWeight(fPhysicsWeight[l])
+            *fMeasurementCharge[fLinkMeasurement[l]];
+    }
+    for (int m = begin; m < end; ++m) NormalizeWeights(m);
+
+    if (fMethod == kLeastSquares) {
+        FitComponent(c, tolerance, iterations, status);
+        return;
+    }
+
+    // Do the relaxation, but limit the total number of iterations.  The
+    // change is the undamped fixed-point step, so it only gets small when
+    // the weights have converged.  If an iteration doesn't make enough
+    // progress, the weights are oscillating (or the over-relaxation is too
+    // large), so the update is damped more.  After an iteration that makes
+    // progress, the damping is relaxed back toward the requested factor.
+    double relaxation = fRelaxation;
+    double change = 0.0;
+    status.fIterations = 0;
+    status.fWarnings = 0;
+    status.fLinkVisits = 0;
+    while (status.fIterations < iterations) {
+        double last = change;
+        change = RelaxWeights(c, relaxation, status);
+        ++status.fIterations;
+        if (change < tolerance) break;
+        if (status.fIterations < 2) continue;
+        if (change < 0.9*last) {
+            relaxation = std::min(1.5*relaxation, fRelaxation);
+        }
+        else {
+            relaxation = std::max(0.5*relaxation, 0.05);
+        }
+    }
+    status.fChange = change;
+}
+
+template <class Object, class Weighting, class Real>
+void CP::TTmplShareCharge<Object,Weighting,Real>::FitComponent(
+    int c, double tolerance, int iterations, Status& status) {
+    // The ridge term relative to the squared measurement residuals.  This
+    // breaks the degeneracy between groups that have the same links.
+    const double ridge = 0.01;
+
+    int begin = fComponentBegin[c];
+    int end = fComponentBegin[c+1];
+    int groupBegin = fComponentGroupBegin[c];
+    int groupEnd = fComponentGroupBegin[c+1];
+
+    // Start from the group charges for the current weights.
+    for (int m = begin; m < end; ++m) fResidual[m] = fMeasurementCharge[m];
+    for (int i = groupBegin; i < groupEnd; ++i) {
+        int g = fComponentGroups[i];
+        double charge = 0.0;
+        for (int j = fGroupBegin[g]; j < fGroupBegin[g+1]; ++j) {
+            int l = fGroupLinks[j];
+            charge += fWeight[l]*fPhysicsCharge[l];
+        }
+        charge /= fGroupBegin[g+1] - fGroupBegin[g];
+        fGroupCharge[g] = charge;
+        for (int j = fGroupBegin[g]; j < fGroupBegin[g+1]; ++j) {
+            int l = fGroupLinks[j];
+            fResidual[fLinkMeasurement[l]]
+                -= Weighting::PhysicsWeight(fPhysicsWeight[l])*charge;
+        }
+    }
+
+    // Do the coordinate descent.  Each group charge is set to the minimum
+    // of the (quadratic) objective with the other charges fixed, but isn't
+    // allowed to be negative.  The residuals are updated after each step.
+    double change = 0.0;
+    status.fIterations = 0;
+    status.fWarnings = 0;
+    status.fLinkVisits = 0;
+    while (status.fIterations < iterations) {
+        double moved = 0.0;
+        double total = 0.0;
+        for (int i = groupBegin; i < groupEnd; ++i) {
+            int g = fComponentGroups[i];
+            double gradient = 0.0;
+            double curvature = ridge;
+            for (int j = fGroupBegin[g]; j < fGroupBegin[g+1]; ++j) {
+                int l = fGroupLinks[j];
+                double p = Weighting::PhysicsWeight(fPhysicsWeight[l]);
+                gradient += p*fResidual[fLinkMeasurement[l]];
+                curvature += p*p;
+            }
+            status.fLinkVisits += fGroupBegin[g+1] - fGroupBegin[g];
+            double charge = fGroupCharge[g];
+            double step = (gradient - ridge*charge)/curvature;
+            if (charge + step < 0.0) step = -charge;
+            fGroupCharge[g] = charge + step;
+            total += fGroupCharge[g];
+            if (step == 0.0) continue;
+            moved += std::abs(step);
+            for (int j = fGroupBegin[g]; j < fGroupBegin[g+1]; ++j) {
+                int l = fGroupLinks[j];
+                fResidual[fLinkMeasurement[l]]
+                    -= Weighting::PhysicsWeight(fPhysicsWeight[l])*step;
+            }
+            status.fLinkVisits += fGroupBegin[g+1] - fGroupBegin[g];
+        }
+        ++status.fIterations;
+        change = (total > 0.0) ? moved/total : 0.0;
+        if (change < tolerance) break;
+    }
+    status.fChange = change;
+
+    // Split each measurement between the links in proportion to the fitted
+    // contribution of each group.  The charge of a link is the weight times
+    // the physics charge, so the physics weight cancels.
+    for (int m = begin; m < end; ++m) {
+        int linkBegin = fMeasurementBegin[m];
+        int linkEnd = fMeasurementBegin[m+1];
+        double total = 0.0;
+        for (int l = linkBegin; l < linkEnd; ++l) {
+            total += Weighting::PhysicsWeight(fPhysicsWeight[l])
+                *fGroupCharge[fLinkGroup[l]];
+        }
+        for (int l = linkBegin; l < linkEnd; ++l) {
+            double w = 1.0/(linkEnd - linkBegin);
+            if (total > 1E-9) w = fGroupCharge[fLinkGroup[l]]/total;
+            fWeight[l] = w;
+            fNewWeight[l] = w;
+        }
+    }
+}
+
+template <class Object, class Weighting, class Real>
+double CP::TTmplShareCharge<Object,Weighting,Real>::RelaxWeights(
+    int c, double relaxation, Status& status) {
+    int begin = fComponentBegin[c];
+    int end = fComponentBegin[c+1];
+    int linkBegin = fMeasurementBegin[begin];
+    int linkEnd = fMeasurementBegin[end];
+
+    // Check if any links need to be eliminated.  The new weights are reset
+    // to the current weights so that only the eliminated links change.
+    if (Weighting::kEliminateLinks) {
+        for (int l = linkBegin; l < linkEnd; ++l) fNewWeight[l] = fWeight[l];
+        for (int m = begin; m < end; ++m) EliminateLinks(m);
+        for (int m = begin; m < end; ++m) UpdateWeights(m);
+        for (int m = begin; m < end; ++m) NormalizeWeights(m);
+    }
+
+    // Save the weights from the last iteration.  They were normalized at
+    // the end of the last iteration (or by SolveComponent before the first
+    // one).
+    for (int l = linkBegin; l < linkEnd; ++l) fLastWeight[l] = fWeight[l];
+
+    // Do one iteration of relaxation.
+    status.fLinkVisits += SumGroupCharges(c);
+    for (int m = begin; m < end; ++m) {
+        status.fWarnings += FindLinkWeights(m, status.fLinkVisits);
+    }
+
+    // Update the weights with the changes.
+    for (int m = begin; m < end; ++m) UpdateWeights(m);
+
+    // Make sure the input weights are normalized.
+    for (int m = begin; m < end; ++m) NormalizeWeights(m);
+
+    // Find the average change of the link weights in each measurement.
+    // This is the full fixed-point step (before it's damped), so it doesn't
+    // get smaller when the relaxation factor is reduced.
+    double delta = 0.0;
+    for (int m = begin; m < end; ++m) {
+        Real change = 0.0;
+        for (int l = fMeasurementBegin[m]; l < fMeasurementBegin[m+1]; ++l) {
+            change += std::abs(fWeight[l] - fLastWeight[l]);
+        }
+        delta += change/(fMeasurementBegin[m+1] - fMeasurementBegin[m]);
+    }
+
+    // Relax the weights.  The step is between normalized weights, and the
+    // result is kept positive and normalized again.
+    if (relaxation != 1.0) {
+        Real r = relaxation;
+        for (int l = linkBegin; l < linkEnd; ++l) {
+            Real w = fLastWeight[l] + r*(fWeight[l] - fLastWeight[l]);
+            fWeight[l] = std::max(w, Real(0));
+        }
+        for (int m = begin; m < end; ++m) NormalizeWeights(m);
+    }
+
+    return delta/(end-begin);
+}
+#endif
@@ -0,0 +1,176 @@
+#include "TWaveformOverlap.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace {
+    /// The alignment of the overlap buffer in floats (32 bytes).
+    const int kAlign = 8;
+};
+
+CP::TWaveformOverlap::TWaveformOverlap()
+    : fOverlap(NULL), fBins(0), fCapacity(0),
+      fCharge(0.0), fMoment1(0.0), fMoment2(0.0), fFirst(0), fLast(0),
+      fVectorized(IsVectorAvailable()) {}
+
+CP::TWaveformOverlap::~TWaveformOverlap() {}
+
+bool CP::TWaveformOverlap::IsVectorAvailable() {
+#ifdef __AVX2__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void CP::TWaveformOverlap::Reserve(int bins) {
+    if (bins <= fCapacity && fOverlap) return;
+    // Leave room to align the start, and to read a full vector past the
+    // end.
+    fBuffer.resize(bins + 2*kAlign);
+    uintptr_t address = reinterpret_cast<uintptr_t>(&fBuffer[0]);
+    int shift = ((kAlign*sizeof(float)
+                  - address % (kAlign*sizeof(float)))
+                 % (kAlign*sizeof(float)))/sizeof(float);
+    fOverlap = &fBuffer[shift];
+    fCapacity = bins;
+}
+
+void CP::TWaveformOverlap::Fill(int bins, int waveforms,
+                                const float* const samples[],
+                                const int first[], const int count[],
+                                double threshold) {
+    Reserve(bins);
+    fBins = bins;
+    fCharge = 0.0;
+    fMoment1 = 0.0;
+    fMoment2 = 0.0;
+    fFirst = bins;
+    fLast = 0;
+    std::memset(fOverlap, 0, bins*sizeof(float));
+    if (waveforms < 1) return;
+
+    // The overlap is only non-zero where all of the waveforms have samples.
+    int begin = 0;
+    int end = bins;
+    for (int w = 0; w < waveforms; ++w) {
+        begin = std::max(begin, first[w]);
+        end = std::min(end, first[w]+count[w]);
+    }
+    if (end <= begin) return;
+
+    if (fVectorized) {
+        FillVector(begin, end, waveforms, samples, first, threshold);
+    }
+    else {
+        FillScalar(begin, end, waveforms, samples, first, threshold);
+    }
+}
+
+void CP::TWaveformOverlap::FillScalar(int begin, int end, int waveforms,
+                                      const float* const samples[],
+                                      const int first[],
+                                      float threshold) {
+    for (int i = begin; i < end; ++i) {
+        float v = samples[0][i-first[0]];
+        for (int w = 1; w < waveforms; ++w) {
+            v = std::min(v, samples[w][i-first[w]]);
+        }
+        v = std::max(0.0f, v);
+        fOverlap[i] = v;
+        double d = v;
+        fCharge += d;
+        fMoment1 += i*d;
+        fMoment2 += (double) i*i*d;
+        if (v > threshold) {
+            if (i < fFirst) fFirst = i;
+            fLast = i;
+        }
+    }
+}
+
+#ifdef __AVX2__
+void CP::TWaveformOverlap::FillVector(int begin, int end, int waveforms,
+                                      const float* const samples[],
+                                      const int first[],
+                                      float threshold) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 cut = _mm256_set1_ps(threshold);
+    const __m256d step = _mm256_set1_pd(4.0);
+    __m256d charge = _mm256_setzero_pd();
+    __m256d moment1 = _mm256_setzero_pd();
+    __m256d moment2 = _mm256_setzero_pd();
+    __m256d indexLow = _mm256_setr_pd(begin, begin+1, begin+2, begin+3);
+    __m256d indexHigh = _mm256_add_pd(indexLow, step);
+    const __m256d step2 = _mm256_set1_pd(8.0);
+
+    int i = begin;
+    for (; i + kAlign <= end; i += kAlign) {
+        __m256 v = _mm256_loadu_ps(samples[0] + (i-first[0]));
+        for (int w = 1; w < waveforms; ++w) {
+            v = _mm256_min_ps(v, _mm256_loadu_ps(samples[w] + (i-first[w])));
+        }
+        v = _mm256_max_ps(v, zero);
+        _mm256_storeu_ps(fOverlap + i, v);
+
+        __m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+        __m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+        charge = _mm256_add_pd(charge, _mm256_add_pd(low, high));
+        __m256d m1Low = _mm256_mul_pd(low, indexLow);
+        __m256d m1High = _mm256_mul_pd(high, indexHigh);
+        moment1 = _mm256_add_pd(moment1, _mm256_add_pd(m1Low, m1High));
+        moment2 = _mm256_add_pd(
+            moment2,
+            _mm256_add_pd(_mm256_mul_pd(m1Low, indexLow),
+                          _mm256_mul_pd(m1High, indexHigh)));
+        indexLow = _mm256_add_pd(indexLow, step2);
+        indexHigh = _mm256_add_pd(indexHigh, step2);
+
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(v, cut, _CMP_GT_OQ));
+        if (mask) {
+            if (fFirst > i) fFirst = i + __builtin_ctz(mask);
+            fLast = i + 31 - __builtin_clz(mask);
+        }
+    }
+
+    double sum[4];
+    _mm256_storeu_pd(sum, charge);
+    fCharge = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    _mm256_storeu_pd(sum, moment1);
+    fMoment1 = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    _mm256_storeu_pd(sum, moment2);
+    fMoment2 = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+
+    // Finish any remaining samples.
+    if (i < end) FillScalar(i, end, waveforms, samples, first, threshold);
+}
+#else
+void CP::TWaveformOverlap::FillVector(int begin, int end, int waveforms,
+                                      const float* const samples[],
+                                      const int first[],
+                                      float threshold) {
+    FillScalar(begin, end, waveforms, samples, first, threshold);
+}
+#endif
+
+void CP::TWaveformOverlap::Moments(int begin, int end,
+                                   double& sum,
+                                   double& moment1,
+                                   double& moment2) const {
+    sum = 0.0;
+    moment1 = 0.0;
+    moment2 = 0.0;
+    begin = std::max(begin, 0);
+    end = std::min(end, fBins);
+    for (int i = begin; i < end; ++i) {
+        double d = fOverlap[i];
+        sum += d;
+        moment1 += i*d;
+        moment2 += (double) i*i*d;
+    }
+}
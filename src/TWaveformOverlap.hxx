@@ -0,0 +1,126 @@
+#ifndef TWaveformOverlap_hxx_seen
+#define TWaveformOverlap_hxx_seen
+
+#include <vector>
+
+namespace CP {
+    class TWaveformOverlap;
+};
+
+/// Calculate the overlap between (up to three) wire waveforms.  The overlap
+/// in each time bin is the minimum of the waveforms in the bin, clipped so
+/// that it is never negative, and is zero for any bin that isn't covered by
+/// all of the waveforms.  This is the "overlap charge distribution" used by
+/// TCluster3D::MakeHit to decide if the wire hits are measuring the same
+/// drifting charge.  The overlap and its moments are calculated in a single
+/// pass.
+///
+/// The object owns the scratch buffer for the overlap, so it should be
+/// created once and reused for every calculation (one object per thread).
+///
+/// \code
+/// CP::TWaveformOverlap kernel;
+/// const float* samples[3] = {s1, s2, s3};
+/// int first[3] = {firstBin1, firstBin2, firstBin3};
+/// int count[3] = {count1, count2, count3};
+/// kernel.Fill(bins, 3, samples, first, count, 1.0);
+/// double charge = kernel.GetCharge();
+/// \endcode
+///
+/// If the code is compiled with AVX2 enabled (e.g. with "-mavx2" or
+/// "-march=native"), the overlap is calculated eight samples at a time,
+/// otherwise a scalar loop is used.  The samples are single precision, but
+/// the moments are accumulated in double precision.
+class CP::TWaveformOverlap {
+public:
+    TWaveformOverlap();
+    virtual ~TWaveformOverlap();
+
+    /// Fill the overlap distribution.  The distribution has "bins" time bins
+    /// and the waveforms are given by an array of pointers to the samples,
+    /// the bin for the first sample, and the number of samples.  All of the
+    /// waveform samples must be inside [0,bins).  If there are no waveforms,
+    /// the overlap is zero everywhere.  The first and last bins where the
+    /// overlap is more than threshold are saved.
+    void Fill(int bins, int waveforms,
+              const float* const samples[],
+              const int first[], const int count[],
+              double threshold);
+
+    /// The number of bins in the overlap distribution.
+    int GetBins() const {return fBins;}
+
+    /// The overlap distribution.  This has GetBins() entries and is aligned
+    /// for vector loads.
+    const float* GetOverlap() const {return fOverlap;}
+
+    /// The total overlap (sum of all bins).
+    double GetCharge() const {return fCharge;}
+
+    /// The sum of bin*overlap for all bins.
+    double GetMoment1() const {return fMoment1;}
+
+    /// The sum of bin*bin*overlap for all bins.
+    double GetMoment2() const {return fMoment2;}
+
+    /// The first bin where the overlap is above the threshold.  This is
+    /// GetBins() if no bin is above the threshold.
+    int GetFirst() const {return fFirst;}
+
+    /// The last bin where the overlap is above the threshold.  This is zero
+    /// if no bin is above the threshold.
+    int GetLast() const {return fLast;}
+
+    /// Calculate the moments of the overlap for the bins in [begin, end).
+    /// The sum is the sum of the overlaps, moment1 is the sum of
+    /// bin*overlap, and moment2 is the sum of bin*bin*overlap.
+    void Moments(int begin, int end,
+                 double& sum, double& moment1, double& moment2) const;
+
+    /// Choose whether the vectorized calculation is used.  This is mostly
+    /// for testing, and is ignored if the code was compiled without AVX2.
+    void SetVectorized(bool v) {fVectorized = v && IsVectorAvailable();}
+
+    /// True if the vectorized calculation is being used.
+    bool IsVectorized() const {return fVectorized;}
+
+    /// True if the code was compiled with the vectorized calculation.
+    static bool IsVectorAvailable();
+
+private:
+    /// Make sure the scratch buffer can hold the bins.
+    void Reserve(int bins);
+
+    /// The scalar version of the overlap calculation for [begin, end).
+    void FillScalar(int begin, int end, int waveforms,
+                    const float* const samples[], const int first[],
+                    float threshold);
+
+    /// The vectorized version of the overlap calculation for [begin, end).
+    void FillVector(int begin, int end, int waveforms,
+                    const float* const samples[], const int first[],
+                    float threshold);
+
+    /// The storage for the overlap.  This is larger than needed so that
+    /// fOverlap can be aligned.
+    std::vector<float> fBuffer;
+
+    /// The aligned overlap distribution inside fBuffer.
+    float* fOverlap;
+
+    /// The number of bins in the overlap.
+    int fBins;
+
+    /// The number of bins that can be held in the buffer.
+    int fCapacity;
+
+    double fCharge;
+    double fMoment1;
+    double fMoment2;
+    int fFirst;
+    int fLast;
+
+    /// Use the vectorized calculation.
+    bool fVectorized;
+};
+#endif
@@ -0,0 +1,252 @@
+#include "TWireCrossings.hxx"
+
+#include <TCaptLog.hxx>
+#include <TManager.hxx>
+#include <TGeomIdManager.hxx>
+#include <CaptGeomId.hxx>
+#include <HEPUnits.hxx>
+
+#include <TGeoManager.h>
+#include <TGeoBBox.h>
+#include <TGeoVolume.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    /// Get the geometry of a wire from the detector geometry.  The wire
+    /// runs along the longest axis of its bounding box.  This returns false
+    /// if the wire isn't in the geometry.
+    bool wireGeometry(CP::TGeometryId id,
+                      CP::TWireCrossings::WireGeometry& wire) {
+        if (!CP::TManager::Get().GeomId().CdId(id)) return false;
+        const TGeoBBox* box = dynamic_cast<const TGeoBBox*>(
+            gGeoManager->GetCurrentVolume()->GetShape());
+        if (!box) return false;
+        double halfLength[3] = {box->GetDX(), box->GetDY(), box->GetDZ()};
+        int axis = std::max_element(halfLength, halfLength+3) - halfLength;
+        double local[3] = {0.0, 0.0, 0.0};
+        double master[3];
+        gGeoManager->LocalToMaster(local,master);
+        local[axis] = 1.0;
+        double direction[3];
+        gGeoManager->LocalToMasterVect(local,direction);
+        wire = CP::TWireCrossings::WireGeometry(
+            id, TVector3(master[0], master[1], master[2]),
+            TVector3(direction[0], direction[1], direction[2]),
+            halfLength[axis]);
+        return true;
+    }
+
+    /// Get the geometry for all of the wires in the detector.  The wires in
+    /// each plane are numbered consecutively from zero.
+    std::vector<CP::TWireCrossings::WireGeometry> detectorWires() {
+        std::vector<CP::TWireCrossings::WireGeometry> wires;
+        CP::TWireCrossings::WireGeometry wire;
+        for (int plane = 0; plane < 3; ++plane) {
+            for (int w = 0;
+                 wireGeometry(CP::GeomId::Captain::Wire(plane,w), wire);
+                 ++w) {
+                wires.push_back(wire);
+            }
+        }
+        return wires;
+    }
+};
+
+const CP::TWireCrossings& CP::TWireCrossings::Get() {
+    static const CP::TWireCrossings crossings(detectorWires(), 2*unit::mm);
+    return crossings;
+}
+
+CP::TWireCrossings::TWireCrossings(const std::vector<WireGeometry>& wires,
+                                   double tolerance)
+    : fTolerance(tolerance) {
+    for (std::vector<WireGeometry>::const_iterator w = wires.begin();
+         w != wires.end(); ++w) {
+        int plane = CP::GeomId::Captain::GetWirePlane(w->fId);
+        if (plane < 0 || 2 < plane) continue;
+        int wire = CP::GeomId::Captain::GetWireNumber(w->fId);
+        if (wire < 0) continue;
+        std::vector<Wire>& planeWires = fWires[plane];
+        if ((int) planeWires.size() <= wire) planeWires.resize(wire+1);
+        Wire& geom = planeWires[wire];
+        if (geom.fValid) {
+            CaptError("Duplicate geometry for wire " << plane
+                      << "-" << wire);
+        }
+        geom.fValid = true;
+        geom.fX = w->fCenter.X();
+        geom.fY = w->fCenter.Y();
+        geom.fDX = w->fDirection.X();
+        geom.fDY = w->fDirection.Y();
+        geom.fHalfLength = std::max(w->fHalfLength, 0.0);
+    }
+    Build();
+}
+
+CP::TWireCrossings::~TWireCrossings() {}
+
+bool CP::TWireCrossings::HasWire(int plane, int wire) const {
+    if (plane < 0 || 2 < plane) return false;
+    if (wire < 0 || (int) fWires[plane].size() <= wire) return false;
+    return fWires[plane][wire].fValid;
+}
+
+void CP::TWireCrossings::Cross(const Wire& w1, const Wire& w2,
+                               double& x, double& y) const {
+    // This must be kept in sync with TCluster3D::PositionXY.
+    double s1 = -(w2.fDX*(w1.fY-w2.fY)+w2.fDY*w2.fX-w2.fDY*w1.fX)
+        /(w2.fDX*w1.fDY-w1.fDX*w2.fDY);
+    x = w1.fX+s1*w1.fDX;
+    y = w1.fY+s1*w1.fDY;
+}
+
+double CP::TWireCrossings::Distance(const Wire& xw,
+                                    double x, double y) const {
+    double len = std::sqrt(xw.fDX*xw.fDX + xw.fDY*xw.fDY);
+    if (len <= 0.0) return 0.0;
+    return ((x-xw.fX)*xw.fDX + (y-xw.fY)*xw.fDY)/len;
+}
+
+bool CP::TWireCrossings::Inside(const Wire& w, double x, double y) const {
+    if (w.fHalfLength <= 0.0) return true;
+    return std::abs(Distance(w,x,y)) <= w.fHalfLength + fTolerance;
+}
+
+void CP::TWireCrossings::Build() {
+    const std::vector<Wire>& xWires = fWires[CP::GeomId::Captain::kXPlane];
+    const std::vector<Wire>& vWires = fWires[CP::GeomId::Captain::kVPlane];
+    const std::vector<Wire>& uWires = fWires[CP::GeomId::Captain::kUPlane];
+    int nX = xWires.size();
+    int nV = vWires.size();
+    int nU = uWires.size();
+
+    CaptNamedInfo("TWireCrossings", "Build crossings for " << nX
+                  << " X, " << nV << " V, and " << nU << " U wires");
+
+    fXV.assign(2*nX*nV, 0.0);
+    fXU.assign(2*nX*nU, 0.0);
+    fXUOrder.assign(nX, std::vector<Crossing>());
+    fCompatible.assign(2*nX*nV, 0);
+    fXVInside.assign(nX*nV, 0);
+    fXUInside.assign(nX*nU, 0);
+
+    for (int x = 0; x < nX; ++x) {
+        const Wire& xw = xWires[x];
+        if (!xw.fValid) continue;
+
+        // Find the U crossings along the X wire.
+        std::vector<Crossing>& order = fXUOrder[x];
+        for (int u = 0; u < nU; ++u) {
+            const Wire& uw = uWires[u];
+            if (!uw.fValid) continue;
+            int index = PairIndex(x,u,nU);
+            Cross(xw,uw,fXU[2*index],fXU[2*index+1]);
+            fXUInside[index] = Inside(xw,fXU[2*index],fXU[2*index+1])
+                && Inside(uw,fXU[2*index],fXU[2*index+1]);
+            Crossing c;
+            c.fDistance = Distance(xw,fXU[2*index],fXU[2*index+1]);
+            c.fWire = u;
+            order.push_back(c);
+        }
+        std::sort(order.begin(), order.end());
+
+        // Find the V crossings along the X wire, and the range of U wires
+        // that cross near the V crossing.  The range is a little generous
+        // to protect against round off, and is checked exactly in
+        // Compatible().
+        for (int v = 0; v < nV; ++v) {
+            const Wire& vw = vWires[v];
+            if (!vw.fValid) continue;
+            int index = PairIndex(x,v,nV);
+            Cross(xw,vw,fXV[2*index],fXV[2*index+1]);
+            fXVInside[index] = Inside(xw,fXV[2*index],fXV[2*index+1])
+                && Inside(vw,fXV[2*index],fXV[2*index+1]);
+            double dist = Distance(xw,fXV[2*index],fXV[2*index+1]);
+            double slop = fTolerance*(1.0+1E-6) + 1E-6*unit::mm;
+            Crossing low;
+            low.fDistance = dist - slop;
+            low.fWire = -1;
+            Crossing high;
+            high.fDistance = dist + slop;
+            high.fWire = nU;
+            fCompatible[2*index]
+                = std::lower_bound(order.begin(), order.end(), low)
+                - order.begin();
+            fCompatible[2*index+1]
+                = std::upper_bound(order.begin(), order.end(), high)
+                - order.begin();
+        }
+    }
+}
+
+TVector3 CP::TWireCrossings::CrossingXV(int xWire, int vWire) const {
+    int index = PairIndex(xWire, vWire,
+                          fWires[CP::GeomId::Captain::kVPlane].size());
+    return TVector3(fXV[2*index], fXV[2*index+1], 0.0);
+}
+
+TVector3 CP::TWireCrossings::CrossingXU(int xWire, int uWire) const {
+    int index = PairIndex(xWire, uWire,
+                          fWires[CP::GeomId::Captain::kUPlane].size());
+    return TVector3(fXU[2*index], fXU[2*index+1], 0.0);
+}
+
+TVector3 CP::TWireCrossings::CrossingVU(int vWire, int uWire) const {
+    double x;
+    double y;
+    Cross(fWires[CP::GeomId::Captain::kVPlane][vWire],
+          fWires[CP::GeomId::Captain::kUPlane][uWire], x, y);
+    return TVector3(x, y, 0.0);
+}
+
+bool CP::TWireCrossings::Compatible(int xWire, int vWire, int uWire) const {
+    if (!HasWire(CP::GeomId::Captain::kXPlane, xWire)) return false;
+    if (!HasWire(CP::GeomId::Captain::kVPlane, vWire)) return false;
+    if (!HasWire(CP::GeomId::Captain::kUPlane, uWire)) return false;
+    int xv = 2*PairIndex(xWire, vWire,
+                         fWires[CP::GeomId::Captain::kVPlane].size());
+    int xu = 2*PairIndex(xWire, uWire,
+                         fWires[CP::GeomId::Captain::kUPlane].size());
+    double dx = fXU[xu] - fXV[xv];
+    double dy = fXU[xu+1] - fXV[xv+1];
+    return std::sqrt(dx*dx + dy*dy) <= fTolerance;
+}
+
+void CP::TWireCrossings::CompatibleU(int xWire, int vWire,
+                                     std::vector<int>& uWires) const {
+    if (!HasWire(CP::GeomId::Captain::kXPlane, xWire)) return;
+    if (!HasWire(CP::GeomId::Captain::kVPlane, vWire)) return;
+    int xv = 2*PairIndex(xWire, vWire,
+                         fWires[CP::GeomId::Captain::kVPlane].size());
+    const std::vector<Crossing>& order = fXUOrder[xWire];
+    for (int i = fCompatible[xv]; i < fCompatible[xv+1]; ++i) {
+        if (!Compatible(xWire, vWire, order[i].fWire)) continue;
+        uWires.push_back(order[i].fWire);
+    }
+}
+
+bool CP::TWireCrossings::Overlap(int xWire, int vWire, int uWire,
+                                 TVector3& position) const {
+    if (!Compatible(xWire, vWire, uWire)) return false;
+    position = CrossingXV(xWire,vWire)
+        + CrossingXU(xWire,uWire)
+        + CrossingVU(vWire,uWire);
+    position *= 1.0/3.0;
+    return true;
+}
+
+bool CP::TWireCrossings::CrossesXV(int xWire, int vWire) const {
+    if (!HasWire(CP::GeomId::Captain::kXPlane, xWire)) return false;
+    if (!HasWire(CP::GeomId::Captain::kVPlane, vWire)) return false;
+    return fXVInside[PairIndex(xWire, vWire,
+                               fWires[CP::GeomId::Captain::kVPlane].size())];
+}
+
+bool CP::TWireCrossings::CrossesXU(int xWire, int uWire) const {
+    if (!HasWire(CP::GeomId::Captain::kXPlane, xWire)) return false;
+    if (!HasWire(CP::GeomId::Captain::kUPlane, uWire)) return false;
+    return fXUInside[PairIndex(xWire, uWire,
+                               fWires[CP::GeomId::Captain::kUPlane].size())];
+}
@@ -0,0 +1,178 @@
+#ifndef TWireCrossings_hxx_seen
+#define TWireCrossings_hxx_seen
+
+#include <TGeometryId.hxx>
+
+#include <TVector3.h>
+
+#include <vector>
+
+namespace CP {
+    class TWireCrossings;
+};
+
+/// A table of the XY crossing points between the wires in the X, V and U
+/// planes.  The wire geometry is fixed, so the crossing points and the
+/// compatible wire combinations are calculated once and then looked up by
+/// (plane, wire number) for every candidate triplet.  The table is filled
+/// from the wire geometry (the wire center, direction and half length for
+/// each wire geometry identifier) when it's constructed and can't be changed
+/// afterwards, so it's safe to share between threads.  The table for the
+/// detector geometry is built the first time it's needed and is accessed
+/// with
+///
+/// \code
+/// const CP::TWireCrossings& crossings = CP::TWireCrossings::Get();
+/// if (!crossings.Compatible(xWire,vWire,uWire)) continue;
+/// \endcode
+///
+/// The crossing points are calculated using exactly the same arithmetic as
+/// TCluster3D::PositionXY, so the table gives identical results for hits on
+/// wires with the same geometry.  Wires that aren't in the geometry never
+/// cross any other wire.
+class CP::TWireCrossings {
+public:
+    /// The geometry of a single wire used to build the table.
+    struct WireGeometry {
+        WireGeometry() : fHalfLength(0) {}
+        WireGeometry(CP::TGeometryId id,
+                     const TVector3& center, const TVector3& direction,
+                     double halfLength)
+            : fId(id), fCenter(center), fDirection(direction),
+              fHalfLength(halfLength) {}
+        /// The geometry identifier of the wire.
+        CP::TGeometryId fId;
+        /// The center of the wire.
+        TVector3 fCenter;
+        /// The direction of the wire (only the XY components are used).
+        TVector3 fDirection;
+        /// The half length of the wire (zero if the wire is treated as
+        /// infinitely long).
+        double fHalfLength;
+    };
+
+    /// Get the table for the detector wire geometry.  The table is built
+    /// from the geometry the first time this is called, so it must not be
+    /// called before the geometry is loaded.
+    static const TWireCrossings& Get();
+
+    /// Build the crossing table for a set of wires.  Three wires are
+    /// considered to cross at a single point if the X-V and X-U crossing
+    /// points are within the tolerance.
+    TWireCrossings(const std::vector<WireGeometry>& wires, double tolerance);
+
+    virtual ~TWireCrossings();
+
+    /// Get the tolerance for three wires to cross at a single point.
+    double GetTolerance() const {return fTolerance;}
+
+    /// Check if there is a wire in the table.
+    bool HasWire(int plane, int wire) const;
+
+    /// Get the crossing point of an X and a V wire.  The z-position is always
+    /// zero.  The wires must be in the table.
+    TVector3 CrossingXV(int xWire, int vWire) const;
+
+    /// Get the crossing point of an X and a U wire.  The z-position is always
+    /// zero.  The wires must be in the table.
+    TVector3 CrossingXU(int xWire, int uWire) const;
+
+    /// Get the crossing point of a V and a U wire.  The z-position is always
+    /// zero.  The wires must be in the table.
+    TVector3 CrossingVU(int vWire, int uWire) const;
+
+    /// Return true if the X, V and U wires cross at a single point (that is,
+    /// the X-V and X-U crossings are within the tolerance).  This is the
+    /// same as the test applied in TCluster3D::OverlapXY.
+    bool Compatible(int xWire, int vWire, int uWire) const;
+
+    /// Fill the U wire numbers that are compatible with an X-V wire pair.
+    /// The wires are added to the output vector ordered by the position of
+    /// the crossing along the X wire.
+    void CompatibleU(int xWire, int vWire, std::vector<int>& uWires) const;
+
+    /// Check that the X, V and U wires cross at a single point and, if they
+    /// do, return the average of the three crossing points by reference.
+    /// This gives the same result as TCluster3D::OverlapXY.
+    bool Overlap(int xWire, int vWire, int uWire, TVector3& position) const;
+
+    /// Return true if an X and a V wire cross inside the length of both
+    /// wires (with the tolerance as a margin).  A wire with a zero half
+    /// length is treated as infinitely long.
+    bool CrossesXV(int xWire, int vWire) const;
+
+    /// Return true if an X and a U wire cross inside the length of both
+    /// wires.  See CrossesXV.
+    bool CrossesXU(int xWire, int uWire) const;
+
+private:
+    /// The cached geometry for a single wire.
+    struct Wire {
+        Wire() : fValid(false), fX(0), fY(0), fDX(0), fDY(0),
+                 fHalfLength(0) {}
+        bool fValid;
+        double fX;
+        double fY;
+        double fDX;
+        double fDY;
+        /// The half length of the wire (zero if it's not known).
+        double fHalfLength;
+    };
+
+    /// A crossing of an X and U wire saved as the distance along the X wire
+    /// (used to sort the U wires), and the U wire number.
+    struct Crossing {
+        double fDistance;
+        int fWire;
+        bool operator < (const Crossing& rhs) const {
+            if (fDistance < rhs.fDistance) return true;
+            if (rhs.fDistance < fDistance) return false;
+            return fWire < rhs.fWire;
+        }
+    };
+
+    /// Build all of the crossing tables from the wire geometry.
+    void Build();
+
+    /// Calculate the crossing point of two wires.  This is the same
+    /// calculation as TCluster3D::PositionXY.
+    void Cross(const Wire& w1, const Wire& w2, double& x, double& y) const;
+
+    /// The position of a point along a wire relative to the wire center.
+    double Distance(const Wire& xw, double x, double y) const;
+
+    /// Check if a point is inside the length of a wire (with the tolerance
+    /// as a margin).
+    bool Inside(const Wire& w, double x, double y) const;
+
+    /// Get the index of an X-V or X-U wire pair in the crossing tables.
+    int PairIndex(int xWire, int wire, int count) const {
+        return xWire*count + wire;
+    }
+
+    /// The geometry for the wires in each plane indexed by the wire number.
+    std::vector<Wire> fWires[3];
+
+    /// The X-V crossing points as (x,y) pairs indexed by PairIndex.
+    std::vector<double> fXV;
+
+    /// The X-U crossing points as (x,y) pairs indexed by PairIndex.
+    std::vector<double> fXU;
+
+    /// The X-U crossings for each X wire sorted by the distance along the X
+    /// wire.
+    std::vector< std::vector<Crossing> > fXUOrder;
+
+    /// The range in fXUOrder of the compatible U wires for each X-V wire
+    /// pair as [begin, end) pairs indexed by PairIndex.
+    std::vector<int> fCompatible;
+
+    /// Flags for the X-V and X-U wire pairs that cross inside the length of
+    /// both wires indexed by PairIndex.
+    std::vector<char> fXVInside;
+    std::vector<char> fXUInside;
+
+    /// The maximum distance between the X-V and X-U crossings.
+    double fTolerance;
+};
+#endif
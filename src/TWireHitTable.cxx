@@ -0,0 +1,98 @@
+#include "TWireHitTable.hxx"
+
+#include <CaptGeomId.hxx>
+
+#include <algorithm>
+
+CP::TWireHitTable::TWireHitTable() {}
+
+CP::TWireHitTable::~TWireHitTable() {}
+
+void CP::TWireHitTable::Clear() {
+    fRows.clear();
+    fHit.clear();
+    fPlane.clear();
+    fWire.clear();
+    fTime.clear();
+    fTimeStart.clear();
+    fTimeStop.clear();
+    fTimeRMS.clear();
+    fDriftTime.clear();
+    fDriftStart.clear();
+    fDriftStop.clear();
+    fCharge.clear();
+    fChargeUnc.clear();
+    fRMSX.clear();
+    fSampleCount.clear();
+    fSampleOffset.clear();
+    fSampleTotal.clear();
+    fSamples.clear();
+    fFloatSamples.clear();
+}
+
+void CP::TWireHitTable::Fill(const CP::THitSelection& hits) {
+    Clear();
+
+    std::size_t n = hits.size();
+    fRows.reserve(n);
+    fHit.reserve(n);
+    fPlane.reserve(n);
+    fWire.reserve(n);
+    fTime.reserve(n);
+    fTimeStart.reserve(n);
+    fTimeStop.reserve(n);
+    fTimeRMS.reserve(n);
+    fDriftTime.reserve(n);
+    fDriftStart.reserve(n);
+    fDriftStop.reserve(n);
+    fCharge.reserve(n);
+    fChargeUnc.reserve(n);
+    fRMSX.reserve(n);
+    fSampleCount.reserve(n);
+    fSampleOffset.reserve(n);
+    fSampleTotal.reserve(n);
+
+    for (CP::THitSelection::const_iterator h = hits.begin();
+         h != hits.end(); ++h) {
+        const CP::THit& hit = **h;
+        fRows.push_back(RowKey(CP::GetPointer(*h), fHit.size()));
+        fHit.push_back(*h);
+        fPlane.push_back(CP::GeomId::Captain::GetWirePlane(hit.GetGeomId()));
+        fWire.push_back(CP::GeomId::Captain::GetWireNumber(hit.GetGeomId()));
+        double time = hit.GetTime();
+        double start = hit.GetTimeStart();
+        double stop = hit.GetTimeStop();
+        double drift = fDrift.GetTime(hit);
+        fTime.push_back(time);
+        fTimeStart.push_back(start);
+        fTimeStop.push_back(stop);
+        fTimeRMS.push_back(hit.GetTimeRMS());
+        fDriftTime.push_back(drift);
+        fDriftStart.push_back(drift + start - time);
+        fDriftStop.push_back(drift + stop - time);
+        fCharge.push_back(hit.GetCharge());
+        fChargeUnc.push_back(hit.GetChargeUncertainty());
+        fRMSX.push_back(hit.GetRMS().X());
+        int samples = hit.GetTimeSamples();
+        fSampleCount.push_back(samples);
+        fSampleOffset.push_back(fSamples.size());
+        double total = 0.0;
+        for (int i = 0; i < samples; ++i) {
+            fSamples.push_back(hit.GetTimeSample(i));
+            total += fSamples.back();
+        }
+        fSampleTotal.push_back(total);
+    }
+
+    fFloatSamples.assign(fSamples.begin(), fSamples.end());
+    std::sort(fRows.begin(), fRows.end());
+}
+
+int CP::TWireHitTable::Find(const CP::THandle<CP::THit>& hit) const {
+    RowKey key(CP::GetPointer(hit), -1);
+    std::vector<RowKey>::const_iterator r
+        = std::lower_bound(fRows.begin(), fRows.end(), key);
+    if (r == fRows.end()) return -1;
+    if (r->first != key.first) return -1;
+    return r->second;
+}
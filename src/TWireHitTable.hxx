@@ -0,0 +1,159 @@
+#ifndef TWireHitTable_hxx_seen
+#define TWireHitTable_hxx_seen
+
+#include "TDriftPosition.hxx"
+
+#include <THandle.hxx>
+#include <THit.hxx>
+#include <THitSelection.hxx>
+
+#include <vector>
+
+namespace CP {
+    class TWireHitTable;
+};
+
+/// A per-event table of the wire hit properties used by the TCluster3D hot
+/// loops.  The properties are copied out of the hits once when the table is
+/// filled, and are then stored as separate contiguous arrays (one entry per
+/// hit) so that the matching, overlap and hit-making calculations don't need
+/// to go through the THandle and virtual THit accessors, or to recreate a
+/// TDriftPosition (which looks up the drift velocity in the runtime
+/// parameters) for every hit pair.  The table rows are in the same order as
+/// the THitSelection used to fill it, and the THit handle for each row is
+/// kept so that the output objects can refer to the original hits.
+///
+/// \code
+/// CP::TWireHitTable table;
+/// table.Fill(*wireHits);
+/// for (std::size_t i = 0; i < table.size(); ++i) {
+///     if (table.GetPlane(i) != CP::GeomId::Captain::kXPlane) continue;
+///     const double* samples = table.GetSamples(i);
+///     ...
+/// }
+/// \endcode
+///
+/// The drift corrected times are calculated with the same arithmetic as
+/// TDriftPosition::GetTime so they give identical results.
+class CP::TWireHitTable {
+public:
+    TWireHitTable();
+    virtual ~TWireHitTable();
+
+    /// Fill the table from a selection of wire hits.  Any previous contents
+    /// are removed.
+    void Fill(const CP::THitSelection& hits);
+
+    /// Remove all of the hits from the table.
+    void Clear();
+
+    /// The number of hits (rows) in the table.
+    std::size_t size() const {return fHit.size();}
+
+    /// True if the table is empty.
+    bool empty() const {return fHit.empty();}
+
+    /// Find the row for a hit.  This returns -1 if the hit is not in the
+    /// table.
+    int Find(const CP::THandle<CP::THit>& hit) const;
+
+    /// The drift position object used to fill the table.  This can be used
+    /// instead of constructing a new TDriftPosition (which looks up the
+    /// drift velocity in the runtime parameters).
+    const CP::TDriftPosition& GetDrift() const {return fDrift;}
+
+    /// The original hit.
+    const CP::THandle<CP::THit>& GetHit(int i) const {return fHit[i];}
+
+    /// The wire plane for the hit (see CP::GeomId::Captain::GetWirePlane).
+    int GetPlane(int i) const {return fPlane[i];}
+
+    /// The wire number for the hit.
+    int GetWire(int i) const {return fWire[i];}
+
+    /// The (uncorrected) central time of the hit.
+    double GetTime(int i) const {return fTime[i];}
+
+    /// The (uncorrected) start time of the hit.
+    double GetTimeStart(int i) const {return fTimeStart[i];}
+
+    /// The (uncorrected) stop time of the hit.
+    double GetTimeStop(int i) const {return fTimeStop[i];}
+
+    /// The time RMS of the hit.
+    double GetTimeRMS(int i) const {return fTimeRMS[i];}
+
+    /// The central time of the hit corrected to the Z=0 plane.  This is the
+    /// same as TDriftPosition::GetTime(hit).
+    double GetDriftTime(int i) const {return fDriftTime[i];}
+
+    /// The drift corrected start of the hit.  This is the start time moved
+    /// by the same drift correction as GetDriftTime().
+    double GetDriftStart(int i) const {return fDriftStart[i];}
+
+    /// The drift corrected stop of the hit.  This is the stop time moved by
+    /// the same drift correction as GetDriftTime().
+    double GetDriftStop(int i) const {return fDriftStop[i];}
+
+    /// The hit charge.
+    double GetCharge(int i) const {return fCharge[i];}
+
+    /// The uncertainty of the hit charge.
+    double GetChargeUncertainty(int i) const {return fChargeUnc[i];}
+
+    /// The X component of the hit RMS (perpendicular to the wire).
+    double GetRMSX(int i) const {return fRMSX[i];}
+
+    /// The number of time samples for the hit.
+    int GetSampleCount(int i) const {return fSampleCount[i];}
+
+    /// The sum of the time samples for the hit.
+    double GetSampleTotal(int i) const {return fSampleTotal[i];}
+
+    /// A pointer to the first time sample of the hit.  The samples for each
+    /// hit are contiguous.
+    const double* GetSamples(int i) const {
+        return fSamples.empty() ? NULL : &fSamples[fSampleOffset[i]];
+    }
+
+    /// A pointer to the first time sample of the hit as single precision.
+    /// This is used by the vectorized waveform calculations.
+    const float* GetFloatSamples(int i) const {
+        if (fFloatSamples.empty()) return NULL;
+        return &fFloatSamples[fSampleOffset[i]];
+    }
+
+private:
+    /// The drift calculation used to fill the table.
+    CP::TDriftPosition fDrift;
+
+    /// A (hit pointer, row) pair used to find the row for a hit.
+    typedef std::pair<const CP::THit*, int> RowKey;
+
+    /// The rows sorted by the hit pointer.
+    std::vector<RowKey> fRows;
+
+    std::vector< CP::THandle<CP::THit> > fHit;
+    std::vector<int> fPlane;
+    std::vector<int> fWire;
+    std::vector<double> fTime;
+    std::vector<double> fTimeStart;
+    std::vector<double> fTimeStop;
+    std::vector<double> fTimeRMS;
+    std::vector<double> fDriftTime;
+    std::vector<double> fDriftStart;
+    std::vector<double> fDriftStop;
+    std::vector<double> fCharge;
+    std::vector<double> fChargeUnc;
+    std::vector<double> fRMSX;
+    std::vector<int> fSampleCount;
+    std::vector<std::size_t> fSampleOffset;
+    std::vector<double> fSampleTotal;
+
+    /// The time samples for all of the hits.
+    std::vector<double> fSamples;
+
+    /// A single precision copy of fSamples.
+    std::vector<float> fFloatSamples;
+};
+#endif
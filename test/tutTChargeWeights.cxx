@@ -0,0 +1,107 @@
+#include <TChargeWeights.hxx>
+
+#include <HEPUnits.hxx>
+#include <TCaptLog.hxx>
+#include <TFADCHit.hxx>
+#include <TReconHit.hxx>
+#include <CaptGeomId.hxx>
+
+#include <tut.h>
+
+#include <vector>
+
+namespace {
+    // Make the X, V and U wire hits for a 3D hit.  New objects are made
+    // every time (like when an event is reprocessed).
+    void makeWires(int wire, double time, CP::THandle<CP::THit> wires[3]) {
+        CP::TWritableFADCHit hit;
+        hit.SetCharge(10.0);
+        hit.SetChargeUncertainty(1.0);
+        hit.SetTime(time);
+        hit.SetTimeRMS(1.0);
+        hit.SetTimeStart(time-1.0);
+        hit.SetTimeStop(time+1.0);
+        hit.SetTimeUncertainty(1.0);
+        int planes[3] = {CP::GeomId::Captain::kXPlane,
+                         CP::GeomId::Captain::kVPlane,
+                         CP::GeomId::Captain::kUPlane};
+        for (int p = 0; p < 3; ++p) {
+            hit.SetGeomId(CP::GeomId::Captain::Wire(planes[p],wire));
+            wires[p] = CP::THandle<CP::THit>(new CP::TFADCHit(hit));
+        }
+    }
+
+    // Make a 3D hit from the wire hits.
+    CP::THandle<CP::THit> makeHit(CP::THandle<CP::THit> wires[3], double z) {
+        CP::TWritableReconHit hit(wires[0], wires[1], wires[2]);
+        hit.SetPosition(TVector3(0.0, 0.0, z));
+        return CP::THandle<CP::THit>(new CP::TReconHit(hit));
+    }
+};
+
+namespace tut {
+    struct baseChargeWeights {
+        baseChargeWeights() {
+            // Run before each test.
+        }
+        ~baseChargeWeights() {
+            // Run after each test.
+        }
+    };
+
+    // Declare the test
+    typedef test_group<baseChargeWeights>::object testChargeWeights;
+    test_group<baseChargeWeights> groupChargeWeights("TChargeWeights");
+
+    // Check that the weights saved for a hit selection are found for new
+    // hits with the same wires, and that 3D hits made from the same wires
+    // are told apart by their position.
+    template<> template<> void testChargeWeights::test<1> () {
+        CP::THandle<CP::THit> wires[3];
+        CP::THitSelection hits;
+        makeWires(1, 1000.0, wires);
+        hits.push_back(makeHit(wires, 10.0*unit::mm));
+        hits.push_back(makeHit(wires, 20.0*unit::mm));
+        makeWires(2, 1000.0, wires);
+        hits.push_back(makeHit(wires, 10.0*unit::mm));
+
+        std::vector<double> saved;
+        for (int i = 0; i < 9; ++i) saved.push_back(0.1*(i+1));
+        CP::TChargeWeights weights;
+        ensure("Wrong number of weights isn't added",
+               !weights.Add(hits, std::vector<double>(8, 1.0)));
+        ensure("Weights are added", weights.Add(hits, saved));
+        ensure_equals("Number of hits", weights.size(), 3U);
+
+        std::vector<double> found;
+        makeWires(1, 1000.0, wires);
+        ensure("Second hit is found",
+               weights.GetWeights(*makeHit(wires, 20.1*unit::mm), found));
+        ensure_equals("Second hit weights", found.size(), 3U);
+        ensure_distance("Second hit weight", found[0], 0.4, 1E-9);
+        ensure("Hit between the splits isn't found",
+               !weights.GetWeights(*makeHit(wires, 15.0*unit::mm), found));
+
+        makeWires(1, 2000.0, wires);
+        ensure("Hit with a different time isn't found",
+               !weights.GetWeights(*makeHit(wires, 10.0*unit::mm), found));
+
+        // Fill the weights for a new selection.  The unknown hit gets the
+        // default weights.
+        CP::THitSelection again;
+        makeWires(2, 1000.0, wires);
+        again.push_back(makeHit(wires, 10.0*unit::mm));
+        makeWires(3, 1000.0, wires);
+        again.push_back(makeHit(wires, 10.0*unit::mm));
+        std::vector<double> filled;
+        weights.Fill(again, filled);
+        ensure_equals("Filled weights", filled.size(), 6U);
+        ensure_distance("Known hit weight", filled[2], 0.9, 1E-9);
+        ensure_distance("Unknown hit weight", filled[3], 1.0, 1E-9);
+    }
+};
+
+// Local Variables:
+// mode:c++
+// c-basic-offset:4
+// End:
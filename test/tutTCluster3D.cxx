@@ -0,0 +1,446 @@
+#include <TCluster3D.hxx>
+#include <TWireHitTable.hxx>
+#include <TDriftPosition.hxx>
+
+#include <HEPUnits.hxx>
+#include <TCaptLog.hxx>
+#include <TFADCHit.hxx>
+#include <TRuntimeParameters.hxx>
+#include <TRealDatum.hxx>
+#include <CaptGeomId.hxx>
+
+#include <tut.h>
+
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cmath>
+
+namespace {
+    // The wire layout assumed by the fixture: three planes of wires with a
+    // 3 mm pitch, the X wires running along the Y axis and the V and U
+    // wires rotated by +/- 60 degrees, and wire 50 through the center.
+    const double gPitch = 3.0*unit::mm;
+    const int gCenterWire = 50;
+    const int gWireCount = 100;
+
+    double wireAngle(int plane) {
+        double angle[3] = {0.0, M_PI/3.0, -M_PI/3.0};
+        return angle[plane];
+    }
+
+    // Add the wire hits for a straight track between two points.  The hit
+    // time is the drift time to the wire plane at Z equal to zero.
+    void addTrack(CP::THitSelection& hits,
+                  const TVector3& begin, const TVector3& end,
+                  double charge) {
+        double velocity = CP::TRuntimeParameters::Get().GetParameterD(
+            "captRecon.driftVelocity");
+        double step = 500*unit::ns;
+        for (int p = 0; p < 3; ++p) {
+            double c = std::cos(wireAngle(p));
+            double s = std::sin(wireAngle(p));
+            // The coordinate perpendicular to the wires.
+            double u0 = begin.X()*c - begin.Y()*s;
+            double u1 = end.X()*c - end.Y()*s;
+            for (int w = 0; w < gWireCount; ++w) {
+                double offset = (w - gCenterWire)*gPitch;
+                double f = (offset - u0)/(u1 - u0);
+                if (f < 0.0 || f > 1.0) continue;
+                double z = begin.Z() + f*(end.Z() - begin.Z());
+                double time = -z/velocity;
+                double rms = 1.0*unit::microsecond;
+                // Digitize a gaussian pulse with the total charge.
+                double start = step*std::floor((time - 3.0*rms)/step);
+                std::vector<double> samples;
+                for (double t = start; t < time + 3.0*rms; t += step) {
+                    double d = (t - time)/rms;
+                    samples.push_back(std::exp(-0.5*d*d));
+                }
+                double sum = 0.0;
+                for (std::size_t i = 0; i < samples.size(); ++i) {
+                    sum += samples[i];
+                }
+                for (std::size_t i = 0; i < samples.size(); ++i) {
+                    samples[i] *= charge/sum;
+                }
+                CP::TWritableFADCHit hit;
+                hit.SetGeomId(CP::GeomId::Captain::Wire(p,w));
+                hit.SetChannelId(CP::TChannelId(1000*p + w));
+                hit.SetCharge(charge);
+                hit.SetChargeUncertainty(std::sqrt(charge));
+                hit.SetTime(time);
+                hit.SetTimeRMS(rms);
+                hit.SetTimeStart(start);
+                hit.SetTimeStop(start + step*(samples.size()-1));
+                hit.SetTimeUncertainty(rms);
+                hit.SetTimeSamples(samples);
+                hits.push_back(CP::THandle<CP::THit>(new CP::TFADCHit(hit)));
+            }
+        }
+    }
+
+    // Make the fixed event: two short tracks at different drift distances.
+    CP::THitSelection* makeEvent() {
+        CP::THitSelection* hits = new CP::THitSelection("wires");
+        addTrack(*hits,
+                 TVector3(-8*unit::mm, -6*unit::mm, -100*unit::mm),
+                 TVector3(9*unit::mm, 7*unit::mm, -115*unit::mm),
+                 1000.0);
+        addTrack(*hits,
+                 TVector3(6*unit::mm, -10*unit::mm, -300*unit::mm),
+                 TVector3(-5*unit::mm, 9*unit::mm, -290*unit::mm),
+                 600.0);
+        return hits;
+    }
+
+    // Make a busier event with random straight tracks.
+    CP::THitSelection* makeBusyEvent(int tracks, unsigned int seed) {
+        CP::THitSelection* hits = new CP::THitSelection("wires");
+        std::srand(seed);
+        for (int t = 0; t < tracks; ++t) {
+            TVector3 begin((240.0*std::rand()/RAND_MAX - 120.0)*unit::mm,
+                           (240.0*std::rand()/RAND_MAX - 120.0)*unit::mm,
+                           -(50.0 + 550.0*std::rand()/RAND_MAX)*unit::mm);
+            TVector3 end((240.0*std::rand()/RAND_MAX - 120.0)*unit::mm,
+                         (240.0*std::rand()/RAND_MAX - 120.0)*unit::mm,
+                         -(50.0 + 550.0*std::rand()/RAND_MAX)*unit::mm);
+            addTrack(*hits, begin, end, 500.0 + 500.0*std::rand()/RAND_MAX);
+        }
+        return hits;
+    }
+
+    // Check that the wire geometry is the layout assumed by the fixture.
+    bool fixtureGeometry(const CP::THitSelection& hits) {
+        for (CP::THitSelection::const_iterator h = hits.begin();
+             h != hits.end(); ++h) {
+            CP::TGeometryId id = (*h)->GetGeomId();
+            int p = CP::GeomId::Captain::GetWirePlane(id);
+            int w = CP::GeomId::Captain::GetWireNumber(id);
+            double offset = (w - gCenterWire)*gPitch;
+            double c = std::cos(wireAngle(p));
+            double s = std::sin(wireAngle(p));
+            TVector3 center(offset*c, -offset*s, 0.0);
+            TVector3 direction(s, c, 0.0);
+            TVector3 position = (*h)->GetPosition();
+            position.SetZ(0.0);
+            if ((position - center).Mag() > 1E-6*unit::mm) return false;
+            if (std::abs((*h)->GetYAxis().Dot(direction)) < 1.0 - 1E-9) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The 3D hits made by TCluster3D from the fixed event in output order.
+    // The positions and wires are the same as the original (unoptimized)
+    // TCluster3D.  The charges are from the charge sharing after it was
+    // changed to stop at convergence, and the four hits on the X-U wire
+    // pairs 51-52 and 52-53 are only above the charge cut since then.
+    struct ExpectedHit {
+        double fX;
+        double fY;
+        double fZ;
+        double fCharge;
+        /// The X, V and U wire numbers (-1 if there isn't a wire).
+        int fWire[3];
+    };
+    const ExpectedHit gExpected[] = {
+        {-3, -1.732050808, -104.2704568, 435.0999601,
+         {49, 50, 49}},
+        {-3, -1.732050808, -106.2402395, 398.2333732,
+         {49, 50, 49}},
+        {0, 0, -105.602398, 402.93429,
+         {50, 50, 50}},
+        {0, 0, -107.9865864, 430.3990434,
+         {50, 50, 50}},
+        {-3, 5.196152423, -290.4710453, 255.4026088,
+         {49, 48, 51}},
+        {-3, 5.196152423, -292.956191, 344.5973912,
+         {49, 48, 51}},
+        {0, 0, -293.5306597, 312.1944566,
+         {50, 50, 50}},
+        {0, 0, -295.9989061, 287.8055434,
+         {50, 50, 50}},
+        {3, -5.196152423, -296.0360152, 271.5587641,
+         {51, 52, 49}},
+        {3, -5.196152423, -298.5049566, 328.4412359,
+         {51, 52, 49}},
+        {-6, -6.92820323, -99.48200615, 290.3026835,
+         {48, -1, 47}},
+        {-6, -6.92820323, -101.6329955, 459.6973165,
+         {48, -1, 47}},
+        {-6, -3.464101615, -100.8518784, 358.696693,
+         {48, -1, 48}},
+        {-6, -3.464101615, -103.2047999, 391.303307,
+         {48, -1, 48}},
+        {3, 1.732050808, -108.0742578, 393.8966497,
+         {51, -1, 51}},
+        {3, 1.732050808, -110.5002522, 498.7921213,
+         {51, -1, 51}},
+        {3, 5.196152423, -109.113716, 88.09192668,
+         {51, -1, 52}},
+        {3, 5.196152423, -111.2392146, 141.816732,
+         {51, -1, 52}},
+        {6, 3.464101615, -110.5396298, 324.0003415,
+         {52, -1, 52}},
+        {6, 3.464101615, -112.8592899, 430.5568332,
+         {52, -1, 52}},
+        {6, 6.92820323, -111.4913199, 84.17787128,
+         {52, -1, 53}},
+        {6, 6.92820323, -113.7188027, 146.2398811,
+         {52, -1, 53}},
+        {9, 5.196152423, -113.0076417, 343.4379927,
+         {53, -1, 53}},
+        {9, 5.196152423, -115.220915, 548.9896506,
+         {53, -1, 53}},
+        {6, -6.92820323, -297.8496474, 199.0153096,
+         {52, 53, -1}},
+        {6, -6.92820323, -300.1067739, 400.9846904,
+         {52, 53, -1}}
+    };
+};
+
+
+namespace tut {
+    struct baseCluster3D {
+        baseCluster3D() {
+            // Run before each test.
+        }
+        ~baseCluster3D() {
+            // Run after each test.
+        }
+    };
+
+    // Check that two hit selections have the same hits in the same order.
+    // The hits must have identical positions, times and charges, and must
+    // be made from the same wire hits.
+    void ensureSameHits(const CP::THitSelection& hits,
+                        const CP::THitSelection& reference) {
+        ensure_equals("Same number of hits", hits.size(), reference.size());
+        for (std::size_t i = 0; i < hits.size(); ++i) {
+            const CP::THit& hit = *hits[i];
+            const CP::THit& ref = *reference[i];
+            ensure_equals("Same hit X", hit.GetPosition().X(),
+                          ref.GetPosition().X());
+            ensure_equals("Same hit Y", hit.GetPosition().Y(),
+                          ref.GetPosition().Y());
+            ensure_equals("Same hit Z", hit.GetPosition().Z(),
+                          ref.GetPosition().Z());
+            ensure_equals("Same hit time", hit.GetTime(), ref.GetTime());
+            ensure_equals("Same hit charge", hit.GetCharge(),
+                          ref.GetCharge());
+            ensure_equals("Same number of constituents",
+                          hit.GetConstituentCount(),
+                          ref.GetConstituentCount());
+            for (int c = 0; c < hit.GetConstituentCount(); ++c) {
+                ensure("Same constituent",
+                       CP::GetPointer(hit.GetConstituent(c))
+                       == CP::GetPointer(ref.GetConstituent(c)));
+            }
+            if (hit.GetConstituentCount() > 0) continue;
+            ensure("Same wire hit", &hit == &ref);
+        }
+    }
+
+    // Declare the test
+    typedef test_group<baseCluster3D>::object testCluster3D;
+    test_group<baseCluster3D> groupCluster3D("TCluster3D");
+
+    // Test that the wire hit table has the hit properties.
+    template<> template<> void testCluster3D::test<1> () {
+        std::unique_ptr<CP::THitSelection> hits(makeEvent());
+        CP::TWireHitTable table;
+        table.Fill(*hits);
+        ensure_equals("Table has a row for each hit",
+                      table.size(), hits->size());
+        CP::TDriftPosition drift;
+        for (std::size_t i = 0; i < hits->size(); ++i) {
+            const CP::THandle<CP::THit>& hit = (*hits)[i];
+            ensure("Rows are in the input order",
+                   table.GetHit(i) == hit);
+            ensure_equals("Row is found", table.Find(hit), (int) i);
+            ensure_equals("Wire plane", table.GetPlane(i),
+                          CP::GeomId::Captain::GetWirePlane(
+                              hit->GetGeomId()));
+            ensure_equals("Wire number", table.GetWire(i),
+                          CP::GeomId::Captain::GetWireNumber(
+                              hit->GetGeomId()));
+            ensure_equals("Drift time", table.GetDriftTime(i),
+                          drift.GetTime(*hit));
+            ensure_equals("Drift start", table.GetDriftStart(i),
+                          table.GetDriftTime(i)
+                          + hit->GetTimeStart() - hit->GetTime());
+            ensure_equals("Sample count", table.GetSampleCount(i),
+                          hit->GetTimeSamples());
+            ensure_distance("Sample total", table.GetSampleTotal(i),
+                            hit->GetCharge(), 1E-9*hit->GetCharge());
+        }
+    }
+
+    // Test that clustering the fixed event gives the expected 3D hits.
+    template<> template<> void testCluster3D::test<2> () {
+        CP::TAlgorithmResult input;
+        input.AddHits(makeEvent());
+        CP::THandle<CP::THitSelection> hits = input.GetHits();
+        if (!fixtureGeometry(*hits)) {
+            CaptLog("TCluster3D fixture test skipped: the wire geometry"
+                    << " isn't the fixture layout");
+            return;
+        }
+
+        CP::TCluster3D cluster3D;
+        CP::THandle<CP::TAlgorithmResult> result
+            = cluster3D.Process(input, CP::TAlgorithmResult::Empty,
+                                CP::TAlgorithmResult::Empty);
+        ensure("Result is made", CP::GetPointer(result));
+        CP::THandle<CP::THitSelection> clustered
+            = result->GetHits("clustered");
+        ensure("Clustered hits are made", CP::GetPointer(clustered));
+        std::size_t expected = sizeof(gExpected)/sizeof(gExpected[0]);
+        ensure_equals("Number of 3D hits", clustered->size(), expected);
+
+        for (std::size_t i = 0; i < expected; ++i) {
+            const CP::THandle<CP::THit>& hit = (*clustered)[i];
+            const ExpectedHit& e = gExpected[i];
+            ensure_distance("Hit X", hit->GetPosition().X(), e.fX,
+                            1E-6*unit::mm);
+            ensure_distance("Hit Y", hit->GetPosition().Y(), e.fY,
+                            1E-6*unit::mm);
+            ensure_distance("Hit Z", hit->GetPosition().Z(), e.fZ,
+                            1E-6*unit::mm);
+            ensure_distance("Hit charge", hit->GetCharge(), e.fCharge,
+                            1E-6*e.fCharge);
+            int wires[3] = {-1, -1, -1};
+            for (int c = 0; c < hit->GetConstituentCount(); ++c) {
+                CP::TGeometryId id = hit->GetConstituent(c)->GetGeomId();
+                int plane = CP::GeomId::Captain::GetWirePlane(id);
+                ensure_equals("One constituent per plane", wires[plane], -1);
+                wires[plane] = CP::GeomId::Captain::GetWireNumber(id);
+            }
+            for (int p = 0; p < 3; ++p) {
+                ensure_equals("Constituent wire", wires[p], e.fWire[p]);
+            }
+        }
+
+        CP::THandle<CP::THitSelection> used = result->GetHits("used");
+        CP::THandle<CP::THitSelection> unused = result->GetHits("unused");
+        ensure("Used hits are saved", CP::GetPointer(used));
+        ensure("Unused hits are saved", CP::GetPointer(unused));
+        ensure_equals("Used wire hits", used->size(), 25U);
+        ensure_equals("Unused wire hits", unused->size(), 3U);
+    }
+
+    // Test that the result doesn't depend on the number of threads,
+    // including the order of the output hits.
+    template<> template<> void testCluster3D::test<3> () {
+        CP::TAlgorithmResult input;
+        input.AddHits(makeBusyEvent(12, 13579));
+
+        CP::TCluster3D cluster3D;
+        cluster3D.SetThreads(1);
+        ensure_equals("Single thread", cluster3D.GetThreads(), 1);
+        CP::THandle<CP::TAlgorithmResult> reference
+            = cluster3D.Process(input);
+        CP::THandle<CP::THitSelection> refClustered
+            = reference->GetHits("clustered");
+        CP::THandle<CP::THitSelection> refUsed = reference->GetHits("used");
+        CP::THandle<CP::THitSelection> refUnused
+            = reference->GetHits("unused");
+        ensure("3D hits are made", refClustered->size() > 0);
+
+        for (int threads = 2; threads <= 16; threads *= 2) {
+            CP::TCluster3D parallel;
+            parallel.SetThreads(threads);
+            CP::THandle<CP::TAlgorithmResult> result
+                = parallel.Process(input);
+            ensureSameHits(*result->GetHits("clustered"),
+                           *refClustered);
+            CP::THandle<CP::THitSelection> used = result->GetHits("used");
+            ensure_equals("Used hits saved", CP::GetPointer(used) != NULL,
+                          CP::GetPointer(refUsed) != NULL);
+            if (used) ensureSameHits(*used, *refUsed);
+            CP::THandle<CP::THitSelection> unused = result->GetHits("unused");
+            ensure_equals("Unused hits saved", CP::GetPointer(unused) != NULL,
+                          CP::GetPointer(refUnused) != NULL);
+            if (unused) ensureSameHits(*unused, *refUnused);
+        }
+    }
+
+    // Test that the saved charge sharing weights are used to start the
+    // charge sharing when the event is reprocessed.  The second pass
+    // starts from the converged weights, so it needs fewer iterations and
+    // finds almost the same charges.  The charge sharing is only solved to
+    // a tolerance, so the extra iterations move some of the hit charges,
+    // and a few hits with very little charge can be removed.
+    template<> template<> void testCluster3D::test<4> () {
+        CP::TAlgorithmResult input;
+        input.AddHits(makeBusyEvent(12, 13579));
+
+        CP::TCluster3D cluster3D;
+        cluster3D.SetSaveChargeWeights(true);
+        ensure("Charge weights are saved", cluster3D.GetSaveChargeWeights());
+        CP::THandle<CP::TAlgorithmResult> first = cluster3D.Process(input);
+        CP::THandle<CP::THitSelection> firstHits = first->GetHits("clustered");
+        CP::THandle<CP::TRealDatum> firstWeights
+            = first->Get<CP::TRealDatum>("chargeWeights");
+        ensure("Charge weights are in the result",
+               CP::GetPointer(firstWeights));
+        ensure("Charge weights are filled",
+               !firstWeights->GetVector().empty());
+        int coldIterations = cluster3D.GetChargeIterations();
+
+        CP::TCluster3D reprocess;
+        reprocess.SetSaveChargeWeights(true);
+        CP::THandle<CP::TAlgorithmResult> second
+            = reprocess.Process(input, CP::TAlgorithmResult::Empty, *first);
+        CP::THandle<CP::THitSelection> secondHits
+            = second->GetHits("clustered");
+        int warmIterations = reprocess.GetChargeIterations();
+        CaptLog("TCluster3D charge iterations: cold " << coldIterations
+                << "  warm " << warmIterations);
+        ensure("Warm start uses fewer iterations",
+               warmIterations < coldIterations);
+
+        ensure("Hits aren't added",
+               secondHits->size() <= firstHits->size());
+        ensure("Almost all hits are kept",
+               secondHits->size() > 0.99*firstHits->size());
+        double firstCharge = 0.0;
+        for (std::size_t i = 0; i < firstHits->size(); ++i) {
+            firstCharge += (*firstHits)[i]->GetCharge();
+        }
+        double secondCharge = 0.0;
+        std::size_t agree = 0;
+        std::size_t j = 0;
+        for (std::size_t i = 0; i < secondHits->size(); ++i) {
+            const CP::THit& hit = *(*secondHits)[i];
+            secondCharge += hit.GetCharge();
+            // The hits are in the same order, so skip any removed hits.
+            while (j < firstHits->size()
+                   && (*firstHits)[j]->GetPosition() != hit.GetPosition()) {
+                ++j;
+            }
+            ensure("Hit is in the first pass", j < firstHits->size());
+            const CP::THit& ref = *(*firstHits)[j++];
+            if (std::abs(hit.GetCharge() - ref.GetCharge())
+                < 0.1*ref.GetCharge()) ++agree;
+        }
+        ensure("Most hit charges agree",
+               agree > 0.9*secondHits->size());
+        ensure_distance("Same total charge", secondCharge, firstCharge,
+                        0.01*firstCharge);
+
+        CP::THandle<CP::TRealDatum> secondWeights
+            = second->Get<CP::TRealDatum>("chargeWeights");
+        ensure("Charge weights are saved again",
+               CP::GetPointer(secondWeights));
+        ensure("Charge weights are saved for the second pass",
+               !secondWeights->GetVector().empty());
+    }
+};
+
+// Local Variables:
+// mode:c++
+// c-basic-offset:4
+// End:
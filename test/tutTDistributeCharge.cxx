@@ -8,6 +8,223 @@
 
 #include <tut.h>
 
+#include <ctime>
+#include <vector>
+
+namespace {
+    // Time the charge sharing for a problem where every measurement is
+    // shared by two groups and each group has linksPerGroup links.  The
+    // groups are windows that overlap by half their length.  This returns
+    // the CPU time for the fixed number of iterations.  If charges is
+    // provided, it's filled with the group charges, and if visits is
+    // provided, it's filled with the number of link visits.
+    template <class Share = CP::TDistributeCharge>
+    double timeDistributeCharge(int linksPerGroup, int links,
+                                int iterations, double tolerance = 0.0,
+                                CP::TDistributeCharge::Method method
+                                = CP::TDistributeCharge::kRelaxation,
+                                int* used = NULL,
+                                std::vector<double>* charges = NULL,
+                                double relaxation = 1.0,
+                                long* visits = NULL) {
+        int nMeasurements = links/2;
+        int nGroups = links/linksPerGroup;
+
+        CP::TWritableFADCHit hit;
+        hit.SetChargeUncertainty(1.0);
+        hit.SetTime(0.0);
+        hit.SetTimeRMS(1.0);
+        hit.SetTimeStart(-1.0);
+        hit.SetTimeStop(1.0);
+        hit.SetTimeUncertainty(1.0);
+        std::vector< CP::THandle<CP::THit> > measurements;
+        for (int m = 0; m < nMeasurements; ++m) {
+            hit.SetGeomId(CP::GeomId::Captain::Wire(
+                              CP::GeomId::Captain::kXPlane,m));
+            hit.SetCharge(1.0 + (m%7));
+            measurements.push_back(
+                CP::THandle<CP::THit>(new CP::TFADCHit(hit)));
+        }
+
+        Share distribute;
+        distribute.SetMethod(method);
+        distribute.SetRelaxation(relaxation);
+        for (int g = 0; g < nGroups; ++g) {
+            CP::TWritableReconHit groupHit(measurements[0],
+                                           measurements[1],
+                                           measurements[2]);
+            CP::THandle<CP::THit> object(new CP::TReconHit(groupHit));
+            typename Share::TMeasurementGroup& group
+                = distribute.AddGroup(object);
+            for (int j = 0; j < linksPerGroup; ++j) {
+                int m = (g*linksPerGroup/2 + j) % nMeasurements;
+                CP::THandle<CP::THit> measurement = measurements[m];
+                group.AddMeasurement(measurement,
+                                     measurement->GetCharge(),
+                                     1.0 + 0.1*(j%3));
+            }
+        }
+
+        std::clock_t start = std::clock();
+        distribute.Solve(tolerance, iterations);
+        double cpu = double(std::clock() - start)/CLOCKS_PER_SEC;
+        if (used) *used = distribute.GetIterations();
+        if (visits) *visits = distribute.GetLinkVisits();
+        if (charges) {
+            charges->clear();
+            for (typename Share::Groups::const_iterator g
+                     = distribute.GetGroups().begin();
+                 g != distribute.GetGroups().end(); ++g) {
+                charges->push_back(g->GetGroupCharge());
+            }
+        }
+        return cpu;
+    }
+
+    // Share the charge for the overlapping windows used by
+    // timeDistributeCharge (with 8 links per group) and return the number
+    // of iterations.  The measurement charges are changed by up to
+    // +-(scale-1)/2 (like a calibration change).  The links start with the
+    // weights in start (if it isn't empty), and the final link weights and
+    // group charges are returned.  This is solved to a tolerance of 1E-4 so
+    // that the cold start needs many iterations.
+    int warmStartWindows(int links, double scale,
+                         const std::vector<double>& start,
+                         std::vector<double>& weights,
+                         std::vector<double>& charges) {
+        const int linksPerGroup = 8;
+        int nMeasurements = links/2;
+        int nGroups = links/linksPerGroup;
+
+        CP::TWritableFADCHit hit;
+        hit.SetChargeUncertainty(1.0);
+        hit.SetTime(0.0);
+        hit.SetTimeRMS(1.0);
+        hit.SetTimeStart(-1.0);
+        hit.SetTimeStop(1.0);
+        hit.SetTimeUncertainty(1.0);
+        std::vector< CP::THandle<CP::THit> > measurements;
+        for (int m = 0; m < nMeasurements; ++m) {
+            hit.SetGeomId(CP::GeomId::Captain::Wire(
+                              CP::GeomId::Captain::kXPlane,m));
+            double change = 1.0 + (scale-1.0)*((m%5)/4.0 - 0.5);
+            hit.SetCharge(change*(1.0 + (m%7)));
+            measurements.push_back(
+                CP::THandle<CP::THit>(new CP::TFADCHit(hit)));
+        }
+
+        CP::TDistributeCharge distribute;
+        distribute.SetRelaxation(0.7);
+        std::size_t l = 0;
+        for (int g = 0; g < nGroups; ++g) {
+            CP::TWritableReconHit groupHit(measurements[0],
+                                           measurements[1],
+                                           measurements[2]);
+            CP::THandle<CP::THit> object(new CP::TReconHit(groupHit));
+            CP::DistributeCharge::TMeasurementGroup& group
+                = distribute.AddGroup(object);
+            for (int j = 0; j < linksPerGroup; ++j, ++l) {
+                int m = (g*linksPerGroup/2 + j) % nMeasurements;
+                CP::THandle<CP::THit> measurement = measurements[m];
+                double weight = 1.0;
+                if (l < start.size()) weight = start[l];
+                group.AddMeasurement(measurement,
+                                     measurement->GetCharge(),
+                                     1.0 + 0.1*(j%3), weight);
+            }
+        }
+
+        distribute.Solve(1E-4, 1000);
+
+        weights.clear();
+        charges.clear();
+        for (CP::TDistributeCharge::Groups::const_iterator g
+                 = distribute.GetGroups().begin();
+             g != distribute.GetGroups().end(); ++g) {
+            charges.push_back(g->GetGroupCharge());
+            for (CP::DistributeCharge::TLinks::const_iterator c
+                     = g->GetLinks().begin();
+                 c != g->GetLinks().end(); ++c) {
+                weights.push_back((*c)->GetWeight());
+            }
+        }
+        return distribute.GetIterations();
+    }
+
+    // Share the charge between the 3D hits made from two X, V and U wire
+    // hits (the same configuration as the tests below) and return the
+    // charges of the 3D hits.  The 3D hit i uses the X wire i%2, the V wire
+    // (i/2)%2 and the U wire i/4.  If physicsWeights is true, the 3D hits
+    // made from wires with different numbers get a smaller physics weight.
+    // If groups isn't empty, only the listed 3D hits are made (and the
+    // result is in the same order as the list).
+    std::vector<double> distributeWires(const double xCharge[2],
+                                        const double vCharge[2],
+                                        const double uCharge[2],
+                                        bool physicsWeights,
+                                        CP::TDistributeCharge::Method method,
+                                        const std::vector<int>& groups
+                                        = std::vector<int>()) {
+        CP::TWritableFADCHit hit;
+        hit.SetChargeUncertainty(1.0);
+        hit.SetTime(0.0);
+        hit.SetTimeRMS(1.0);
+        hit.SetTimeStart(-1.0);
+        hit.SetTimeStop(1.0);
+        hit.SetTimeUncertainty(1.0);
+        CP::THandle<CP::THit> wires[3][2];
+        const double* charges[3] = {xCharge, vCharge, uCharge};
+        int planes[3] = {CP::GeomId::Captain::kXPlane,
+                         CP::GeomId::Captain::kVPlane,
+                         CP::GeomId::Captain::kUPlane};
+        for (int p = 0; p < 3; ++p) {
+            for (int w = 0; w < 2; ++w) {
+                hit.SetGeomId(CP::GeomId::Captain::Wire(planes[p],w+1));
+                hit.SetCharge(charges[p][w]);
+                wires[p][w] = CP::THandle<CP::THit>(new CP::TFADCHit(hit));
+            }
+        }
+
+        std::vector<int> hits(groups);
+        if (hits.empty()) {
+            for (int i = 0; i < 8; ++i) hits.push_back(i);
+        }
+
+        CP::TDistributeCharge distribute;
+        distribute.SetMethod(method);
+        for (std::size_t h = 0; h < hits.size(); ++h) {
+            int i = hits[h];
+            int x = i%2;
+            int v = (i/2)%2;
+            int u = i/4;
+            CP::TWritableReconHit reconHit(wires[0][x],wires[1][v],
+                                           wires[2][u]);
+            CP::THandle<CP::THit> object(new CP::TReconHit(reconHit));
+            CP::DistributeCharge::TMeasurementGroup& group
+                = distribute.AddGroup(object);
+            double physicsWeight = 1.0;
+            if (physicsWeights) {
+                if (x != v) physicsWeight *= 0.1;
+                if (x != u) physicsWeight *= 0.1;
+                if (u != v) physicsWeight *= 0.1;
+            }
+            group.AddMeasurement(wires[0][x], charges[0][x], physicsWeight);
+            group.AddMeasurement(wires[1][v], charges[1][v], physicsWeight);
+            group.AddMeasurement(wires[2][u], charges[2][u], physicsWeight);
+        }
+
+        distribute.Solve();
+
+        std::vector<double> result;
+        for (CP::TDistributeCharge::Groups::const_iterator g
+                 = distribute.GetGroups().begin();
+             g != distribute.GetGroups().end(); ++g) {
+            result.push_back(g->GetGroupCharge());
+        }
+        return result;
+    }
+};
+
 namespace tut {
     struct baseDistributeCharge {
         baseDistributeCharge() {
@@ -479,6 +696,270 @@ namespace tut {
                          finalCharge,
                          expectedCharge, 0.0001);
     }
+
+    // Check the cost of the relaxation.  The cost of an iteration should be
+    // proportional to the number of links, and not depend on the number of
+    // links in each group.  This is checked with the number of link visits
+    // (when the group charge is summed for every link, the large groups
+    // visit about 64 times more links).  The CPU times are only logged
+    // since they depend on the machine.
+    template<> template<> void testDistributeCharge::test<5> () {
+        const int links = 1<<15;
+        const int iterations = 50;
+        const CP::TDistributeCharge::Method method
+            = CP::TDistributeCharge::kRelaxation;
+        int smallUsed = 0;
+        long smallVisits = 0;
+        double smallGroups = timeDistributeCharge(8, links, iterations, 0.0,
+                                                  method, &smallUsed, NULL,
+                                                  1.0, &smallVisits);
+        int largeUsed = 0;
+        long largeVisits = 0;
+        double largeGroups = timeDistributeCharge(512, links, iterations, 0.0,
+                                                  method, &largeUsed, NULL,
+                                                  1.0, &largeVisits);
+        int doubleUsed = 0;
+        long doubleVisits = 0;
+        double doubleLinks = timeDistributeCharge(8, 2*links, iterations, 0.0,
+                                                  method, &doubleUsed, NULL,
+                                                  1.0, &doubleVisits);
+
+        CaptLog("TDistributeCharge benchmark: " << links << " links"
+                << "  8 links/group: " << smallGroups << " s"
+                << "  512 links/group: " << largeGroups << " s"
+                << "  " << 2*links << " links: " << doubleLinks << " s");
+
+        ensure_equals("Small groups use all iterations",
+                      smallUsed, iterations);
+        ensure_equals("Large groups use all iterations",
+                      largeUsed, iterations);
+        ensure_equals("Double links use all iterations",
+                      doubleUsed, iterations);
+        ensure("Links are visited", smallVisits > 0);
+        ensure_equals("Iteration cost doesn't depend on the group size",
+                      largeVisits, smallVisits);
+        ensure_equals("Iteration cost is linear in the number of links",
+                      doubleVisits, 2*smallVisits);
+    }
+
+    // Check that the least squares method agrees with the relaxation when
+    // the 3D hit charges are unique.  Only three of the eight 3D hits are
+    // made, so the six wire charges determine the charge of each 3D hit,
+    // and both methods must find it to within a few percent of the charge
+    // of each hit.
+    template<> template<> void testDistributeCharge::test<6> () {
+        const double charges[2][3][2] = {{{5.0,3.0}, {4.0,4.0}, {5.0,3.0}},
+                                         {{6.0,3.0}, {5.0,4.0}, {5.0,4.0}}};
+        const int hits[2][3] = {{0, 2, 7}, {0, 1, 6}};
+        const double expected[2][3] = {{4.0, 1.0, 3.0}, {2.0, 3.0, 4.0}};
+        for (int t = 0; t < 2; ++t) {
+            std::vector<int> groups(hits[t], hits[t]+3);
+            std::vector<double> relaxed
+                = distributeWires(charges[t][0], charges[t][1], charges[t][2],
+                                  false, CP::TDistributeCharge::kRelaxation,
+                                  groups);
+            std::vector<double> fitted
+                = distributeWires(charges[t][0], charges[t][1], charges[t][2],
+                                  false, CP::TDistributeCharge::kLeastSquares,
+                                  groups);
+            for (std::size_t i = 0; i < groups.size(); ++i) {
+                ensure_distance("Relaxation finds the unique charge",
+                                relaxed[i], expected[t][i],
+                                0.05*expected[t][i]);
+                ensure_distance("Least squares finds the unique charge",
+                                fitted[i], expected[t][i],
+                                0.05*expected[t][i]);
+                ensure_distance("Least squares agrees with relaxation",
+                                fitted[i], relaxed[i], 0.05*relaxed[i]);
+            }
+        }
+    }
+
+    // Benchmark the least squares method against the relaxation.  Both
+    // methods are run to the same tolerance on the problem used for the
+    // relaxation benchmark.
+    template<> template<> void testDistributeCharge::test<7> () {
+        const int links = 1<<15;
+        const int iterations = 1000;
+        int relaxedIterations = 0;
+        double relaxed = timeDistributeCharge(
+            8, links, iterations, 0.01, CP::TDistributeCharge::kRelaxation,
+            &relaxedIterations);
+        int fittedIterations = 0;
+        double fitted = timeDistributeCharge(
+            8, links, iterations, 0.01, CP::TDistributeCharge::kLeastSquares,
+            &fittedIterations);
+
+        CaptLog("TDistributeCharge methods: " << links << " links"
+                << "  relaxation: " << relaxed << " s"
+                << " (" << relaxedIterations << " iterations)"
+                << "  least squares: " << fitted << " s"
+                << " (" << fittedIterations << " iterations)");
+
+        ensure("Relaxation converges", relaxedIterations < iterations);
+        ensure("Least squares converges", fittedIterations < iterations);
+    }
+
+    // Check that the single precision relaxation agrees with the double
+    // precision relaxation.  The group charges must agree to within the
+    // tolerance used by TCluster3D.
+    template<> template<> void testDistributeCharge::test<8> () {
+        const int links = 1<<15;
+        const int iterations = 1000;
+        const double tolerance = 0.01;
+        std::vector<double> doubleCharges;
+        int doubleIterations = 0;
+        double doubleTime = timeDistributeCharge<CP::TDistributeCharge>(
+            8, links, iterations, tolerance,
+            CP::TDistributeCharge::kRelaxation,
+            &doubleIterations, &doubleCharges);
+        std::vector<double> floatCharges;
+        int floatIterations = 0;
+        double floatTime = timeDistributeCharge<CP::TFloatDistributeCharge>(
+            8, links, iterations, tolerance,
+            CP::TDistributeCharge::kRelaxation,
+            &floatIterations, &floatCharges);
+
+        CaptLog("TDistributeCharge precision: " << links << " links"
+                << "  double: " << doubleTime << " s"
+                << " (" << doubleIterations << " iterations)"
+                << "  float: " << floatTime << " s"
+                << " (" << floatIterations << " iterations)");
+
+        ensure_equals("Same number of groups",
+                      floatCharges.size(), doubleCharges.size());
+        double doubleTotal = 0.0;
+        double floatTotal = 0.0;
+        for (std::size_t i = 0; i < doubleCharges.size(); ++i) {
+            doubleTotal += doubleCharges[i];
+            floatTotal += floatCharges[i];
+            ensure_distance("Single precision group charge",
+                            floatCharges[i], doubleCharges[i],
+                            tolerance*doubleCharges[i]);
+        }
+        ensure_tolerance("Single precision total charge",
+                         floatTotal, doubleTotal, tolerance);
+    }
+
+    // Check that starting from the weights of a previous solution converges
+    // in fewer iterations.  The second solution has the measurement charges
+    // changed by up to 2.5%.  The overlapping windows don't have a unique
+    // solution, so the warm and cold starts don't find the same group
+    // charges, but the total charge must be the same.
+    template<> template<> void testDistributeCharge::test<9> () {
+        const int links = 1<<12;
+        std::vector<double> none;
+        std::vector<double> weights;
+        std::vector<double> charges;
+        warmStartWindows(links, 1.0, none, weights, charges);
+
+        std::vector<double> coldWeights;
+        std::vector<double> coldCharges;
+        int cold = warmStartWindows(links, 1.05, none,
+                                    coldWeights, coldCharges);
+        std::vector<double> warmWeights;
+        std::vector<double> warmCharges;
+        int warm = warmStartWindows(links, 1.05, weights,
+                                    warmWeights, warmCharges);
+
+        CaptLog("TDistributeCharge warm start: " << links << " links"
+                << "  cold: " << cold << " iterations"
+                << "  warm: " << warm << " iterations");
+
+        ensure("Warm start uses fewer iterations", 4*warm < cold);
+        ensure_equals("Same number of groups",
+                      warmCharges.size(), coldCharges.size());
+        double coldTotal = 0.0;
+        double warmTotal = 0.0;
+        for (std::size_t i = 0; i < coldCharges.size(); ++i) {
+            coldTotal += coldCharges[i];
+            warmTotal += warmCharges[i];
+        }
+        ensure_tolerance("Warm start total charge",
+                         warmTotal, coldTotal, 0.001);
+    }
+
+    // Check that the convergence test doesn't depend on the relaxation
+    // factor.  A heavily damped iteration takes small steps, but it hasn't
+    // converged until the undamped step is less than the tolerance, so it
+    // can't need fewer iterations than the plain iteration.
+    template<> template<> void testDistributeCharge::test<10> () {
+        const int links = 1<<12;
+        const int iterations = 1000;
+        const double tolerance = 0.01;
+        int plain = 0;
+        timeDistributeCharge(8, links, iterations, tolerance,
+                             CP::TDistributeCharge::kRelaxation,
+                             &plain, NULL, 1.0);
+        int damped = 0;
+        timeDistributeCharge(8, links, iterations, tolerance,
+                             CP::TDistributeCharge::kRelaxation,
+                             &damped, NULL, 0.05);
+
+        CaptLog("TDistributeCharge damping: " << links << " links"
+                << "  plain: " << plain << " iterations"
+                << "  damped: " << damped << " iterations");
+
+        ensure("Damping doesn't fake convergence", plain <= damped);
+    }
+
+    // Check the least squares method and the relaxation for the wire
+    // configurations in the tests above.  All eight 3D hits are made, so
+    // the six wire charges don't determine the 3D hit charges, and the
+    // methods are expected to choose different solutions: the ridge term
+    // in the least squares fit splits the charge evenly and puts none on
+    // the 3D hits that it doesn't need, while the relaxation leaves some
+    // charge on every 3D hit.  Both must conserve the charge, reproduce the
+    // charge of every wire, and give the same charge to 3D hits that are
+    // equivalent.
+    template<> template<> void testDistributeCharge::test<11> () {
+        const double charges[3][3][2] = {{{5.0,3.0}, {7.0,1.0}, {5.0,3.0}},
+                                         {{5.0,1.0}, {5.0,1.0}, {5.0,1.0}},
+                                         {{5.0,1.0}, {5.0,1.0}, {5.0,1.0}}};
+        const bool physicsWeights[3] = {false, false, true};
+        const CP::TDistributeCharge::Method methods[2]
+            = {CP::TDistributeCharge::kRelaxation,
+               CP::TDistributeCharge::kLeastSquares};
+        for (int t = 0; t < 3; ++t) {
+            for (int m = 0; m < 2; ++m) {
+                std::vector<double> result
+                    = distributeWires(charges[t][0], charges[t][1],
+                                      charges[t][2], physicsWeights[t],
+                                      methods[m]);
+                double expectedCharge = charges[t][0][0] + charges[t][0][1];
+                double totalCharge = 0.0;
+                for (std::size_t i = 0; i < result.size(); ++i) {
+                    totalCharge += result[i];
+                    ensure("Charge is not negative", result[i] >= 0.0);
+                }
+                ensure_tolerance("Charge sharing perserves normalization.",
+                                 totalCharge, expectedCharge, 0.0001);
+                for (int p = 0; p < 3; ++p) {
+                    for (int w = 0; w < 2; ++w) {
+                        double wireCharge = 0.0;
+                        for (int i = 0; i < 8; ++i) {
+                            int wire[3] = {i%2, (i/2)%2, i/4};
+                            if (wire[p] == w) wireCharge += result[i];
+                        }
+                        ensure_distance("Wire charge is reproduced",
+                                        wireCharge, charges[t][p][w],
+                                        0.02*charges[t][p][w]);
+                    }
+                }
+                if (t != 1) continue;
+                // The wire charges are symmetric, so the 3D hits with one
+                // (or two) wires on the low charge side are equivalent.
+                ensure_distance("Equivalent 3D hits (one wire)",
+                                result[2], result[1], 0.01*result[1] + 1E-4);
+                ensure_distance("Equivalent 3D hits (one wire)",
+                                result[4], result[1], 0.01*result[1] + 1E-4);
+                ensure_distance("Equivalent 3D hits (two wires)",
+                                result[5], result[3], 0.01*result[3] + 1E-4);
+                ensure_distance("Equivalent 3D hits (two wires)",
+                                result[6], result[3], 0.01*result[3] + 1E-4);
+            }
+        }
+    }
 };
 
 // Local Variables:
@@ -0,0 +1,70 @@
+#include <TGaussianTable.hxx>
+
+#include <tut.h>
+
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+
+namespace tut {
+    struct baseGaussianTable {
+        baseGaussianTable() {
+            // Run before each test.
+        }
+        ~baseGaussianTable() {
+            // Run after each test.
+        }
+
+        /// The weighted sum as it was done in TCluster3D::FindOverlap
+        /// before there was a table.  This is the reference for the table.
+        double Reference(const std::vector<double>& samples,
+                         double t0, double dt, double tMax) {
+            double sum = 0.0;
+            for (std::size_t i=0; i<samples.size(); ++i) {
+                double t = t0 + dt*i;
+                if (t > tMax) continue;
+                sum += std::exp(-0.5*t*t)*samples[i];
+            }
+            return sum;
+        }
+    };
+
+    // Declare the test
+    typedef test_group<baseGaussianTable>::object testGaussianTable;
+    test_group<baseGaussianTable> groupGaussianTable("TGaussianTable");
+
+    // Test that the table matches the Gaussian.
+    template<> template<> void testGaussianTable::test<1> () {
+        const CP::TGaussianTable& gaussian = CP::TGaussianTable::Get();
+        ensure_equals("Peak value", gaussian.Value(0.0), 1.0);
+        for (double t = -10.0; t < 10.0; t += 0.00731) {
+            ensure_distance("Table matches exp",
+                            gaussian.Value(t), std::exp(-0.5*t*t), 1E-6);
+        }
+        ensure_equals("Zero outside of range",
+                      gaussian.Value(gaussian.GetRange() + 0.1), 0.0);
+        ensure_equals("Symmetric",
+                      gaussian.Value(-1.2345), gaussian.Value(1.2345));
+    }
+
+    // Test that the weighted sum matches the reference.
+    template<> template<> void testGaussianTable::test<2> () {
+        std::srand(2468);
+        const CP::TGaussianTable& gaussian = CP::TGaussianTable::Get();
+        for (int trial=0; trial<200; ++trial) {
+            int n = 1 + std::rand()%60;
+            std::vector<double> samples;
+            double total = 0.0;
+            for (int i=0; i<n; ++i) {
+                samples.push_back(100.0*std::rand()/RAND_MAX - 10.0);
+                total += std::abs(samples.back());
+            }
+            double dt = 0.05 + 0.5*std::rand()/RAND_MAX;
+            double t0 = -0.5*n*dt + 4.0*std::rand()/RAND_MAX - 2.0;
+            double sum = gaussian.WeightedSum(&samples[0], n, t0, dt, 2.0);
+            ensure_distance("Weighted sum matches reference",
+                            sum, Reference(samples, t0, dt, 2.0),
+                            1E-6*total + 1E-9);
+        }
+    }
+};
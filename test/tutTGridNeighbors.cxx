@@ -0,0 +1,155 @@
+#include <TGridNeighbors.hxx>
+
+#include <TCaptLog.hxx>
+
+#include <TVector3.h>
+
+#include <tut.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+namespace tut {
+    struct baseGridNeighbors {
+        baseGridNeighbors() {
+            // Run before each test.
+        }
+        ~baseGridNeighbors() {
+            // Run after each test.
+        }
+    };
+
+    // Collect the values found by a search.
+    struct CollectValues {
+        bool operator()(const int& value, float) {
+            fValues.push_back(value);
+            return true;
+        }
+        std::vector<int> fValues;
+    };
+
+    // Stop the search after the first value.
+    struct FirstValue {
+        FirstValue() : fCount(0) {}
+        bool operator()(const int&, float) {
+            ++fCount;
+            return false;
+        }
+        int fCount;
+    };
+
+    // Declare the test
+    typedef test_group<baseGridNeighbors>::object testGridNeighbors;
+    test_group<baseGridNeighbors> groupGridNeighbors("TGridNeighbors");
+
+    // Test the declaration and a simple search.
+    template<> template<> void testGridNeighbors::test<1> () {
+        typedef CP::TGridNeighbors<int> Neighbors;
+        Neighbors neighbors(1.0);
+        ensure("Search is empty", neighbors.empty());
+        CollectValues empty;
+        neighbors.ForEachWithin(0.0, 0.0, 0.0, 1.0, empty);
+        ensure_equals("Empty search finds nothing", empty.fValues.size(), 0U);
+
+        for (int i=0; i<5; ++i) neighbors.AddPoint(i,0.5*i,0.0,0.0);
+        ensure_equals("Search size", neighbors.size(), 5U);
+
+        CollectValues found;
+        neighbors.ForEachWithin(0.0, 0.0, 0.0, 1.1, found);
+        std::sort(found.fValues.begin(), found.fValues.end());
+        ensure_equals("Neighbors within radius", found.fValues.size(), 3U);
+        ensure_equals("First value", found.fValues[0], 0);
+        ensure_equals("Last value", found.fValues[2], 2);
+
+        FirstValue first;
+        neighbors.ForEachWithin(0.0, 0.0, 0.0, 10.0, first);
+        ensure_equals("Visitor can stop the search", first.fCount, 1);
+
+        // Points added after a search are found by the next search.
+        neighbors.AddPoint(5,0.0,0.5,0.0);
+        CollectValues added;
+        neighbors.ForEachWithin(0.0, 0.0, 0.0, 1.1, added);
+        ensure_equals("Added point is found", added.fValues.size(), 4U);
+
+        CollectValues outside;
+        neighbors.ForEachWithin(100.0, 0.0, 0.0, 1.0, outside);
+        ensure_equals("Nothing outside the grid", outside.fValues.size(), 0U);
+    }
+
+    // Compare the grid search to a brute force search with an anisotropic
+    // basis and a search radius that doesn't match the cell size.
+    template<> template<> void testGridNeighbors::test<2> () {
+        typedef CP::TGridNeighbors<int> Neighbors;
+        TVector3 e1(1,0,0);
+        TVector3 e2(0,1,0);
+        TVector3 e3(0,0,4);
+        Neighbors neighbors(e1,e2,e3,1.0);
+        std::srand(12345);
+        std::vector<TVector3> points;
+        for (int i=0; i<2000; ++i) {
+            TVector3 p(20.0*std::rand()/RAND_MAX,
+                       20.0*std::rand()/RAND_MAX,
+                       80.0*std::rand()/RAND_MAX);
+            neighbors.AddPoint(i,p.X(),p.Y(),p.Z());
+            points.push_back(p);
+        }
+        for (int trial=0; trial<100; ++trial) {
+            const TVector3& q = points[trial];
+            double radius = (trial%2) ? 1.0 : 2.5;
+            CollectValues found;
+            neighbors.ForEachWithin(q.X(), q.Y(), q.Z(), radius, found);
+            std::sort(found.fValues.begin(), found.fValues.end());
+            // The points that must be found, and the points that may be
+            // found since they are at the edge for float precision.
+            std::vector<int> inside;
+            std::vector<int> edge;
+            for (std::size_t i=0; i<points.size(); ++i) {
+                double dx = points[i].X() - q.X();
+                double dy = points[i].Y() - q.Y();
+                double dz = (points[i].Z() - q.Z())/4.0;
+                double d2 = dx*dx + dy*dy + dz*dz;
+                if (d2 > radius*radius + 1E-4) continue;
+                edge.push_back(i);
+                if (d2 > radius*radius - 1E-4) continue;
+                inside.push_back(i);
+            }
+            ensure("All neighbors found",
+                   std::includes(found.fValues.begin(), found.fValues.end(),
+                                 inside.begin(), inside.end()));
+            ensure("No extra neighbors",
+                   std::includes(edge.begin(), edge.end(),
+                                 found.fValues.begin(), found.fValues.end()));
+        }
+    }
+
+    // Test points that are spread over far more cells along one axis than
+    // fit into an int.  The cell size is increased so the grid still works.
+    template<> template<> void testGridNeighbors::test<3> () {
+        typedef CP::TGridNeighbors<int> Neighbors;
+        Neighbors neighbors(1.0);
+        neighbors.AddPoint(0, 0.0, 0.0, 0.0);
+        neighbors.AddPoint(1, 0.5, 0.0, 0.0);
+        neighbors.AddPoint(2, 1E12, 0.0, 0.0);
+        neighbors.AddPoint(3, 1E12, 0.5, 0.0);
+
+        CollectValues low;
+        neighbors.ForEachWithin(0.0, 0.0, 0.0, 1.0, low);
+        std::sort(low.fValues.begin(), low.fValues.end());
+        ensure_equals("Neighbors at the low end", low.fValues.size(), 2U);
+        ensure_equals("First low neighbor", low.fValues[0], 0);
+        ensure_equals("Second low neighbor", low.fValues[1], 1);
+
+        CollectValues high;
+        neighbors.ForEachWithin(1E12, 0.0, 0.0, 1.0, high);
+        std::sort(high.fValues.begin(), high.fValues.end());
+        ensure_equals("Neighbors at the high end", high.fValues.size(), 2U);
+        ensure_equals("First high neighbor", high.fValues[0], 2);
+        ensure_equals("Second high neighbor", high.fValues[1], 3);
+    }
+};
+
+// Local Variables:
+// mode:c++
+// c-basic-offset:4
+// End:
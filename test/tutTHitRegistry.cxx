@@ -0,0 +1,96 @@
+#include <THitRegistry.hxx>
+#include <TDenseHitSet.hxx>
+
+#include <TCaptLog.hxx>
+#include <TFADCHit.hxx>
+#include <CaptGeomId.hxx>
+
+#include <tut.h>
+
+#include <vector>
+
+namespace tut {
+    struct baseHitRegistry {
+        baseHitRegistry() {
+            // Run before each test.
+        }
+        ~baseHitRegistry() {
+            // Run after each test.
+        }
+
+        /// Make some wire hits.
+        void MakeHits(int count, CP::THitSelection& hits) {
+            CP::TWritableFADCHit hit;
+            for (int i=0; i<count; ++i) {
+                hit.SetGeomId(CP::GeomId::Captain::Wire(
+                                  CP::GeomId::Captain::kXPlane,i));
+                hit.SetCharge(1.0*i);
+                hits.push_back(
+                    CP::THandle<CP::TFADCHit>(new CP::TFADCHit(hit)));
+            }
+        }
+    };
+
+    // Declare the test
+    typedef test_group<baseHitRegistry>::object testHitRegistry;
+    test_group<baseHitRegistry> groupHitRegistry("THitRegistry");
+
+    // Test the declaration.
+    template<> template<> void testHitRegistry::test<1> () {
+        CP::THitRegistry registry;
+        ensure("Registry is empty", registry.empty());
+        CP::THitSelection hits;
+        MakeHits(1, hits);
+        ensure_equals("Unregistered hit isn't found",
+                      registry.Find(hits[0]), -1);
+    }
+
+    // Test that the identifiers are dense and stable.
+    template<> template<> void testHitRegistry::test<2> () {
+        CP::THitRegistry registry;
+        CP::THitSelection hits;
+        MakeHits(1000, hits);
+        for (std::size_t i=0; i<hits.size(); ++i) {
+            ensure_equals("Identifiers are assigned in order",
+                          registry.Register(hits[i]), (int) i);
+        }
+        ensure_equals("All hits registered", registry.size(), hits.size());
+        for (std::size_t i=0; i<hits.size(); ++i) {
+            ensure_equals("Registering again gives the same identifier",
+                          registry.Register(hits[i]), (int) i);
+            ensure_equals("Hit is found", registry.Find(hits[i]), (int) i);
+            ensure("Identifier gives back the hit",
+                   CP::GetPointer(registry.GetHit(i))
+                   == CP::GetPointer(hits[i]));
+        }
+        ensure_equals("No hits added", registry.size(), hits.size());
+
+        registry.Clear();
+        ensure("Registry is empty after clear", registry.empty());
+        ensure_equals("Cleared hit isn't found", registry.Find(hits[10]), -1);
+        ensure_equals("Identifiers restart after clear",
+                      registry.Register(hits[10]), 0);
+    }
+
+    // Test the dense hit set.
+    template<> template<> void testHitRegistry::test<3> () {
+        CP::TDenseHitSet set(10);
+        ensure("Set is empty", set.empty());
+        ensure("First insert is new", set.Insert(3));
+        ensure("Second insert isn't new", !set.Insert(3));
+        ensure("Insert past the capacity", set.Insert(25));
+        set.Insert(0);
+        ensure_equals("Set size", set.size(), 3U);
+        ensure("Contains 3", set.Contains(3));
+        ensure("Contains 25", set.Contains(25));
+        ensure("Doesn't contain 4", !set.Contains(4));
+        ensure("Doesn't contain a negative id", !set.Contains(-1));
+        ensure("Doesn't contain a large id", !set.Contains(1000));
+        ensure_equals("Members in insertion order", set.GetMembers()[0], 3);
+        ensure_equals("Members in insertion order", set.GetMembers()[1], 25);
+        ensure_equals("Members in insertion order", set.GetMembers()[2], 0);
+        set.Clear();
+        ensure("Set is empty after clear", set.empty());
+        ensure("Cleared member is removed", !set.Contains(25));
+    }
+};
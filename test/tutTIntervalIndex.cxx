@@ -0,0 +1,94 @@
+#include <TIntervalIndex.hxx>
+
+#include <TCaptLog.hxx>
+
+#include <tut.h>
+
+#include <vector>
+#include <cstdlib>
+
+namespace tut {
+    struct baseIntervalIndex {
+        baseIntervalIndex() {
+            // Run before each test.
+        }
+        ~baseIntervalIndex() {
+            // Run after each test.
+        }
+    };
+
+    // Declare the test
+    typedef test_group<baseIntervalIndex>::object testIntervalIndex;
+    test_group<baseIntervalIndex> groupIntervalIndex("TIntervalIndex");
+
+    // Test the declaration.
+    template<> template<> void testIntervalIndex::test<1> () {
+        CP::TIntervalIndex index;
+        ensure("Index is empty", index.empty());
+        index.Build();
+        std::vector<int> output;
+        index.Find(0.0, 1.0, output);
+        ensure_equals("Empty index finds nothing", output.size(), 0U);
+    }
+
+    // Test simple overlaps including intervals touching at the end points.
+    template<> template<> void testIntervalIndex::test<2> () {
+        CP::TIntervalIndex index;
+        index.Add(5.0, 6.0, 0);
+        index.Add(0.0, 1.0, 1);
+        index.Add(1.0, 2.0, 2);
+        index.Add(0.5, 10.0, 3);
+        index.Build();
+        ensure_equals("Index size", index.size(), 4U);
+
+        std::vector<int> output;
+        index.Find(1.0, 1.0, output);
+        ensure_equals("Overlaps at 1.0", output.size(), 3U);
+        ensure_equals("First value", output[0], 1);
+        ensure_equals("Second value", output[1], 2);
+        ensure_equals("Third value", output[2], 3);
+
+        output.clear();
+        index.Find(10.5, 11.0, output);
+        ensure_equals("Nothing after the end", output.size(), 0U);
+
+        output.clear();
+        index.Find(3.0, 4.0, output);
+        ensure_equals("Long interval only", output.size(), 1U);
+        ensure_equals("Long interval value", output[0], 3);
+    }
+
+    // Compare the index to a brute force search.
+    template<> template<> void testIntervalIndex::test<3> () {
+        std::srand(12345);
+        std::vector<double> begin;
+        std::vector<double> end;
+        CP::TIntervalIndex index;
+        for (int i=0; i<500; ++i) {
+            double b = 1000.0*std::rand()/RAND_MAX;
+            double e = b + 20.0*std::rand()/RAND_MAX;
+            begin.push_back(b);
+            end.push_back(e);
+            index.Add(b,e,i);
+        }
+        index.Build();
+
+        for (int trial=0; trial<100; ++trial) {
+            double b = 1000.0*std::rand()/RAND_MAX;
+            double e = b + 10.0*std::rand()/RAND_MAX;
+            std::vector<int> expected;
+            for (std::size_t i=0; i<begin.size(); ++i) {
+                if (end[i] < b) continue;
+                if (e < begin[i]) continue;
+                expected.push_back(i);
+            }
+            std::vector<int> output;
+            index.Find(b,e,output);
+            ensure_equals("Overlap count matches",
+                          output.size(), expected.size());
+            for (std::size_t i=0; i<output.size(); ++i) {
+                ensure_equals("Overlap value matches", output[i], expected[i]);
+            }
+        }
+    }
+};
@@ -0,0 +1,173 @@
+#include <TIsolatedHitFilter.hxx>
+#include <TDriftPosition.hxx>
+
+#include <HEPUnits.hxx>
+#include <TCaptLog.hxx>
+#include <TFADCHit.hxx>
+#include <TRuntimeParameters.hxx>
+#include <CaptGeomId.hxx>
+
+#include <tut.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+    // The half width of the hit time ranges.
+    const double gHalfWidth = 1.0*unit::microsecond;
+
+    // Make a wire hit with a drift corrected time range centered on a time.
+    // The hit time is shifted by the drift correction for the wire, so hits
+    // on different planes with the same time are at the same drift
+    // corrected time.
+    CP::THandle<CP::THit> makeHit(int plane, int wire, double time) {
+        CP::TWritableFADCHit hit;
+        hit.SetGeomId(CP::GeomId::Captain::Wire(plane,wire));
+        hit.SetCharge(100.0);
+        hit.SetChargeUncertainty(10.0);
+        hit.SetTime(0.0);
+        hit.SetTimeRMS(gHalfWidth/2.0);
+        hit.SetTimeStart(-gHalfWidth);
+        hit.SetTimeStop(gHalfWidth);
+        hit.SetTimeUncertainty(gHalfWidth/2.0);
+        CP::TFADCHit probe(hit);
+        CP::TDriftPosition drift;
+        time -= drift.GetTime(probe);
+        hit.SetTime(time);
+        hit.SetTimeStart(time - gHalfWidth);
+        hit.SetTimeStop(time + gHalfWidth);
+        return CP::THandle<CP::THit>(new CP::TFADCHit(hit));
+    }
+
+    double timeWindow() {
+        return std::max(CP::TRuntimeParameters::Get().GetParameterD(
+                            "captRecon.isolatedHitFilter.timeWindow"),
+                        1*unit::ns);
+    }
+
+    int wireWindow() {
+        return CP::TRuntimeParameters::Get().GetParameterI(
+            "captRecon.isolatedHitFilter.wireWindow");
+    }
+
+    // Run the filter on a selection of hits.
+    CP::THandle<CP::TAlgorithmResult> filterHits(CP::THitSelection* hits) {
+        CP::TAlgorithmResult input;
+        input.AddHits(hits);
+        CP::TIsolatedHitFilter filter;
+        return filter.Process(input);
+    }
+
+    // Check if a hit is in a selection.
+    bool contains(const CP::THandle<CP::THitSelection>& hits,
+                  const CP::THandle<CP::THit>& hit) {
+        if (!hits) return false;
+        return std::find(hits->begin(), hits->end(), hit) != hits->end();
+    }
+};
+
+namespace tut {
+    struct baseIsolatedHitFilter {
+        baseIsolatedHitFilter() {
+            // Run before each test.
+        }
+        ~baseIsolatedHitFilter() {
+            // Run after each test.
+        }
+    };
+
+    // Declare the test
+    typedef test_group<baseIsolatedHitFilter>::object testIsolatedHitFilter;
+    test_group<baseIsolatedHitFilter> groupIsolatedHitFilter(
+        "TIsolatedHitFilter");
+
+    // Test that a hit without any neighbors is rejected.
+    template<> template<> void testIsolatedHitFilter::test<1> () {
+        CP::THitSelection* hits = new CP::THitSelection("wires");
+        CP::THandle<CP::THit> alone = makeHit(0, 40, 100*unit::microsecond);
+        hits->push_back(alone);
+        CP::THandle<CP::TAlgorithmResult> result = filterHits(hits);
+        ensure("Result is made", CP::GetPointer(result));
+        CP::THandle<CP::THitSelection> rejected = result->GetHits("rejected");
+        CP::THandle<CP::THitSelection> filtered = result->GetHits("filtered");
+        ensure("Isolated hit is rejected", contains(rejected, alone));
+        ensure("Isolated hit isn't kept", !contains(filtered, alone));
+    }
+
+    // Test the wire window for neighbors on the same plane.
+    template<> template<> void testIsolatedHitFilter::test<2> () {
+        double time = 100*unit::microsecond;
+        CP::THitSelection* hits = new CP::THitSelection("wires");
+        CP::THandle<CP::THit> inside1 = makeHit(0, 40, time);
+        CP::THandle<CP::THit> inside2 = makeHit(0, 40 + wireWindow(), time);
+        CP::THandle<CP::THit> outside1 = makeHit(0, 60, time);
+        CP::THandle<CP::THit> outside2
+            = makeHit(0, 60 + wireWindow() + 1, time);
+        hits->push_back(inside1);
+        hits->push_back(outside1);
+        hits->push_back(inside2);
+        hits->push_back(outside2);
+        CP::THandle<CP::TAlgorithmResult> result = filterHits(hits);
+        CP::THandle<CP::THitSelection> filtered = result->GetHits("filtered");
+        CP::THandle<CP::THitSelection> rejected = result->GetHits("rejected");
+        ensure("Filtered hits are the default",
+               CP::GetPointer(result->GetHits()) == CP::GetPointer(filtered));
+        ensure("Hit with a neighbor in the wire window is kept",
+               contains(filtered, inside1) && contains(filtered, inside2));
+        ensure("Hit with a neighbor outside the wire window is rejected",
+               contains(rejected, outside1) && contains(rejected, outside2));
+        ensure_equals("Kept hits", filtered->size(), 2U);
+        ensure("Kept hits are in the input order",
+               (*filtered)[0] == inside1 && (*filtered)[1] == inside2);
+    }
+
+    // Test the time window for neighbors on the same plane.  The time window
+    // is the largest allowed gap between the hit time ranges.
+    template<> template<> void testIsolatedHitFilter::test<3> () {
+        double time = 100*unit::microsecond;
+        double inside = 2*gHalfWidth + timeWindow() - 10*unit::ns;
+        double outside = 2*gHalfWidth + timeWindow() + 10*unit::ns;
+        CP::THitSelection* hits = new CP::THitSelection("wires");
+        CP::THandle<CP::THit> inside1 = makeHit(0, 40, time);
+        CP::THandle<CP::THit> inside2 = makeHit(0, 41, time + inside);
+        CP::THandle<CP::THit> outside1 = makeHit(0, 70, time);
+        CP::THandle<CP::THit> outside2 = makeHit(0, 71, time + outside);
+        hits->push_back(inside1);
+        hits->push_back(inside2);
+        hits->push_back(outside1);
+        hits->push_back(outside2);
+        CP::THandle<CP::TAlgorithmResult> result = filterHits(hits);
+        CP::THandle<CP::THitSelection> filtered = result->GetHits("filtered");
+        CP::THandle<CP::THitSelection> rejected = result->GetHits("rejected");
+        ensure("Hit with a neighbor inside the time window is kept",
+               contains(filtered, inside1) && contains(filtered, inside2));
+        ensure("Hit just outside the time window is rejected",
+               contains(rejected, outside1) && contains(rejected, outside2));
+    }
+
+    // Test neighbors on a different plane.  The V and U wires always cross,
+    // so this doesn't depend on the wire crossing table.
+    template<> template<> void testIsolatedHitFilter::test<4> () {
+        double time = 100*unit::microsecond;
+        double outside = 2*gHalfWidth + timeWindow() + 10*unit::ns;
+        CP::THitSelection* hits = new CP::THitSelection("wires");
+        CP::THandle<CP::THit> vHit = makeHit(1, 30, time);
+        CP::THandle<CP::THit> uHit = makeHit(2, 60, time);
+        CP::THandle<CP::THit> late = makeHit(1, 80, time + outside);
+        hits->push_back(vHit);
+        hits->push_back(uHit);
+        hits->push_back(late);
+        CP::THandle<CP::TAlgorithmResult> result = filterHits(hits);
+        CP::THandle<CP::THitSelection> filtered = result->GetHits("filtered");
+        CP::THandle<CP::THitSelection> rejected = result->GetHits("rejected");
+        ensure("Hits with a neighbor on another plane are kept",
+               contains(filtered, vHit) && contains(filtered, uHit));
+        ensure("Hit just outside the time window of the other plane"
+               " is rejected", contains(rejected, late));
+    }
+};
+
+// Local Variables:
+// mode:c++
+// c-basic-offset:4
+// End:
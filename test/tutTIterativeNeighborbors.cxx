@@ -12,6 +12,10 @@
 
 #include <tut.h>
 
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
 namespace tut {
     struct baseNeighbors {
         baseNeighbors() {
@@ -111,6 +115,88 @@ namespace tut {
         }
     }
 
+    // Test that a cursor returns the same neighbors in the same order as a
+    // brute force search, that two cursors can search at the same time, and
+    // that points added after a search are found.
+    template<> template<> void testNeighbors::test<4> () {
+        typedef CP::TIterativeNeighbors<int> Neighbors;
+        Neighbors neighbors(TVector3(1,0,0),TVector3(0,1,0),TVector3(0,0,3));
+        std::srand(12345);
+        std::vector<TVector3> points;
+        for (int i=0; i<1000; ++i) {
+            TVector3 p(10.0*std::rand()/RAND_MAX,
+                       10.0*std::rand()/RAND_MAX,
+                       30.0*std::rand()/RAND_MAX);
+            neighbors.AddPoint(i,p.X(),p.Y(),p.Z());
+            points.push_back(p);
+        }
+
+        Neighbors::TCursor cursor(neighbors);
+        Neighbors::TCursor other(neighbors);
+        for (int trial=0; trial<50; ++trial) {
+            const TVector3& q = points[10*trial];
+            std::vector<double> expected;
+            for (std::size_t i=0; i<points.size(); ++i) {
+                double dx = points[i].X() - q.X();
+                double dy = points[i].Y() - q.Y();
+                double dz = (points[i].Z() - q.Z())/3.0;
+                expected.push_back(dx*dx + dy*dy + dz*dz);
+            }
+            std::sort(expected.begin(), expected.end());
+            cursor.Start(q.X(), q.Y(), q.Z());
+            other.Start(q.Y(), q.X(), q.Z());
+            std::size_t count = 0;
+            while (cursor.Next()) {
+                other.Next();
+                int value = cursor.GetNeighbor().first;
+                double dist2 = cursor.GetNeighbor().second;
+                ensure_distance("Neighbor distance is in order",
+                                dist2, expected[count], 1E-4);
+                double dx = points[value].X() - q.X();
+                double dy = points[value].Y() - q.Y();
+                double dz = (points[value].Z() - q.Z())/3.0;
+                ensure_distance("Neighbor distance is correct",
+                                dist2, dx*dx + dy*dy + dz*dz, 1E-4);
+                ++count;
+            }
+            ensure_equals("All neighbors found", count, points.size());
+        }
+
+        neighbors.AddPoint(-1, 100.0, 100.0, 100.0);
+        Neighbors::iterator closest = neighbors.begin(99.0, 99.0, 99.0);
+        ensure("Added point is found", closest != neighbors.end());
+        ensure_equals("Added point is closest", closest->first, -1);
+    }
+
+    // Test that a copy searches its own points, even after the original is
+    // gone.
+    template<> template<> void testNeighbors::test<5> () {
+        typedef CP::TIterativeNeighbors<int> Neighbors;
+        Neighbors* original = new Neighbors;
+        for (int i=0; i<10; ++i) original->AddPoint(i,1.0*i,0.0,0.0);
+        original->begin(0.0,0.0,0.0);
+        Neighbors copy(*original);
+        Neighbors assigned;
+        assigned.AddPoint(-1,0.0,0.0,0.0);
+        assigned = *original;
+        delete original;
+
+        Neighbors::iterator closest = copy.begin(3.2,0.0,0.0);
+        ensure("Copy finds a point", closest != copy.end());
+        ensure_equals("Copy finds the closest point", closest->first, 3);
+        int count = 0;
+        for (; closest != copy.end(); ++closest) ++count;
+        ensure_equals("Copy finds all of the points", count, 10);
+
+        closest = assigned.begin(7.9,0.0,0.0);
+        ensure("Assigned copy finds a point", closest != assigned.end());
+        ensure_equals("Assigned copy finds the closest point",
+                      closest->first, 8);
+        count = 0;
+        for (; closest != assigned.end(); ++closest) ++count;
+        ensure_equals("Assigned copy replaces the points", count, 10);
+    }
+
 };
 
 // Local Variables:
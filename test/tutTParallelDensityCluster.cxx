@@ -0,0 +1,316 @@
+#include <TParallelDensityCluster.hxx>
+#include <TCaptLog.hxx>
+#include <TVector3.h>
+#include <tut.h>
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+
+namespace tut {
+    struct basePDCParallel {
+        basePDCParallel() {
+            // Run before each test.
+        }
+        ~basePDCParallel() {
+            // Run after each test.
+        }
+    };
+
+    struct TParallelPoint {
+        TParallelPoint(const TVector3& v) : fVector(v) {}
+        TVector3& GetPosition() {return fVector;}
+        TVector3 fVector;
+    };
+    typedef struct TParallelPoint* TParallelHandle;
+    typedef CP::TParallelDensityCluster<TParallelHandle> ParallelCluster;
+
+    // Make a synthetic hit cloud with straight tracks of closely spaced
+    // points and uniform noise.
+    void MakeHitCloud(std::vector<TParallelHandle>& points,
+                      int tracks, int noise, unsigned int seed) {
+        std::srand(seed);
+        for (int t=0; t<tracks; ++t) {
+            TVector3 start(500.0*std::rand()/RAND_MAX,
+                           500.0*std::rand()/RAND_MAX,
+                           500.0*std::rand()/RAND_MAX);
+            TVector3 dir(std::rand()-0.5*RAND_MAX,
+                         std::rand()-0.5*RAND_MAX,
+                         std::rand()-0.5*RAND_MAX);
+            dir = dir.Unit();
+            int length = 50 + std::rand()%200;
+            for (int i=0; i<length; ++i) {
+                TVector3 jitter(std::rand()-0.5*RAND_MAX,
+                                std::rand()-0.5*RAND_MAX,
+                                std::rand()-0.5*RAND_MAX);
+                jitter *= 0.5/RAND_MAX;
+                points.push_back(
+                    new TParallelPoint(start + 0.7*i*dir + jitter));
+            }
+        }
+        for (int i=0; i<noise; ++i) {
+            points.push_back(
+                new TParallelPoint(TVector3(500.0*std::rand()/RAND_MAX,
+                                            500.0*std::rand()/RAND_MAX,
+                                            500.0*std::rand()/RAND_MAX)));
+        }
+    }
+
+    // Summarize the result as the cluster index of each point (the remaining
+    // points have the index equal to the cluster count).
+    std::vector<int> ClusterIndex(const ParallelCluster& dCluster,
+                                  std::size_t clusters,
+                                  const std::vector<TParallelHandle>& points) {
+        std::map<TParallelHandle,int> index;
+        for (std::size_t c=0; c<=clusters; ++c) {
+            const ParallelCluster::Points& cluster = dCluster.GetCluster(c);
+            for (ParallelCluster::Points::const_iterator p = cluster.begin();
+                 p != cluster.end(); ++p) {
+                index[*p] = c;
+            }
+        }
+        std::vector<int> result;
+        for (std::size_t i=0; i<points.size(); ++i) {
+            result.push_back(index[points[i]]);
+        }
+        return result;
+    }
+
+    // The squared distance between two points found in single precision the
+    // same way as TParallelDensityCluster, so points at the edge of the
+    // maximum distance are treated the same way.
+    float BruteDistance2(TParallelHandle a, TParallelHandle b) {
+        float pa[3] = {(float) a->GetPosition().X(),
+                       (float) a->GetPosition().Y(),
+                       (float) a->GetPosition().Z()};
+        float pb[3] = {(float) b->GetPosition().X(),
+                       (float) b->GetPosition().Y(),
+                       (float) b->GetPosition().Z()};
+        float dist2 = 0.0;
+        for (int i=0; i<3; ++i) {
+            float d = pa[i] - pb[i];
+            dist2 += d*d;
+        }
+        return dist2;
+    }
+
+    // A brute force DBSCAN.  A point is a core point if there are at least
+    // minPoints other points within maxDist (inclusive).  The clusters are
+    // the connected components of the core points, and each other point is
+    // added to the cluster of the closest core point within maxDist (the
+    // earlier point wins a tie).  This returns the cluster label of each
+    // point, or -1 if the point isn't in a cluster.
+    std::vector<int> BruteDBSCAN(const std::vector<TParallelHandle>& points,
+                                 unsigned int minPoints, double maxDist) {
+        int n = points.size();
+        double dist2 = maxDist*maxDist;
+        std::vector<bool> core(n);
+        for (int i=0; i<n; ++i) {
+            unsigned int count = 0;
+            for (int j=0; j<n; ++j) {
+                if (i == j) continue;
+                if (BruteDistance2(points[i],points[j]) <= dist2) ++count;
+            }
+            core[i] = (count >= minPoints);
+        }
+        std::vector<int> label(n,-1);
+        int clusters = 0;
+        for (int i=0; i<n; ++i) {
+            if (!core[i] || label[i] >= 0) continue;
+            std::vector<int> stack(1,i);
+            label[i] = clusters;
+            while (!stack.empty()) {
+                int p = stack.back();
+                stack.pop_back();
+                for (int j=0; j<n; ++j) {
+                    if (!core[j] || label[j] >= 0) continue;
+                    if (BruteDistance2(points[p],points[j]) > dist2) continue;
+                    label[j] = clusters;
+                    stack.push_back(j);
+                }
+            }
+            ++clusters;
+        }
+        for (int i=0; i<n; ++i) {
+            if (core[i]) continue;
+            int closest = -1;
+            float closestDist2 = 0.0;
+            for (int j=0; j<n; ++j) {
+                if (!core[j]) continue;
+                float d2 = BruteDistance2(points[i],points[j]);
+                if (d2 > dist2) continue;
+                if (closest >= 0 && d2 >= closestDist2) continue;
+                closest = j;
+                closestDist2 = d2;
+            }
+            if (closest >= 0) label[i] = label[closest];
+        }
+        return label;
+    }
+
+    // Declare the test
+    typedef test_group<basePDCParallel>::object testPDCParallel;
+    test_group<basePDCParallel> groupPDCParallel(
+        "TParallelDensityCluster");
+
+    // Test that the cluster can be constructed.
+    template<> template<> void testPDCParallel::test<1> () {
+        ParallelCluster dCluster(5,1.0);
+        ensure_equals("Default thread count", dCluster.GetThreads(), 1);
+        std::vector<TParallelHandle> points;
+        dCluster.Cluster(points.begin(), points.end());
+        ensure_equals("No clusters no input objects",
+                      dCluster.GetClusterCount(), 0U);
+        ensure_equals("No remaining points",
+                      dCluster.GetCluster(0).size(), 0U);
+    }
+
+    // Test clusters of lattice points.  The first lattice is larger, and
+    // the point between the lattices is a border point that is closest to
+    // the second lattice.
+    template<> template<> void testPDCParallel::test<2> () {
+        std::vector<TParallelHandle> points;
+        for (int i=0; i<7; ++i) {
+            for (int j=0; j<7; ++j) {
+                points.push_back(new TParallelPoint(TVector3(i,j,0)));
+            }
+        }
+        TParallelHandle border = new TParallelPoint(TVector3(3,9.45,0));
+        points.push_back(border);
+        for (int i=0; i<6; ++i) {
+            for (int j=0; j<6; ++j) {
+                points.push_back(new TParallelPoint(TVector3(i,j+10,0)));
+            }
+        }
+        points.push_back(new TParallelPoint(TVector3(20,20,20)));
+        points.push_back(new TParallelPoint(TVector3(20,21.5,20)));
+
+        ParallelCluster dCluster(4,1.5);
+        dCluster.SetThreads(4);
+        dCluster.Cluster(points.begin(), points.end());
+        ensure_equals("Two clusters", dCluster.GetClusterCount(), 2U);
+        ensure_equals("Larger cluster first",
+                      dCluster.GetCluster(0).size(), 49U);
+        ensure_equals("Second cluster has the border point",
+                      dCluster.GetCluster(1).size(), 37U);
+        ensure("Border point in the second cluster",
+               std::find(dCluster.GetCluster(1).begin(),
+                         dCluster.GetCluster(1).end(), border)
+               != dCluster.GetCluster(1).end());
+        ensure_equals("Remaining points",
+                      dCluster.GetCluster(2).size(), 2U);
+        ensure("Cluster points in input order",
+               dCluster.GetCluster(0).front() == points.front());
+
+        for (std::size_t i=0; i<points.size(); ++i) delete points[i];
+    }
+
+    // Test that the result matches a brute force DBSCAN, and doesn't depend
+    // on the number of threads.
+    template<> template<> void testPDCParallel::test<3> () {
+        std::vector<TParallelHandle> points;
+        MakeHitCloud(points, 10, 1000, 54321);
+        const unsigned int minPoints = 3;
+        const double maxDist = 1.5;
+
+        ParallelCluster dCluster(minPoints,maxDist);
+        dCluster.Cluster(points.begin(), points.end());
+        std::size_t clusters = dCluster.GetClusterCount();
+        std::vector<int> reference = ClusterIndex(dCluster,clusters,points);
+        ensure("Clusters found", clusters > 0);
+
+        // Compare to a brute force DBSCAN.  The labels must be the same up
+        // to the numbering of the clusters.
+        std::vector<int> brute = BruteDBSCAN(points, minPoints, maxDist);
+        std::map<int,int> toCluster;
+        std::map<int,int> toBrute;
+        for (std::size_t i=0; i<points.size(); ++i) {
+            if (brute[i] < 0) {
+                ensure_equals("Noise points aren't in a cluster",
+                              reference[i], (int) clusters);
+                continue;
+            }
+            ensure("Clustered points are in a cluster",
+                   reference[i] < (int) clusters);
+            if (!toCluster.count(brute[i])) toCluster[brute[i]] = reference[i];
+            if (!toBrute.count(reference[i])) toBrute[reference[i]] = brute[i];
+            ensure_equals("Brute force cluster maps to one cluster",
+                          toCluster[brute[i]], reference[i]);
+            ensure_equals("Cluster maps to one brute force cluster",
+                          toBrute[reference[i]], brute[i]);
+        }
+        ensure_equals("Same number of clusters as brute force",
+                      toCluster.size(), clusters);
+        for (std::size_t c=1; c<clusters; ++c) {
+            ensure("Clusters are ordered by size",
+                   dCluster.GetCluster(c-1).size()
+                   >= dCluster.GetCluster(c).size());
+        }
+
+        for (int threads=2; threads<=16; threads *= 2) {
+            dCluster.SetThreads(threads);
+            dCluster.Cluster(points.begin(), points.end());
+            ensure_equals("Same clusters for any number of threads",
+                          dCluster.GetClusterCount(), clusters);
+            std::vector<int> result = ClusterIndex(dCluster,clusters,points);
+            ensure("Same cluster labels for any number of threads",
+                   result == reference);
+        }
+
+        for (std::size_t i=0; i<points.size(); ++i) delete points[i];
+    }
+
+    // A scaling benchmark on a synthetic hit cloud.  This only checks that
+    // the result doesn't change, and logs the time for each number of
+    // threads.  It takes a while, so it's only run when the
+    // CAPTRECON_BENCHMARK environment variable is set.
+    template<> template<> void testPDCParallel::test<4> () {
+        if (!std::getenv("CAPTRECON_BENCHMARK")) {
+            CaptLog("TParallelDensityCluster benchmark skipped:"
+                    << " set CAPTRECON_BENCHMARK to run it");
+            return;
+        }
+        std::vector<TParallelHandle> points;
+        MakeHitCloud(points, 1000, 100000, 98765);
+
+        ParallelCluster dCluster(3,1.5);
+        std::vector<int> reference;
+        std::size_t clusters = 0;
+        double single = 0.0;
+        for (int threads=1; threads<=16; threads *= 2) {
+            dCluster.SetThreads(threads);
+            std::chrono::steady_clock::time_point start
+                = std::chrono::steady_clock::now();
+            dCluster.Cluster(points.begin(), points.end());
+            double wall = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            if (threads == 1) {
+                single = wall;
+                clusters = dCluster.GetClusterCount();
+                reference = ClusterIndex(dCluster,clusters,points);
+            }
+            else {
+                ensure_equals("Benchmark clusters are the same",
+                              dCluster.GetClusterCount(), clusters);
+                ensure("Benchmark labels are the same",
+                       ClusterIndex(dCluster,clusters,points) == reference);
+            }
+            CaptLog("TParallelDensityCluster benchmark: "
+                    << points.size() << " points"
+                    << " " << clusters << " clusters"
+                    << " threads: " << threads
+                    << " wall: " << wall << " s"
+                    << " speedup: " << ((wall > 0.0) ? single/wall : 0.0));
+        }
+
+        for (std::size_t i=0; i<points.size(); ++i) delete points[i];
+    }
+};
+
+// Local Variables:
+// mode:c++
+// c-basic-offset:4
+// End:
@@ -4,6 +4,8 @@
 #include <tut.h>
 
 #include <memory>
+#include <algorithm>
+#include <cstdlib>
 
 namespace tut {
     struct basePDCluster {
@@ -81,6 +83,103 @@ namespace tut {
 
     }
 
+    // Test that the grid neighbor search finds the same clusters as the
+    // default search.
+    template<> template<> void testPDCluster::test<3> () {
+        std::vector<TVector3Handle> vectors;
+        std::srand(12345);
+        for (int blob=0; blob<10; ++blob) {
+            TVector3 center(100.0*std::rand()/RAND_MAX,
+                            100.0*std::rand()/RAND_MAX,
+                            100.0*std::rand()/RAND_MAX);
+            int points = 10 + 20*blob;
+            for (int i=0; i<points; ++i) {
+                TVector3 offset(4.0*std::rand()/RAND_MAX - 2.0,
+                                4.0*std::rand()/RAND_MAX - 2.0,
+                                4.0*std::rand()/RAND_MAX - 2.0);
+                vectors.push_back(new TVector3Object(center+offset));
+            }
+        }
+        for (int i=0; i<100; ++i) {
+            TVector3 noise(100.0*std::rand()/RAND_MAX,
+                           100.0*std::rand()/RAND_MAX,
+                           100.0*std::rand()/RAND_MAX);
+            vectors.push_back(new TVector3Object(noise));
+        }
+
+        const int minPoints = 4;
+        const double maxDist = 1.0;
+        typedef CP::TPositionDensityCluster<TVector3Handle> TreeCluster;
+        typedef CP::TPositionDensityCluster<TVector3Handle,
+                                            CP::TGridNeighbors> GridCluster;
+        TreeCluster treeCluster(minPoints,maxDist);
+        GridCluster gridCluster(minPoints,maxDist);
+        treeCluster.SetBasis(TVector3(1,0,0),TVector3(0,1,0),TVector3(0,0,2));
+        gridCluster.SetBasis(TVector3(1,0,0),TVector3(0,1,0),TVector3(0,0,2));
+        treeCluster.Cluster(vectors.begin(), vectors.end());
+        gridCluster.Cluster(vectors.begin(), vectors.end());
+
+        ensure("Clusters are found", treeCluster.GetClusterCount() > 0);
+        ensure_equals("Same number of clusters",
+                      gridCluster.GetClusterCount(),
+                      treeCluster.GetClusterCount());
+        for (std::size_t i=0; i<=treeCluster.GetClusterCount(); ++i) {
+            ensure("Same cluster points",
+                   gridCluster.GetCluster(i) == treeCluster.GetCluster(i));
+        }
+
+        for (std::vector<TVector3Handle>::iterator v = vectors.begin();
+             v != vectors.end(); ++v) {
+            delete (*v);
+        }
+    }
+
+    // Test that dense blocks of points form clusters, that a border point
+    // (close to a cluster, but without enough neighbors) is added to the
+    // cluster, and that isolated points are left over.
+    template<> template<> void testPDCluster::test<4> () {
+        std::vector<TVector3Handle> vectors;
+        for (int block=0; block<2; ++block) {
+            for (int i=0; i<4; ++i) {
+                for (int j=0; j<4; ++j) {
+                    for (int k=0; k<3; ++k) {
+                        TVector3 p(10.0*block + 0.5*i, 0.5*j, 0.5*k);
+                        vectors.push_back(new TVector3Object(p));
+                    }
+                }
+            }
+        }
+        TVector3Handle border = new TVector3Object(TVector3(-0.55,0,0));
+        vectors.push_back(border);
+        for (int i=0; i<5; ++i) {
+            TVector3 p(5.0, 5.0 + 2.0*i, 0.0);
+            vectors.push_back(new TVector3Object(p));
+        }
+
+        const int minPoints = 4;
+        const double maxDist = 0.6;
+        CP::TPositionDensityCluster<TVector3Handle,
+                                   CP::TGridNeighbors> dCluster(minPoints,
+                                                                maxDist);
+        dCluster.Cluster(vectors.begin(), vectors.end());
+        ensure_equals("Two clusters", dCluster.GetClusterCount(), 2U);
+        ensure_equals("First cluster size",
+                      dCluster.GetCluster(0).size(), 49U);
+        ensure_equals("Second cluster size",
+                      dCluster.GetCluster(1).size(), 48U);
+        ensure("Border point is in the first cluster",
+               std::find(dCluster.GetCluster(0).begin(),
+                         dCluster.GetCluster(0).end(),
+                         border) != dCluster.GetCluster(0).end());
+        ensure_equals("Isolated points remain",
+                      dCluster.GetCluster(2).size(), 5U);
+
+        for (std::vector<TVector3Handle>::iterator v = vectors.begin();
+             v != vectors.end(); ++v) {
+            delete (*v);
+        }
+    }
+
 };
 
 // Local Variables:
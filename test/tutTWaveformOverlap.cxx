@@ -0,0 +1,210 @@
+#include <TWaveformOverlap.hxx>
+
+#include <TCaptLog.hxx>
+
+#include <tut.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+namespace tut {
+    struct baseWaveformOverlap {
+        baseWaveformOverlap() {
+            // Run before each test.
+        }
+        ~baseWaveformOverlap() {
+            // Run after each test.
+        }
+
+        /// Make a random waveform with a peak and a little noise.
+        std::vector<double> MakeWaveform(int n, double peak) {
+            std::vector<double> samples;
+            double center = 0.5*n;
+            double width = 0.15*n + 1.0;
+            for (int i=0; i<n; ++i) {
+                double d = (i-center)/width;
+                double noise = 10.0*std::rand()/RAND_MAX - 5.0;
+                samples.push_back(peak*std::exp(-0.5*d*d) + noise);
+            }
+            return samples;
+        }
+
+        /// The overlap calculation as it was done in TCluster3D::MakeHit
+        /// before there was a waveform overlap kernel.  This is the
+        /// reference for the kernel.
+        void Reference(int bins,
+                       const std::vector< std::vector<double> >& waves,
+                       const std::vector<int>& first,
+                       std::vector<double>& overlap,
+                       double& charge, int& start, int& stop) {
+            overlap.assign(bins, 0.0);
+            for (std::size_t w=0; w<waves.size(); ++w) {
+                int ibin = first[w];
+                int n = waves[w].size();
+                if (w == 0) {
+                    for (int i=0; i<n; ++i) {
+                        overlap[i+ibin] = std::max(0.0,waves[w][i]);
+                    }
+                    continue;
+                }
+                for (int i=0; i<ibin; ++i) overlap[i] = 0.0;
+                for (int i=0; i<n; ++i) {
+                    overlap[i+ibin] = std::max(0.0,
+                                               std::min(overlap[i+ibin],
+                                                        waves[w][i]));
+                }
+                for (std::size_t i=ibin+n; i<overlap.size(); ++i) {
+                    overlap[i] = 0.0;
+                }
+            }
+            charge = 0.0;
+            start = overlap.size();
+            stop = 0;
+            for (std::size_t i=0; i<overlap.size(); ++i) {
+                charge += overlap[i];
+                if ((int) i < start && overlap[i] > 1) start = i;
+                if ((int) i > stop && overlap[i] > 1) stop = i;
+            }
+        }
+
+        /// Run the kernel and compare to the reference calculation.
+        void Compare(CP::TWaveformOverlap& kernel, int waveforms) {
+            int bins = 40 + std::rand()%80;
+            std::vector< std::vector<double> > waves;
+            std::vector< std::vector<float> > floats;
+            std::vector<int> first;
+            std::vector<int> count;
+            for (int w=0; w<waveforms; ++w) {
+                int n = 2 + std::rand()%30;
+                waves.push_back(MakeWaveform(n, 50.0 + 500.0*w));
+                floats.push_back(std::vector<float>(waves.back().begin(),
+                                                    waves.back().end()));
+                first.push_back(std::rand()%(bins-n));
+                count.push_back(n);
+            }
+
+            std::vector<double> overlap;
+            double charge;
+            int start;
+            int stop;
+            Reference(bins, waves, first, overlap, charge, start, stop);
+
+            std::vector<const float*> samples;
+            for (int w=0; w<waveforms; ++w) samples.push_back(&floats[w][0]);
+            kernel.Fill(bins, waveforms, &samples[0], &first[0], &count[0],
+                        1.0);
+
+            ensure_equals("Number of bins", kernel.GetBins(), bins);
+            ensure_distance("Overlap charge matches reference",
+                            kernel.GetCharge(), charge,
+                            1E-5*std::abs(charge) + 1E-3);
+            ensure_equals("First bin matches reference",
+                          kernel.GetFirst(), start);
+            ensure_equals("Last bin matches reference",
+                          kernel.GetLast(), stop);
+            double moment1 = 0.0;
+            double moment2 = 0.0;
+            for (int i=0; i<bins; ++i) {
+                ensure_distance("Overlap matches reference",
+                                (double) kernel.GetOverlap()[i], overlap[i],
+                                1E-5*std::abs(overlap[i]) + 1E-5);
+                moment1 += i*overlap[i];
+                moment2 += i*i*overlap[i];
+            }
+            ensure_distance("First moment matches reference",
+                            kernel.GetMoment1(), moment1,
+                            1E-5*std::abs(moment1) + 1E-3);
+            ensure_distance("Second moment matches reference",
+                            kernel.GetMoment2(), moment2,
+                            1E-5*std::abs(moment2) + 1E-3);
+
+            double sum, m1, m2;
+            kernel.Moments(0, bins, sum, m1, m2);
+            ensure_distance("Moments charge matches",
+                            sum, kernel.GetCharge(),
+                            1E-9*std::abs(sum) + 1E-6);
+            ensure_distance("Moments first moment matches",
+                            m1, kernel.GetMoment1(),
+                            1E-9*std::abs(m1) + 1E-6);
+        }
+    };
+
+    // Declare the test
+    typedef test_group<baseWaveformOverlap>::object testWaveformOverlap;
+    test_group<baseWaveformOverlap> groupWaveformOverlap("TWaveformOverlap");
+
+    // Test the declaration and an empty overlap.
+    template<> template<> void testWaveformOverlap::test<1> () {
+        CP::TWaveformOverlap kernel;
+        kernel.Fill(20, 0, NULL, NULL, NULL, 1.0);
+        ensure_equals("Number of bins", kernel.GetBins(), 20);
+        ensure_equals("No charge", kernel.GetCharge(), 0.0);
+        ensure_equals("First bin", kernel.GetFirst(), 20);
+        ensure_equals("Last bin", kernel.GetLast(), 0);
+        for (int i=0; i<20; ++i) {
+            ensure_equals("Empty overlap", kernel.GetOverlap()[i], 0.0f);
+        }
+    }
+
+    // Test that the default calculation matches the reference.
+    template<> template<> void testWaveformOverlap::test<2> () {
+        std::srand(1234);
+        CP::TWaveformOverlap kernel;
+        for (int trial=0; trial<200; ++trial) {
+            Compare(kernel, 1 + trial%3);
+        }
+    }
+
+    // Test that the scalar calculation matches the reference.
+    template<> template<> void testWaveformOverlap::test<3> () {
+        std::srand(4321);
+        CP::TWaveformOverlap kernel;
+        kernel.SetVectorized(false);
+        ensure("Scalar calculation selected", !kernel.IsVectorized());
+        for (int trial=0; trial<200; ++trial) {
+            Compare(kernel, 1 + trial%3);
+        }
+    }
+
+    // Test that the vectorized and scalar calculations agree bin by bin.
+    template<> template<> void testWaveformOverlap::test<4> () {
+        if (!CP::TWaveformOverlap::IsVectorAvailable()) {
+            CaptLog("Vectorized waveform overlap not compiled");
+            return;
+        }
+        std::srand(5678);
+        CP::TWaveformOverlap vectorized;
+        CP::TWaveformOverlap scalar;
+        scalar.SetVectorized(false);
+        for (int trial=0; trial<100; ++trial) {
+            std::vector< std::vector<float> > waves;
+            std::vector<int> first;
+            std::vector<int> count;
+            int bins = 100;
+            for (int w=0; w<3; ++w) {
+                std::vector<double> d = MakeWaveform(30+w, 300.0);
+                waves.push_back(std::vector<float>(d.begin(), d.end()));
+                first.push_back(10 + std::rand()%20);
+                count.push_back(d.size());
+            }
+            const float* samples[3]
+                = {&waves[0][0], &waves[1][0], &waves[2][0]};
+            vectorized.Fill(bins, 3, samples, &first[0], &count[0], 1.0);
+            scalar.Fill(bins, 3, samples, &first[0], &count[0], 1.0);
+            for (int i=0; i<bins; ++i) {
+                ensure_equals("Overlaps are identical",
+                              vectorized.GetOverlap()[i],
+                              scalar.GetOverlap()[i]);
+            }
+            ensure_equals("First bins are identical",
+                          vectorized.GetFirst(), scalar.GetFirst());
+            ensure_equals("Last bins are identical",
+                          vectorized.GetLast(), scalar.GetLast());
+            ensure_distance("Charges agree",
+                            vectorized.GetCharge(), scalar.GetCharge(),
+                            1E-12*std::abs(scalar.GetCharge()));
+        }
+    }
+};
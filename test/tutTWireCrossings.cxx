@@ -0,0 +1,204 @@
+#include <TWireCrossings.hxx>
+
+#include <TCaptLog.hxx>
+#include <CaptGeomId.hxx>
+#include <HEPUnits.hxx>
+
+#include <tut.h>
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+
+namespace tut {
+    struct baseWireCrossings {
+        baseWireCrossings() {
+            // Run before each test.
+        }
+        ~baseWireCrossings() {
+            // Run after each test.
+        }
+    };
+
+    // A small circular wire plane geometry.  The X wires run along the Y
+    // axis, and the V and U wires are rotated by +/- 60 degrees.  The wires
+    // have a 3 mm pitch and end at the edge of the circle.
+    const int gWireCount = 31;
+    const double gPitch = 3.0*unit::mm;
+    const double gRadius = 47.3*unit::mm;
+    const double gTolerance = 2.0*unit::mm;
+
+    TVector3 WireDirection(int plane) {
+        double angle[3] = {0.0, M_PI/3.0, -M_PI/3.0};
+        return TVector3(std::sin(angle[plane]), std::cos(angle[plane]), 0.0);
+    }
+
+    TVector3 WireCenter(int plane, int wire) {
+        TVector3 dir = WireDirection(plane);
+        double offset = (wire - gWireCount/2)*gPitch;
+        return TVector3(offset*dir.Y(), -offset*dir.X(), 0.0);
+    }
+
+    double WireHalfLength(int plane, int wire) {
+        double offset = WireCenter(plane,wire).Mag();
+        return std::sqrt(gRadius*gRadius - offset*offset);
+    }
+
+    std::vector<CP::TWireCrossings::WireGeometry> MakeWires() {
+        std::vector<CP::TWireCrossings::WireGeometry> wires;
+        for (int p = 0; p < 3; ++p) {
+            for (int w = 0; w < gWireCount; ++w) {
+                wires.push_back(CP::TWireCrossings::WireGeometry(
+                                    CP::GeomId::Captain::Wire(p,w),
+                                    WireCenter(p,w), WireDirection(p),
+                                    WireHalfLength(p,w)));
+            }
+        }
+        return wires;
+    }
+
+    // The brute force crossing point of two wires found by solving
+    //    c1 + s1*d1 = c2 + s2*d2
+    // with Cramer's rule.
+    TVector3 BruteCrossing(int plane1, int wire1, int plane2, int wire2) {
+        TVector3 c1 = WireCenter(plane1,wire1);
+        TVector3 d1 = WireDirection(plane1);
+        TVector3 c2 = WireCenter(plane2,wire2);
+        TVector3 d2 = WireDirection(plane2);
+        TVector3 r = c2 - c1;
+        double det = -d1.X()*d2.Y() + d2.X()*d1.Y();
+        double s1 = (-r.X()*d2.Y() + d2.X()*r.Y())/det;
+        return c1 + s1*d1;
+    }
+
+    // The brute force distance of a point from the end of a wire (positive
+    // if the point is outside of the wire length plus the tolerance).
+    double BruteOutside(int plane, int wire, const TVector3& point) {
+        double along = (point - WireCenter(plane,wire))
+            .Dot(WireDirection(plane));
+        return std::abs(along) - WireHalfLength(plane,wire) - gTolerance;
+    }
+
+    // Declare the test
+    typedef test_group<baseWireCrossings>::object testWireCrossings;
+    test_group<baseWireCrossings> groupWireCrossings("TWireCrossings");
+
+    // Test an empty table and wires that aren't in the table.
+    template<> template<> void testWireCrossings::test<1> () {
+        std::vector<CP::TWireCrossings::WireGeometry> wires;
+        CP::TWireCrossings empty(wires, gTolerance);
+        ensure_distance("Tolerance", empty.GetTolerance(), gTolerance, 1E-9);
+        ensure("No wires in an empty table", !empty.HasWire(0,0));
+        ensure("Missing wires don't cross", !empty.CrossesXV(0,0));
+        ensure("Missing wires aren't compatible", !empty.Compatible(0,0,0));
+
+        CP::TWireCrossings crossings(MakeWires(), gTolerance);
+        ensure("Wire in the table", crossings.HasWire(2,gWireCount-1));
+        ensure("Wire past the end isn't in the table",
+               !crossings.HasWire(0,gWireCount));
+        ensure("Invalid plane isn't in the table",
+               !crossings.HasWire(3,0));
+        ensure("Missing X wire doesn't cross",
+               !crossings.CrossesXV(gWireCount,0));
+        ensure("Missing U wire doesn't cross",
+               !crossings.CrossesXU(0,gWireCount));
+        ensure("Missing U wire isn't compatible",
+               !crossings.Compatible(0,0,gWireCount));
+        std::vector<int> uWires;
+        crossings.CompatibleU(gWireCount,0,uWires);
+        ensure("Missing X wire has no compatible U wires", uWires.empty());
+    }
+
+    // Test the crossing points and the wire length checks against a brute
+    // force calculation.
+    template<> template<> void testWireCrossings::test<2> () {
+        CP::TWireCrossings crossings(MakeWires(), gTolerance);
+        int inside = 0;
+        for (int x = 0; x < gWireCount; ++x) {
+            for (int w = 0; w < gWireCount; ++w) {
+                TVector3 xv = BruteCrossing(0,x,1,w);
+                ensure_distance("XV crossing",
+                                (crossings.CrossingXV(x,w) - xv).Mag(),
+                                0.0, 1E-9*unit::mm);
+                TVector3 xu = BruteCrossing(0,x,2,w);
+                ensure_distance("XU crossing",
+                                (crossings.CrossingXU(x,w) - xu).Mag(),
+                                0.0, 1E-9*unit::mm);
+                TVector3 vu = BruteCrossing(1,x,2,w);
+                ensure_distance("VU crossing",
+                                (crossings.CrossingVU(x,w) - vu).Mag(),
+                                0.0, 1E-9*unit::mm);
+
+                double xvOutside = std::max(BruteOutside(0,x,xv),
+                                            BruteOutside(1,w,xv));
+                if (std::abs(xvOutside) > 1E-6*unit::mm) {
+                    ensure_equals("XV crosses inside the wires",
+                                  crossings.CrossesXV(x,w),
+                                  xvOutside < 0.0);
+                    if (xvOutside < 0.0) ++inside;
+                }
+                double xuOutside = std::max(BruteOutside(0,x,xu),
+                                            BruteOutside(2,w,xu));
+                if (std::abs(xuOutside) > 1E-6*unit::mm) {
+                    ensure_equals("XU crosses inside the wires",
+                                  crossings.CrossesXU(x,w),
+                                  xuOutside < 0.0);
+                }
+            }
+        }
+        ensure("Some wires cross inside the plane", inside > 0);
+        ensure("Some wires cross outside the plane",
+               inside < gWireCount*gWireCount);
+    }
+
+    // Test the compatible U wires for each X-V pair against a brute force
+    // search of all the U wires.
+    template<> template<> void testWireCrossings::test<3> () {
+        CP::TWireCrossings crossings(MakeWires(), gTolerance);
+        int compatible = 0;
+        for (int x = 0; x < gWireCount; ++x) {
+            for (int v = 0; v < gWireCount; ++v) {
+                TVector3 xv = BruteCrossing(0,x,1,v);
+                std::vector< std::pair<double,int> > expected;
+                for (int u = 0; u < gWireCount; ++u) {
+                    TVector3 xu = BruteCrossing(0,x,2,u);
+                    double dist = (xu - xv).Mag();
+                    ensure("Brute force crossings aren't on the tolerance",
+                           std::abs(dist - gTolerance) > 1E-6*unit::mm);
+                    bool match = (dist <= gTolerance);
+                    ensure_equals("Compatible matches brute force",
+                                  crossings.Compatible(x,v,u), match);
+                    if (!match) continue;
+                    double along = (xu - WireCenter(0,x))
+                        .Dot(WireDirection(0));
+                    expected.push_back(std::make_pair(along,u));
+                    TVector3 position;
+                    ensure("Overlap for compatible wires",
+                           crossings.Overlap(x,v,u,position));
+                    TVector3 average
+                        = (xv + xu + BruteCrossing(1,v,2,u))*(1.0/3.0);
+                    ensure_distance("Overlap position",
+                                    (position - average).Mag(),
+                                    0.0, 1E-9*unit::mm);
+                }
+                std::sort(expected.begin(), expected.end());
+                std::vector<int> uWires;
+                crossings.CompatibleU(x,v,uWires);
+                ensure_equals("Number of compatible U wires",
+                              uWires.size(), expected.size());
+                for (std::size_t i = 0; i < expected.size(); ++i) {
+                    ensure_equals("Compatible U wire in order along X",
+                                  uWires[i], expected[i].second);
+                }
+                compatible += expected.size();
+            }
+        }
+        ensure("Some compatible triplets", compatible > 0);
+    }
+};
+
+// Local Variables:
+// mode:c++
+// c-basic-offset:4
+// End: